@@ -105,6 +105,18 @@ bool KFileItemListView::enlargeSmallPreviews() const
     return m_modelRolesUpdater ? m_modelRolesUpdater->enlargeSmallPreviews() : false;
 }
 
+void KFileItemListView::setRecursiveFolderSizes(bool enabled)
+{
+    if (m_modelRolesUpdater) {
+        m_modelRolesUpdater->setRecursiveFolderSizes(enabled);
+    }
+}
+
+bool KFileItemListView::recursiveFolderSizes() const
+{
+    return m_modelRolesUpdater ? m_modelRolesUpdater->recursiveFolderSizes() : false;
+}
+
 void KFileItemListView::setEnabledPlugins(const QStringList& list)
 {
     if (m_modelRolesUpdater) {
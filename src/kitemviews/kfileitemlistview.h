@@ -55,6 +55,14 @@ public:
     void setEnlargeSmallPreviews(bool enlarge);
     bool enlargeSmallPreviews() const;
 
+    /**
+     * If enabled, the size of the contents of local folders is shown
+     * instead of the number of items. Per default the recursive sizes
+     * are disabled.
+     */
+    void setRecursiveFolderSizes(bool enabled);
+    bool recursiveFolderSizes() const;
+
     /**
      * Sets the list of enabled thumbnail plugins that are used for previews.
      * Per default all plugins enabled in the KConfigGroup "PreviewSettings"
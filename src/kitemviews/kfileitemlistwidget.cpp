@@ -57,17 +57,32 @@ bool KFileItemListWidgetInformant::itemIsLink(int index, const KItemListView* vi
 
 QString KFileItemListWidgetInformant::roleText(const QByteArray& role,
                                                const QHash<QByteArray, QVariant>& values) const
+{
+    return roleText(role, values.value(role), values.value("isDir").toBool());
+}
+
+QString KFileItemListWidgetInformant::itemRoleText(int index, const QByteArray& role, const KItemListView* view) const
+{
+    Q_ASSERT(qobject_cast<KFileItemModel*>(view->model()));
+    KFileItemModel* fileItemModel = static_cast<KFileItemModel*>(view->model());
+
+    static const int isDirRoleId = KItemModelBase::roleId("isDir");
+    const bool isDir = fileItemModel->roleValue(index, isDirRoleId).toBool();
+    return roleText(role, fileItemModel->roleValue(index, cachedRoleId(role)), isDir);
+}
+
+QString KFileItemListWidgetInformant::roleText(const QByteArray& role, const QVariant& roleValue, bool isDir) const
 {
     QString text;
-    const QVariant roleValue = values.value(role);
 
     // Implementation note: In case if more roles require a custom handling
     // use a hash + switch for a linear runtime.
 
     if (role == "size") {
-        if (values.value("isDir").toBool()) {
+        if (isDir && roleValue.userType() != qMetaTypeId<KIO::filesize_t>()) {
             // The item represents a directory. Show the number of sub directories
-            // instead of the file size of the directory.
+            // instead of the file size of the directory, unless the size of
+            // the contents has been determined.
             if (!roleValue.isNull()) {
                 const int count = roleValue.toInt();
                 if (count < 0) {
@@ -83,8 +98,9 @@ QString KFileItemListWidgetInformant::roleText(const QByteArray& role,
     } else if (role == "modificationtime" || role == "accesstime" || role == "deletiontime") {
         const QDateTime dateTime = roleValue.toDateTime();
         text = QLocale().toString(dateTime, QLocale::ShortFormat);
-    } else {
-        text = KStandardItemListWidgetInformant::roleText(role, values);
+    } else if (role != "rating") {
+        // The rating is shown by an image and has no text.
+        text = roleValue.toString();
     }
 
     return text;
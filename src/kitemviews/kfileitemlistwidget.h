@@ -34,7 +34,15 @@ protected:
     virtual QString itemText(int index, const KItemListView* view) const Q_DECL_OVERRIDE;
     virtual bool itemIsLink(int index, const KItemListView* view) const Q_DECL_OVERRIDE;
     virtual QString roleText(const QByteArray& role, const QHash<QByteArray, QVariant>& values) const Q_DECL_OVERRIDE;
+    virtual QString itemRoleText(int index, const QByteArray& role, const KItemListView* view) const Q_DECL_OVERRIDE;
     virtual QFont customizedFontForLinks(const QFont& baseFont) const Q_DECL_OVERRIDE;
+
+private:
+    /**
+     * Helper method for roleText() and itemRoleText(): Returns the string
+     * representation of the value \a roleValue of the role \a role.
+     */
+    QString roleText(const QByteArray& role, const QVariant& roleValue, bool isDir) const;
 };
 
 class DOLPHIN_EXPORT KFileItemListWidget : public KStandardItemListWidget
@@ -31,15 +31,27 @@
 #include "private/kfileitemmodelsortalgorithm.h"
 #include "private/kfileitemmodeldirlister.h"
 
+#include <QFutureWatcher>
 #include <QMimeData>
 #include <QTimer>
 #include <QWidget>
 
 #include <algorithm>
+#include <limits>
 #include <vector>
 
 // #define KFILEITEMMODEL_DEBUG
 
+namespace {
+    // Items that are added by KDirLister in batches of at least this size
+    // are prepared in a worker thread, see KFileItemModel::prepareItems().
+    // For smaller batches the overhead is not worth it.
+    const int MinimumItemCountForPreparationThread = 100;
+
+    // Returned by KFileItemModel::groupKey() if the sort role provides no keys.
+    const qint64 NoGroupKey = std::numeric_limits<qint64>::max();
+}
+
 KFileItemModel::KFileItemModel(QObject* parent) :
     KItemModelBase("text", parent),
     m_dirLister(0),
@@ -48,6 +60,8 @@ KFileItemModel::KFileItemModel(QObject* parent) :
     m_sortingProgressPercent(-1),
     m_roles(),
     m_itemData(),
+    m_roleStore(),
+    m_rolesForIds(),
     m_items(),
     m_filter(),
     m_filteredItems(),
@@ -55,7 +69,11 @@ KFileItemModel::KFileItemModel(QObject* parent) :
     m_maximumUpdateIntervalTimer(0),
     m_resortAllItemsTimer(0),
     m_pendingItemsToInsert(),
+    m_preparingItems(),
+    m_itemsToResort(),
+    m_resortAllItemsRequired(false),
     m_groups(),
+    m_groupsDate(),
     m_expandedDirs(),
     m_urlsToExpand()
 {
@@ -104,17 +122,19 @@ KFileItemModel::KFileItemModel(QObject* parent) :
     // When changing the value of an item which represents the sort-role a resorting must be
     // triggered. Especially in combination with KFileItemModelRolesUpdater this might be done
     // for a lot of items within a quite small timeslot. To prevent expensive resortings the
-    // resorting is postponed until the timer has been exceeded.
+    // resorting is postponed until the timer has been exceeded. Only the changed items are
+    // moved to their new positions, see KFileItemModel::resortChangedItems().
     m_resortAllItemsTimer = new QTimer(this);
     m_resortAllItemsTimer->setInterval(500);
     m_resortAllItemsTimer->setSingleShot(true);
-    connect(m_resortAllItemsTimer, &QTimer::timeout, this, &KFileItemModel::resortAllItems);
+    connect(m_resortAllItemsTimer, &QTimer::timeout, this, &KFileItemModel::resortChangedItems);
 
     connect(GeneralSettings::self(), &GeneralSettings::sortingChoiceChanged, this, &KFileItemModel::slotSortingChoiceChanged);
 }
 
 KFileItemModel::~KFileItemModel()
 {
+    discardPreparingItems();
     qDeleteAll(m_itemData);
     qDeleteAll(m_filteredItems);
     qDeleteAll(m_pendingItemsToInsert);
@@ -156,22 +176,49 @@ QHash<QByteArray, QVariant> KFileItemModel::data(int index) const
 {
     if (index >= 0 && index < count()) {
         ItemData* data = m_itemData.at(index);
-        if (data->values.isEmpty()) {
-            data->values = retrieveData(data->item, data->parent);
+        if (!isDataRetrieved(data)) {
+            retrieveData(data);
         }
 
-        return data->values;
+        return itemValues(data);
     }
     return QHash<QByteArray, QVariant>();
 }
 
+QVariant KFileItemModel::roleValue(int index, int roleId) const
+{
+    if (index < 0 || index >= count() || roleId < 0) {
+        return QVariant();
+    }
+
+    ItemData* data = m_itemData.at(index);
+    if (!isDataRetrieved(data)) {
+        retrieveData(data);
+    }
+
+    if (roleId >= m_rolesForIds.count()) {
+        const int previousCount = m_rolesForIds.count();
+        m_rolesForIds.resize(roleId + 1);
+        for (int id = previousCount; id <= roleId; ++id) {
+            const QByteArray role = roleForId(id);
+            m_rolesForIds[id] = qMakePair(typeForRole(role), role);
+        }
+    }
+
+    const QPair<RoleType, QByteArray>& role = m_rolesForIds.at(roleId);
+    return itemValue(data, role.first, role.second);
+}
+
 bool KFileItemModel::setData(int index, const QHash<QByteArray, QVariant>& values)
 {
     if (index < 0 || index >= count()) {
         return false;
     }
 
-    QHash<QByteArray, QVariant> currentValues = data(index);
+    ItemData* itemData = m_itemData.at(index);
+    if (!isDataRetrieved(itemData)) {
+        retrieveData(itemData);
+    }
 
     // Determine which roles have been changed
     QSet<QByteArray> changedRoles;
@@ -181,8 +228,8 @@ bool KFileItemModel::setData(int index, const QHash<QByteArray, QVariant>& value
         const QByteArray role = sharedValue(it.key());
         const QVariant value = it.value();
 
-        if (currentValues[role] != value) {
-            currentValues[role] = value;
+        if (itemValue(itemData, role) != value) {
+            setItemValue(itemData, role, value);
             changedRoles.insert(role);
         }
     }
@@ -191,12 +238,16 @@ bool KFileItemModel::setData(int index, const QHash<QByteArray, QVariant>& value
         return false;
     }
 
-    m_itemData[index]->values = currentValues;
     if (changedRoles.contains("text")) {
         QUrl url = m_itemData[index]->item.url();
+        m_items.remove(url);
         url = url.adjusted(QUrl::RemoveFilename);
-        url.setPath(url.path() + currentValues["text"].toString());
+        url.setPath(url.path() + itemValue(itemData, "text").toString());
         m_itemData[index]->item.setUrl(url);
+        m_items.insert(url, itemData);
+
+        m_itemData[index]->sortKey.reset();
+        updateSortKeys(QList<ItemData*>() << m_itemData[index]);
     }
 
     emitItemsChangedAndTriggerResorting(KItemRangeList() << KItemRange(index, 1), changedRoles);
@@ -204,6 +255,70 @@ bool KFileItemModel::setData(int index, const QHash<QByteArray, QVariant>& value
     return true;
 }
 
+void KFileItemModel::setRoleValues(const QByteArray& role, const QHash<int, QVariant>& values)
+{
+    QHash<int, QHash<QByteArray, QVariant> > itemValues;
+    itemValues.reserve(values.count());
+
+    QHashIterator<int, QVariant> it(values);
+    while (it.hasNext()) {
+        it.next();
+        itemValues[it.key()].insert(role, it.value());
+    }
+
+    setRoleValues(itemValues);
+}
+
+void KFileItemModel::setRoleValues(const QHash<int, QHash<QByteArray, QVariant> >& values)
+{
+    const int itemCount = count();
+
+    QVector<int> changedIndexes;
+    QSet<QByteArray> changedRoles;
+    QHashIterator<int, QHash<QByteArray, QVariant> > it(values);
+    while (it.hasNext()) {
+        it.next();
+        const int index = it.key();
+        if (index < 0 || index >= itemCount) {
+            continue;
+        }
+
+        if (it.value().contains("text")) {
+            // Changing the name requires updating the URL of the item.
+            setData(index, it.value());
+            continue;
+        }
+
+        ItemData* itemData = m_itemData.at(index);
+        if (!isDataRetrieved(itemData)) {
+            retrieveData(itemData);
+        }
+
+        bool itemChanged = false;
+        QHashIterator<QByteArray, QVariant> roleIt(it.value());
+        while (roleIt.hasNext()) {
+            roleIt.next();
+            const QByteArray role = sharedValue(roleIt.key());
+            if (itemValue(itemData, role) != roleIt.value()) {
+                setItemValue(itemData, role, roleIt.value());
+                changedRoles.insert(role);
+                itemChanged = true;
+            }
+        }
+
+        if (itemChanged) {
+            changedIndexes.append(index);
+        }
+    }
+
+    if (changedIndexes.isEmpty()) {
+        return;
+    }
+
+    std::sort(changedIndexes.begin(), changedIndexes.end());
+    emitItemsChangedAndTriggerResorting(KItemRangeList::fromSortedContainer(changedIndexes), changedRoles);
+}
+
 void KFileItemModel::setSortDirectoriesFirst(bool dirsFirst)
 {
     if (dirsFirst != m_sortDirsFirst) {
@@ -287,12 +402,12 @@ int KFileItemModel::indexForKeyboardSearch(const QString& text, int startFromInd
 {
     startFromIndex = qMax(0, startFromIndex);
     for (int i = startFromIndex; i < count(); ++i) {
-        if (fileItem(i).text().startsWith(text, Qt::CaseInsensitive)) {
+        if (m_itemData.at(i)->item.text().startsWith(text, Qt::CaseInsensitive)) {
             return i;
         }
     }
     for (int i = 0; i < startFromIndex; ++i) {
-        if (fileItem(i).text().startsWith(text, Qt::CaseInsensitive)) {
+        if (m_itemData.at(i)->item.text().startsWith(text, Qt::CaseInsensitive)) {
             return i;
         }
     }
@@ -326,33 +441,8 @@ QList<QPair<int, QVariant> > KFileItemModel::groups() const
         QElapsedTimer timer;
         timer.start();
 #endif
-        switch (typeForRole(sortRole())) {
-        case NameRole:        m_groups = nameRoleGroups(); break;
-        case SizeRole:        m_groups = sizeRoleGroups(); break;
-        case ModificationTimeRole:
-            m_groups = timeRoleGroups([](const ItemData *item) {
-                return item->item.time(KFileItem::ModificationTime);
-            });
-            break;
-        case CreationTimeRole:
-            m_groups = timeRoleGroups([](const ItemData *item) {
-                return item->item.time(KFileItem::CreationTime);
-            });
-            break;
-        case AccessTimeRole:
-            m_groups = timeRoleGroups([](const ItemData *item) {
-                return item->item.time(KFileItem::AccessTime);
-            });
-            break;
-        case DeletionTimeRole:
-            m_groups = timeRoleGroups([](const ItemData *item) {
-                return item->values.value("deletiontime").toDateTime();
-            });
-            break;
-        case PermissionsRole: m_groups = permissionRoleGroups(); break;
-        case RatingRole:      m_groups = ratingRoleGroups(); break;
-        default:              m_groups = genericStringRoleGroups(sortRole()); break;
-        }
+        appendGroups(m_groups, 0, count());
+        m_groupsDate = QDate::currentDate();
 
 #ifdef KFILEITEMMODEL_DEBUG
         qCDebug(DolphinDebug) << "[TIME] Calculating groups for" << count() << "items:" << timer.elapsed();
@@ -389,33 +479,13 @@ int KFileItemModel::index(const QUrl& url) const
 {
     const QUrl urlToFind = url.adjusted(QUrl::StripTrailingSlash);
 
-    const int itemCount = m_itemData.count();
-    int itemsInHash = m_items.count();
-
-    int index = m_items.value(urlToFind, -1);
-    while (index < 0 && itemsInHash < itemCount) {
-        // Not all URLs are stored yet in m_items. We grow m_items until either
-        // urlToFind is found, or all URLs have been stored in m_items.
-        // Note that we do not add the URLs to m_items one by one, but in
-        // larger blocks. After each block, we check if urlToFind is in
-        // m_items. We could in principle compare urlToFind with each URL while
-        // we are going through m_itemData, but comparing two QUrls will,
-        // unlike calling qHash for the URLs, trigger a parsing of the URLs
-        // which costs both CPU cycles and memory.
-        const int blockSize = 1000;
-        const int currentBlockEnd = qMin(itemsInHash + blockSize, itemCount);
-        for (int i = itemsInHash; i < currentBlockEnd; ++i) {
-            const QUrl nextUrl = m_itemData.at(i)->item.url();
-            m_items.insert(nextUrl, i);
-        }
-
-        itemsInHash = currentBlockEnd;
-        index = m_items.value(urlToFind, -1);
-    }
+    const ItemData* data = m_items.value(urlToFind);
+    const int index = data ? data->index : -1;
+    Q_ASSERT(index < 0 || m_itemData.at(index) == data);
 
     if (index < 0) {
-        // The item could not be found, even though all items from m_itemData
-        // should be in m_items now. We print some diagnostic information which
+        // The item could not be found. If m_items does not contain all items
+        // from m_itemData, the model is inconsistent. We print some diagnostic information which
         // might help to find the cause of the problem, but only once. This
         // prevents that obtaining and printing the debugging information
         // wastes CPU cycles and floods the shell or .xsession-errors.
@@ -497,18 +567,20 @@ void KFileItemModel::setRoles(const QSet<QByteArray>& roles)
         // Update m_data with the changed requested roles
         const int maxIndex = count() - 1;
         for (int i = 0; i <= maxIndex; ++i) {
-            m_itemData[i]->values = retrieveData(m_itemData.at(i)->item, m_itemData.at(i)->parent);
+            ItemData* itemData = m_itemData.at(i);
+            resetData(itemData);
+            retrieveData(itemData);
         }
 
         emit itemsChanged(KItemRangeList() << KItemRange(0, count()), changedRoles);
     }
 
-    // Clear the 'values' of all filtered items. They will be re-populated with the
-    // correct roles the next time 'values' will be accessed via data(int).
+    // Clear the values of all filtered items. They will be re-populated with the
+    // correct roles the next time the values will be accessed via data(int).
     QHash<KFileItem, ItemData*>::iterator filteredIt = m_filteredItems.begin();
     const QHash<KFileItem, ItemData*>::iterator filteredEnd = m_filteredItems.end();
     while (filteredIt != filteredEnd) {
-        (*filteredIt)->values.clear();
+        resetData(*filteredIt);
         ++filteredIt;
     }
 }
@@ -566,7 +638,7 @@ bool KFileItemModel::setExpanded(int index, bool expanded)
         int childIndex = firstChildIndex;
         while (childIndex < itemCount && expandedParentsCount(childIndex) > parentLevel) {
             ItemData* itemData = m_itemData.at(childIndex);
-            if (itemData->values.value("isExpanded").toBool()) {
+            if (m_roleStore.testFlag(itemData->slot, KFileItemModelRoleStore::IsExpandedFlag)) {
                 const QUrl targetUrl = itemData->item.targetUrl();
                 const QUrl url = itemData->item.url();
                 m_expandedDirs.remove(targetUrl);
@@ -589,7 +661,7 @@ bool KFileItemModel::setExpanded(int index, bool expanded)
 bool KFileItemModel::isExpanded(int index) const
 {
     if (index >= 0 && index < count()) {
-        return m_itemData.at(index)->values.value("isExpanded").toBool();
+        return m_roleStore.testFlag(m_itemData.at(index)->slot, KFileItemModelRoleStore::IsExpandedFlag);
     }
     return false;
 }
@@ -597,9 +669,12 @@ bool KFileItemModel::isExpanded(int index) const
 bool KFileItemModel::isExpandable(int index) const
 {
     if (index >= 0 && index < count()) {
-        // Call data (instead of accessing m_itemData directly)
-        // to ensure that the value is initialized.
-        return data(index).value("isExpandable").toBool();
+        // Assure that the value is initialized.
+        ItemData* itemData = m_itemData.at(index);
+        if (!isDataRetrieved(itemData)) {
+            retrieveData(itemData);
+        }
+        return m_roleStore.testFlag(itemData->slot, KFileItemModelRoleStore::IsExpandableFlag);
     }
     return false;
 }
@@ -696,7 +771,7 @@ void KFileItemModel::applyFilters()
 
         // Only filter non-expanded items as child items may never
         // exist without a parent item
-        if (!itemData->values.value("isExpanded").toBool()) {
+        if (!m_roleStore.testFlag(itemData->slot, KFileItemModelRoleStore::IsExpandedFlag)) {
             const KFileItem item = itemData->item;
             if (!m_filter.matches(item)) {
                 newFilteredIndexes.append(index);
@@ -743,7 +818,7 @@ void KFileItemModel::removeFilteredChildren(const KItemRangeList& itemRanges)
     QHash<KFileItem, ItemData*>::iterator it = m_filteredItems.begin();
     while (it != m_filteredItems.end()) {
         if (parents.contains(it.value()->parent)) {
-            delete it.value();
+            deleteItemData(it.value());
             it = m_filteredItems.erase(it);
         } else {
             ++it;
@@ -831,6 +906,8 @@ void KFileItemModel::loadSortingSettings()
 void KFileItemModel::resortAllItems()
 {
     m_resortAllItemsTimer->stop();
+    m_itemsToResort.clear();
+    m_resortAllItemsRequired = false;
 
     const int itemCount = count();
     if (itemCount <= 0) {
@@ -844,28 +921,132 @@ void KFileItemModel::resortAllItems()
     qCDebug(DolphinDebug) << "Resorting" << itemCount << "items";
 #endif
 
-    // Remember the order of the current URLs so
-    // that it can be determined which indexes have
-    // been moved because of the resorting.
-    QList<QUrl> oldUrls;
-    oldUrls.reserve(itemCount);
-    foreach (const ItemData* itemData, m_itemData) {
-        oldUrls.append(itemData->item.url());
+    // Resort the items
+    prepareItemsForSorting(m_itemData);
+    sort(m_itemData.begin(), m_itemData.end());
+
+    emitItemsMovedAfterResorting();
+
+#ifdef KFILEITEMMODEL_DEBUG
+    qCDebug(DolphinDebug) << "[TIME] Resorting of" << itemCount << "items:" << timer.elapsed();
+#endif
+}
+
+void KFileItemModel::resortChangedItems()
+{
+    m_resortAllItemsTimer->stop();
+
+    const int itemCount = count();
+    const int changedItemCount = m_itemsToResort.count();
+
+    bool resortAll = m_resortAllItemsRequired || changedItemCount > itemCount / 4;
+    if (!resortAll) {
+        // Expanded items must be moved together with their children,
+        // which is only done by resortAllItems().
+        foreach (const ItemData* itemData, m_itemsToResort) {
+            if (m_roleStore.testFlag(itemData->slot, KFileItemModelRoleStore::IsExpandedFlag)) {
+                resortAll = true;
+                break;
+            }
+        }
     }
 
-    m_items.clear();
-    m_items.reserve(itemCount);
+    if (resortAll) {
+        resortAllItems();
+        return;
+    }
 
-    // Resort the items
-    sort(m_itemData.begin(), m_itemData.end());
+#ifdef KFILEITEMMODEL_DEBUG
+    QElapsedTimer timer;
+    timer.start();
+    qCDebug(DolphinDebug) << "===========================================================";
+    qCDebug(DolphinDebug) << "Resorting" << changedItemCount << "of" << itemCount << "items";
+#endif
+
+    if (changedItemCount > 0) {
+        // Take the changed items out of m_itemData. Note that ItemData::index
+        // still contains the index before the resorting, which is required by
+        // emitItemsMovedAfterResorting().
+        QVector<int> changedIndexes;
+        changedIndexes.reserve(changedItemCount);
+        foreach (const ItemData* itemData, m_itemsToResort) {
+            changedIndexes.append(itemData->index);
+        }
+        m_itemsToResort.clear();
+        std::sort(changedIndexes.begin(), changedIndexes.end());
+
+        QList<ItemData*> changedItems;
+        changedItems.reserve(changedItemCount);
+        QList<ItemData*> otherItems;
+        otherItems.reserve(itemCount - changedItemCount);
+
+        int previousIndex = 0;
+        foreach (int index, changedIndexes) {
+            for (int i = previousIndex; i < index; ++i) {
+                otherItems.append(m_itemData.at(i));
+            }
+            changedItems.append(m_itemData.at(index));
+            previousIndex = index + 1;
+        }
+        for (int i = previousIndex; i < itemCount; ++i) {
+            otherItems.append(m_itemData.at(i));
+        }
+
+        // The other items are still sorted correctly. Sort the changed items
+        // and merge them into the other items. The position of each changed
+        // item is determined by a binary search, hence only
+        // O(changedItemCount * log(itemCount)) comparisons are required.
+        prepareItemsForSorting(changedItems);
+        sort(changedItems.begin(), changedItems.end());
+
+        auto itemLessThan = [this](const ItemData* a, const ItemData* b) {
+            return lessThan(a, b, m_collator);
+        };
+
+        m_itemData.clear();
+        m_itemData.reserve(itemCount);
+
+        QList<ItemData*>::const_iterator begin = otherItems.constBegin();
+        const QList<ItemData*>::const_iterator end = otherItems.constEnd();
+        foreach (ItemData* changedItem, changedItems) {
+            const QList<ItemData*>::const_iterator position = std::upper_bound(begin, end, changedItem, itemLessThan);
+            for (QList<ItemData*>::const_iterator it = begin; it != position; ++it) {
+                m_itemData.append(*it);
+            }
+            m_itemData.append(changedItem);
+            begin = position;
+        }
+        for (QList<ItemData*>::const_iterator it = begin; it != end; ++it) {
+            m_itemData.append(*it);
+        }
+
+        Q_ASSERT(m_itemData.count() == itemCount);
+    }
+
+    emitItemsMovedAfterResorting();
+
+#ifdef KFILEITEMMODEL_DEBUG
+    qCDebug(DolphinDebug) << "[TIME] Resorting of" << changedItemCount << "items:" << timer.elapsed();
+#endif
+}
+
+void KFileItemModel::emitItemsMovedAfterResorting()
+{
+    const int itemCount = count();
+
+    // Determine the new index of each item by the index before the resorting,
+    // which is still stored in ItemData::index, and update ItemData::index.
+    QVector<int> newIndexes(itemCount);
     for (int i = 0; i < itemCount; ++i) {
-        m_items.insert(m_itemData.at(i)->item.url(), i);
+        ItemData* itemData = m_itemData.at(i);
+        newIndexes[itemData->index] = i;
+        itemData->index = i;
     }
 
     // Determine the first index that has been moved.
     int firstMovedIndex = 0;
     while (firstMovedIndex < itemCount
-           && firstMovedIndex == m_items.value(oldUrls.at(firstMovedIndex))) {
+           && firstMovedIndex == newIndexes.at(firstMovedIndex)) {
         ++firstMovedIndex;
     }
 
@@ -875,7 +1056,7 @@ void KFileItemModel::resortAllItems()
 
         int lastMovedIndex = itemCount - 1;
         while (lastMovedIndex > firstMovedIndex
-               && lastMovedIndex == m_items.value(oldUrls.at(lastMovedIndex))) {
+               && lastMovedIndex == newIndexes.at(lastMovedIndex)) {
             --lastMovedIndex;
         }
 
@@ -888,8 +1069,7 @@ void KFileItemModel::resortAllItems()
         QList<int> movedToIndexes;
         movedToIndexes.reserve(movedItemsCount);
         for (int i = firstMovedIndex; i <= lastMovedIndex; ++i) {
-            const int newIndex = m_items.value(oldUrls.at(i));
-            movedToIndexes.append(newIndex);
+            movedToIndexes.append(newIndexes.at(i));
         }
 
         emit itemsMoved(KItemRange(firstMovedIndex, movedItemsCount), movedToIndexes);
@@ -901,10 +1081,6 @@ void KFileItemModel::resortAllItems()
             emit groupsChanged();
         }
     }
-
-#ifdef KFILEITEMMODEL_DEBUG
-    qCDebug(DolphinDebug) << "[TIME] Resorting of" << itemCount << "items:" << timer.elapsed();
-#endif
 }
 
 void KFileItemModel::slotCompleted()
@@ -976,25 +1152,45 @@ void KFileItemModel::slotItemsAdded(const QUrl &directoryUrl, const KFileItemLis
         // they got collapsed again with KFileItemModel::setExpanded(false). So it must be
         // checked whether the parent for new items is still expanded.
         const int parentIndex = index(parentUrl);
-        if (parentIndex >= 0 && !m_itemData[parentIndex]->values.value("isExpanded").toBool()) {
+        if (parentIndex >= 0 && !m_roleStore.testFlag(m_itemData.at(parentIndex)->slot, KFileItemModelRoleStore::IsExpandedFlag)) {
             // The parent is not expanded.
             return;
         }
     }
 
-    QList<ItemData*> itemDataList = createItemDataList(parentUrl, items);
+    if (items.count() >= MinimumItemCountForPreparationThread) {
+        // Create the ItemData instances, apply the name filter, calculate
+        // the collation keys and pre-sort the items in a worker thread.
+        const QUrl preparedParentUrl = index(parentUrl) < 0 ? QUrl() : parentUrl;
+
+        ItemPreparationSettings settings;
+        settings.filterPattern = m_filter.pattern();
+        settings.sortRole = m_sortRole;
+        settings.naturalSorting = m_naturalSorting;
+        settings.locale = m_collator.locale();
+        settings.caseSensitivity = m_collator.caseSensitivity();
+        settings.ignorePunctuation = m_collator.ignorePunctuation();
+        settings.numericMode = m_collator.numericMode();
 
-    if (!m_filter.hasSetFilters()) {
-        m_pendingItemsToInsert.append(itemDataList);
+        QFutureWatcher<PreparedItems*>* watcher = new QFutureWatcher<PreparedItems*>(this);
+        connect(watcher, &QFutureWatcher<PreparedItems*>::finished, this, &KFileItemModel::slotItemsPrepared);
+        watcher->setFuture(QtConcurrent::run(&KFileItemModel::prepareItems, items, preparedParentUrl, settings));
+        m_preparingItems.append(watcher);
     } else {
-        // The name or type filter is active. Hide filtered items
-        // before inserting them into the model and remember
-        // the filtered items in m_filteredItems.
-        foreach (ItemData* itemData, itemDataList) {
-            if (m_filter.matches(itemData->item)) {
-                m_pendingItemsToInsert.append(itemData);
-            } else {
-                m_filteredItems.insert(itemData->item, itemData);
+        QList<ItemData*> itemDataList = createItemDataList(parentUrl, items);
+
+        if (!m_filter.hasSetFilters()) {
+            m_pendingItemsToInsert.append(itemDataList);
+        } else {
+            // The name or type filter is active. Hide filtered items
+            // before inserting them into the model and remember
+            // the filtered items in m_filteredItems.
+            foreach (ItemData* itemData, itemDataList) {
+                if (m_filter.matches(itemData->item)) {
+                    m_pendingItemsToInsert.append(itemData);
+                } else {
+                    m_filteredItems.insert(itemData->item, itemData);
+                }
             }
         }
     }
@@ -1021,7 +1217,7 @@ void KFileItemModel::slotItemsDeleted(const KFileItemList& items)
             // Probably the item has been filtered.
             QHash<KFileItem, ItemData*>::iterator it = m_filteredItems.find(item);
             if (it != m_filteredItems.end()) {
-                delete it.value();
+                deleteItemData(it.value());
                 m_filteredItems.erase(it);
             }
         }
@@ -1067,6 +1263,9 @@ void KFileItemModel::slotRefreshItems(const QList<QPair<KFileItem, KFileItem> >&
 
     QSet<QByteArray> changedRoles;
 
+    // Items whose collation key must be recalculated
+    QList<ItemData*> changedItemDataList;
+
     QListIterator<QPair<KFileItem, KFileItem> > it(items);
     while (it.hasNext()) {
         const QPair<KFileItem, KFileItem>& itemPair = it.next();
@@ -1074,23 +1273,29 @@ void KFileItemModel::slotRefreshItems(const QList<QPair<KFileItem, KFileItem> >&
         const KFileItem& newItem = itemPair.second;
         const int indexForItem = index(oldItem);
         if (indexForItem >= 0) {
-            m_itemData[indexForItem]->item = newItem;
+            ItemData* itemData = m_itemData.at(indexForItem);
+            const QHash<QByteArray, QVariant> oldValues = data(indexForItem);
+
+            itemData->item = newItem;
+            if (itemData->sortKey && oldItem.text() != newItem.text()) {
+                itemData->sortKey.reset();
+                changedItemDataList.append(itemData);
+            }
 
             // Keep old values as long as possible if they could not retrieved synchronously yet.
             // The update of the values will be done asynchronously by KFileItemModelRolesUpdater.
-            QHashIterator<QByteArray, QVariant> it(retrieveData(newItem, m_itemData.at(indexForItem)->parent));
-            QHash<QByteArray, QVariant>& values = m_itemData[indexForItem]->values;
+            retrieveData(itemData);
+            QHashIterator<QByteArray, QVariant> it(itemValues(itemData));
             while (it.hasNext()) {
                 it.next();
                 const QByteArray& role = it.key();
-                if (values.value(role) != it.value()) {
-                    values.insert(role, it.value());
+                if (oldValues.value(role) != it.value()) {
                     changedRoles.insert(role);
                 }
             }
 
             m_items.remove(oldItem.url());
-            m_items.insert(newItem.url(), indexForItem);
+            m_items.insert(newItem.url(), itemData);
             indexes.append(indexForItem);
         } else {
             // Check if 'oldItem' is one of the filtered items.
@@ -1099,9 +1304,12 @@ void KFileItemModel::slotRefreshItems(const QList<QPair<KFileItem, KFileItem> >&
                 ItemData* itemData = it.value();
                 itemData->item = newItem;
 
-                // The data stored in 'values' might have changed. Therefore, we clear
-                // 'values' and re-populate it the next time it is requested via data(int).
-                itemData->values.clear();
+                // The role values might have changed. Therefore, we clear them
+                // and re-populate them the next time they are requested via data(int).
+                // The same applies to the collation key, which is calculated in
+                // insertItems() when the item gets visible again.
+                resetData(itemData);
+                itemData->sortKey.reset();
 
                 m_filteredItems.erase(it);
                 m_filteredItems.insert(newItem, itemData);
@@ -1109,12 +1317,14 @@ void KFileItemModel::slotRefreshItems(const QList<QPair<KFileItem, KFileItem> >&
         }
     }
 
-    // If the changed items have been created recently, they might not be in m_items yet.
-    // In that case, the list 'indexes' might be empty.
+    // If the changed items are filtered or have been created recently, they are
+    // not part of the model yet. In that case, the list 'indexes' might be empty.
     if (indexes.isEmpty()) {
         return;
     }
 
+    updateSortKeys(changedItemDataList);
+
     // Extract the item-ranges out of the changed indexes
     qSort(indexes);
     const KItemRangeList itemRangeList = KItemRangeList::fromSortedContainer(indexes);
@@ -1127,12 +1337,16 @@ void KFileItemModel::slotClear()
     qCDebug(DolphinDebug) << "Clearing all items";
 #endif
 
+    discardPreparingItems();
+
     qDeleteAll(m_filteredItems);
     m_filteredItems.clear();
     m_groups.clear();
 
     m_maximumUpdateIntervalTimer->stop();
     m_resortAllItemsTimer->stop();
+    m_itemsToResort.clear();
+    m_resortAllItemsRequired = false;
 
     qDeleteAll(m_pendingItemsToInsert);
     m_pendingItemsToInsert.clear();
@@ -1145,23 +1359,44 @@ void KFileItemModel::slotClear()
         emit itemsRemoved(KItemRangeList() << KItemRange(0, removedCount));
     }
 
+    // All ItemData instances have been deleted, hence all slots can be released.
+    m_roleStore.clear();
+
     m_expandedDirs.clear();
 }
 
 void KFileItemModel::slotSortingChoiceChanged()
 {
+    // The collation keys of the items that are prepared in worker
+    // threads are based on the old settings.
+    finishItemPreparation();
+
     loadSortingSettings();
+    resetSortKeys();
+    updateSortKeys(m_itemData);
     resortAllItems();
 }
 
 void KFileItemModel::dispatchPendingItemsToInsert()
 {
+    finishItemPreparation();
+
     if (!m_pendingItemsToInsert.isEmpty()) {
         insertItems(m_pendingItemsToInsert);
         m_pendingItemsToInsert.clear();
     }
 }
 
+void KFileItemModel::slotItemsPrepared()
+{
+    // Adopt the prepared items in the order in which they have been added.
+    while (!m_preparingItems.isEmpty() && m_preparingItems.first()->isFinished()) {
+        QFutureWatcher<PreparedItems*>* watcher = m_preparingItems.takeFirst();
+        adoptPreparedItems(watcher->result());
+        watcher->deleteLater();
+    }
+}
+
 void KFileItemModel::insertItems(QList<ItemData*>& newItems)
 {
     if (newItems.isEmpty()) {
@@ -1175,8 +1410,16 @@ void KFileItemModel::insertItems(QList<ItemData*>& newItems)
     qCDebug(DolphinDebug) << "Inserting" << newItems.count() << "items";
 #endif
 
-    m_groups.clear();
     prepareItemsForSorting(newItems);
+    updateSortKeys(newItems);
+
+    if (!m_itemsToResort.isEmpty()) {
+        // The position of the new items is determined by comparing them
+        // with the existing items, some of which are not sorted correctly.
+        // resortChangedItems() can only move the changed items, hence all
+        // items must be resorted.
+        m_resortAllItemsRequired = true;
+    }
 
     if (m_sortRole == NameRole && m_naturalSorting) {
         // Natural sorting of items can be very slow. However, it becomes much
@@ -1201,6 +1444,12 @@ void KFileItemModel::insertItems(QList<ItemData*>& newItems)
         // Optimization for the common special case that there are no
         // items in the model yet. Happens, e.g., when entering a folder.
         m_itemData = newItems;
+        m_items.reserve(newItemCount);
+        for (int i = 0; i < newItemCount; ++i) {
+            ItemData* itemData = m_itemData.at(i);
+            itemData->index = i;
+            m_items.insert(itemData->item.url(), itemData);
+        }
         itemRanges << KItemRange(0, newItemCount);
     } else {
         m_itemData.reserve(totalItemCount);
@@ -1209,7 +1458,9 @@ void KFileItemModel::insertItems(QList<ItemData*>& newItems)
         }
 
         // We build the new list m_itemData in reverse order to minimize
-        // the number of moves and guarantee O(N) complexity.
+        // the number of moves and guarantee O(N) complexity. The indexes
+        // of the moved items are updated on the fly, the items in front
+        // of the first inserted item keep their index.
         int targetIndex = totalItemCount - 1;
         int sourceIndexExistingItems = existingItemCount - 1;
         int sourceIndexNewItems = newItemCount - 1;
@@ -1226,12 +1477,16 @@ void KFileItemModel::insertItems(QList<ItemData*>& newItems)
                     rangeCount = 0;
                 }
 
-                m_itemData[targetIndex] = m_itemData.at(sourceIndexExistingItems);
+                ItemData* existingItem = m_itemData.at(sourceIndexExistingItems);
+                existingItem->index = targetIndex;
+                m_itemData[targetIndex] = existingItem;
                 --sourceIndexExistingItems;
             } else {
                 // Insert a new item into the list.
                 ++rangeCount;
+                newItem->index = targetIndex;
                 m_itemData[targetIndex] = newItem;
+                m_items.insert(newItem->item.url(), newItem);
                 --sourceIndexNewItems;
             }
             --targetIndex;
@@ -1246,9 +1501,7 @@ void KFileItemModel::insertItems(QList<ItemData*>& newItems)
         std::reverse(itemRanges.begin(), itemRanges.end());
     }
 
-    // The indexes in m_items are not correct anymore. Therefore, we clear m_items.
-    // It will be re-populated with the updated indices if index(const QUrl&) is called.
-    m_items.clear();
+    updateGroupsAfterInsertion(itemRanges);
 
     emit itemsInserted(itemRanges);
 
@@ -1263,16 +1516,20 @@ void KFileItemModel::removeItems(const KItemRangeList& itemRanges, RemoveItemsBe
         return;
     }
 
-    m_groups.clear();
-
     // Step 1: Remove the items from m_itemData, and free the ItemData.
     int removedItemsCount = 0;
     foreach (const KItemRange& range, itemRanges) {
         removedItemsCount += range.count;
 
         for (int index = range.index; index < range.index + range.count; ++index) {
+            ItemData* itemData = m_itemData.at(index);
+            const QHash<QUrl, ItemData*>::iterator it = m_items.find(itemData->item.url());
+            if (it != m_items.end() && it.value() == itemData) {
+                m_items.erase(it);
+            }
+            m_itemsToResort.remove(itemData);
             if (behavior == DeleteItemData) {
-                delete m_itemData.at(index);
+                deleteItemData(itemData);
             }
 
             m_itemData[index] = 0;
@@ -1287,6 +1544,7 @@ void KFileItemModel::removeItems(const KItemRangeList& itemRanges, RemoveItemsBe
     const int oldItemDataCount = m_itemData.count();
     while (source < oldItemDataCount) {
         m_itemData[target] = m_itemData[source];
+        m_itemData[target]->index = target;
         ++target;
         ++source;
 
@@ -1299,9 +1557,7 @@ void KFileItemModel::removeItems(const KItemRangeList& itemRanges, RemoveItemsBe
 
     m_itemData.erase(m_itemData.end() - removedItemsCount, m_itemData.end());
 
-    // The indexes in m_items are not correct anymore. Therefore, we clear m_items.
-    // It will be re-populated with the updated indices if index(const QUrl&) is called.
-    m_items.clear();
+    updateGroupsAfterRemoval(itemRanges);
 
     emit itemsRemoved(itemRanges);
 }
@@ -1325,26 +1581,159 @@ QList<KFileItemModel::ItemData*> KFileItemModel::createItemDataList(const QUrl&
         ItemData* itemData = new ItemData();
         itemData->item = item;
         itemData->parent = parentItem;
+        itemData->slot = m_roleStore.allocate();
+        itemData->index = -1;
         itemDataList.append(itemData);
     }
 
     return itemDataList;
 }
 
+KFileItemModel::PreparedItems* KFileItemModel::prepareItems(const KFileItemList& items, const QUrl& parentUrl,
+                                                            const ItemPreparationSettings& settings)
+{
+    KFileItemModelFilter filter;
+    filter.setPattern(settings.filterPattern);
+    const bool hasSetFilters = filter.hasSetFilters();
+
+    // QCollator is not reentrant, hence m_collator may not be used here.
+    QCollator collator(settings.locale);
+    collator.setCaseSensitivity(settings.caseSensitivity);
+    collator.setIgnorePunctuation(settings.ignorePunctuation);
+    collator.setNumericMode(settings.numericMode);
+
+    PreparedItems* preparedItems = new PreparedItems();
+    preparedItems->parentUrl = parentUrl;
+    preparedItems->items.reserve(items.count());
+
+    foreach (const KFileItem& item, items) {
+        ItemData* itemData = new ItemData();
+        itemData->item = item;
+        itemData->parent = 0;
+        itemData->slot = -1;
+        itemData->index = -1;
+
+        if (hasSetFilters && !filter.matches(item)) {
+            preparedItems->filteredItems.append(itemData);
+            continue;
+        }
+
+        if (settings.naturalSorting) {
+            itemData->sortKey.reset(new QCollatorSortKey(collator.sortKey(item.text())));
+        }
+        preparedItems->items.append(itemData);
+    }
+
+    if (settings.sortRole == NameRole) {
+        // Sorting the items in insertItems() is much faster if the
+        // input sequence is already mostly sorted, see insertItems().
+        mergeSort(preparedItems->items.begin(), preparedItems->items.end(), nameLessThan);
+    }
+
+    return preparedItems;
+}
+
+void KFileItemModel::adoptPreparedItems(PreparedItems* preparedItems)
+{
+    ItemData* parent = 0;
+    if (!preparedItems->parentUrl.isEmpty()) {
+        const int parentIndex = index(preparedItems->parentUrl);
+        if (parentIndex >= 0) {
+            parent = m_itemData.at(parentIndex);
+        }
+
+        if (!parent || !m_roleStore.testFlag(parent->slot, KFileItemModelRoleStore::IsExpandedFlag)) {
+            // The parent has been removed or collapsed while the items have been prepared.
+            qDeleteAll(preparedItems->items);
+            qDeleteAll(preparedItems->filteredItems);
+            delete preparedItems;
+            return;
+        }
+    }
+
+    if (m_sortRole == TypeRole) {
+        // Like in createItemDataList(), try to resolve the MIME-types to
+        // prevent a reordering of the items when sorting by type.
+        KFileItemList items;
+        items.reserve(preparedItems->items.count());
+        foreach (const ItemData* itemData, preparedItems->items) {
+            items.append(itemData->item);
+        }
+        determineMimeTypes(items, 200);
+    }
+
+    // prepareItems() has only applied the name filter, which might have
+    // been changed in the meantime. So the filter is checked again.
+    const bool hasSetFilters = m_filter.hasSetFilters();
+    auto adoptItemData = [this, hasSetFilters, parent](ItemData* itemData) {
+        itemData->parent = parent;
+        itemData->slot = m_roleStore.allocate();
+        if (hasSetFilters && !m_filter.matches(itemData->item)) {
+            m_filteredItems.insert(itemData->item, itemData);
+        } else {
+            m_pendingItemsToInsert.append(itemData);
+        }
+    };
+
+    foreach (ItemData* itemData, preparedItems->items) {
+        adoptItemData(itemData);
+    }
+    foreach (ItemData* itemData, preparedItems->filteredItems) {
+        adoptItemData(itemData);
+    }
+
+    delete preparedItems;
+}
+
+void KFileItemModel::finishItemPreparation()
+{
+    while (!m_preparingItems.isEmpty()) {
+        QFutureWatcher<PreparedItems*>* watcher = m_preparingItems.takeFirst();
+        watcher->waitForFinished();
+        adoptPreparedItems(watcher->result());
+        watcher->deleteLater();
+    }
+}
+
+void KFileItemModel::discardPreparingItems()
+{
+    foreach (QFutureWatcher<PreparedItems*>* watcher, m_preparingItems) {
+        watcher->waitForFinished();
+
+        PreparedItems* preparedItems = watcher->result();
+        qDeleteAll(preparedItems->items);
+        qDeleteAll(preparedItems->filteredItems);
+        delete preparedItems;
+
+        watcher->deleteLater();
+    }
+    m_preparingItems.clear();
+}
+
+void KFileItemModel::deleteItemData(ItemData* itemData)
+{
+    m_roleStore.release(itemData->slot);
+    delete itemData;
+}
+
 void KFileItemModel::prepareItemsForSorting(QList<ItemData*>& itemDataList)
 {
     switch (m_sortRole) {
+    case SizeRole:
+    case ModificationTimeRole:
+    case CreationTimeRole:
+    case AccessTimeRole:
     case PermissionsRole:
     case OwnerRole:
     case GroupRole:
     case DestinationRole:
     case PathRole:
     case DeletionTimeRole:
-        // These roles can be determined with retrieveData, and they have to be stored
-        // in the QHash "values" for the sorting.
+        // These roles can be determined with retrieveData, and the sorting
+        // reads them from m_roleStore or from the QHash "values".
         foreach (ItemData* itemData, itemDataList) {
-            if (itemData->values.isEmpty()) {
-                itemData->values = retrieveData(itemData->item, itemData->parent);
+            if (!isDataRetrieved(itemData)) {
+                retrieveData(itemData);
             }
         }
         break;
@@ -1352,10 +1741,10 @@ void KFileItemModel::prepareItemsForSorting(QList<ItemData*>& itemDataList)
     case TypeRole:
         // At least store the data including the file type for items with known MIME type.
         foreach (ItemData* itemData, itemDataList) {
-            if (itemData->values.isEmpty()) {
+            if (!isDataRetrieved(itemData)) {
                 const KFileItem item = itemData->item;
                 if (item.isDir() || item.isMimeTypeKnown()) {
-                    itemData->values = retrieveData(itemData->item, itemData->parent);
+                    retrieveData(itemData);
                 }
             }
         }
@@ -1364,22 +1753,21 @@ void KFileItemModel::prepareItemsForSorting(QList<ItemData*>& itemDataList)
     default:
         // The other roles are either resolved by KFileItemModelRolesUpdater
         // (this includes the SizeRole for directories), or they do not need
-        // to be stored in the QHash "values" for sorting because the data can
-        // be retrieved directly from the KFileItem (NameRole, SizeRole for files,
-        // DateRole).
+        // to be stored for sorting because the data can be retrieved directly
+        // from the KFileItem (NameRole).
         break;
     }
 }
 
-int KFileItemModel::expandedParentsCount(const ItemData* data)
+int KFileItemModel::expandedParentsCount(const ItemData* data) const
 {
-    // The hash 'values' is only guaranteed to contain the key "expandedParentsCount"
+    // m_roleStore is only guaranteed to contain the value of "expandedParentsCount"
     // if the corresponding item is expanded, and it is not a top-level item.
     const ItemData* parent = data->parent;
     if (parent) {
         if (parent->parent) {
-            Q_ASSERT(parent->values.contains("expandedParentsCount"));
-            return parent->values.value("expandedParentsCount").toInt() + 1;
+            Q_ASSERT(m_roleStore.expandedParentsCount(parent->slot) >= 0);
+            return m_roleStore.expandedParentsCount(parent->slot) + 1;
         } else {
             return 1;
         }
@@ -1409,7 +1797,7 @@ void KFileItemModel::removeExpandedItems()
 
     while (it != end) {
         if (it.value()->parent) {
-            delete it.value();
+            deleteItemData(it.value());
             it = m_filteredItems.erase(it);
         } else {
             ++it;
@@ -1424,36 +1812,56 @@ void KFileItemModel::emitItemsChangedAndTriggerResorting(const KItemRangeList& i
     // Trigger a resorting if necessary. Note that this can happen even if the sort
     // role has not changed at all because the file name can be used as a fallback.
     if (changedRoles.contains(sortRole()) || changedRoles.contains(roleForType(NameRole))) {
-        foreach (const KItemRange& range, itemRanges) {
-            bool needsResorting = false;
+        bool needsResorting = false;
 
+        foreach (const KItemRange& range, itemRanges) {
+            // Resorting the items of the range is necessary if the order of the
+            // items is not correct anymore. The items in m_itemsToResort will
+            // be moved anyway, therefore they are skipped when comparing the
+            // items with their predecessors and successors. This guarantees
+            // that all items which are not in m_itemsToResort are sorted
+            // correctly, which is required by resortChangedItems().
             const int first = range.index;
             const int last = range.index + range.count - 1;
 
-            // Resorting the model is necessary if
-            // (a)  The first item in the range is "lessThan" its predecessor,
-            // (b)  the successor of the last item is "lessThan" the last item, or
-            // (c)  the internal order of the items in the range is incorrect.
-            if (first > 0
-                && lessThan(m_itemData.at(first), m_itemData.at(first - 1), m_collator)) {
-                needsResorting = true;
-            } else if (last < count() - 1
-                && lessThan(m_itemData.at(last + 1), m_itemData.at(last), m_collator)) {
-                needsResorting = true;
-            } else {
-                for (int index = first; index < last; ++index) {
-                    if (lessThan(m_itemData.at(index + 1), m_itemData.at(index), m_collator)) {
-                        needsResorting = true;
-                        break;
-                    }
+            int index = first - 1;
+            while (index >= 0 && m_itemsToResort.contains(m_itemData.at(index))) {
+                --index;
+            }
+            const ItemData* previous = (index >= 0) ? m_itemData.at(index) : 0;
+
+            bool rangeNeedsResorting = false;
+            const int itemCount = count();
+            for (index = first; index < itemCount; ++index) {
+                ItemData* itemData = m_itemData.at(index);
+                if (m_itemsToResort.contains(itemData)) {
+                    continue;
+                }
+
+                if (previous && lessThan(itemData, previous, m_collator)) {
+                    rangeNeedsResorting = true;
+                    break;
+                }
+
+                if (index > last) {
+                    // The successor of the range has been checked.
+                    break;
                 }
+                previous = itemData;
             }
 
-            if (needsResorting) {
-                m_resortAllItemsTimer->start();
-                return;
+            if (rangeNeedsResorting) {
+                for (int index = first; index <= last; ++index) {
+                    m_itemsToResort.insert(m_itemData.at(index));
+                }
+                needsResorting = true;
             }
         }
+
+        if (needsResorting) {
+            m_resortAllItemsTimer->start();
+            return;
+        }
     }
 
     if (groupedSorting() && changedRoles.contains(sortRole())) {
@@ -1478,8 +1886,11 @@ void KFileItemModel::resetRoles()
 
 KFileItemModel::RoleType KFileItemModel::typeForRole(const QByteArray& role) const
 {
-    static QHash<QByteArray, RoleType> roles;
-    if (roles.isEmpty()) {
+    // The initialization of a static local variable is thread-safe, which is
+    // required because sortRoleCompare() is invoked by several threads.
+    static const QHash<QByteArray, RoleType> roles = []() {
+        QHash<QByteArray, RoleType> roles;
+
         // Insert user visible roles that can be accessed with
         // KFileItemModel::roleInformation()
         int count = 0;
@@ -1498,15 +1909,18 @@ KFileItemModel::RoleType KFileItemModel::typeForRole(const QByteArray& role) con
         roles.insert("expandedParentsCount", ExpandedParentsCountRole);
 
         Q_ASSERT(roles.count() == RolesCount);
-    }
+        return roles;
+    }();
 
     return roles.value(role, NoRole);
 }
 
 QByteArray KFileItemModel::roleForType(RoleType roleType) const
 {
-    static QHash<RoleType, QByteArray> roles;
-    if (roles.isEmpty()) {
+    // See typeForRole() regarding thread-safety.
+    static const QHash<RoleType, QByteArray> roles = []() {
+        QHash<RoleType, QByteArray> roles;
+
         // Insert user visible roles that can be accessed with
         // KFileItemModel::roleInformation()
         int count = 0;
@@ -1525,38 +1939,43 @@ QByteArray KFileItemModel::roleForType(RoleType roleType) const
         roles.insert(ExpandedParentsCountRole, "expandedParentsCount");
 
         Q_ASSERT(roles.count() == RolesCount);
-    };
+        return roles;
+    }();
 
     return roles.value(roleType);
 }
 
-QHash<QByteArray, QVariant> KFileItemModel::retrieveData(const KFileItem& item, const ItemData* parent) const
+void KFileItemModel::retrieveData(ItemData* itemData) const
 {
-    // It is important to insert only roles that are fast to retrieve. E.g.
+    // It is important to store only roles that are fast to retrieve. E.g.
     // KFileItem::iconName() can be very expensive if the MIME-type is unknown
     // and hence will be retrieved asynchronously by KFileItemModelRolesUpdater.
-    QHash<QByteArray, QVariant> data;
-    data.insert(sharedValue("url"), item.url());
+    const KFileItem& item = itemData->item;
+    const int slot = itemData->slot;
+
+    m_roleStore.setFlag(slot, KFileItemModelRoleStore::RetrievedFlag, true);
 
     const bool isDir = item.isDir();
     if (m_requestRole[IsDirRole] && isDir) {
-        data.insert(sharedValue("isDir"), true);
+        m_roleStore.setFlag(slot, KFileItemModelRoleStore::IsDirFlag, true);
     }
 
     if (m_requestRole[IsLinkRole] && item.isLink()) {
-        data.insert(sharedValue("isLink"), true);
+        m_roleStore.setFlag(slot, KFileItemModelRoleStore::IsLinkFlag, true);
     }
 
     if (m_requestRole[IsHiddenRole] && item.isHidden()) {
-        data.insert(sharedValue("isHidden"), true);
+        m_roleStore.setFlag(slot, KFileItemModelRoleStore::IsHiddenFlag, true);
     }
 
     if (m_requestRole[NameRole]) {
-        data.insert(sharedValue("text"), item.text());
+        // The text is provided by KFileItem::text(). Only a text
+        // that has been set by setData() is stored in 'values'.
+        itemData->values.remove("text");
     }
 
     if (m_requestRole[SizeRole] && !isDir) {
-        data.insert(sharedValue("size"), item.size());
+        m_roleStore.setNumber(KFileItemModelRoleStore::SizeColumn, slot, item.size());
     }
 
     if (m_requestRole[ModificationTimeRole]) {
@@ -1564,7 +1983,7 @@ QHash<QByteArray, QVariant> KFileItemModel::retrieveData(const KFileItem& item,
         // having several thousands of items. Instead the formatting of the
         // date-time will be done on-demand by the view when the date will be shown.
         const QDateTime dateTime = item.time(KFileItem::ModificationTime);
-        data.insert(sharedValue("modificationtime"), dateTime);
+        m_roleStore.setDateTime(KFileItemModelRoleStore::ModificationTimeColumn, slot, dateTime);
     }
 
     if (m_requestRole[CreationTimeRole]) {
@@ -1572,7 +1991,7 @@ QHash<QByteArray, QVariant> KFileItemModel::retrieveData(const KFileItem& item,
         // having several thousands of items. Instead the formatting of the
         // date-time will be done on-demand by the view when the date will be shown.
         const QDateTime dateTime = item.time(KFileItem::CreationTime);
-        data.insert(sharedValue("creationtime"), dateTime);
+        m_roleStore.setDateTime(KFileItemModelRoleStore::CreationTimeColumn, slot, dateTime);
     }
 
     if (m_requestRole[AccessTimeRole]) {
@@ -1580,19 +1999,19 @@ QHash<QByteArray, QVariant> KFileItemModel::retrieveData(const KFileItem& item,
         // having several thousands of items. Instead the formatting of the
         // date-time will be done on-demand by the view when the date will be shown.
         const QDateTime dateTime = item.time(KFileItem::AccessTime);
-        data.insert(sharedValue("accesstime"), dateTime);
+        m_roleStore.setDateTime(KFileItemModelRoleStore::AccessTimeColumn, slot, dateTime);
     }
 
     if (m_requestRole[PermissionsRole]) {
-        data.insert(sharedValue("permissions"), item.permissionsString());
+        m_roleStore.setString(KFileItemModelRoleStore::PermissionsColumn, slot, item.permissionsString());
     }
 
     if (m_requestRole[OwnerRole]) {
-        data.insert(sharedValue("owner"), item.user());
+        m_roleStore.setString(KFileItemModelRoleStore::OwnerColumn, slot, item.user());
     }
 
     if (m_requestRole[GroupRole]) {
-        data.insert(sharedValue("group"), item.group());
+        m_roleStore.setString(KFileItemModelRoleStore::GroupColumn, slot, item.group());
     }
 
     if (m_requestRole[DestinationRole]) {
@@ -1600,7 +2019,7 @@ QHash<QByteArray, QVariant> KFileItemModel::retrieveData(const KFileItem& item,
         if (destination.isEmpty()) {
             destination = QStringLiteral("-");
         }
-        data.insert(sharedValue("destination"), destination);
+        itemData->values.insert(sharedValue("destination"), destination);
     }
 
     if (m_requestRole[PathRole]) {
@@ -1623,7 +2042,7 @@ QHash<QByteArray, QVariant> KFileItemModel::retrieveData(const KFileItem& item,
 
         const int index = path.lastIndexOf(item.text());
         path = path.mid(0, index - 1);
-        data.insert(sharedValue("path"), path);
+        itemData->values.insert(sharedValue("path"), path);
     }
 
     if (m_requestRole[DeletionTimeRole]) {
@@ -1631,76 +2050,368 @@ QHash<QByteArray, QVariant> KFileItemModel::retrieveData(const KFileItem& item,
         if (item.url().scheme() == QLatin1String("trash")) {
             deletionTime = QDateTime::fromString(item.entry().stringValue(KIO::UDSEntry::UDS_EXTRA + 1), Qt::ISODate);
         }
-        data.insert(sharedValue("deletiontime"), deletionTime);
+        m_roleStore.setDateTime(KFileItemModelRoleStore::DeletionTimeColumn, slot, deletionTime);
     }
 
     if (m_requestRole[IsExpandableRole] && isDir) {
-        data.insert(sharedValue("isExpandable"), true);
+        m_roleStore.setFlag(slot, KFileItemModelRoleStore::IsExpandableFlag, true);
     }
 
     if (m_requestRole[ExpandedParentsCountRole]) {
-        if (parent) {
-            const int level = expandedParentsCount(parent) + 1;
-            data.insert(sharedValue("expandedParentsCount"), level);
+        if (itemData->parent) {
+            const int level = expandedParentsCount(itemData->parent) + 1;
+            m_roleStore.setExpandedParentsCount(slot, level);
         }
     }
 
     if (item.isMimeTypeKnown()) {
-        data.insert(sharedValue("iconName"), item.iconName());
+        m_roleStore.setString(KFileItemModelRoleStore::IconNameColumn, slot, item.iconName());
 
         if (m_requestRole[TypeRole]) {
-            data.insert(sharedValue("type"), item.mimeComment());
+            m_roleStore.setString(KFileItemModelRoleStore::TypeColumn, slot, item.mimeComment());
         }
     } else if (m_requestRole[TypeRole] && isDir) {
         static const QString folderMimeType = item.mimeComment();
-        data.insert(sharedValue("type"), folderMimeType);
+        m_roleStore.setString(KFileItemModelRoleStore::TypeColumn, slot, folderMimeType);
     }
-
-    return data;
 }
 
-bool KFileItemModel::lessThan(const ItemData* a, const ItemData* b, const QCollator& collator) const
+bool KFileItemModel::isDataRetrieved(const ItemData* itemData) const
 {
-    int result = 0;
+    return m_roleStore.testFlag(itemData->slot, KFileItemModelRoleStore::RetrievedFlag);
+}
 
-    if (a->parent != b->parent) {
-        const int expansionLevelA = expandedParentsCount(a);
-        const int expansionLevelB = expandedParentsCount(b);
+void KFileItemModel::resetData(ItemData* itemData)
+{
+    m_roleStore.reset(itemData->slot);
+    itemData->values.clear();
+}
 
-        // If b has a higher expansion level than a, check if a is a parent
-        // of b, and make sure that both expansion levels are equal otherwise.
-        for (int i = expansionLevelB; i > expansionLevelA; --i) {
-            if (b->parent == a) {
-                return true;
-            }
-            b = b->parent;
-        }
+QVariant KFileItemModel::itemValue(const ItemData* itemData, const QByteArray& role) const
+{
+    return itemValue(itemData, typeForRole(role), role);
+}
 
-        // If a has a higher expansion level than a, check if b is a parent
-        // of a, and make sure that both expansion levels are equal otherwise.
-        for (int i = expansionLevelA; i > expansionLevelB; --i) {
-            if (a->parent == b) {
-                return false;
-            }
-            a = a->parent;
-        }
+QVariant KFileItemModel::itemValue(const ItemData* itemData, RoleType roleType, const QByteArray& role) const
+{
+    const int slot = itemData->slot;
 
-        Q_ASSERT(expandedParentsCount(a) == expandedParentsCount(b));
+    switch (roleType) {
+    case NameRole:
+        return itemData->values.value(role, itemData->item.text());
 
-        // Compare the last parents of a and b which are different.
-        while (a->parent != b->parent) {
-            a = a->parent;
-            b = b->parent;
+    case SizeRole: {
+        const qint64 size = m_roleStore.number(KFileItemModelRoleStore::SizeColumn, slot);
+        if (size == KFileItemModelRoleStore::NoNumber) {
+            return QVariant();
         }
+        // For directories, the size represents the number of sub-items, unless
+        // KFileItemModelRolesUpdater has determined the size of the contents.
+        const bool isItemCount = itemData->item.isDir() &&
+                                 !m_roleStore.testFlag(slot, KFileItemModelRoleStore::IsRecursiveSizeFlag);
+        return isItemCount ? QVariant(static_cast<int>(size))
+                           : QVariant::fromValue(static_cast<KIO::filesize_t>(size));
     }
 
-    if (m_sortDirsFirst || m_sortRole == SizeRole) {
-        const bool isDirA = a->item.isDir();
-        const bool isDirB = b->item.isDir();
-        if (isDirA && !isDirB) {
-            return true;
-        } else if (!isDirA && isDirB) {
-            return false;
+    case ModificationTimeRole:
+    case CreationTimeRole:
+    case AccessTimeRole:
+    case DeletionTimeRole: {
+        const KFileItemModelRoleStore::NumberColumn column = timeColumn(roleType);
+        if (m_roleStore.number(column, slot) == KFileItemModelRoleStore::NoNumber) {
+            return QVariant();
+        }
+        return m_roleStore.dateTime(column, slot);
+    }
+
+    case PermissionsRole:
+    case OwnerRole:
+    case GroupRole:
+    case TypeRole: {
+        const int id = m_roleStore.stringId(stringColumn(roleType), slot);
+        return id < 0 ? QVariant() : QVariant(m_roleStore.stringForId(id));
+    }
+
+    case RatingRole: {
+        const qint64 rating = m_roleStore.number(KFileItemModelRoleStore::RatingColumn, slot);
+        return rating == KFileItemModelRoleStore::NoNumber ? QVariant() : QVariant(static_cast<int>(rating));
+    }
+
+    case IsDirRole:
+    case IsLinkRole:
+    case IsHiddenRole:
+    case IsExpandedRole:
+    case IsExpandableRole: {
+        const KFileItemModelRoleStore::Flag flag = roleFlag(roleType);
+        return m_roleStore.hasFlag(slot, flag) ? QVariant(m_roleStore.testFlag(slot, flag)) : QVariant();
+    }
+
+    case ExpandedParentsCountRole: {
+        const int level = m_roleStore.expandedParentsCount(slot);
+        return level < 0 ? QVariant() : QVariant(level);
+    }
+
+    default:
+        break;
+    }
+
+    if (role == "url") {
+        return itemData->item.url();
+    } else if (role == "iconName") {
+        const int id = m_roleStore.stringId(KFileItemModelRoleStore::IconNameColumn, slot);
+        return id < 0 ? QVariant() : QVariant(m_roleStore.stringForId(id));
+    }
+
+    return itemData->values.value(role);
+}
+
+void KFileItemModel::setItemValue(ItemData* itemData, const QByteArray& role, const QVariant& value)
+{
+    const int slot = itemData->slot;
+
+    switch (typeForRole(role)) {
+    case SizeRole:
+        m_roleStore.setNumber(KFileItemModelRoleStore::SizeColumn, slot,
+                              value.isNull() ? KFileItemModelRoleStore::NoNumber : value.toLongLong());
+        m_roleStore.setFlag(slot, KFileItemModelRoleStore::IsRecursiveSizeFlag,
+                            itemData->item.isDir() && value.userType() == qMetaTypeId<KIO::filesize_t>());
+        return;
+
+    case ModificationTimeRole:
+    case CreationTimeRole:
+    case AccessTimeRole:
+    case DeletionTimeRole: {
+        const KFileItemModelRoleStore::NumberColumn column = timeColumn(typeForRole(role));
+        if (value.isValid()) {
+            m_roleStore.setDateTime(column, slot, value.toDateTime());
+        } else {
+            m_roleStore.setNumber(column, slot, KFileItemModelRoleStore::NoNumber);
+        }
+        return;
+    }
+
+    case PermissionsRole:
+    case OwnerRole:
+    case GroupRole:
+    case TypeRole:
+        if (value.isValid()) {
+            m_roleStore.setString(stringColumn(typeForRole(role)), slot, value.toString());
+        } else {
+            m_roleStore.unsetString(stringColumn(typeForRole(role)), slot);
+        }
+        return;
+
+    case RatingRole:
+        m_roleStore.setNumber(KFileItemModelRoleStore::RatingColumn, slot,
+                              value.isValid() ? value.toInt() : KFileItemModelRoleStore::NoNumber);
+        return;
+
+    case IsDirRole:
+    case IsLinkRole:
+    case IsHiddenRole:
+    case IsExpandedRole:
+    case IsExpandableRole: {
+        const KFileItemModelRoleStore::Flag flag = roleFlag(typeForRole(role));
+        if (value.isValid()) {
+            m_roleStore.setFlag(slot, flag, value.toBool());
+        } else {
+            m_roleStore.unsetFlag(slot, flag);
+        }
+        return;
+    }
+
+    case ExpandedParentsCountRole:
+        m_roleStore.setExpandedParentsCount(slot, value.isValid() ? value.toInt() : -1);
+        return;
+
+    default:
+        break;
+    }
+
+    if (role == "iconName") {
+        if (value.isValid()) {
+            m_roleStore.setString(KFileItemModelRoleStore::IconNameColumn, slot, value.toString());
+        } else {
+            m_roleStore.unsetString(KFileItemModelRoleStore::IconNameColumn, slot);
+        }
+    } else if (role != "url") {
+        // The URL is always provided by the KFileItem.
+        itemData->values.insert(role, value);
+    }
+}
+
+QHash<QByteArray, QVariant> KFileItemModel::itemValues(const ItemData* itemData) const
+{
+    // Use static keys to assure that the keys in the returned
+    // hashes are implicitly shared.
+    static const QByteArray urlRole = sharedValue("url");
+    static const QByteArray textRole = sharedValue("text");
+    static const QByteArray iconNameRole = sharedValue("iconName");
+    static const QByteArray sizeRole = sharedValue("size");
+    static const QByteArray expandedParentsCountRole = sharedValue("expandedParentsCount");
+    static const QByteArray ratingRole = sharedValue("rating");
+
+    static const struct {
+        QByteArray role;
+        KFileItemModelRoleStore::Flag flag;
+    } flagRoles[] = {
+        { sharedValue("isDir"), KFileItemModelRoleStore::IsDirFlag },
+        { sharedValue("isLink"), KFileItemModelRoleStore::IsLinkFlag },
+        { sharedValue("isHidden"), KFileItemModelRoleStore::IsHiddenFlag },
+        { sharedValue("isExpanded"), KFileItemModelRoleStore::IsExpandedFlag },
+        { sharedValue("isExpandable"), KFileItemModelRoleStore::IsExpandableFlag }
+    };
+
+    static const struct {
+        QByteArray role;
+        KFileItemModelRoleStore::StringColumn column;
+    } stringRoles[] = {
+        { sharedValue("permissions"), KFileItemModelRoleStore::PermissionsColumn },
+        { sharedValue("owner"), KFileItemModelRoleStore::OwnerColumn },
+        { sharedValue("group"), KFileItemModelRoleStore::GroupColumn },
+        { sharedValue("type"), KFileItemModelRoleStore::TypeColumn },
+        { iconNameRole, KFileItemModelRoleStore::IconNameColumn }
+    };
+
+    static const struct {
+        QByteArray role;
+        KFileItemModelRoleStore::NumberColumn column;
+    } timeRoles[] = {
+        { sharedValue("modificationtime"), KFileItemModelRoleStore::ModificationTimeColumn },
+        { sharedValue("creationtime"), KFileItemModelRoleStore::CreationTimeColumn },
+        { sharedValue("accesstime"), KFileItemModelRoleStore::AccessTimeColumn },
+        { sharedValue("deletiontime"), KFileItemModelRoleStore::DeletionTimeColumn }
+    };
+
+    const int slot = itemData->slot;
+    const KFileItem& item = itemData->item;
+
+    QHash<QByteArray, QVariant> values = itemData->values;
+    values.insert(urlRole, item.url());
+
+    if (m_requestRole[NameRole] && !values.contains(textRole)) {
+        values.insert(textRole, item.text());
+    }
+
+    for (const auto& flagRole : flagRoles) {
+        if (m_roleStore.hasFlag(slot, flagRole.flag)) {
+            values.insert(flagRole.role, m_roleStore.testFlag(slot, flagRole.flag));
+        }
+    }
+
+    for (const auto& stringRole : stringRoles) {
+        const int id = m_roleStore.stringId(stringRole.column, slot);
+        if (id >= 0) {
+            values.insert(stringRole.role, m_roleStore.stringForId(id));
+        }
+    }
+
+    for (const auto& timeRole : timeRoles) {
+        if (m_roleStore.number(timeRole.column, slot) != KFileItemModelRoleStore::NoNumber) {
+            values.insert(timeRole.role, m_roleStore.dateTime(timeRole.column, slot));
+        }
+    }
+
+    const QVariant size = itemValue(itemData, sizeRole);
+    if (!size.isNull()) {
+        values.insert(sizeRole, size);
+    }
+
+    const qint64 rating = m_roleStore.number(KFileItemModelRoleStore::RatingColumn, slot);
+    if (rating != KFileItemModelRoleStore::NoNumber) {
+        values.insert(ratingRole, static_cast<int>(rating));
+    }
+
+    const int level = m_roleStore.expandedParentsCount(slot);
+    if (level >= 0) {
+        values.insert(expandedParentsCountRole, level);
+    }
+
+    return values;
+}
+
+KFileItemModelRoleStore::NumberColumn KFileItemModel::timeColumn(RoleType roleType)
+{
+    switch (roleType) {
+    case ModificationTimeRole: return KFileItemModelRoleStore::ModificationTimeColumn;
+    case CreationTimeRole:     return KFileItemModelRoleStore::CreationTimeColumn;
+    case AccessTimeRole:       return KFileItemModelRoleStore::AccessTimeColumn;
+    case DeletionTimeRole:     return KFileItemModelRoleStore::DeletionTimeColumn;
+    default:
+        Q_UNREACHABLE();
+        return KFileItemModelRoleStore::ModificationTimeColumn;
+    }
+}
+
+KFileItemModelRoleStore::StringColumn KFileItemModel::stringColumn(RoleType roleType)
+{
+    switch (roleType) {
+    case PermissionsRole: return KFileItemModelRoleStore::PermissionsColumn;
+    case OwnerRole:       return KFileItemModelRoleStore::OwnerColumn;
+    case GroupRole:       return KFileItemModelRoleStore::GroupColumn;
+    case TypeRole:        return KFileItemModelRoleStore::TypeColumn;
+    default:
+        Q_UNREACHABLE();
+        return KFileItemModelRoleStore::TypeColumn;
+    }
+}
+
+KFileItemModelRoleStore::Flag KFileItemModel::roleFlag(RoleType roleType)
+{
+    switch (roleType) {
+    case IsDirRole:        return KFileItemModelRoleStore::IsDirFlag;
+    case IsLinkRole:       return KFileItemModelRoleStore::IsLinkFlag;
+    case IsHiddenRole:     return KFileItemModelRoleStore::IsHiddenFlag;
+    case IsExpandedRole:   return KFileItemModelRoleStore::IsExpandedFlag;
+    case IsExpandableRole: return KFileItemModelRoleStore::IsExpandableFlag;
+    default:
+        Q_UNREACHABLE();
+        return KFileItemModelRoleStore::IsDirFlag;
+    }
+}
+
+bool KFileItemModel::lessThan(const ItemData* a, const ItemData* b, const QCollator& collator) const
+{
+    int result = 0;
+
+    if (a->parent != b->parent) {
+        const int expansionLevelA = expandedParentsCount(a);
+        const int expansionLevelB = expandedParentsCount(b);
+
+        // If b has a higher expansion level than a, check if a is a parent
+        // of b, and make sure that both expansion levels are equal otherwise.
+        for (int i = expansionLevelB; i > expansionLevelA; --i) {
+            if (b->parent == a) {
+                return true;
+            }
+            b = b->parent;
+        }
+
+        // If a has a higher expansion level than a, check if b is a parent
+        // of a, and make sure that both expansion levels are equal otherwise.
+        for (int i = expansionLevelA; i > expansionLevelB; --i) {
+            if (a->parent == b) {
+                return false;
+            }
+            a = a->parent;
+        }
+
+        Q_ASSERT(expandedParentsCount(a) == expandedParentsCount(b));
+
+        // Compare the last parents of a and b which are different.
+        while (a->parent != b->parent) {
+            a = a->parent;
+            b = b->parent;
+        }
+    }
+
+    if (m_sortDirsFirst || m_sortRole == SizeRole) {
+        const bool isDirA = a->item.isDir();
+        const bool isDirB = b->item.isDir();
+        if (isDirA && !isDirB) {
+            return true;
+        } else if (!isDirA && isDirB) {
+            return false;
         }
     }
 
@@ -1756,17 +2467,13 @@ void KFileItemModel::sort(QList<KFileItemModel::ItemData*>::iterator begin,
 {
     KFileItemModelLessThan lessThan(this, m_collator);
 
-    if (m_sortRole == NameRole) {
-        // Sorting by name can be expensive, in particular if natural sorting is
-        // enabled. Use all CPU cores to speed up the sorting process.
-        static const int numberOfThreads = QThread::idealThreadCount();
-        parallelMergeSort(begin, end, lessThan, numberOfThreads);
-    } else {
-        // Sorting by other roles is quite fast. Use only one thread to prevent
-        // problems caused by non-reentrant comparison functions, see
-        // https://bugs.kde.org/show_bug.cgi?id=312679
-        mergeSort(begin, end, lessThan);
-    }
+    // Use all CPU cores to speed up the sorting process. sortRoleCompare() only
+    // reads values that have been stored in m_roleStore and ItemData::values
+    // before the sorting, and it only uses const methods of the items. Hence
+    // it is reentrant for all sort roles (in earlier versions, this was not
+    // the case, see https://bugs.kde.org/show_bug.cgi?id=312679).
+    static const int numberOfThreads = QThread::idealThreadCount();
+    parallelMergeSort(begin, end, lessThan, numberOfThreads);
 }
 
 int KFileItemModel::sortRoleCompare(const ItemData* a, const ItemData* b, const QCollator& collator) const
@@ -1782,26 +2489,31 @@ int KFileItemModel::sortRoleCompare(const ItemData* a, const ItemData* b, const
         break;
 
     case SizeRole: {
+        const qint64 sizeA = m_roleStore.number(KFileItemModelRoleStore::SizeColumn, a->slot);
+        const qint64 sizeB = m_roleStore.number(KFileItemModelRoleStore::SizeColumn, b->slot);
         if (itemA.isDir()) {
             // See "if (m_sortFoldersFirst || m_sortRole == SizeRole)" in KFileItemModel::lessThan():
             Q_ASSERT(itemB.isDir());
 
-            const QVariant valueA = a->values.value("size");
-            const QVariant valueB = b->values.value("size");
-            if (valueA.isNull() && valueB.isNull()) {
+            // The size of a directory is the number of sub-items or the size
+            // of its contents, which is resolved asynchronously by
+            // KFileItemModelRolesUpdater.
+            if (sizeA == KFileItemModelRoleStore::NoNumber && sizeB == KFileItemModelRoleStore::NoNumber) {
                 result = 0;
-            } else if (valueA.isNull()) {
+            } else if (sizeA == KFileItemModelRoleStore::NoNumber) {
                 result = -1;
-            } else if (valueB.isNull()) {
+            } else if (sizeB == KFileItemModelRoleStore::NoNumber) {
                 result = +1;
+            } else if (sizeA > sizeB) {
+                result = +1;
+            } else if (sizeA < sizeB) {
+                result = -1;
             } else {
-                result = valueA.toInt() - valueB.toInt();
+                result = 0;
             }
         } else {
             // See "if (m_sortFoldersFirst || m_sortRole == SizeRole)" in KFileItemModel::lessThan():
             Q_ASSERT(!itemB.isDir());
-            const KIO::filesize_t sizeA = itemA.size();
-            const KIO::filesize_t sizeB = itemB.size();
             if (sizeA > sizeB) {
                 result = +1;
             } else if (sizeA < sizeB) {
@@ -1813,53 +2525,59 @@ int KFileItemModel::sortRoleCompare(const ItemData* a, const ItemData* b, const
         break;
     }
 
-    case ModificationTimeRole: {
-        const QDateTime dateTimeA = itemA.time(KFileItem::ModificationTime);
-        const QDateTime dateTimeB = itemB.time(KFileItem::ModificationTime);
-        if (dateTimeA < dateTimeB) {
-            result = -1;
-        } else if (dateTimeA > dateTimeB) {
-            result = +1;
-        }
-        break;
-    }
-
-    case CreationTimeRole: {
-        const QDateTime dateTimeA = itemA.time(KFileItem::CreationTime);
-        const QDateTime dateTimeB = itemB.time(KFileItem::CreationTime);
-        if (dateTimeA < dateTimeB) {
+    case ModificationTimeRole:
+    case CreationTimeRole:
+    case AccessTimeRole:
+    case DeletionTimeRole: {
+        // The times are stored as milliseconds since the epoch in m_roleStore,
+        // see prepareItemsForSorting().
+        const KFileItemModelRoleStore::NumberColumn column = timeColumn(m_sortRole);
+        const qint64 timeA = m_roleStore.number(column, a->slot);
+        const qint64 timeB = m_roleStore.number(column, b->slot);
+        if (timeA < timeB) {
             result = -1;
-        } else if (dateTimeA > dateTimeB) {
+        } else if (timeA > timeB) {
             result = +1;
         }
         break;
     }
 
-    case DeletionTimeRole: {
-        const QDateTime dateTimeA = a->values.value("deletiontime").toDateTime();
-        const QDateTime dateTimeB = b->values.value("deletiontime").toDateTime();
-        if (dateTimeA < dateTimeB) {
-            result = -1;
-        } else if (dateTimeA > dateTimeB) {
-            result = +1;
+    case PermissionsRole:
+    case OwnerRole:
+    case GroupRole:
+    case TypeRole: {
+        // Equal strings have equal ids in m_roleStore, hence the
+        // strings only need to be compared if the ids are different.
+        const KFileItemModelRoleStore::StringColumn column = stringColumn(m_sortRole);
+        const int idA = m_roleStore.stringId(column, a->slot);
+        const int idB = m_roleStore.stringId(column, b->slot);
+        if (idA != idB) {
+            result = QString::compare(m_roleStore.stringForId(idA), m_roleStore.stringForId(idB));
         }
         break;
     }
 
     case RatingRole: {
-        result = a->values.value("rating").toInt() - b->values.value("rating").toInt();
+        // Items without rating are treated like items with the rating 0.
+        const qint64 ratingA = m_roleStore.number(KFileItemModelRoleStore::RatingColumn, a->slot);
+        const qint64 ratingB = m_roleStore.number(KFileItemModelRoleStore::RatingColumn, b->slot);
+        result = static_cast<int>((ratingA == KFileItemModelRoleStore::NoNumber ? 0 : ratingA)
+                                - (ratingB == KFileItemModelRoleStore::NoNumber ? 0 : ratingB));
         break;
     }
 
     case ImageSizeRole: {
         // Alway use a natural comparing to interpret the numbers of a string like
         // "1600 x 1200" for having a correct sorting.
-        result = collator.compare(a->values.value("imageSize").toString(),
-                                  b->values.value("imageSize").toString());
+        static const QByteArray imageSizeRole("imageSize");
+        result = collator.compare(a->values.value(imageSizeRole).toString(),
+                                  b->values.value(imageSizeRole).toString());
         break;
     }
 
     default: {
+        // Note that only const methods of the QHash and the QVariants are used,
+        // which may be invoked by several threads at the same time.
         const QByteArray role = roleForType(m_sortRole);
         result = QString::compare(a->values.value(role).toString(),
                                   b->values.value(role).toString());
@@ -1873,8 +2591,14 @@ int KFileItemModel::sortRoleCompare(const ItemData* a, const ItemData* b, const
         return result;
     }
 
-    // Fallback #1: Compare the text of the items
-    result = stringCompare(itemA.text(), itemB.text(), collator);
+    // Fallback #1: Compare the text of the items. If natural sorting is enabled,
+    // the collation keys from updateSortKeys() are used, which results in the
+    // same order as QCollator::compare(), but requires only a byte-wise comparison.
+    if (a->sortKey && b->sortKey) {
+        result = a->sortKey->compare(*b->sortKey);
+    } else {
+        result = stringCompare(itemA.text(), itemB.text(), collator);
+    }
     if (result != 0) {
         return result;
     }
@@ -1908,355 +2632,501 @@ int KFileItemModel::stringCompare(const QString& a, const QString& b, const QCol
     return QString::compare(a, b, Qt::CaseSensitive);
 }
 
-bool KFileItemModel::useMaximumUpdateInterval() const
+void KFileItemModel::updateSortKeys(const QList<ItemData*>& itemDataList) const
 {
-    return !m_dirLister->url().isLocalFile();
-}
+    if (!m_naturalSorting || itemDataList.isEmpty()) {
+        return;
+    }
 
-QList<QPair<int, QVariant> > KFileItemModel::nameRoleGroups() const
-{
-    Q_ASSERT(!m_itemData.isEmpty());
+    // QCollator is not reentrant. Like in KFileItemModelLessThan, each thread
+    // uses its own collator with the settings of m_collator.
+    const QLocale locale = m_collator.locale();
+    const Qt::CaseSensitivity caseSensitivity = m_collator.caseSensitivity();
+    const bool ignorePunctuation = m_collator.ignorePunctuation();
+    const bool numericMode = m_collator.numericMode();
 
-    const int maxIndex = count() - 1;
-    QList<QPair<int, QVariant> > groups;
+    auto calculateSortKeys = [=](QList<ItemData*>::const_iterator begin, QList<ItemData*>::const_iterator end) {
+        QCollator collator(locale);
+        collator.setCaseSensitivity(caseSensitivity);
+        collator.setIgnorePunctuation(ignorePunctuation);
+        collator.setNumericMode(numericMode);
 
-    QString groupValue;
-    QChar firstChar;
-    for (int i = 0; i <= maxIndex; ++i) {
-        if (isChildItem(i)) {
-            continue;
+        for (QList<ItemData*>::const_iterator it = begin; it != end; ++it) {
+            ItemData* itemData = *it;
+            if (!itemData->sortKey) {
+                itemData->sortKey.reset(new QCollatorSortKey(collator.sortKey(itemData->item.text())));
+            }
         }
+    };
 
-        const QString name = m_itemData.at(i)->item.text();
+    // Only split the work if each thread gets a reasonable number of items.
+    const int minimumBlockSize = 1000;
+    static const int numberOfThreads = QThread::idealThreadCount();
 
-        // Use the first character of the name as group indication
-        QChar newFirstChar = name.at(0).toUpper();
-        if (newFirstChar == QLatin1Char('~') && name.length() > 1) {
-            newFirstChar = name.at(1).toUpper();
-        }
+    const int itemCount = itemDataList.count();
+    const int blockSize = qMax(minimumBlockSize, (itemCount + numberOfThreads - 1) / numberOfThreads);
 
-        if (firstChar != newFirstChar) {
-            QString newGroupValue;
-            if (newFirstChar.isLetter()) {
-                // Try to find a matching group in the range 'A' to 'Z'.
-                static std::vector<QChar> lettersAtoZ;
-                lettersAtoZ.reserve('Z' - 'A' + 1);
-                if (lettersAtoZ.empty()) {
-                    for (char c = 'A'; c <= 'Z'; ++c) {
-                        lettersAtoZ.push_back(QLatin1Char(c));
-                    }
-                }
+    QVector<QFuture<void> > futures;
+    QList<ItemData*>::const_iterator begin = itemDataList.constBegin();
+    int remainingCount = itemCount;
+    while (remainingCount > blockSize) {
+        const QList<ItemData*>::const_iterator end = begin + blockSize;
+        futures.append(QtConcurrent::run([=]() { calculateSortKeys(begin, end); }));
+        begin = end;
+        remainingCount -= blockSize;
+    }
 
-                auto localeAwareLessThan = [this](QChar c1, QChar c2) -> bool {
-                    return m_collator.compare(c1, c2) < 0;
-                };
+    // The last block is handled by the current thread.
+    calculateSortKeys(begin, itemDataList.constEnd());
 
-                std::vector<QChar>::iterator it = std::lower_bound(lettersAtoZ.begin(), lettersAtoZ.end(), newFirstChar, localeAwareLessThan);
-                if (it != lettersAtoZ.end()) {
-                    if (localeAwareLessThan(newFirstChar, *it) && it != lettersAtoZ.begin()) {
-                        // newFirstChar belongs to the group preceding *it.
-                        // Example: for an umlaut 'A' in the German locale, *it would be 'B' now.
-                        --it;
-                    }
-                    newGroupValue = *it;
-                } else {
-                    newGroupValue = newFirstChar;
-                }
-            } else if (newFirstChar >= QLatin1Char('0') && newFirstChar <= QLatin1Char('9')) {
-                // Apply group '0 - 9' for any name that starts with a digit
-                newGroupValue = i18nc("@title:group Groups that start with a digit", "0 - 9");
-            } else {
-                newGroupValue = i18nc("@title:group", "Others");
-            }
+    for (QFuture<void>& future : futures) {
+        future.waitForFinished();
+    }
+}
 
-            if (newGroupValue != groupValue) {
-                groupValue = newGroupValue;
-                groups.append(QPair<int, QVariant>(i, newGroupValue));
-            }
+void KFileItemModel::resetSortKeys()
+{
+    foreach (ItemData* itemData, m_itemData) {
+        itemData->sortKey.reset();
+    }
 
-            firstChar = newFirstChar;
-        }
+    foreach (ItemData* itemData, m_filteredItems) {
+        itemData->sortKey.reset();
+    }
+
+    foreach (ItemData* itemData, m_pendingItemsToInsert) {
+        itemData->sortKey.reset();
     }
-    return groups;
 }
 
-QList<QPair<int, QVariant> > KFileItemModel::sizeRoleGroups() const
+bool KFileItemModel::useMaximumUpdateInterval() const
 {
-    Q_ASSERT(!m_itemData.isEmpty());
+    return !m_dirLister->url().isLocalFile();
+}
 
-    const int maxIndex = count() - 1;
-    QList<QPair<int, QVariant> > groups;
+QVariant KFileItemModel::groupValue(const ItemData* itemData) const
+{
+    switch (m_sortRole) {
+    case NameRole:
+        return nameRoleGroupValue(itemData);
+    case SizeRole:
+        return sizeRoleGroupValue(itemData);
+    case ModificationTimeRole:
+    case CreationTimeRole:
+    case AccessTimeRole:
+    case DeletionTimeRole:
+        return timeRoleGroupValue(m_roleStore.dateTime(timeColumn(m_sortRole), itemData->slot));
+    case PermissionsRole:
+        return permissionRoleGroupValue(itemData);
+    case RatingRole: {
+        const qint64 rating = m_roleStore.number(KFileItemModelRoleStore::RatingColumn, itemData->slot);
+        return (rating == KFileItemModelRoleStore::NoNumber) ? 0 : static_cast<int>(rating);
+    }
+    default:
+        return itemValue(itemData, m_sortRole, roleForType(m_sortRole)).toString();
+    }
+}
 
-    QString groupValue;
-    for (int i = 0; i <= maxIndex; ++i) {
-        if (isChildItem(i)) {
-            continue;
-        }
+qint64 KFileItemModel::groupKey(const ItemData* itemData) const
+{
+    switch (m_sortRole) {
+    case NameRole:
+        return nameRoleGroupChar(itemData).unicode();
 
-        const KFileItem& item = m_itemData.at(i)->item;
-        const KIO::filesize_t fileSize = !item.isNull() ? item.size() : ~0U;
-        QString newGroupValue;
+    case SizeRole: {
+        const KFileItem& item = itemData->item;
         if (!item.isNull() && item.isDir()) {
-            newGroupValue = i18nc("@title:group Size", "Folders");
-        } else if (fileSize < 5 * 1024 * 1024) {
-            newGroupValue = i18nc("@title:group Size", "Small");
-        } else if (fileSize < 10 * 1024 * 1024) {
-            newGroupValue = i18nc("@title:group Size", "Medium");
-        } else {
-            newGroupValue = i18nc("@title:group Size", "Big");
+            return 0;
         }
-
-        if (newGroupValue != groupValue) {
-            groupValue = newGroupValue;
-            groups.append(QPair<int, QVariant>(i, newGroupValue));
+        const KIO::filesize_t fileSize = !item.isNull() ? item.size() : ~0U;
+        if (fileSize < 5 * 1024 * 1024) {
+            return 1;
+        } else if (fileSize < 10 * 1024 * 1024) {
+            return 2;
         }
+        return 3;
     }
 
-    return groups;
-}
+    case ModificationTimeRole:
+    case CreationTimeRole:
+    case AccessTimeRole:
+    case DeletionTimeRole: {
+        // The group only depends on the date. Note that the value of
+        // m_roleStore is the time in milliseconds, hence it cannot be used
+        // directly.
+        const QDateTime fileTime = m_roleStore.dateTime(timeColumn(m_sortRole), itemData->slot);
+        return fileTime.date().toJulianDay();
+    }
 
-QList<QPair<int, QVariant> > KFileItemModel::timeRoleGroups(std::function<QDateTime(const ItemData *)> fileTimeCb) const
-{
-    Q_ASSERT(!m_itemData.isEmpty());
+    case PermissionsRole:
+        return m_roleStore.stringId(KFileItemModelRoleStore::PermissionsColumn, itemData->slot);
 
-    const int maxIndex = count() - 1;
-    QList<QPair<int, QVariant> > groups;
+    case RatingRole:
+        return m_roleStore.number(KFileItemModelRoleStore::RatingColumn, itemData->slot);
 
-    const QDate currentDate = QDate::currentDate();
+    default:
+        return NoGroupKey;
+    }
+}
 
-    QDate previousFileDate;
-    QString groupValue;
-    for (int i = 0; i <= maxIndex; ++i) {
+void KFileItemModel::appendGroups(QList<QPair<int, QVariant> >& groups, int begin, int end, QVariant& value) const
+{
+    qint64 previousKey = NoGroupKey;
+    for (int i = begin; i < end; ++i) {
         if (isChildItem(i)) {
             continue;
         }
 
-        const QDateTime fileTime = fileTimeCb(m_itemData.at(i));
-        const QDate fileDate = fileTime.date();
-        if (fileDate == previousFileDate) {
+        const ItemData* itemData = m_itemData.at(i);
+        const qint64 key = groupKey(itemData);
+        if (key != NoGroupKey && key == previousKey) {
             // The current item is in the same group as the previous item
             continue;
         }
-        previousFileDate = fileDate;
+        previousKey = key;
 
-        const int daysDistance = fileDate.daysTo(currentDate);
+        const QVariant newValue = groupValue(itemData);
+        if (newValue != value || !value.isValid()) {
+            value = newValue;
+            groups.append(QPair<int, QVariant>(i, newValue));
+        }
+    }
+}
 
-        QString newGroupValue;
-        if (currentDate.year() == fileDate.year() &&
-            currentDate.month() == fileDate.month()) {
+void KFileItemModel::appendGroups(QList<QPair<int, QVariant> >& groups, int begin, int end) const
+{
+    QVariant value;
+    appendGroups(groups, begin, end, value);
+}
 
-            switch (daysDistance / 7) {
-            case 0:
-                switch (daysDistance) {
-                case 0:  newGroupValue = i18nc("@title:group Date", "Today"); break;
-                case 1:  newGroupValue = i18nc("@title:group Date", "Yesterday"); break;
-                default:
-                    newGroupValue = fileTime.toString(
-                        i18nc("@title:group Date: The week day name: dddd", "dddd"));
-                    newGroupValue = i18nc("Can be used to script translation of \"dddd\""
-                        "with context @title:group Date", "%1", newGroupValue);
-                }
-                break;
-            case 1:
-                newGroupValue = i18nc("@title:group Date", "One Week Ago");
-                break;
-            case 2:
-                newGroupValue = i18nc("@title:group Date", "Two Weeks Ago");
-                break;
-            case 3:
-                newGroupValue = i18nc("@title:group Date", "Three Weeks Ago");
-                break;
-            case 4:
-            case 5:
-                newGroupValue = i18nc("@title:group Date", "Earlier this Month");
-                break;
-            default:
-                Q_ASSERT(false);
-            }
-        } else {
-            const QDate lastMonthDate = currentDate.addMonths(-1);
-            if  (lastMonthDate.year() == fileDate.year() &&
-                 lastMonthDate.month() == fileDate.month()) {
-
-                if (daysDistance == 1) {
-                    newGroupValue = fileTime.toString(i18nc("@title:group Date: "
-                        "MMMM is full month name in current locale, and yyyy is "
-                        "full year number", "'Yesterday' (MMMM, yyyy)"));
-                    newGroupValue = i18nc("Can be used to script translation of "
-                        "\"'Yesterday' (MMMM, yyyy)\" with context @title:group Date",
-                        "%1", newGroupValue);
-                } else if (daysDistance <= 7) {
-                    newGroupValue = fileTime.toString(i18nc("@title:group Date: "
-                        "The week day name: dddd, MMMM is full month name "
-                        "in current locale, and yyyy is full year number",
-                        "dddd (MMMM, yyyy)"));
-                    newGroupValue = i18nc("Can be used to script translation of "
-                        "\"dddd (MMMM, yyyy)\" with context @title:group Date",
-                        "%1", newGroupValue);
-                } else if (daysDistance <= 7 * 2) {
-                    newGroupValue = fileTime.toString(i18nc("@title:group Date: "
-                        "MMMM is full month name in current locale, and yyyy is "
-                        "full year number", "'One Week Ago' (MMMM, yyyy)"));
-                    newGroupValue = i18nc("Can be used to script translation of "
-                        "\"'One Week Ago' (MMMM, yyyy)\" with context @title:group Date",
-                        "%1", newGroupValue);
-                } else if (daysDistance <= 7 * 3) {
-                    newGroupValue = fileTime.toString(i18nc("@title:group Date: "
-                        "MMMM is full month name in current locale, and yyyy is "
-                        "full year number", "'Two Weeks Ago' (MMMM, yyyy)"));
-                    newGroupValue = i18nc("Can be used to script translation of "
-                        "\"'Two Weeks Ago' (MMMM, yyyy)\" with context @title:group Date",
-                        "%1", newGroupValue);
-                } else if (daysDistance <= 7 * 4) {
-                    newGroupValue = fileTime.toString(i18nc("@title:group Date: "
-                        "MMMM is full month name in current locale, and yyyy is "
-                        "full year number", "'Three Weeks Ago' (MMMM, yyyy)"));
-                    newGroupValue = i18nc("Can be used to script translation of "
-                        "\"'Three Weeks Ago' (MMMM, yyyy)\" with context @title:group Date",
-                        "%1", newGroupValue);
-                } else {
-                    newGroupValue = fileTime.toString(i18nc("@title:group Date: "
-                        "MMMM is full month name in current locale, and yyyy is "
-                        "full year number", "'Earlier on' MMMM, yyyy"));
-                    newGroupValue = i18nc("Can be used to script translation of "
-                        "\"'Earlier on' MMMM, yyyy\" with context @title:group Date",
-                        "%1", newGroupValue);
-                }
-            } else {
-                newGroupValue = fileTime.toString(i18nc("@title:group "
-                    "The month and year: MMMM is full month name in current locale, "
-                    "and yyyy is full year number", "MMMM, yyyy"));
-                newGroupValue = i18nc("Can be used to script translation of "
-                    "\"MMMM, yyyy\" with context @title:group Date",
-                    "%1", newGroupValue);
-            }
+void KFileItemModel::updateGroupsAfterInsertion(const KItemRangeList& itemRanges)
+{
+    if (m_groups.isEmpty()) {
+        // The groups will be determined by groups() when they are needed.
+        return;
+    }
+
+    if (m_groupsDate != QDate::currentDate() || !m_expandedDirs.isEmpty()) {
+        // The values of the time groups depend on the current date, and
+        // child items might be inserted in front of the first item of a group.
+        // Let groups() determine all groups again.
+        m_groups.clear();
+        return;
+    }
+
+    QList<QPair<int, QVariant> > groups;
+    groups.reserve(m_groups.count());
+
+    // Each iteration moves the groups in front of the next inserted range
+    // to 'groups', and appends the groups of the inserted items. The indexes
+    // of the old groups are shifted by the number of items inserted before.
+    QList<QPair<int, QVariant> >::const_iterator oldGroup = m_groups.constBegin();
+    const QList<QPair<int, QVariant> >::const_iterator oldGroupsEnd = m_groups.constEnd();
+    int insertedCount = 0;
+    foreach (const KItemRange& range, itemRanges) {
+        while (oldGroup != oldGroupsEnd && oldGroup->first < range.index) {
+            groups.append(QPair<int, QVariant>(oldGroup->first + insertedCount, oldGroup->second));
+            ++oldGroup;
         }
 
-        if (newGroupValue != groupValue) {
-            groupValue = newGroupValue;
-            groups.append(QPair<int, QVariant>(i, newGroupValue));
+        const int first = range.index + insertedCount;
+        const int last = first + range.count;
+
+        // The inserted items are compared with the group of the item in front
+        // of them, i.e., with the last group in 'groups'.
+        QVariant value = groups.isEmpty() ? QVariant() : groups.last().second;
+        const QVariant previousValue = value;
+        appendGroups(groups, first, last, value);
+
+        insertedCount += range.count;
+
+        // The item behind the inserted items either starts an old group,
+        // which is dropped if it has the same value as the last inserted
+        // item, or it belongs to the group in front of the inserted items.
+        if (oldGroup != oldGroupsEnd && oldGroup->first == range.index) {
+            if (oldGroup->second == value) {
+                ++oldGroup;
+            }
+        } else if (last < count() && value != previousValue) {
+            groups.append(QPair<int, QVariant>(last, previousValue));
         }
     }
 
-    return groups;
+    while (oldGroup != oldGroupsEnd) {
+        groups.append(QPair<int, QVariant>(oldGroup->first + insertedCount, oldGroup->second));
+        ++oldGroup;
+    }
+
+    m_groups = groups;
 }
 
-QList<QPair<int, QVariant> > KFileItemModel::permissionRoleGroups() const
+void KFileItemModel::updateGroupsAfterRemoval(const KItemRangeList& itemRanges)
 {
-    Q_ASSERT(!m_itemData.isEmpty());
+    if (m_groups.isEmpty()) {
+        return;
+    }
 
-    const int maxIndex = count() - 1;
-    QList<QPair<int, QVariant> > groups;
+    if (m_itemData.isEmpty() || !m_expandedDirs.isEmpty()) {
+        // If child items are removed, the first remaining item of a group
+        // might be a child item. Let groups() determine all groups again.
+        m_groups.clear();
+        return;
+    }
 
-    QString permissionsString;
-    QString groupValue;
-    for (int i = 0; i <= maxIndex; ++i) {
-        if (isChildItem(i)) {
-            continue;
-        }
+    // The first item of each group is moved to the front by the number of
+    // items that have been removed in front of it. If the first item itself
+    // has been removed, the first remaining item of the group gets this index.
+    const int groupCount = m_groups.count();
+    QVector<int> newBegins;
+    newBegins.reserve(groupCount);
 
-        const ItemData* itemData = m_itemData.at(i);
-        const QString newPermissionsString = itemData->values.value("permissions").toString();
-        if (newPermissionsString == permissionsString) {
-            continue;
+    KItemRangeList::const_iterator range = itemRanges.constBegin();
+    const KItemRangeList::const_iterator rangesEnd = itemRanges.constEnd();
+    int removedCount = 0;
+    for (int i = 0; i < groupCount; ++i) {
+        const int begin = m_groups.at(i).first;
+        while (range != rangesEnd && range->index + range->count <= begin) {
+            removedCount += range->count;
+            ++range;
         }
-        permissionsString = newPermissionsString;
 
-        const QFileInfo info(itemData->item.url().toLocalFile());
-
-        // Set user string
-        QString user;
-        if (info.permission(QFile::ReadUser)) {
-            user = i18nc("@item:intext Access permission, concatenated", "Read, ");
-        }
-        if (info.permission(QFile::WriteUser)) {
-            user += i18nc("@item:intext Access permission, concatenated", "Write, ");
-        }
-        if (info.permission(QFile::ExeUser)) {
-            user += i18nc("@item:intext Access permission, concatenated", "Execute, ");
+        int removedInFront = removedCount;
+        if (range != rangesEnd && range->index < begin) {
+            removedInFront += begin - range->index;
         }
-        user = user.isEmpty() ? i18nc("@item:intext Access permission, concatenated", "Forbidden") : user.mid(0, user.count() - 2);
+        newBegins.append(begin - removedInFront);
+    }
 
-        // Set group string
-        QString group;
-        if (info.permission(QFile::ReadGroup)) {
-            group = i18nc("@item:intext Access permission, concatenated", "Read, ");
-        }
-        if (info.permission(QFile::WriteGroup)) {
-            group += i18nc("@item:intext Access permission, concatenated", "Write, ");
-        }
-        if (info.permission(QFile::ExeGroup)) {
-            group += i18nc("@item:intext Access permission, concatenated", "Execute, ");
+    // Drop the groups without remaining items, and merge groups which
+    // are adjacent now and have the same value.
+    QList<QPair<int, QVariant> > groups;
+    groups.reserve(groupCount);
+    for (int i = 0; i < groupCount; ++i) {
+        const int newBegin = newBegins.at(i);
+        const int newEnd = (i + 1 < groupCount) ? newBegins.at(i + 1) : count();
+        if (newBegin >= newEnd) {
+            continue;
         }
-        group = group.isEmpty() ? i18nc("@item:intext Access permission, concatenated", "Forbidden") : group.mid(0, group.count() - 2);
 
-        // Set others string
-        QString others;
-        if (info.permission(QFile::ReadOther)) {
-            others = i18nc("@item:intext Access permission, concatenated", "Read, ");
+        const QVariant& value = m_groups.at(i).second;
+        if (groups.isEmpty() || groups.last().second != value) {
+            groups.append(QPair<int, QVariant>(newBegin, value));
         }
-        if (info.permission(QFile::WriteOther)) {
-            others += i18nc("@item:intext Access permission, concatenated", "Write, ");
-        }
-        if (info.permission(QFile::ExeOther)) {
-            others += i18nc("@item:intext Access permission, concatenated", "Execute, ");
+    }
+
+    m_groups = groups;
+}
+
+QChar KFileItemModel::nameRoleGroupChar(const ItemData* itemData)
+{
+    const QString name = itemData->item.text();
+    if (name.isEmpty()) {
+        return QChar();
+    }
+
+    // Use the first character of the name as group indication
+    QChar firstChar = name.at(0).toUpper();
+    if (firstChar == QLatin1Char('~') && name.length() > 1) {
+        firstChar = name.at(1).toUpper();
+    }
+    return firstChar;
+}
+
+QVariant KFileItemModel::nameRoleGroupValue(const ItemData* itemData) const
+{
+    const QChar newFirstChar = nameRoleGroupChar(itemData);
+
+    QString newGroupValue;
+    if (newFirstChar.isLetter()) {
+        // Try to find a matching group in the range 'A' to 'Z'.
+        static std::vector<QChar> lettersAtoZ;
+        lettersAtoZ.reserve('Z' - 'A' + 1);
+        if (lettersAtoZ.empty()) {
+            for (char c = 'A'; c <= 'Z'; ++c) {
+                lettersAtoZ.push_back(QLatin1Char(c));
+            }
         }
-        others = others.isEmpty() ? i18nc("@item:intext Access permission, concatenated", "Forbidden") : others.mid(0, others.count() - 2);
 
-        const QString newGroupValue = i18nc("@title:group Files and folders by permissions", "User: %1 | Group: %2 | Others: %3", user, group, others);
-        if (newGroupValue != groupValue) {
-            groupValue = newGroupValue;
-            groups.append(QPair<int, QVariant>(i, newGroupValue));
+        auto localeAwareLessThan = [this](QChar c1, QChar c2) -> bool {
+            return m_collator.compare(c1, c2) < 0;
+        };
+
+        std::vector<QChar>::iterator it = std::lower_bound(lettersAtoZ.begin(), lettersAtoZ.end(), newFirstChar, localeAwareLessThan);
+        if (it != lettersAtoZ.end()) {
+            if (localeAwareLessThan(newFirstChar, *it) && it != lettersAtoZ.begin()) {
+                // newFirstChar belongs to the group preceding *it.
+                // Example: for an umlaut 'A' in the German locale, *it would be 'B' now.
+                --it;
+            }
+            newGroupValue = *it;
+        } else {
+            newGroupValue = newFirstChar;
         }
+    } else if (newFirstChar >= QLatin1Char('0') && newFirstChar <= QLatin1Char('9')) {
+        // Apply group '0 - 9' for any name that starts with a digit
+        newGroupValue = i18nc("@title:group Groups that start with a digit", "0 - 9");
+    } else {
+        newGroupValue = i18nc("@title:group", "Others");
     }
 
-    return groups;
+    return newGroupValue;
 }
 
-QList<QPair<int, QVariant> > KFileItemModel::ratingRoleGroups() const
+QVariant KFileItemModel::sizeRoleGroupValue(const ItemData* itemData) const
 {
-    Q_ASSERT(!m_itemData.isEmpty());
+    switch (groupKey(itemData)) {
+    case 0:  return i18nc("@title:group Size", "Folders");
+    case 1:  return i18nc("@title:group Size", "Small");
+    case 2:  return i18nc("@title:group Size", "Medium");
+    default: return i18nc("@title:group Size", "Big");
+    }
+}
 
-    const int maxIndex = count() - 1;
-    QList<QPair<int, QVariant> > groups;
+QVariant KFileItemModel::timeRoleGroupValue(const QDateTime& fileTime) const
+{
+    const QDate currentDate = QDate::currentDate();
+    const QDate fileDate = fileTime.date();
 
-    int groupValue = -1;
-    for (int i = 0; i <= maxIndex; ++i) {
-        if (isChildItem(i)) {
-            continue;
+    const int daysDistance = fileDate.daysTo(currentDate);
+
+    QString newGroupValue;
+    if (currentDate.year() == fileDate.year() &&
+        currentDate.month() == fileDate.month()) {
+
+        switch (daysDistance / 7) {
+        case 0:
+            switch (daysDistance) {
+            case 0:  newGroupValue = i18nc("@title:group Date", "Today"); break;
+            case 1:  newGroupValue = i18nc("@title:group Date", "Yesterday"); break;
+            default:
+                newGroupValue = fileTime.toString(
+                    i18nc("@title:group Date: The week day name: dddd", "dddd"));
+                newGroupValue = i18nc("Can be used to script translation of \"dddd\""
+                    "with context @title:group Date", "%1", newGroupValue);
+            }
+            break;
+        case 1:
+            newGroupValue = i18nc("@title:group Date", "One Week Ago");
+            break;
+        case 2:
+            newGroupValue = i18nc("@title:group Date", "Two Weeks Ago");
+            break;
+        case 3:
+            newGroupValue = i18nc("@title:group Date", "Three Weeks Ago");
+            break;
+        case 4:
+        case 5:
+            newGroupValue = i18nc("@title:group Date", "Earlier this Month");
+            break;
+        default:
+            Q_ASSERT(false);
         }
-        const int newGroupValue = m_itemData.at(i)->values.value("rating", 0).toInt();
-        if (newGroupValue != groupValue) {
-            groupValue = newGroupValue;
-            groups.append(QPair<int, QVariant>(i, newGroupValue));
+    } else {
+        const QDate lastMonthDate = currentDate.addMonths(-1);
+        if  (lastMonthDate.year() == fileDate.year() &&
+             lastMonthDate.month() == fileDate.month()) {
+
+            if (daysDistance == 1) {
+                newGroupValue = fileTime.toString(i18nc("@title:group Date: "
+                    "MMMM is full month name in current locale, and yyyy is "
+                    "full year number", "'Yesterday' (MMMM, yyyy)"));
+                newGroupValue = i18nc("Can be used to script translation of "
+                    "\"'Yesterday' (MMMM, yyyy)\" with context @title:group Date",
+                    "%1", newGroupValue);
+            } else if (daysDistance <= 7) {
+                newGroupValue = fileTime.toString(i18nc("@title:group Date: "
+                    "The week day name: dddd, MMMM is full month name "
+                    "in current locale, and yyyy is full year number",
+                    "dddd (MMMM, yyyy)"));
+                newGroupValue = i18nc("Can be used to script translation of "
+                    "\"dddd (MMMM, yyyy)\" with context @title:group Date",
+                    "%1", newGroupValue);
+            } else if (daysDistance <= 7 * 2) {
+                newGroupValue = fileTime.toString(i18nc("@title:group Date: "
+                    "MMMM is full month name in current locale, and yyyy is "
+                    "full year number", "'One Week Ago' (MMMM, yyyy)"));
+                newGroupValue = i18nc("Can be used to script translation of "
+                    "\"'One Week Ago' (MMMM, yyyy)\" with context @title:group Date",
+                    "%1", newGroupValue);
+            } else if (daysDistance <= 7 * 3) {
+                newGroupValue = fileTime.toString(i18nc("@title:group Date: "
+                    "MMMM is full month name in current locale, and yyyy is "
+                    "full year number", "'Two Weeks Ago' (MMMM, yyyy)"));
+                newGroupValue = i18nc("Can be used to script translation of "
+                    "\"'Two Weeks Ago' (MMMM, yyyy)\" with context @title:group Date",
+                    "%1", newGroupValue);
+            } else if (daysDistance <= 7 * 4) {
+                newGroupValue = fileTime.toString(i18nc("@title:group Date: "
+                    "MMMM is full month name in current locale, and yyyy is "
+                    "full year number", "'Three Weeks Ago' (MMMM, yyyy)"));
+                newGroupValue = i18nc("Can be used to script translation of "
+                    "\"'Three Weeks Ago' (MMMM, yyyy)\" with context @title:group Date",
+                    "%1", newGroupValue);
+            } else {
+                newGroupValue = fileTime.toString(i18nc("@title:group Date: "
+                    "MMMM is full month name in current locale, and yyyy is "
+                    "full year number", "'Earlier on' MMMM, yyyy"));
+                newGroupValue = i18nc("Can be used to script translation of "
+                    "\"'Earlier on' MMMM, yyyy\" with context @title:group Date",
+                    "%1", newGroupValue);
+            }
+        } else {
+            newGroupValue = fileTime.toString(i18nc("@title:group "
+                "The month and year: MMMM is full month name in current locale, "
+                "and yyyy is full year number", "MMMM, yyyy"));
+            newGroupValue = i18nc("Can be used to script translation of "
+                "\"MMMM, yyyy\" with context @title:group Date",
+                "%1", newGroupValue);
         }
     }
 
-    return groups;
+    return newGroupValue;
 }
 
-QList<QPair<int, QVariant> > KFileItemModel::genericStringRoleGroups(const QByteArray& role) const
+QVariant KFileItemModel::permissionRoleGroupValue(const ItemData* itemData) const
 {
-    Q_ASSERT(!m_itemData.isEmpty());
+    const QFileInfo info(itemData->item.url().toLocalFile());
 
-    const int maxIndex = count() - 1;
-    QList<QPair<int, QVariant> > groups;
+    // Set user string
+    QString user;
+    if (info.permission(QFile::ReadUser)) {
+        user = i18nc("@item:intext Access permission, concatenated", "Read, ");
+    }
+    if (info.permission(QFile::WriteUser)) {
+        user += i18nc("@item:intext Access permission, concatenated", "Write, ");
+    }
+    if (info.permission(QFile::ExeUser)) {
+        user += i18nc("@item:intext Access permission, concatenated", "Execute, ");
+    }
+    user = user.isEmpty() ? i18nc("@item:intext Access permission, concatenated", "Forbidden") : user.mid(0, user.count() - 2);
 
-    bool isFirstGroupValue = true;
-    QString groupValue;
-    for (int i = 0; i <= maxIndex; ++i) {
-        if (isChildItem(i)) {
-            continue;
-        }
-        const QString newGroupValue = m_itemData.at(i)->values.value(role).toString();
-        if (newGroupValue != groupValue || isFirstGroupValue) {
-            groupValue = newGroupValue;
-            groups.append(QPair<int, QVariant>(i, newGroupValue));
-            isFirstGroupValue = false;
-        }
+    // Set group string
+    QString group;
+    if (info.permission(QFile::ReadGroup)) {
+        group = i18nc("@item:intext Access permission, concatenated", "Read, ");
+    }
+    if (info.permission(QFile::WriteGroup)) {
+        group += i18nc("@item:intext Access permission, concatenated", "Write, ");
+    }
+    if (info.permission(QFile::ExeGroup)) {
+        group += i18nc("@item:intext Access permission, concatenated", "Execute, ");
+    }
+    group = group.isEmpty() ? i18nc("@item:intext Access permission, concatenated", "Forbidden") : group.mid(0, group.count() - 2);
+
+    // Set others string
+    QString others;
+    if (info.permission(QFile::ReadOther)) {
+        others = i18nc("@item:intext Access permission, concatenated", "Read, ");
+    }
+    if (info.permission(QFile::WriteOther)) {
+        others += i18nc("@item:intext Access permission, concatenated", "Write, ");
+    }
+    if (info.permission(QFile::ExeOther)) {
+        others += i18nc("@item:intext Access permission, concatenated", "Execute, ");
     }
+    others = others.isEmpty() ? i18nc("@item:intext Access permission, concatenated", "Forbidden") : others.mid(0, others.count() - 2);
 
-    return groups;
+    return i18nc("@title:group Files and folders by permissions", "User: %1 | Group: %2 | Others: %3", user, group, others);
 }
 
 void KFileItemModel::emitSortProgress(int resolvedCount)
@@ -2272,7 +3142,7 @@ void KFileItemModel::emitSortProgress(int resolvedCount)
         m_sortingProgressPercent = -1;
         if (m_resortAllItemsTimer->isActive()) {
             m_resortAllItemsTimer->stop();
-            resortAllItems();
+            resortChangedItems();
         }
 
         emit directorySortingProgress(100);
@@ -2360,9 +3230,8 @@ QByteArray KFileItemModel::sharedValue(const QByteArray& value)
 
 bool KFileItemModel::isConsistent() const
 {
-    // m_items may contain less items than m_itemData because m_items
-    // is populated lazily, see KFileItemModel::index(const QUrl& url).
-    if (m_items.count() > m_itemData.count()) {
+    if (m_items.count() != m_itemData.count()) {
+        qCWarning(DolphinDebug) << "m_items contains" << m_items.count() << "items, m_itemData contains" << m_itemData.count() << "items";
         return false;
     }
 
@@ -25,14 +25,16 @@
 #include <QUrl>
 #include <kitemviews/kitemmodelbase.h>
 #include <kitemviews/private/kfileitemmodelfilter.h>
+#include <kitemviews/private/kfileitemmodelrolestore.h>
 
 #include <QCollator>
 #include <QHash>
+#include <QScopedPointer>
 #include <QSet>
-
-#include <functional>
+#include <QVector>
 
 class KFileItemModelDirLister;
+template <typename T> class QFutureWatcher;
 class QTimer;
 
 /**
@@ -83,8 +85,25 @@ public:
 
     virtual int count() const Q_DECL_OVERRIDE;
     virtual QHash<QByteArray, QVariant> data(int index) const Q_DECL_OVERRIDE;
+    virtual QVariant roleValue(int index, int roleId) const Q_DECL_OVERRIDE;
     virtual bool setData(int index, const QHash<QByteArray, QVariant>& values) Q_DECL_OVERRIDE;
 
+    /**
+     * Sets the value of the role \a role for several items at once. The keys
+     * of \a values are the indexes of the items. In contrast to invoking setData()
+     * for each item, the signal itemsChanged() is only emitted once for all
+     * changed items.
+     */
+    void setRoleValues(const QByteArray& role, const QHash<int, QVariant>& values);
+
+    /**
+     * Sets the values of several roles for several items at once. The keys
+     * of \a values are the indexes of the items. Like for the other overload,
+     * the signal itemsChanged() is only emitted once for all changed items,
+     * unless the role "text" is changed.
+     */
+    void setRoleValues(const QHash<int, QHash<QByteArray, QVariant> >& values);
+
     /**
      * Sets a separate sorting with directories first (true) or a mixed
      * sorting of files and directories (false).
@@ -269,6 +288,14 @@ private slots:
      */
     void resortAllItems();
 
+    /**
+     * Moves the items in m_itemsToResort, whose sort role values have been
+     * changed, to their new positions. All other items keep their relative
+     * order, which allows to determine the new positions by a binary search.
+     * If this is not possible, resortAllItems() is invoked.
+     */
+    void resortChangedItems();
+
     void slotCompleted();
     void slotCanceled();
     void slotItemsAdded(const QUrl& directoryUrl, const KFileItemList& items);
@@ -279,6 +306,13 @@ private slots:
 
     void dispatchPendingItemsToInsert();
 
+    /**
+     * Is invoked if a worker thread has finished preparing items that
+     * have been added by slotItemsAdded(). Moves the prepared items to
+     * m_pendingItemsToInsert and m_filteredItems.
+     */
+    void slotItemsPrepared();
+
 private:
     enum RoleType {
         // User visible roles:
@@ -297,8 +331,54 @@ private:
     struct ItemData
     {
         KFileItem item;
+
+        // Values of the roles that are not stored in m_roleStore. Note that
+        // the hash does not allocate any memory as long as it is empty.
         QHash<QByteArray, QVariant> values;
+
         ItemData* parent;
+
+        // Slot of the item in m_roleStore
+        int slot;
+
+        // Index of the item in m_itemData. It is only valid for items that
+        // are part of the model, i.e., not for filtered or pending items.
+        int index;
+
+        // Collation key for item.text(). It is only set if natural sorting is
+        // enabled, see KFileItemModel::updateSortKeys().
+        QScopedPointer<QCollatorSortKey> sortKey;
+    };
+
+    /**
+     * Copy of the settings of the model that are required to prepare the
+     * items added by slotItemsAdded() in a worker thread, see prepareItems().
+     */
+    struct ItemPreparationSettings
+    {
+        QString filterPattern;
+        RoleType sortRole;
+        bool naturalSorting;
+        QLocale locale;
+        Qt::CaseSensitivity caseSensitivity;
+        bool ignorePunctuation;
+        bool numericMode;
+    };
+
+    /**
+     * Items that have been prepared by prepareItems().
+     */
+    struct PreparedItems
+    {
+        // URL of the parent of the items. It is empty for the items
+        // of the root directory.
+        QUrl parentUrl;
+
+        // Items that match the name filter, sorted by nameLessThan()
+        QList<ItemData*> items;
+
+        // Items that do not match the name filter
+        QList<ItemData*> filteredItems;
     };
 
     enum RemoveItemsBehavior {
@@ -313,18 +393,67 @@ private:
      * Helper method for insertItems() and removeItems(): Creates
      * a list of ItemData elements based on the given items.
      * Note that the ItemData instances are created dynamically and
-     * must be deleted by the caller.
+     * must be deleted by the caller with deleteItemData().
      */
     QList<ItemData*> createItemDataList(const QUrl& parentUrl, const KFileItemList& items) const;
 
     /**
-     * Prepares the items for sorting. Normally, the hash 'values' in ItemData is filled
-     * lazily to save time and memory, but for some sort roles, it is expected that the
-     * sort role data is stored in 'values'.
+     * Creates the ItemData elements for \a items in a worker thread: Checks
+     * which items match the name filter, calculates the collation keys and
+     * pre-sorts the items by nameLessThan(). Only the names of the items are
+     * accessed, because other getters of KFileItem like mimetype() or time()
+     * cache their results in the data that is shared with the main thread.
+     * The slots of the items are allocated by adoptPreparedItems(), because
+     * m_roleStore may only be accessed by the main thread.
+     *
+     * The parents of the items are set by adoptPreparedItems() too, as
+     * the item data of the model may only be accessed by the main thread.
+     *
+     * @param parentUrl       URL of the parent of all items. It must be empty
+     *                        for the items of the root directory.
+     * @param settings        Settings of the model when the items have been added.
+     */
+    static PreparedItems* prepareItems(const KFileItemList& items, const QUrl& parentUrl,
+                                       const ItemPreparationSettings& settings);
+
+    /**
+     * Moves the items of \a preparedItems to m_pendingItemsToInsert and
+     * m_filteredItems, sets their parents, allocates their slots in
+     * m_roleStore and deletes \a preparedItems. The filters are checked
+     * again, because the MIME-type filter requires the MIME-types of the
+     * items and the name filter might have been changed in the meantime.
+     * The items are dropped if their parent has been removed or collapsed
+     * in the meantime.
+     */
+    void adoptPreparedItems(PreparedItems* preparedItems);
+
+    /**
+     * Waits until all items that are prepared in worker threads are
+     * available and adopts them. Must be invoked before any operation that
+     * requires that all items are available, or which changes the settings
+     * that have been used to prepare the items.
+     */
+    void finishItemPreparation();
+
+    /**
+     * Waits until all items that are prepared in worker threads are
+     * available and deletes them.
+     */
+    void discardPreparingItems();
+
+    /**
+     * Deletes \a itemData and releases its slot in m_roleStore.
+     */
+    void deleteItemData(ItemData* itemData);
+
+    /**
+     * Prepares the items for sorting. Normally, the role values of the items are
+     * retrieved lazily to save time, but for some sort roles, it is expected that
+     * the sort role data is available in m_roleStore or in 'values'.
      */
     void prepareItemsForSorting(QList<ItemData*>& itemDataList);
 
-    static int expandedParentsCount(const ItemData* data);
+    int expandedParentsCount(const ItemData* data) const;
 
     void removeExpandedItems();
 
@@ -335,6 +464,14 @@ private:
      */
     void emitItemsChangedAndTriggerResorting(const KItemRangeList& itemRanges, const QSet<QByteArray>& changedRoles);
 
+    /**
+     * Helper method for resortAllItems() and resortChangedItems(): Emits the
+     * itemsMoved() signal for the items whose position in m_itemData differs
+     * from ItemData::index, and updates ItemData::index. If no item has been
+     * moved, groupsChanged() is emitted if necessary.
+     */
+    void emitItemsMovedAfterResorting();
+
     /**
      * Resets all values from m_requestRole to false.
      */
@@ -352,7 +489,56 @@ private:
      */
     QByteArray roleForType(RoleType roleType) const;
 
-    QHash<QByteArray, QVariant> retrieveData(const KFileItem& item, const ItemData* parent) const;
+    /**
+     * Stores the values of all requested roles that can be retrieved
+     * quickly from the KFileItem in m_roleStore. Values of roles that
+     * have been set by setData() before are only overwritten if they
+     * can be retrieved by this method.
+     */
+    void retrieveData(ItemData* itemData) const;
+
+    /**
+     * @return True if retrieveData() has been invoked for \a itemData
+     *         since the last call of resetData().
+     */
+    bool isDataRetrieved(const ItemData* itemData) const;
+
+    /**
+     * Removes all role values of \a itemData. They will be retrieved
+     * again the next time they are accessed.
+     */
+    void resetData(ItemData* itemData);
+
+    /**
+     * @return The value of the role \a role for \a itemData, or an invalid
+     *         QVariant if no value is available. The value is read from
+     *         m_roleStore if possible.
+     */
+    QVariant itemValue(const ItemData* itemData, const QByteArray& role) const;
+
+    /**
+     * Equivalent to itemValue(itemData, role) but does not need to
+     * determine the type of \a role.
+     */
+    QVariant itemValue(const ItemData* itemData, RoleType roleType, const QByteArray& role) const;
+
+    /**
+     * Sets the value of the role \a role for \a itemData.
+     */
+    void setItemValue(ItemData* itemData, const QByteArray& role, const QVariant& value);
+
+    /**
+     * @return All role values of \a itemData as hash, as returned by data(int).
+     */
+    QHash<QByteArray, QVariant> itemValues(const ItemData* itemData) const;
+
+    /**
+     * Helper methods for itemValue() and setItemValue(): Map the roles that
+     * are stored in m_roleStore to the corresponding columns or flags.
+     */
+    static KFileItemModelRoleStore::NumberColumn timeColumn(RoleType roleType);
+    static KFileItemModelRoleStore::StringColumn stringColumn(RoleType roleType);
+    static KFileItemModelRoleStore::Flag roleFlag(RoleType roleType);
 
     /**
      * @return True if \a a has a KFileItem whose text is 'less than' the one
@@ -381,22 +567,73 @@ private:
 
     int stringCompare(const QString& a, const QString& b, const QCollator& collator) const;
 
+    /**
+     * Calculates the collation keys for the texts of all items in \a itemDataList
+     * that have no key yet. The keys are only needed if natural sorting is enabled:
+     * comparing two keys is much cheaper than QCollator::compare(). The work
+     * is distributed among all CPU cores.
+     */
+    void updateSortKeys(const QList<ItemData*>& itemDataList) const;
+
+    /**
+     * Removes the collation keys of all items. Must be invoked if the settings
+     * of m_collator have been changed.
+     */
+    void resetSortKeys();
+
     bool useMaximumUpdateInterval() const;
 
-    QList<QPair<int, QVariant> > nameRoleGroups() const;
-    QList<QPair<int, QVariant> > sizeRoleGroups() const;
-    QList<QPair<int, QVariant> > timeRoleGroups(std::function<QDateTime(const ItemData *)> fileTimeCb) const;
-    QList<QPair<int, QVariant> > permissionRoleGroups() const;
-    QList<QPair<int, QVariant> > ratingRoleGroups() const;
-    QList<QPair<int, QVariant> > genericStringRoleGroups(const QByteArray& typeForRole) const;
+    /**
+     * @return The value of the group of \a itemData for the current sort
+     *         role, e.g. the first letter of the name if sorting by name.
+     */
+    QVariant groupValue(const ItemData* itemData) const;
+
+    /**
+     * @return A key for the group of \a itemData, which can be determined
+     *         without any allocation. Items with equal keys are in the same
+     *         group, hence groupValue() only needs to be invoked if the key
+     *         changes. NoGroupKey is returned if the current sort role does
+     *         not provide such keys.
+     */
+    qint64 groupKey(const ItemData* itemData) const;
+
+    /**
+     * Appends the groups of the items from \a begin to \a end (exclusive) to
+     * \a groups. A group is only appended if its value differs from \a value,
+     * which is the value of the group in front of \a begin. Afterwards,
+     * \a value contains the value of the last group.
+     */
+    void appendGroups(QList<QPair<int, QVariant> >& groups, int begin, int end, QVariant& value) const;
+    void appendGroups(QList<QPair<int, QVariant> >& groups, int begin, int end) const;
+
+    /**
+     * Updates m_groups after the items \a itemRanges have been inserted.
+     * Only the groups of the inserted items are determined, the other groups
+     * are moved. Must be invoked before itemsInserted() is emitted.
+     */
+    void updateGroupsAfterInsertion(const KItemRangeList& itemRanges);
+
+    /**
+     * Updates m_groups after the items \a itemRanges have been removed. No
+     * group values need to be determined. Must be invoked before itemsRemoved()
+     * is emitted.
+     */
+    void updateGroupsAfterRemoval(const KItemRangeList& itemRanges);
+
+    static QChar nameRoleGroupChar(const ItemData* itemData);
+    QVariant nameRoleGroupValue(const ItemData* itemData) const;
+    QVariant sizeRoleGroupValue(const ItemData* itemData) const;
+    QVariant timeRoleGroupValue(const QDateTime& fileTime) const;
+    QVariant permissionRoleGroupValue(const ItemData* itemData) const;
 
     /**
-     * Helper method for all xxxRoleGroups() methods to check whether the
-     * item with the given index is a child-item. A child-item is defined
-     * as item having an expansion-level > 0. All xxxRoleGroups() methods
-     * should skip the grouping if the item is a child-item (although
-     * KItemListView would be capable to show sub-groups in groups this
-     * results in visual clutter for most usecases).
+     * Helper method for appendGroups() to check whether the item with
+     * the given index is a child-item. A child-item is defined as item
+     * having an expansion-level > 0. The grouping must be skipped if the
+     * item is a child-item (although KItemListView would be capable to
+     * show sub-groups in groups this results in visual clutter for most
+     * usecases).
      */
     bool isChildItem(int index) const;
 
@@ -473,11 +710,21 @@ private:
 
     QList<ItemData*> m_itemData;
 
-    // m_items is a cache for the method index(const QUrl&). If it contains N
-    // entries, it is guaranteed that these correspond to the first N items in
-    // the model, i.e., that (for every i between 0 and N - 1)
-    // m_items.value(fileItem(i).url()) == i
-    mutable QHash<QUrl, int> m_items;
+    // Contains the role values of all items in m_itemData, m_filteredItems
+    // and m_pendingItemsToInsert. The items in m_preparingItems get their
+    // slots when they are adopted by adoptPreparedItems(). It is mutable
+    // because the values are retrieved lazily in const methods like data(int).
+    mutable KFileItemModelRoleStore m_roleStore;
+
+    // Cache for roleValue(): Contains the role type and the role for
+    // each role id that has been passed to roleValue().
+    mutable QVector<QPair<RoleType, QByteArray> > m_rolesForIds;
+
+    // Contains the URLs of all items in m_itemData. It is updated whenever
+    // items are inserted, removed or renamed. The index of an item for the
+    // method index(const QUrl&) is given by ItemData::index, which is updated
+    // together with the position in m_itemData.
+    QHash<QUrl, ItemData*> m_items;
 
     KFileItemModelFilter m_filter;
     QHash<KFileItem, ItemData*> m_filteredItems; // Items that got hidden by KFileItemModel::setNameFilter()
@@ -488,9 +735,25 @@ private:
     QTimer* m_resortAllItemsTimer;
     QList<ItemData*> m_pendingItemsToInsert;
 
-    // Cache for KFileItemModel::groups()
+    // Items from slotItemsAdded() that are prepared in worker threads, in the
+    // order in which they have been added.
+    QList<QFutureWatcher<PreparedItems*>*> m_preparingItems;
+
+    // Items whose position might be wrong because the value of the sort role
+    // has been changed. They are moved when m_resortAllItemsTimer is exceeded,
+    // see resortChangedItems(). All other items are sorted correctly unless
+    // m_resortAllItemsRequired is true.
+    QSet<ItemData*> m_itemsToResort;
+    bool m_resortAllItemsRequired;
+
+    // Cache for KFileItemModel::groups(). It is updated when items are
+    // inserted or removed, see updateGroupsAfterInsertion().
     mutable QList<QPair<int, QVariant> > m_groups;
 
+    // The date when m_groups has been determined. The groups of the time
+    // roles depend on the current date.
+    mutable QDate m_groupsDate;
+
     // Stores the URLs (key: target url, value: url) of the expanded directories.
     QHash<QUrl, QUrl> m_expandedDirs;
 
@@ -499,7 +762,7 @@ private:
     QSet<QUrl> m_urlsToExpand;
 
     friend class KFileItemModelLessThan;       // Accesses lessThan() method
-    friend class KFileItemModelRolesUpdater;   // Accesses emitSortProgress() method
+    friend class KFileItemModelRolesUpdater;   // Accesses emitSortProgress() and slotRefreshItems() methods
     friend class KFileItemModelTest;           // For unit testing
     friend class KFileItemModelBenchmark;      // For unit testing
     friend class KFileItemListViewTest;        // For unit testing
@@ -34,12 +34,15 @@
 
 #include "private/kpixmapmodifier.h"
 #include "private/kdirectorycontentscounter.h"
+#include "private/kfileitemmimetyperesolver.h"
 
 #include <QApplication>
 #include <QPainter>
 #include <QPixmap>
 #include <QElapsedTimer>
+#include <QThread>
 #include <QTimer>
+#include <QtConcurrent/QtConcurrentRun>
 
 #include <algorithm>
 
@@ -57,6 +60,11 @@ namespace {
     // may perform a blocking operation
     const int MaxBlockTimeout = 200;
 
+    // Maximum time in ms that the KFileItemModelRolesUpdater may block
+    // the GUI thread once the initial icons are shown, e.g. when scrolling.
+    // Resolved roles are applied to the model at most once per FrameTimeout.
+    const int FrameTimeout = 16;
+
     // If the number of items is smaller than ResolveAllItemsLimit,
     // the roles of all items will be resolved.
     const int ResolveAllItemsLimit = 500;
@@ -64,6 +72,9 @@ namespace {
     // Not only the visible area, but up to ReadAheadPages before and after
     // this area will be resolved.
     const int ReadAheadPages = 5;
+
+    // Maximum number of items that are passed to one preview job.
+    const int MaxItemsPerPreviewJob = 20;
 }
 
 KFileItemModelRolesUpdater::KFileItemModelRolesUpdater(KFileItemModel* model, QObject* parent) :
@@ -87,13 +98,23 @@ KFileItemModelRolesUpdater::KFileItemModelRolesUpdater(KFileItemModel* model, QO
     m_pendingSortRoleItems(),
     m_pendingIndexes(),
     m_pendingPreviewItems(),
-    m_previewJob(),
+    m_previewJobs(),
+    m_previewJobItems(),
+    m_previewCache(),
+    m_composingPreviews(),
+    m_composedPreviews(),
     m_recentlyChangedItemsTimer(0),
     m_recentlyChangedItems(),
     m_changedItems(),
-    m_directoryContentsCounter(0)
+    m_pendingResolvedItems(),
+    m_pendingRoleValues(),
+    m_pendingRoleValuesTimer(0),
+    m_directoryContentsCounter(0),
+    m_mimeTypeResolver(0)
   #ifdef HAVE_BALOO
-  , m_balooFileMonitor(0)
+  , m_balooFileMonitor(0),
+    m_pendingBalooItems(),
+    m_balooWorkers()
   #endif
 {
     Q_ASSERT(model);
@@ -103,6 +124,9 @@ KFileItemModelRolesUpdater::KFileItemModelRolesUpdater(KFileItemModel* model, QO
                                                          << QStringLiteral("directorythumbnail")
                                                          << QStringLiteral("imagethumbnail")
                                                          << QStringLiteral("jpegthumbnail"));
+    m_previewCache.setEnabledPlugins(m_enabledPlugins);
+    m_previewCache.setEnlargeSmallPreviews(m_enlargeSmallPreviews);
+    m_previewCache.setMaximumRemoteSize(globalConfig.readEntry("MaximumRemoteSize", qulonglong(0)));
 
     connect(m_model, &KFileItemModel::itemsInserted,
             this,    &KFileItemModelRolesUpdater::slotItemsInserted);
@@ -122,6 +146,11 @@ KFileItemModelRolesUpdater::KFileItemModelRolesUpdater(KFileItemModel* model, QO
     m_recentlyChangedItemsTimer->setSingleShot(true);
     connect(m_recentlyChangedItemsTimer, &QTimer::timeout, this, &KFileItemModelRolesUpdater::resolveRecentlyChangedItems);
 
+    m_pendingRoleValuesTimer = new QTimer(this);
+    m_pendingRoleValuesTimer->setInterval(FrameTimeout);
+    m_pendingRoleValuesTimer->setSingleShot(true);
+    connect(m_pendingRoleValuesTimer, &QTimer::timeout, this, &KFileItemModelRolesUpdater::applyPendingRoleValues);
+
     m_resolvableRoles.insert("size");
     m_resolvableRoles.insert("type");
     m_resolvableRoles.insert("isExpandable");
@@ -132,6 +161,12 @@ KFileItemModelRolesUpdater::KFileItemModelRolesUpdater(KFileItemModel* model, QO
     m_directoryContentsCounter = new KDirectoryContentsCounter(m_model, this);
     connect(m_directoryContentsCounter, &KDirectoryContentsCounter::result,
             this,                       &KFileItemModelRolesUpdater::slotDirectoryContentsCountReceived);
+    connect(m_directoryContentsCounter, &KDirectoryContentsCounter::sizeResult,
+            this,                       &KFileItemModelRolesUpdater::slotDirectorySizeReceived);
+
+    m_mimeTypeResolver = new KFileItemMimeTypeResolver(this);
+    connect(m_mimeTypeResolver, &KFileItemMimeTypeResolver::mimeTypeResolved,
+            this,               &KFileItemModelRolesUpdater::slotMimeTypeResolved);
 
     auto plugins = KPluginLoader::instantiatePlugins(QStringLiteral("kf5/overlayicon"), nullptr, qApp);
     foreach (QObject *it, plugins) {
@@ -155,11 +190,13 @@ void KFileItemModelRolesUpdater::setIconSize(const QSize& size)
 {
     if (size != m_iconSize) {
         m_iconSize = size;
+        m_previewCache.setIconSize(size);
         if (m_state == Paused) {
             m_iconSizeChangedDuringPausing = true;
         } else if (m_previewShown) {
             // An icon size change requires the regenerating of
             // all previews
+            killPreviewJob();
             m_finishedItems.clear();
             startUpdating();
         }
@@ -219,6 +256,7 @@ void KFileItemModelRolesUpdater::setEnlargeSmallPreviews(bool enlarge)
 {
     if (enlarge != m_enlargeSmallPreviews) {
         m_enlargeSmallPreviews = enlarge;
+        m_previewCache.setEnlargeSmallPreviews(enlarge);
         if (m_previewShown) {
             updateAllPreviews();
         }
@@ -230,10 +268,40 @@ bool KFileItemModelRolesUpdater::enlargeSmallPreviews() const
     return m_enlargeSmallPreviews;
 }
 
+void KFileItemModelRolesUpdater::setRecursiveFolderSizes(bool enabled)
+{
+    if (enabled == m_directoryContentsCounter->recursiveSizesEnabled()) {
+        return;
+    }
+
+    m_directoryContentsCounter->setRecursiveSizesEnabled(enabled);
+
+    if (!m_roles.contains("size")) {
+        return;
+    }
+
+    // Request the sizes of all local directories again. The
+    // visible directories are handled first.
+    const int count = m_model->count();
+    for (int index = 0; index < count; ++index) {
+        const KFileItem item = m_model->fileItem(index);
+        if (item.isDir() && item.isLocalFile()) {
+            const bool visible = (index >= m_firstVisibleIndex && index <= m_lastVisibleIndex);
+            m_directoryContentsCounter->addDirectory(item.localPath(), visible);
+        }
+    }
+}
+
+bool KFileItemModelRolesUpdater::recursiveFolderSizes() const
+{
+    return m_directoryContentsCounter->recursiveSizesEnabled();
+}
+
 void KFileItemModelRolesUpdater::setEnabledPlugins(const QStringList& list)
 {
     if (m_enabledPlugins != list) {
         m_enabledPlugins = list;
+        m_previewCache.setEnabledPlugins(list);
         if (m_previewShown) {
             updateAllPreviews();
         }
@@ -394,6 +462,16 @@ void KFileItemModelRolesUpdater::slotItemsRemoved(const KItemRangeList& itemRang
         m_recentlyChangedItems.clear();
         m_recentlyChangedItemsTimer->stop();
         m_changedItems.clear();
+        m_pendingResolvedItems.clear();
+        m_pendingRoleValues.clear();
+        m_pendingRoleValuesTimer->stop();
+        m_mimeTypeResolver->clear();
+        clearComposingPreviews();
+#ifdef HAVE_BALOO
+        // The results of running workers are ignored, as the items
+        // are not part of the model anymore.
+        m_pendingBalooItems.clear();
+#endif
 
         killPreviewJob();
     } else {
@@ -490,6 +568,8 @@ void KFileItemModelRolesUpdater::slotSortRoleChanged(const QByteArray& current,
 
 void KFileItemModelRolesUpdater::slotGotPreview(const KFileItem& item, const QPixmap& pixmap)
 {
+    m_previewJobItems.remove(item);
+
     if (m_state != PreviewJobRunning) {
         return;
     }
@@ -501,78 +581,65 @@ void KFileItemModelRolesUpdater::slotGotPreview(const KFileItem& item, const QPi
         return;
     }
 
-    QPixmap scaledPixmap = pixmap;
+    // Scaling and framing large previews is expensive, hence it is done
+    // in a worker thread. Only the conversion of the result to a pixmap
+    // is done in the GUI thread, see applyPendingRoleValues().
+    QHash<KFileItem, ComposingPreview>::iterator it = m_composingPreviews.find(item);
+    if (it != m_composingPreviews.end()) {
+        // The result for an older preview of the item is not needed anymore.
+        disconnect(it->watcher, 0, this, 0);
+        it->watcher->deleteLater();
+        m_composingPreviews.erase(it);
+    }
 
+    const QImage image = pixmap.toImage();
     const QString mimeType = item.mimetype();
-    const int slashIndex = mimeType.indexOf(QLatin1Char('/'));
-    const bool isFontPreview = mimeType.right(slashIndex).contains(QLatin1String("font"));
-    const bool isFolderPreview = item.isDir();
-    const bool isWindowsExePreview = mimeType == QLatin1String("application/x-ms-dos-executable") ||
-                                     mimeType == QLatin1String("application/x-msdownload");
-
-    if (!isFolderPreview && !isFontPreview && !isWindowsExePreview) {
-        if (m_enlargeSmallPreviews) {
-            KPixmapModifier::applyFrame(scaledPixmap, m_iconSize);
-        } else {
-            // Assure that small previews don't get enlarged. Instead they
-            // should be shown centered within the frame.
-            const QSize contentSize = KPixmapModifier::sizeInsideFrame(m_iconSize);
-            const bool enlargingRequired = scaledPixmap.width()  < contentSize.width() &&
-                                           scaledPixmap.height() < contentSize.height();
-            if (enlargingRequired) {
-                QSize frameSize = scaledPixmap.size() / scaledPixmap.devicePixelRatio();
-                frameSize.scale(m_iconSize, Qt::KeepAspectRatio);
-
-                QPixmap largeFrame(frameSize);
-                largeFrame.fill(Qt::transparent);
-
-                KPixmapModifier::applyFrame(largeFrame, frameSize);
+    const bool isDir = item.isDir();
+    const QSize iconSize = m_iconSize;
+    const qreal devicePixelRatio = qApp->devicePixelRatio();
+    const bool enlargeSmallPreviews = m_enlargeSmallPreviews;
+
+    ComposingPreview composing;
+    composing.watcher = new QFutureWatcher<QImage>(this);
+    composing.iconSize = iconSize;
+    composing.enlargeSmallPreviews = enlargeSmallPreviews;
+    connect(composing.watcher, &QFutureWatcher<QImage>::finished,
+            this, &KFileItemModelRolesUpdater::slotPreviewComposed);
+    composing.watcher->setFuture(QtConcurrent::run([=]() {
+        return framedPreview(image, mimeType, isDir, iconSize, devicePixelRatio, enlargeSmallPreviews);
+    }));
+    m_composingPreviews.insert(item, composing);
+}
 
-                QPainter painter(&largeFrame);
-                painter.drawPixmap((largeFrame.width()  - scaledPixmap.width() / scaledPixmap.devicePixelRatio()) / 2,
-                                   (largeFrame.height() - scaledPixmap.height() / scaledPixmap.devicePixelRatio()) / 2,
-                                   scaledPixmap);
-                scaledPixmap = largeFrame;
-            } else {
-                // The image must be shrinked as it is too large to fit into
-                // the available icon size
-                KPixmapModifier::applyFrame(scaledPixmap, m_iconSize);
-            }
+void KFileItemModelRolesUpdater::slotPreviewComposed()
+{
+    QHash<KFileItem, ComposingPreview>::iterator it = m_composingPreviews.begin();
+    while (it != m_composingPreviews.end()) {
+        const ComposingPreview& composing = it.value();
+        if (!composing.watcher->isFinished()) {
+            ++it;
+            continue;
         }
-    } else {
-        KPixmapModifier::scale(scaledPixmap, m_iconSize);
-    }
-
-    QHash<QByteArray, QVariant> data = rolesData(item);
 
-    const QStringList overlays = data["iconOverlays"].toStringList();
-    // Strangely KFileItem::overlays() returns empty string-values, so
-    // we need to check first whether an overlay must be drawn at all.
-    // It is more efficient to do it here, as KIconLoader::drawOverlays()
-    // assumes that an overlay will be drawn and has some additional
-    // setup time.
-    foreach (const QString& overlay, overlays) {
-        if (!overlay.isEmpty()) {
-            // There is at least one overlay, draw all overlays above m_pixmap
-            // and cancel the check
-            KIconLoader::global()->drawOverlays(overlays, scaledPixmap, KIconLoader::Desktop);
-            break;
+        // Previews for an outdated icon size are dropped. The
+        // item has been added to m_pendingPreviewItems again.
+        if (composing.iconSize == m_iconSize && composing.enlargeSmallPreviews == m_enlargeSmallPreviews) {
+            m_composedPreviews.append(qMakePair(it.key(), composing.watcher->result()));
         }
-    }
 
-    data.insert("iconPixmap", scaledPixmap);
-
-    disconnect(m_model, &KFileItemModel::itemsChanged,
-               this,    &KFileItemModelRolesUpdater::slotItemsChanged);
-    m_model->setData(index, data);
-    connect(m_model, &KFileItemModel::itemsChanged,
-            this,    &KFileItemModelRolesUpdater::slotItemsChanged);
+        composing.watcher->deleteLater();
+        it = m_composingPreviews.erase(it);
+    }
 
-    m_finishedItems.insert(item);
+    if (!m_composedPreviews.isEmpty() && !m_pendingRoleValuesTimer->isActive()) {
+        m_pendingRoleValuesTimer->start();
+    }
 }
 
 void KFileItemModelRolesUpdater::slotPreviewFailed(const KFileItem& item)
 {
+    m_previewJobItems.remove(item);
+
     if (m_state != PreviewJobRunning) {
         return;
     }
@@ -583,34 +650,45 @@ void KFileItemModelRolesUpdater::slotPreviewFailed(const KFileItem& item)
     if (index >= 0) {
         QHash<QByteArray, QVariant> data;
         data.insert("iconPixmap", QPixmap());
-
-        disconnect(m_model, &KFileItemModel::itemsChanged,
-                   this,    &KFileItemModelRolesUpdater::slotItemsChanged);
-        m_model->setData(index, data);
-        connect(m_model, &KFileItemModel::itemsChanged,
-                this,    &KFileItemModelRolesUpdater::slotItemsChanged);
+        setPendingRoleValues(item, data);
 
         applyResolvedRoles(index, ResolveAll);
         m_finishedItems.insert(item);
     }
 }
 
-void KFileItemModelRolesUpdater::slotPreviewJobFinished()
+void KFileItemModelRolesUpdater::slotPreviewJobFinished(KJob* job)
 {
-    m_previewJob = 0;
+    KIO::PreviewJob* previewJob = static_cast<KIO::PreviewJob*>(job);
+    m_previewJobs.remove(previewJob);
+
+    // Forget the items which have not been delivered because of an error.
+    QHash<KFileItem, KIO::PreviewJob*>::iterator it = m_previewJobItems.begin();
+    while (it != m_previewJobItems.end()) {
+        if (it.value() == previewJob) {
+            it = m_previewJobItems.erase(it);
+        } else {
+            ++it;
+        }
+    }
 
     if (m_state != PreviewJobRunning) {
         return;
     }
 
+    startPreviewJob();
+}
+
+void KFileItemModelRolesUpdater::slotAllPreviewJobsFinished()
+{
+    if (m_state != PreviewJobRunning || !m_previewJobs.isEmpty() || !m_pendingPreviewItems.isEmpty()) {
+        return;
+    }
+
     m_state = Idle;
 
-    if (!m_pendingPreviewItems.isEmpty()) {
-        startPreviewJob();
-    } else {
-        if (!m_changedItems.isEmpty()) {
-            updateChangedItems();
-        }
+    if (!m_changedItems.isEmpty()) {
+        updateChangedItems();
     }
 }
 
@@ -659,7 +737,12 @@ void KFileItemModelRolesUpdater::resolveNextPendingRoles()
         return;
     }
 
-    while (!m_pendingIndexes.isEmpty()) {
+    // Resolve as many items as possible within one frame. The results
+    // are applied to the model by applyPendingRoleValues().
+    QElapsedTimer timer;
+    timer.start();
+
+    while (!m_pendingIndexes.isEmpty() && timer.elapsed() < FrameTimeout) {
         const int index = m_pendingIndexes.takeFirst();
         const KFileItem item = m_model->fileItem(index);
 
@@ -667,10 +750,16 @@ void KFileItemModelRolesUpdater::resolveNextPendingRoles()
             continue;
         }
 
+        if (KFileItemMimeTypeResolver::canResolve(item)) {
+            // The roles are resolved when the MIME type is
+            // known, see applyPendingRoleValues().
+            m_mimeTypeResolver->addItem(item);
+            continue;
+        }
+
         applyResolvedRoles(index, ResolveAll);
         m_finishedItems.insert(item);
         m_changedItems.remove(item);
-        break;
     }
 
     if (!m_pendingIndexes.isEmpty()) {
@@ -679,18 +768,23 @@ void KFileItemModelRolesUpdater::resolveNextPendingRoles()
         m_state = Idle;
 
         if (m_clearPreviews) {
+            applyPendingRoleValues();
+
             // Only go through the list if there are items which might still have previews.
             if (m_finishedItems.count() != m_model->count()) {
                 QHash<QByteArray, QVariant> data;
                 data.insert("iconPixmap", QPixmap());
 
-                disconnect(m_model, &KFileItemModel::itemsChanged,
-                           this,    &KFileItemModelRolesUpdater::slotItemsChanged);
-                for (int index = 0; index <= m_model->count(); ++index) {
+                QHash<int, QHash<QByteArray, QVariant> > values;
+                for (int index = 0; index < m_model->count(); ++index) {
                     if (m_model->data(index).contains("iconPixmap")) {
-                        m_model->setData(index, data);
+                        values.insert(index, data);
                     }
                 }
+
+                disconnect(m_model, &KFileItemModel::itemsChanged,
+                           this,    &KFileItemModelRolesUpdater::slotItemsChanged);
+                m_model->setRoleValues(values);
                 connect(m_model, &KFileItemModel::itemsChanged,
                         this,    &KFileItemModelRolesUpdater::slotItemsChanged);
 
@@ -728,42 +822,152 @@ void KFileItemModelRolesUpdater::applyChangedBalooRoles(const QString& file)
 void KFileItemModelRolesUpdater::applyChangedBalooRolesForItem(const KFileItem &item)
 {
 #ifdef HAVE_BALOO
-    Baloo::File file(item.localPath());
-    file.load();
+    // Reading the meta data from Baloo requires disk access. It is done
+    // by worker threads, see startBalooWorkers().
+    if (!m_pendingBalooItems.contains(item)) {
+        m_pendingBalooItems.append(item);
+    }
+    startBalooWorkers();
+#else
+#ifndef Q_CC_MSVC
+    Q_UNUSED(item);
+#endif
+#endif
+}
 
-    const KBalooRolesProvider& rolesProvider = KBalooRolesProvider::instance();
-    QHash<QByteArray, QVariant> data;
+void KFileItemModelRolesUpdater::slotBalooRolesResolved()
+{
+#ifdef HAVE_BALOO
+    QHash<QFutureWatcher<QHash<QByteArray, QVariant> >*, KFileItem>::iterator it = m_balooWorkers.begin();
+    while (it != m_balooWorkers.end()) {
+        QFutureWatcher<QHash<QByteArray, QVariant> >* watcher = it.key();
+        if (!watcher->isFinished()) {
+            ++it;
+            continue;
+        }
 
-    foreach (const QByteArray& role, rolesProvider.roles()) {
-        // Overwrite all the role values with an empty QVariant, because the roles
-        // provider doesn't overwrite it when the property value list is empty.
-        // See bug 322348
-        data.insert(role, QVariant());
+        const KFileItem item = it.value();
+        if (m_model->index(item) >= 0) {
+            setPendingRoleValues(item, watcher->result());
+        }
+
+        watcher->deleteLater();
+        it = m_balooWorkers.erase(it);
     }
 
-    QHashIterator<QByteArray, QVariant> it(rolesProvider.roleValues(file, m_roles));
-    while (it.hasNext()) {
-        it.next();
-        data.insert(it.key(), it.value());
+    startBalooWorkers();
+#endif
+}
+
+void KFileItemModelRolesUpdater::applyPendingRoleValues()
+{
+    m_pendingRoleValuesTimer->stop();
+
+    if (!m_composedPreviews.isEmpty()) {
+        QList<QPair<KFileItem, QImage> > previews;
+        previews.swap(m_composedPreviews);
+
+        for (int i = 0; i < previews.count(); ++i) {
+            const KFileItem& item = previews.at(i).first;
+            const QImage& image = previews.at(i).second;
+            if (m_model->index(item) >= 0 && !image.isNull()) {
+                m_previewCache.insert(item, image);
+                applyPreview(item, QPixmap::fromImage(image));
+            }
+        }
     }
 
+    if (!m_pendingResolvedItems.isEmpty()) {
+        // Replace the items by the items with known MIME types. The
+        // model updates the roles "iconName" and "type" by itself.
+        QList<QPair<KFileItem, KFileItem> > items;
+        items.swap(m_pendingResolvedItems);
+
+        disconnect(m_model, &KFileItemModel::itemsChanged,
+                   this,    &KFileItemModelRolesUpdater::slotItemsChanged);
+        m_model->slotRefreshItems(items);
+        connect(m_model, &KFileItemModel::itemsChanged,
+                this,    &KFileItemModelRolesUpdater::slotItemsChanged);
+
+        if (m_state != Paused && !m_previewShown) {
+            // Resolve the remaining roles, which have been postponed
+            // by resolveNextPendingRoles().
+            for (int i = 0; i < items.count(); ++i) {
+                const KFileItem& item = items.at(i).second;
+                const int index = m_model->index(item);
+                if (index >= 0 && !m_finishedItems.contains(item)) {
+                    applyResolvedRoles(index, ResolveAll);
+                    m_finishedItems.insert(item);
+                    m_changedItems.remove(item);
+                }
+            }
+        }
+
+        if (m_state == PreviewJobRunning && !m_pendingPreviewItems.isEmpty()) {
+            // The preview jobs wait for the MIME types, see startPreviewJob().
+            startPreviewJob();
+        }
+    }
+
+    // The previews and resolved roles above have been added to
+    // m_pendingRoleValues, so the restarted timer is not needed.
+    m_pendingRoleValuesTimer->stop();
+
+    if (m_pendingRoleValues.isEmpty()) {
+        return;
+    }
+
+    // Apply all values of the frame at once, so that the model
+    // emits itemsChanged() only once instead of once per item.
+    QHash<int, QHash<QByteArray, QVariant> > values;
+    values.reserve(m_pendingRoleValues.count());
+
+    QHash<KFileItem, QHash<QByteArray, QVariant> >::const_iterator it = m_pendingRoleValues.constBegin();
+    for (; it != m_pendingRoleValues.constEnd(); ++it) {
+        // The item might have been removed since its roles have been resolved.
+        const int index = m_model->index(it.key());
+        if (index >= 0) {
+            values.insert(index, it.value());
+        }
+    }
+    m_pendingRoleValues.clear();
+
     disconnect(m_model, &KFileItemModel::itemsChanged,
                this,    &KFileItemModelRolesUpdater::slotItemsChanged);
-    const int index = m_model->index(item);
-    m_model->setData(index, data);
+    m_model->setRoleValues(values);
     connect(m_model, &KFileItemModel::itemsChanged,
             this,    &KFileItemModelRolesUpdater::slotItemsChanged);
-#else
-#ifndef Q_CC_MSVC
-    Q_UNUSED(item);
-#endif
-#endif
 }
 
 void KFileItemModelRolesUpdater::slotDirectoryContentsCountReceived(const QString& path, int count)
 {
-    const bool getSizeRole = m_roles.contains("size");
-    const bool getIsExpandableRole = m_roles.contains("isExpandable");
+    applyDirectoryContents(path, count, count > 0);
+}
+
+void KFileItemModelRolesUpdater::slotDirectorySizeReceived(const QString& path, int count, KIO::filesize_t size)
+{
+    // The number of items is unknown as long as the directory is scanned
+    applyDirectoryContents(path, QVariant::fromValue(size), (count < 0) ? QVariant() : QVariant(count > 0));
+}
+
+void KFileItemModelRolesUpdater::slotMimeTypeResolved(const KFileItem& item, const QString& mimeType)
+{
+    if (m_model->index(item) < 0) {
+        return;
+    }
+
+    const KFileItem newItem = KFileItemMimeTypeResolver::itemWithMimeType(item, mimeType);
+    m_pendingResolvedItems.append(qMakePair(item, newItem));
+
+    if (!m_pendingRoleValuesTimer->isActive()) {
+        m_pendingRoleValuesTimer->start();
+    }
+}
+
+void KFileItemModelRolesUpdater::applyDirectoryContents(const QString& path, const QVariant& size, const QVariant& isExpandable)
+{
+    const bool getSizeRole = m_roles.contains("size") && size.isValid();
+    const bool getIsExpandableRole = m_roles.contains("isExpandable") && isExpandable.isValid();
 
     if (getSizeRole || getIsExpandableRole) {
         const int index = m_model->index(QUrl::fromLocalFile(path));
@@ -771,17 +975,13 @@ void KFileItemModelRolesUpdater::slotDirectoryContentsCountReceived(const QStrin
             QHash<QByteArray, QVariant> data;
 
             if (getSizeRole) {
-                data.insert("size", count);
+                data.insert("size", size);
             }
             if (getIsExpandableRole) {
-                data.insert("isExpandable", count > 0);
+                data.insert("isExpandable", isExpandable);
             }
 
-            disconnect(m_model, &KFileItemModel::itemsChanged,
-                       this,    &KFileItemModelRolesUpdater::slotItemsChanged);
-            m_model->setData(index, data);
-            connect(m_model, &KFileItemModel::itemsChanged,
-                    this,    &KFileItemModelRolesUpdater::slotItemsChanged);
+            setPendingRoleValues(m_model->fileItem(index), data);
         }
     }
 }
@@ -798,9 +998,10 @@ void KFileItemModelRolesUpdater::startUpdating()
         return;
     }
 
-    // Terminate all updates that are currently active.
-    killPreviewJob();
+    // Terminate all updates that are currently active. The running preview
+    // jobs are not killed, but the pending items are re-prioritized below.
     m_pendingIndexes.clear();
+    m_mimeTypeResolver->clear();
 
     QElapsedTimer timer;
     timer.start();
@@ -823,7 +1024,8 @@ void KFileItemModelRolesUpdater::startUpdating()
 
         foreach (int index, indexes) {
             const KFileItem item = m_model->fileItem(index);
-            if (!m_finishedItems.contains(item)) {
+            if (!m_finishedItems.contains(item) && !m_previewJobItems.contains(item) &&
+                !isComposingPreview(item)) {
                 m_pendingPreviewItems.append(item);
             }
         }
@@ -853,25 +1055,37 @@ void KFileItemModelRolesUpdater::updateVisibleIcons()
     timer.start();
 
     // Try to determine the final icons for all visible items.
+    const int timeout = blockTimeout();
     int index;
-    for (index = m_firstVisibleIndex; index <= lastVisibleIndex && timer.elapsed() < MaxBlockTimeout; ++index) {
+    for (index = m_firstVisibleIndex; index <= lastVisibleIndex && timer.elapsed() < timeout; ++index) {
         applyResolvedRoles(index, ResolveFast);
     }
 
+    // Determine the MIME types of the remaining visible items in worker threads.
+    for (; index <= lastVisibleIndex; ++index) {
+        const KFileItem item = m_model->fileItem(index);
+        if (KFileItemMimeTypeResolver::canResolve(item)) {
+            m_mimeTypeResolver->addItem(item);
+        }
+    }
+
+    // Show the icons of the visible items without waiting for the next frame.
+    applyPendingRoleValues();
+
     // KFileItemListView::initializeItemListWidget(KItemListWidget*) will load
     // preliminary icons (i.e., without mime type determination) for the
     // remaining items.
 }
 
+int KFileItemModelRolesUpdater::blockTimeout() const
+{
+    return m_finishedItems.isEmpty() ? MaxBlockTimeout : FrameTimeout;
+}
+
 void KFileItemModelRolesUpdater::startPreviewJob()
 {
     m_state = PreviewJobRunning;
 
-    if (m_pendingPreviewItems.isEmpty()) {
-        QTimer::singleShot(0, this, &KFileItemModelRolesUpdater::slotPreviewJobFinished);
-        return;
-    }
-
     // PreviewJob internally caches items always with the size of
     // 128 x 128 pixels or 256 x 256 pixels. A (slow) downscaling is done
     // by PreviewJob if a smaller size is requested. For images KFileItemModelRolesUpdater must
@@ -880,49 +1094,176 @@ void KFileItemModelRolesUpdater::startPreviewJob()
     const QSize cacheSize = (m_iconSize.width() > 128) || (m_iconSize.height() > 128)
                              ? QSize(256, 256) : QSize(128, 128);
 
-    // KIO::filePreview() will request the MIME-type of all passed items, which (in the
-    // worst case) might block the application for several seconds. To prevent such
-    // a blocking, we only pass items with known mime type to the preview job.
-    const int count = m_pendingPreviewItems.count();
-    KFileItemList itemSubSet;
-    itemSubSet.reserve(count);
-
-    if (m_pendingPreviewItems.first().isMimeTypeKnown()) {
-        // Some mime types are known already, probably because they were
-        // determined when loading the icons for the visible items. Start
-        // a preview job for all items at the beginning of the list which
-        // have a known mime type.
-        do {
-            itemSubSet.append(m_pendingPreviewItems.takeFirst());
-        } while (!m_pendingPreviewItems.isEmpty() && m_pendingPreviewItems.first().isMimeTypeKnown());
-    } else {
-        // Determine mime types for MaxBlockTimeout ms, and start a preview
-        // job for the corresponding items.
-        QElapsedTimer timer;
-        timer.start();
+    // Each preview job uses one thumbnail process, so the number of jobs
+    // is limited by the number of CPU cores. The visible items are
+    // distributed among all jobs.
+    const int maxJobs = qMax(1, QThread::idealThreadCount());
+    const int maxBackgroundJobs = qMax(1, maxJobs / 2);
+    const int visibleCount = qMax(1, m_lastVisibleIndex - m_firstVisibleIndex + 1);
+    const int itemsPerJob = qBound(1, (visibleCount + maxJobs - 1) / maxJobs, MaxItemsPerPreviewJob);
+
+    QElapsedTimer timer;
+    timer.start();
+    const int timeout = blockTimeout();
+
+    bool waitForMimeTypes = false;
+    while (!m_pendingPreviewItems.isEmpty() && !waitForMimeTypes) {
+        // The item of the model is newer than the pending item
+        // if its MIME type has been determined by m_mimeTypeResolver.
+        const int firstIndex = m_model->index(m_pendingPreviewItems.first());
+        if (firstIndex < 0) {
+            m_pendingPreviewItems.removeFirst();
+            continue;
+        }
+
+        const PreviewTier tier = previewTier(firstIndex);
+        if (m_previewJobs.count() >= maxJobs) {
+            // Visible items have precedence over jobs that only
+            // create previews for items far away from the visible area.
+            KIO::PreviewJob* backgroundJob = 0;
+            if (tier == VisibleTier) {
+                foreach (KIO::PreviewJob* job, m_previewJobs) {
+                    if (isBackgroundPreviewJob(job)) {
+                        backgroundJob = job;
+                        break;
+                    }
+                }
+            }
+
+            if (!backgroundJob) {
+                break;
+            }
+            m_pendingPreviewItems.append(killPreviewJob(backgroundJob));
+        }
+
+        if (tier == BackgroundTier) {
+            int backgroundJobs = 0;
+            foreach (KIO::PreviewJob* job, m_previewJobs) {
+                if (isBackgroundPreviewJob(job)) {
+                    ++backgroundJobs;
+                }
+            }
+            if (backgroundJobs >= maxBackgroundJobs) {
+                break;
+            }
+        }
+
+        // KIO::filePreview() will request the MIME-type of all passed items, which (in the
+        // worst case) might block the application for several seconds. To prevent such
+        // a blocking, we only pass items with known mime type to the preview job.
+        KFileItemList itemSubSet;
+        itemSubSet.reserve(itemsPerJob);
+
+        while (!m_pendingPreviewItems.isEmpty() && itemSubSet.count() < itemsPerJob) {
+            const int index = m_model->index(m_pendingPreviewItems.first());
+            if (index < 0) {
+                m_pendingPreviewItems.removeFirst();
+                continue;
+            }
+
+            if (previewTier(index) != tier) {
+                break;
+            }
+
+            const KFileItem item = m_model->fileItem(index);
+            if (!item.isMimeTypeKnown()) {
+                if (KFileItemMimeTypeResolver::canResolve(item)) {
+                    waitForMimeTypes = true;
+                    break;
+                }
+
+                // The MIME types of non-local files can only be determined
+                // synchronously. Do this for blockTimeout() ms.
+                if (!itemSubSet.isEmpty() && timer.elapsed() >= timeout) {
+                    waitForMimeTypes = true;
+                    break;
+                }
+                item.determineMimeType();
+            }
+
+            // Previews which have been created before for the current icon size
+            // are loaded from m_previewCache without a preview job.
+            if (timer.elapsed() < timeout) {
+                const QPixmap cachedPixmap = m_previewCache.pixmap(item);
+                if (!cachedPixmap.isNull()) {
+                    m_changedItems.remove(item);
+                    applyPreview(item, cachedPixmap);
+                    m_pendingPreviewItems.removeFirst();
+                    continue;
+                }
+            }
 
-        do {
-            const KFileItem item = m_pendingPreviewItems.takeFirst();
-            item.determineMimeType();
             itemSubSet.append(item);
-        } while (!m_pendingPreviewItems.isEmpty() && timer.elapsed() < MaxBlockTimeout);
+            m_pendingPreviewItems.removeFirst();
+        }
+
+        if (itemSubSet.isEmpty()) {
+            continue;
+        }
+
+        KIO::PreviewJob* job = new KIO::PreviewJob(itemSubSet, cacheSize, &m_enabledPlugins);
+
+        job->setIgnoreMaximumSize(itemSubSet.first().isLocalFile());
+        if (job->uiDelegate()) {
+            KJobWidgets::setWindow(job, qApp->activeWindow());
+        }
+
+        connect(job,  &KIO::PreviewJob::gotPreview,
+                this, &KFileItemModelRolesUpdater::slotGotPreview);
+        connect(job,  &KIO::PreviewJob::failed,
+                this, &KFileItemModelRolesUpdater::slotPreviewFailed);
+        connect(job,  &KIO::PreviewJob::finished,
+                this, &KFileItemModelRolesUpdater::slotPreviewJobFinished);
+
+        m_previewJobs.insert(job);
+        foreach (const KFileItem& item, itemSubSet) {
+            m_previewJobItems.insert(item, job);
+        }
     }
 
-    KIO::PreviewJob* job = new KIO::PreviewJob(itemSubSet, cacheSize, &m_enabledPlugins);
+    // Let the worker threads determine the MIME types of the remaining
+    // items. The next preview jobs are started by applyPendingRoleValues()
+    // if they cannot be started by slotPreviewJobFinished().
+    foreach (const KFileItem& pendingItem, m_pendingPreviewItems) {
+        const KFileItem item = m_model->fileItem(m_model->index(pendingItem));
+        if (KFileItemMimeTypeResolver::canResolve(item)) {
+            m_mimeTypeResolver->addItem(item);
+        }
+    }
 
-    job->setIgnoreMaximumSize(itemSubSet.first().isLocalFile());
-    if (job->uiDelegate()) {
-        KJobWidgets::setWindow(job, qApp->activeWindow());
+    if (m_previewJobs.isEmpty() && m_pendingPreviewItems.isEmpty()) {
+        // All previews have been created or loaded from the cache, or all
+        // pending items have been removed from the model.
+        QTimer::singleShot(0, this, &KFileItemModelRolesUpdater::slotAllPreviewJobsFinished);
     }
+}
 
-    connect(job,  &KIO::PreviewJob::gotPreview,
-            this, &KFileItemModelRolesUpdater::slotGotPreview);
-    connect(job,  &KIO::PreviewJob::failed,
-            this, &KFileItemModelRolesUpdater::slotPreviewFailed);
-    connect(job,  &KIO::PreviewJob::finished,
-            this, &KFileItemModelRolesUpdater::slotPreviewJobFinished);
+KFileItemModelRolesUpdater::PreviewTier KFileItemModelRolesUpdater::previewTier(int index) const
+{
+    if (index >= m_firstVisibleIndex && index <= m_lastVisibleIndex) {
+        return VisibleTier;
+    }
 
-    m_previewJob = job;
+    const int readAheadItems = qMin(ReadAheadPages * m_maximumVisibleItems, ResolveAllItemsLimit / 2);
+    if (index >= m_firstVisibleIndex - readAheadItems && index <= m_lastVisibleIndex + readAheadItems) {
+        return ReadAheadTier;
+    }
+
+    return BackgroundTier;
+}
+
+bool KFileItemModelRolesUpdater::isBackgroundPreviewJob(KIO::PreviewJob* job) const
+{
+    QHash<KFileItem, KIO::PreviewJob*>::const_iterator it = m_previewJobItems.constBegin();
+    for (; it != m_previewJobItems.constEnd(); ++it) {
+        if (it.value() == job) {
+            const int index = m_model->index(it.key());
+            if (index >= 0 && previewTier(index) != BackgroundTier) {
+                return false;
+            }
+        }
+    }
+    return true;
 }
 
 void KFileItemModelRolesUpdater::updateChangedItems()
@@ -980,9 +1321,7 @@ void KFileItemModelRolesUpdater::updateChangedItems()
             m_pendingPreviewItems.append(m_model->fileItem(index));
         }
 
-        if (!m_previewJob) {
-            startPreviewJob();
-        }
+        startPreviewJob();
     } else {
         const bool resolvingInProgress = !m_pendingIndexes.isEmpty();
         m_pendingIndexes = visibleChangedIndexes + m_pendingIndexes + invisibleChangedIndexes;
@@ -1000,6 +1339,13 @@ void KFileItemModelRolesUpdater::applySortRole(int index)
     const KFileItem item = m_model->fileItem(index);
 
     if (m_model->sortRole() == "type") {
+        if (KFileItemMimeTypeResolver::canResolve(item)) {
+            // The model updates the role "type" and resorts the item
+            // when the MIME type is known, see applyPendingRoleValues().
+            m_mimeTypeResolver->addItem(item);
+            return;
+        }
+
         if (!item.isMimeTypeKnown()) {
             item.determineMimeType();
         }
@@ -1007,6 +1353,12 @@ void KFileItemModelRolesUpdater::applySortRole(int index)
         data.insert("type", item.mimeComment());
     } else if (m_model->sortRole() == "size" && item.isLocalFile() && item.isDir()) {
         const QString path = item.localPath();
+        if (m_directoryContentsCounter->recursiveSizesEnabled()) {
+            // Scanning the whole directory tree would block the GUI. The
+            // item is resorted when the size has been determined.
+            m_directoryContentsCounter->addDirectory(path);
+            return;
+        }
         data.insert("size", m_directoryContentsCounter->countDirectoryContentsSynchronously(path));
     } else {
         // Probably the sort role is a baloo role - just determine all roles.
@@ -1057,11 +1409,7 @@ bool KFileItemModelRolesUpdater::applyResolvedRoles(int index, ResolveHint hint)
             data.insert("iconPixmap", QPixmap());
         }
 
-        disconnect(m_model, &KFileItemModel::itemsChanged,
-                   this,    &KFileItemModelRolesUpdater::slotItemsChanged);
-        m_model->setData(index, data);
-        connect(m_model, &KFileItemModel::itemsChanged,
-                this,    &KFileItemModelRolesUpdater::slotItemsChanged);
+        setPendingRoleValues(item, data);
         return true;
     }
 
@@ -1079,8 +1427,11 @@ QHash<QByteArray, QVariant> KFileItemModelRolesUpdater::rolesData(const KFileIte
         if (item.isLocalFile()) {
             // Tell m_directoryContentsCounter that we want to count the items
             // inside the directory. The result will be received in slotDirectoryContentsCountReceived.
+            // Visible directories are counted first.
             const QString path = item.localPath();
-            m_directoryContentsCounter->addDirectory(path);
+            const int index = m_model->index(item);
+            const bool visible = (index >= m_firstVisibleIndex && index <= m_lastVisibleIndex);
+            m_directoryContentsCounter->addDirectory(path, visible);
         } else if (getSizeRole) {
             data.insert("size", -1); // -1 indicates an unknown number of items
         }
@@ -1099,11 +1450,174 @@ QHash<QByteArray, QVariant> KFileItemModelRolesUpdater::rolesData(const KFileIte
 #ifdef HAVE_BALOO
     if (m_balooFileMonitor) {
         m_balooFileMonitor->addFile(item.localPath());
-        applyChangedBalooRolesForItem(item);
+        if (KBalooRolesProvider::instance().roles().contains(m_model->sortRole())) {
+            // The item can only be sorted if the sort role is known.
+            QHashIterator<QByteArray, QVariant> it(balooRoleValues(item.localPath(), m_roles));
+            while (it.hasNext()) {
+                it.next();
+                data.insert(it.key(), it.value());
+            }
+        } else {
+            applyChangedBalooRolesForItem(item);
+        }
+    }
+#endif
+    return data;
+}
+
+void KFileItemModelRolesUpdater::setPendingRoleValues(const KFileItem& item, const QHash<QByteArray, QVariant>& values)
+{
+    QHash<QByteArray, QVariant>& pendingValues = m_pendingRoleValues[item];
+    QHashIterator<QByteArray, QVariant> it(values);
+    while (it.hasNext()) {
+        it.next();
+        pendingValues.insert(it.key(), it.value());
+    }
+
+    if (!m_pendingRoleValuesTimer->isActive()) {
+        m_pendingRoleValuesTimer->start();
+    }
+}
+
+void KFileItemModelRolesUpdater::startBalooWorkers()
+{
+#ifdef HAVE_BALOO
+    const int maxWorkers = qMax(1, QThread::idealThreadCount());
+    while (!m_pendingBalooItems.isEmpty() && m_balooWorkers.count() < maxWorkers) {
+        const KFileItem item = m_pendingBalooItems.takeFirst();
+        if (m_model->index(item) < 0) {
+            continue;
+        }
+
+        QFutureWatcher<QHash<QByteArray, QVariant> >* watcher = new QFutureWatcher<QHash<QByteArray, QVariant> >(this);
+        connect(watcher, &QFutureWatcher<QHash<QByteArray, QVariant> >::finished,
+                this, &KFileItemModelRolesUpdater::slotBalooRolesResolved);
+        watcher->setFuture(QtConcurrent::run(&KFileItemModelRolesUpdater::balooRoleValues, item.localPath(), m_roles));
+        m_balooWorkers.insert(watcher, item);
     }
 #endif
+}
+
+#ifdef HAVE_BALOO
+QHash<QByteArray, QVariant> KFileItemModelRolesUpdater::balooRoleValues(const QString& path, const QSet<QByteArray>& roles)
+{
+    Baloo::File file(path);
+    file.load();
+
+    const KBalooRolesProvider& rolesProvider = KBalooRolesProvider::instance();
+    QHash<QByteArray, QVariant> data;
+
+    foreach (const QByteArray& role, rolesProvider.roles()) {
+        // Overwrite all the role values with an empty QVariant, because the roles
+        // provider doesn't overwrite it when the property value list is empty.
+        // See bug 322348
+        data.insert(role, QVariant());
+    }
+
+    QHashIterator<QByteArray, QVariant> it(rolesProvider.roleValues(file, roles));
+    while (it.hasNext()) {
+        it.next();
+        data.insert(it.key(), it.value());
+    }
+
     return data;
 }
+#endif
+
+QImage KFileItemModelRolesUpdater::framedPreview(const QImage& image, const QString& mimeType, bool isDir,
+                                                 const QSize& iconSize, qreal devicePixelRatio,
+                                                 bool enlargeSmallPreviews)
+{
+    QImage scaledImage = image;
+
+    const int slashIndex = mimeType.indexOf(QLatin1Char('/'));
+    const bool isFontPreview = mimeType.right(slashIndex).contains(QLatin1String("font"));
+    const bool isFolderPreview = isDir;
+    const bool isWindowsExePreview = mimeType == QLatin1String("application/x-ms-dos-executable") ||
+                                     mimeType == QLatin1String("application/x-msdownload");
+
+    if (!isFolderPreview && !isFontPreview && !isWindowsExePreview) {
+        if (enlargeSmallPreviews) {
+            KPixmapModifier::applyFrame(scaledImage, iconSize, devicePixelRatio);
+        } else {
+            // Assure that small previews don't get enlarged. Instead they
+            // should be shown centered within the frame.
+            const QSize contentSize = KPixmapModifier::sizeInsideFrame(iconSize);
+            const bool enlargingRequired = scaledImage.width()  < contentSize.width() &&
+                                           scaledImage.height() < contentSize.height();
+            if (enlargingRequired) {
+                QSize frameSize = scaledImage.size() / scaledImage.devicePixelRatio();
+                frameSize.scale(iconSize, Qt::KeepAspectRatio);
+
+                QImage largeFrame(frameSize, QImage::Format_ARGB32_Premultiplied);
+                largeFrame.fill(Qt::transparent);
+
+                KPixmapModifier::applyFrame(largeFrame, frameSize, devicePixelRatio);
+
+                QPainter painter(&largeFrame);
+                painter.drawImage((largeFrame.width()  - scaledImage.width() / scaledImage.devicePixelRatio()) / 2,
+                                  (largeFrame.height() - scaledImage.height() / scaledImage.devicePixelRatio()) / 2,
+                                  scaledImage);
+                painter.end();
+                scaledImage = largeFrame;
+            } else {
+                // The image must be shrinked as it is too large to fit into
+                // the available icon size
+                KPixmapModifier::applyFrame(scaledImage, iconSize, devicePixelRatio);
+            }
+        }
+    } else {
+        KPixmapModifier::scale(scaledImage, iconSize);
+    }
+
+    return scaledImage;
+}
+
+bool KFileItemModelRolesUpdater::isComposingPreview(const KFileItem& item) const
+{
+    const QHash<KFileItem, ComposingPreview>::const_iterator it = m_composingPreviews.constFind(item);
+    return it != m_composingPreviews.constEnd() &&
+           it->iconSize == m_iconSize &&
+           it->enlargeSmallPreviews == m_enlargeSmallPreviews;
+}
+
+void KFileItemModelRolesUpdater::clearComposingPreviews()
+{
+    // The running workers cannot be canceled, but their results are ignored.
+    foreach (const ComposingPreview& composing, m_composingPreviews) {
+        disconnect(composing.watcher, 0, this, 0);
+        composing.watcher->deleteLater();
+    }
+    m_composingPreviews.clear();
+    m_composedPreviews.clear();
+}
+
+void KFileItemModelRolesUpdater::applyPreview(const KFileItem& item, const QPixmap& framedPixmap)
+{
+    QPixmap pixmap = framedPixmap;
+
+    QHash<QByteArray, QVariant> data = rolesData(item);
+
+    const QStringList overlays = data["iconOverlays"].toStringList();
+    // Strangely KFileItem::overlays() returns empty string-values, so
+    // we need to check first whether an overlay must be drawn at all.
+    // It is more efficient to do it here, as KIconLoader::drawOverlays()
+    // assumes that an overlay will be drawn and has some additional
+    // setup time.
+    foreach (const QString& overlay, overlays) {
+        if (!overlay.isEmpty()) {
+            // There is at least one overlay, draw all overlays above the pixmap
+            // and cancel the check
+            KIconLoader::global()->drawOverlays(overlays, pixmap, KIconLoader::Desktop);
+            break;
+        }
+    }
+
+    data.insert("iconPixmap", pixmap);
+    setPendingRoleValues(item, data);
+
+    m_finishedItems.insert(item);
+}
 
 void KFileItemModelRolesUpdater::slotOverlaysChanged(const QUrl& url, const QStringList &)
 {
@@ -1126,6 +1640,7 @@ void KFileItemModelRolesUpdater::updateAllPreviews()
     if (m_state == Paused) {
         m_previewChangedDuringPausing = true;
     } else {
+        killPreviewJob();
         m_finishedItems.clear();
         startUpdating();
     }
@@ -1133,17 +1648,34 @@ void KFileItemModelRolesUpdater::updateAllPreviews()
 
 void KFileItemModelRolesUpdater::killPreviewJob()
 {
-    if (m_previewJob) {
-        disconnect(m_previewJob,  &KIO::PreviewJob::gotPreview,
-                   this, &KFileItemModelRolesUpdater::slotGotPreview);
-        disconnect(m_previewJob,  &KIO::PreviewJob::failed,
-                   this, &KFileItemModelRolesUpdater::slotPreviewFailed);
-        disconnect(m_previewJob,  &KIO::PreviewJob::finished,
-                   this, &KFileItemModelRolesUpdater::slotPreviewJobFinished);
-        m_previewJob->kill();
-        m_previewJob = 0;
-        m_pendingPreviewItems.clear();
+    foreach (KIO::PreviewJob* job, m_previewJobs) {
+        killPreviewJob(job);
+    }
+    m_pendingPreviewItems.clear();
+}
+
+KFileItemList KFileItemModelRolesUpdater::killPreviewJob(KIO::PreviewJob* job)
+{
+    disconnect(job,  &KIO::PreviewJob::gotPreview,
+               this, &KFileItemModelRolesUpdater::slotGotPreview);
+    disconnect(job,  &KIO::PreviewJob::failed,
+               this, &KFileItemModelRolesUpdater::slotPreviewFailed);
+    disconnect(job,  &KIO::PreviewJob::finished,
+               this, &KFileItemModelRolesUpdater::slotPreviewJobFinished);
+    job->kill();
+    m_previewJobs.remove(job);
+
+    KFileItemList remainingItems;
+    QHash<KFileItem, KIO::PreviewJob*>::iterator it = m_previewJobItems.begin();
+    while (it != m_previewJobItems.end()) {
+        if (it.value() == job) {
+            remainingItems.append(it.key());
+            it = m_previewJobItems.erase(it);
+        } else {
+            ++it;
+        }
     }
+    return remainingItems;
 }
 
 QList<int> KFileItemModelRolesUpdater::indexesToResolve() const
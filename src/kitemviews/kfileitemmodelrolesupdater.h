@@ -24,16 +24,23 @@
 
 #include <KFileItem>
 #include <kitemviews/kitemmodelbase.h>
+#include <kitemviews/private/kfileitempreviewcache.h>
 
 #include "dolphin_export.h"
 
+#include <QFutureWatcher>
+#include <QHash>
+#include <QImage>
 #include <QObject>
+#include <QPair>
 #include <QSet>
 #include <QSize>
 #include <QStringList>
 
 class KDirectoryContentsCounter;
+class KFileItemMimeTypeResolver;
 class KFileItemModel;
+class KJob;
 class QPixmap;
 class QTimer;
 class KOverlayIconPlugin;
@@ -61,7 +68,18 @@ namespace KIO {
  * items, but only for the visible items, some items around the visible area,
  * and the items on the first and last pages of the view. This is a compromise
  * that aims to minimize the risk that the user sees items with unknown icons
- * in the view when scrolling or pressing Home or End.
+ * in the view when scrolling or pressing Home or End. The items are handled
+ * in this order of priority, see \a indexesToResolve().
+ *
+ * Except for the initial loading of a directory, the GUI thread is never
+ * blocked for longer than one frame (16 ms). The MIME types of local files
+ * are determined by a KFileItemMimeTypeResolver in worker threads.
+ *
+ * Previews which have been created once are stored in a KFileItemPreviewCache.
+ * They are loaded from there without starting a KIO::PreviewJob as long as
+ * the icon size and the files have not been changed. The resolved roles are collected
+ * and applied to the model at most once per frame by \a applyPendingRoleValues().
+ * Roles that must be read from Baloo are determined by a pool of worker threads.
  *
  * Determining the roles is done in several phases:
  *
@@ -73,14 +91,16 @@ namespace KIO {
  *      has been successfully determined for all items, or items are inserted
  *      in the view, or the visible items might have changed because items
  *      were removed or moved, tries to determine the icons for all visible
- *      items synchronously for 200 ms. Then:
+ *      items synchronously for 200 ms (or for one frame if the roles of
+ *      other items have been determined already). Then:
  *
  *      (a) If previews are disabled, icons and all other roles are determined
  *          asynchronously for the interesting items. This is done by the
  *          function \a resolveNextPendingRoles().
  *
- *      (b) If previews are enabled, a \a KIO::PreviewJob is started that loads
- *          the previews for the interesting items. At the same time, the icons
+ *      (b) If previews are enabled, several \a KIO::PreviewJob instances are
+ *          started that load the previews for the interesting items, see
+ *          \a startPreviewJob(). At the same time, the icons
  *          for these items are determined asynchronously as fast as possible
  *          by \a resolveNextPendingRoles(). This minimizes the risk that the
  *          user sees "unknown" icons when scrolling before the previews have
@@ -124,6 +144,15 @@ public:
     void setEnlargeSmallPreviews(bool enlarge);
     bool enlargeSmallPreviews() const;
 
+    /**
+     * If enabled, the "size" role of local directories is the disk usage
+     * of their contents instead of the number of items. The size is
+     * determined by scanning the whole directory tree in the background.
+     * Per default the recursive sizes are disabled.
+     */
+    void setRecursiveFolderSizes(bool enabled);
+    bool recursiveFolderSizes() const;
+
     /**
      * If \a paused is set to true the asynchronous resolving of roles will be paused.
      * State changes during pauses like changing the icon size or the preview-shown
@@ -170,6 +199,13 @@ private slots:
      */
     void slotGotPreview(const KFileItem& item, const QPixmap& pixmap);
 
+    /**
+     * Is invoked after a preview has been scaled and framed in a worker
+     * thread. Queues the result for applyPendingRoleValues().
+     * @see slotGotPreview()
+     */
+    void slotPreviewComposed();
+
     /**
      * Is invoked after generating a preview has failed.
      * @see startPreviewJob()
@@ -177,12 +213,18 @@ private slots:
     void slotPreviewFailed(const KFileItem& item);
 
     /**
-     * Is invoked when the preview job has been finished. Starts a new preview
-     * job if there are any interesting items without previews left, or updates
-     * the changed items otherwise.     *
+     * Is invoked when the preview job \a job has been finished. Starts new
+     * preview jobs if there are any interesting items without previews left.
      * @see startPreviewJob()
      */
-    void slotPreviewJobFinished();
+    void slotPreviewJobFinished(KJob* job);
+
+    /**
+     * Is invoked when no preview job is running anymore and no items are
+     * pending. Updates the changed items.
+     * @see startPreviewJob()
+     */
+    void slotAllPreviewJobsFinished();
 
     /**
      * Is invoked when one of the KOverlayIconPlugin emit the signal that an overlay has changed
@@ -213,8 +255,37 @@ private slots:
     void applyChangedBalooRoles(const QString& file);
     void applyChangedBalooRolesForItem(const KFileItem& file);
 
+    /**
+     * Is invoked when a worker thread has read the Baloo roles of an item.
+     * Queues the result for the model and starts the next worker.
+     * @see startBalooWorkers()
+     */
+    void slotBalooRolesResolved();
+
+    /**
+     * Applies the role values that have been collected in m_pendingRoleValues
+     * to the model. Is invoked once per frame by m_pendingRoleValuesTimer.
+     * All values are applied by one KFileItemModel::setRoleValues() call, so
+     * that the model emits only one itemsChanged() signal per frame.
+     */
+    void applyPendingRoleValues();
+
     void slotDirectoryContentsCountReceived(const QString& path, int count);
 
+    /**
+     * Is invoked when m_directoryContentsCounter has determined the disk usage
+     * \a size of the directory \a path. If the directory is still scanned,
+     * \a size is a partial total and \a count is -1.
+     */
+    void slotDirectorySizeReceived(const QString& path, int count, KIO::filesize_t size);
+
+    /**
+     * Is invoked when m_mimeTypeResolver has determined the MIME type of
+     * \a item. The item of the model is replaced by an item with the MIME
+     * type in applyPendingRoleValues().
+     */
+    void slotMimeTypeResolved(const KFileItem& item, const QString& mimeType);
+
 private:
     /**
      * Starts the updating of all roles. The visible items are handled first.
@@ -222,23 +293,67 @@ private:
     void startUpdating();
 
     /**
-     * Loads the icons for the visible items. After 200 ms, the function
-     * stops determining mime types and only loads preliminary icons.
+     * Applies the "size" and "isExpandable" roles of the directory \a path,
+     * which have been determined by m_directoryContentsCounter. Invalid
+     * values are not applied.
+     */
+    void applyDirectoryContents(const QString& path, const QVariant& size, const QVariant& isExpandable);
+
+    /**
+     * Loads the icons for the visible items. After blockTimeout() ms, the
+     * function stops determining mime types and only loads preliminary icons.
      * This is a compromise that prevents that
-     * (a) the GUI is blocked for more than 200 ms, and
+     * (a) the GUI is blocked for too long, and
      * (b) "unknown" icons could be shown in the view.
      */
     void updateVisibleIcons();
 
     /**
-     * Creates previews for the items starting from the first item in
-     * m_pendingPreviewItems.
+     * @return The maximum time in ms for blocking operations on the GUI thread.
+     *         While no roles have been resolved yet, e.g. when a directory
+     *         is opened, MaxBlockTimeout is used to prevent that "unknown"
+     *         icons are shown. Afterwards, e.g. when scrolling, the GUI
+     *         is not blocked for longer than one frame.
+     */
+    int blockTimeout() const;
+
+    /**
+     * Starts preview jobs for the items starting from the first item in
+     * m_pendingPreviewItems. Up to QThread::idealThreadCount() jobs are running
+     * at the same time. Each job gets a few items of the same tier only (see
+     * previewTier()), so that the pending items can be re-prioritized quickly
+     * if the visible range changes. Background items may only use half of the
+     * jobs, and a background job is killed if visible items are waiting.
      * @see slotGotPreview()
      * @see slotPreviewFailed()
      * @see slotPreviewJobFinished()
      */
     void startPreviewJob();
 
+    enum PreviewTier {
+        VisibleTier,
+        ReadAheadTier,
+        BackgroundTier
+    };
+
+    /**
+     * @return The tier of the item with the index \a index: Visible items are
+     *         handled first, followed by the items in the read-ahead range
+     *         and all other items.
+     */
+    PreviewTier previewTier(int index) const;
+
+    /**
+     * @return True if the remaining items of the preview job \a job are
+     *         background items only.
+     */
+    bool isBackgroundPreviewJob(KIO::PreviewJob* job) const;
+
+    /**
+     * Kills the preview job \a job. Its remaining items are returned.
+     */
+    KFileItemList killPreviewJob(KIO::PreviewJob* job);
+
     /**
      * Ensures that icons, previews, and other roles are determined for any
      * items that have been changed.
@@ -259,6 +374,46 @@ private:
     bool applyResolvedRoles(int index, ResolveHint hint);
     QHash<QByteArray, QVariant> rolesData(const KFileItem& item);
 
+    /**
+     * @return The preview \a image scaled to \a iconSize and (depending on
+     *         \a mimeType) surrounded by a frame. Is invoked in a worker thread.
+     */
+    static QImage framedPreview(const QImage& image, const QString& mimeType, bool isDir,
+                                const QSize& iconSize, qreal devicePixelRatio,
+                                bool enlargeSmallPreviews);
+
+    /**
+     * @return True if the preview of \a item is being scaled and framed
+     *         for the current icon size.
+     */
+    bool isComposingPreview(const KFileItem& item) const;
+
+    /**
+     * Discards the previews which are being scaled and framed.
+     */
+    void clearComposingPreviews();
+
+    /**
+     * Applies the framed preview \a pixmap and all other roles of \a item
+     * to the model. The icon overlays are drawn above the preview.
+     */
+    void applyPreview(const KFileItem& item, const QPixmap& pixmap);
+
+    /**
+     * Remembers the role values \a values for the item \a item. They are
+     * applied to the model together with the values of other items by
+     * applyPendingRoleValues().
+     */
+    void setPendingRoleValues(const KFileItem& item, const QHash<QByteArray, QVariant>& values);
+
+    /**
+     * Starts worker threads that read the Baloo roles for the items in
+     * m_pendingBalooItems. Not more than QThread::idealThreadCount()
+     * workers are running at the same time.
+     * @see slotBalooRolesResolved()
+     */
+    void startBalooWorkers();
+
     /**
      * @return The number of items of the path \a path.
      */
@@ -270,6 +425,9 @@ private:
      */
     void updateAllPreviews();
 
+    /**
+     * Kills all preview jobs and clears the pending items.
+     */
     void killPreviewJob();
 
     QList<int> indexesToResolve() const;
@@ -323,10 +481,27 @@ private:
     QList<int> m_pendingIndexes;
 
     // Items which have been left over from the last call of startPreviewJob().
-    // A new preview job will be started from them once the first one finishes.
+    // New preview jobs will be started from them once a running job finishes.
     KFileItemList m_pendingPreviewItems;
 
-    KIO::PreviewJob* m_previewJob;
+    // Running preview jobs and the items that have not been delivered by them yet.
+    QSet<KIO::PreviewJob*> m_previewJobs;
+    QHash<KFileItem, KIO::PreviewJob*> m_previewJobItems;
+    KFileItemPreviewCache m_previewCache;
+
+    // Previews which are being scaled and framed in worker threads. The
+    // parameters are remembered to detect outdated results.
+    struct ComposingPreview
+    {
+        QFutureWatcher<QImage>* watcher;
+        QSize iconSize;
+        bool enlargeSmallPreviews;
+    };
+    QHash<KFileItem, ComposingPreview> m_composingPreviews;
+
+    // Framed previews which are converted to pixmaps and applied
+    // to the model in applyPendingRoleValues().
+    QList<QPair<KFileItem, QImage> > m_composedPreviews;
 
     // When downloading or copying large files, the slot slotItemsChanged()
     // will be called periodically within a quite short delay. To prevent
@@ -339,13 +514,30 @@ private:
     // Items which have not been changed repeatedly recently.
     QSet<KFileItem> m_changedItems;
 
+    // Items with a resolved MIME type which replace the items of the model
+    // in applyPendingRoleValues(). The first item of each pair is the old item.
+    QList<QPair<KFileItem, KFileItem> > m_pendingResolvedItems;
+
+    // Role values which have been resolved, but have not been applied to the
+    // model yet. Setting the data of many items separately would result in
+    // an itemsChanged() signal and a relayout of the view for each item.
+    QHash<KFileItem, QHash<QByteArray, QVariant> > m_pendingRoleValues;
+    QTimer* m_pendingRoleValuesTimer;
+
     KDirectoryContentsCounter* m_directoryContentsCounter;
+    KFileItemMimeTypeResolver* m_mimeTypeResolver;
 
     QList<KOverlayIconPlugin*> m_overlayIconsPlugin;
 
 #ifdef HAVE_BALOO
+    static QHash<QByteArray, QVariant> balooRoleValues(const QString& path, const QSet<QByteArray>& roles);
+
     Baloo::FileMonitor* m_balooFileMonitor;
     Baloo::IndexerConfig m_balooConfig;
+
+    // Items whose Baloo roles still have to be read, in the order of priority.
+    KFileItemList m_pendingBalooItems;
+    QHash<QFutureWatcher<QHash<QByteArray, QVariant> >*, KFileItem> m_balooWorkers;
 #endif
 };
 
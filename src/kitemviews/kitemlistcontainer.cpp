@@ -58,6 +58,11 @@ KItemListContainerViewport::KItemListContainerViewport(QGraphicsScene* scene, QW
     setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
     setViewportMargins(0, 0, 0, 0);
     setFrameShape(QFrame::NoFrame);
+
+    // When scrolling, all visible item-widgets are moved and hence get dirty. Let
+    // QGraphicsView repaint the bounding rectangle in this case instead of merging
+    // thousands of small rectangles, but keep minimal updates e.g. for hovering.
+    setViewportUpdateMode(QGraphicsView::SmartViewportUpdate);
 }
 
 void KItemListContainerViewport::wheelEvent(QWheelEvent* event)
@@ -76,7 +81,13 @@ KItemListContainer::KItemListContainer(KItemListController* controller, QWidget*
     Q_ASSERT(controller);
     controller->setParent(this);
 
-    QGraphicsView* graphicsView = new KItemListContainerViewport(new QGraphicsScene(this), this);
+    // The item-widgets are moved on each scroll step, which would require updating
+    // the BSP index of the scene for each of them. The index is not needed at all, as
+    // KItemListView::itemAt() determines the items by the layout and not by the scene.
+    QGraphicsScene* scene = new QGraphicsScene(this);
+    scene->setItemIndexMethod(QGraphicsScene::NoIndex);
+
+    QGraphicsView* graphicsView = new KItemListContainerViewport(scene, this);
     setViewport(graphicsView);
 
     m_horizontalSmoothScroller = new KItemListSmoothScroller(horizontalScrollBar(), this);
@@ -29,6 +29,7 @@
 #include "kitemlistselectionmanager.h"
 #include "kitemlistwidget.h"
 
+#include "private/kitemlistcolumnwidthresolver.h"
 #include "private/kitemlistheaderwidget.h"
 #include "private/kitemlistrubberband.h"
 #include "private/kitemlistsizehintresolver.h"
@@ -54,6 +55,10 @@ namespace {
 
     // Delay in ms for triggering the next autoscroll
     const int RepeatingAutoScrollDelay = 1000 / 60;
+
+    // Duration in ms of one frame. Model changes that arrive within
+    // one frame are applied with a single layout.
+    const int FrameTimeout = 1000 / 60;
 }
 
 #ifndef QT_NO_ACCESSIBILITY
@@ -79,6 +84,13 @@ KItemListView::KItemListView(QGraphicsWidget* parent) :
     m_editingRole(false),
     m_activeTransactions(0),
     m_endTransactionAnimationHint(Animation),
+    m_modelChangeTime(),
+    m_modelChangeTimer(0),
+    m_postponeLayout(false),
+    m_postponedItemCount(0),
+    m_postponedLayoutAnimationHint(Animation),
+    m_postponedChangedIndex(0),
+    m_postponedChangedCount(0),
     m_itemSize(),
     m_controller(0),
     m_model(0),
@@ -90,6 +102,7 @@ KItemListView::KItemListView(QGraphicsWidget* parent) :
     m_visibleGroups(),
     m_visibleCells(),
     m_sizeHintResolver(0),
+    m_columnWidthResolver(0),
     m_layouter(0),
     m_animation(0),
     m_layoutTimer(0),
@@ -109,6 +122,7 @@ KItemListView::KItemListView(QGraphicsWidget* parent) :
     setAcceptHoverEvents(true);
 
     m_sizeHintResolver = new KItemListSizeHintResolver(this);
+    m_columnWidthResolver = new KItemListColumnWidthResolver(this);
 
     m_layouter = new KItemListViewLayouter(m_sizeHintResolver, this);
 
@@ -121,6 +135,11 @@ KItemListView::KItemListView(QGraphicsWidget* parent) :
     m_layoutTimer->setSingleShot(true);
     connect(m_layoutTimer, &QTimer::timeout, this, &KItemListView::slotLayoutTimerFinished);
 
+    m_modelChangeTimer = new QTimer(this);
+    m_modelChangeTimer->setInterval(FrameTimeout);
+    m_modelChangeTimer->setSingleShot(true);
+    connect(m_modelChangeTimer, &QTimer::timeout, this, &KItemListView::slotModelChangeTimerFinished);
+
     m_rubberBand = new KItemListRubberBand(this);
     connect(m_rubberBand, &KItemListRubberBand::activationChanged, this, &KItemListView::slotRubberBandActivationChanged);
 
@@ -148,6 +167,9 @@ KItemListView::~KItemListView()
 
     delete m_sizeHintResolver;
     m_sizeHintResolver = 0;
+
+    delete m_columnWidthResolver;
+    m_columnWidthResolver = 0;
 }
 
 void KItemListView::setScrollOffset(qreal offset)
@@ -313,6 +335,7 @@ void KItemListView::setWidgetCreator(KItemListWidgetCreatorBase* widgetCreator)
         delete m_widgetCreator;
     }
     m_widgetCreator = widgetCreator;
+    m_columnWidthResolver->clearCache();
 }
 
 KItemListWidgetCreatorBase* KItemListView::widgetCreator() const
@@ -472,6 +495,7 @@ void KItemListView::setSupportsItemExpanding(bool supportsExpanding)
 {
     if (m_supportsItemExpanding != supportsExpanding) {
         m_supportsItemExpanding = supportsExpanding;
+        m_columnWidthResolver->clearCache();
         updateSiblingsInformation();
         onSupportsItemExpandingChanged(supportsExpanding);
     }
@@ -735,6 +759,8 @@ void KItemListView::setItemSize(const QSizeF& size)
             m_layouter->setItemSize(newSize);
         }
     } else {
+        // The column-widths are not required anymore.
+        m_columnWidthResolver->clearCache();
         m_layouter->setItemSize(size);
     }
 
@@ -778,6 +804,7 @@ void KItemListView::setStyleOption(const KItemListStyleOption& option)
     }
 
     m_sizeHintResolver->clearCache();
+    m_columnWidthResolver->clearCache();
     m_layouter->markAsDirty();
     doLayout(animate ? Animation : NoAnimation);
 
@@ -988,10 +1015,25 @@ void KItemListView::updatePalette()
     }
 }
 
+void KItemListView::updateEstimatedItemSizeHints()
+{
+    if (m_sizeHintResolver->clearEstimatedSizeHints()) {
+        m_layouter->markAsDirty();
+        doLayout(NoAnimation);
+    }
+}
+
 void KItemListView::slotItemsInserted(const KItemRangeList& itemRanges)
 {
+    int insertedCount = 0;
+    foreach (const KItemRange& range, itemRanges) {
+        insertedCount += range.count;
+    }
+    beginModelChange(insertedCount);
+
+    m_columnWidthResolver->itemsInserted(itemRanges);
     if (m_itemSize.isEmpty()) {
-        updatePreferredColumnWidths(itemRanges);
+        updateChangedPreferredColumnWidths();
     }
 
     const bool hasMultipleRanges = (itemRanges.count() > 1);
@@ -999,9 +1041,8 @@ void KItemListView::slotItemsInserted(const KItemRangeList& itemRanges)
         beginTransaction();
     }
 
-    m_layouter->markAsDirty();
-
     m_sizeHintResolver->itemsInserted(itemRanges);
+    m_layouter->itemsInserted(itemRanges);
 
     int previouslyInsertedCount = 0;
     foreach (const KItemRange& range, itemRanges) {
@@ -1095,14 +1136,21 @@ void KItemListView::slotItemsInserted(const KItemRangeList& itemRanges)
     if (useAlternateBackgrounds()) {
         updateAlternateBackgrounds();
     }
+
+    endModelChange();
 }
 
 void KItemListView::slotItemsRemoved(const KItemRangeList& itemRanges)
 {
+    int removedCount = 0;
+    foreach (const KItemRange& range, itemRanges) {
+        removedCount += range.count;
+    }
+    beginModelChange(removedCount);
+
+    m_columnWidthResolver->itemsRemoved(itemRanges);
     if (m_itemSize.isEmpty()) {
-        // Don't pass the item-range: The preferred column-widths of
-        // all items must be adjusted when removing items.
-        updatePreferredColumnWidths();
+        updateChangedPreferredColumnWidths();
     }
 
     const bool hasMultipleRanges = (itemRanges.count() > 1);
@@ -1110,9 +1158,8 @@ void KItemListView::slotItemsRemoved(const KItemRangeList& itemRanges)
         beginTransaction();
     }
 
-    m_layouter->markAsDirty();
-
     m_sizeHintResolver->itemsRemoved(itemRanges);
+    m_layouter->itemsRemoved(itemRanges);
 
     for (int i = itemRanges.count() - 1; i >= 0; --i) {
         const KItemRange& range = itemRanges[i];
@@ -1210,11 +1257,16 @@ void KItemListView::slotItemsRemoved(const KItemRangeList& itemRanges)
     if (useAlternateBackgrounds()) {
         updateAlternateBackgrounds();
     }
+
+    endModelChange();
 }
 
 void KItemListView::slotItemsMoved(const KItemRange& itemRange, const QList<int>& movedToIndexes)
 {
+    beginModelChange(itemRange.count);
+
     m_sizeHintResolver->itemsMoved(itemRange, movedToIndexes);
+    m_columnWidthResolver->itemsMoved(itemRange, movedToIndexes);
     m_layouter->markAsDirty();
 
     if (m_controller) {
@@ -1234,14 +1286,21 @@ void KItemListView::slotItemsMoved(const KItemRange& itemRange, const QList<int>
 
     doLayout(NoAnimation);
     updateSiblingsInformation();
+
+    endModelChange();
 }
 
 void KItemListView::slotItemsChanged(const KItemRangeList& itemRanges,
                                      const QSet<QByteArray>& roles)
 {
     const bool updateSizeHints = itemSizeHintUpdateRequired(roles);
-    if (updateSizeHints && m_itemSize.isEmpty()) {
-        updatePreferredColumnWidths(itemRanges);
+    if (updateSizeHints) {
+        foreach (const KItemRange& itemRange, itemRanges) {
+            m_columnWidthResolver->itemsChanged(itemRange.index, itemRange.count);
+        }
+        if (m_itemSize.isEmpty()) {
+            updateChangedPreferredColumnWidths();
+        }
     }
 
     foreach (const KItemRange& itemRange, itemRanges) {
@@ -1250,7 +1309,7 @@ void KItemListView::slotItemsChanged(const KItemRangeList& itemRanges,
 
         if (updateSizeHints) {
             m_sizeHintResolver->itemsChanged(index, count, roles);
-            m_layouter->markAsDirty();
+            m_layouter->markItemsAsDirty(index, count);
 
             if (!m_layoutTimer->isActive()) {
                 m_layoutTimer->start();
@@ -1415,6 +1474,19 @@ void KItemListView::slotLayoutTimerFinished()
     doLayout(Animation);
 }
 
+void KItemListView::slotModelChangeTimerFinished()
+{
+    // The coalesced changes cannot be animated as one change. Only
+    // animate the moving of items if a few items have been changed.
+    LayoutAnimationHint hint = m_postponedLayoutAnimationHint;
+    if (!animateChangedItemCount(m_postponedItemCount)) {
+        hint = NoAnimation;
+    }
+
+    doLayout(hint, m_postponedChangedIndex, m_postponedChangedCount);
+    updateSiblingsInformation();
+}
+
 void KItemListView::slotRubberBandPosChanged()
 {
     update();
@@ -1598,6 +1670,7 @@ void KItemListView::setModel(KItemModelBase* model)
                    this,    &KItemListView::slotSortRoleChanged);
 
         m_sizeHintResolver->itemsRemoved(KItemRangeList() << KItemRange(0, m_model->count()));
+        m_columnWidthResolver->clearCache();
     }
 
     m_model = model;
@@ -1651,6 +1724,21 @@ void KItemListView::doLayout(LayoutAnimationHint hint, int changedIndex, int cha
         return;
     }
 
+    if (m_postponeLayout) {
+        // The layout is done for all model changes of the current
+        // frame by slotModelChangeTimerFinished().
+        if (hint == NoAnimation) {
+            m_postponedLayoutAnimationHint = NoAnimation;
+        }
+        postponeLayoutChange(changedIndex, changedCount);
+        return;
+    }
+
+    if (m_modelChangeTimer->isActive()) {
+        // The postponed model changes are applied by this layout.
+        m_modelChangeTimer->stop();
+    }
+
     if (!m_model || m_model->count() < 0) {
         return;
     }
@@ -2160,53 +2248,18 @@ bool KItemListView::useAlternateBackgrounds() const
     return m_itemSize.isEmpty() && m_visibleRoles.count() > 1;
 }
 
-QHash<QByteArray, qreal> KItemListView::preferredColumnWidths(const KItemRangeList& itemRanges) const
+QHash<QByteArray, qreal> KItemListView::preferredColumnWidths() const
 {
-    QElapsedTimer timer;
-    timer.start();
+    QHash<QByteArray, qreal> widths = m_columnWidthResolver->preferredColumnWidths(visibleRoles());
 
-    QHash<QByteArray, qreal> widths;
-
-    // Calculate the minimum width for each column that is required
-    // to show the headline unclipped.
+    // Ignore widths smaller than the width for showing the headline unclipped.
     const QFontMetricsF fontMetrics(m_headerWidget->font());
     const int gripMargin   = m_headerWidget->style()->pixelMetric(QStyle::PM_HeaderGripMargin);
     const int headerMargin = m_headerWidget->style()->pixelMetric(QStyle::PM_HeaderMargin);
     foreach (const QByteArray& visibleRole, visibleRoles()) {
         const QString headerText = m_model->roleDescription(visibleRole);
         const qreal headerWidth = fontMetrics.width(headerText) + gripMargin + headerMargin * 2;
-        widths.insert(visibleRole, headerWidth);
-    }
-
-    // Calculate the preferred column withs for each item and ignore values
-    // smaller than the width for showing the headline unclipped.
-    const KItemListWidgetCreatorBase* creator = widgetCreator();
-    int calculatedItemCount = 0;
-    bool maxTimeExceeded = false;
-    foreach (const KItemRange& itemRange, itemRanges) {
-        const int startIndex = itemRange.index;
-        const int endIndex = startIndex + itemRange.count - 1;
-
-        for (int i = startIndex; i <= endIndex; ++i) {
-            foreach (const QByteArray& visibleRole, visibleRoles()) {
-                qreal maxWidth = widths.value(visibleRole, 0);
-                const qreal width = creator->preferredRoleColumnWidth(visibleRole, i, this);
-                maxWidth = qMax(width, maxWidth);
-                widths.insert(visibleRole, maxWidth);
-            }
-
-            if (calculatedItemCount > 100 && timer.elapsed() > 200) {
-                // When having several thousands of items calculating the sizes can get
-                // very expensive. We accept a possibly too small role-size in favour
-                // of having no blocking user interface.
-                maxTimeExceeded = true;
-                break;
-            }
-            ++calculatedItemCount;
-        }
-        if (maxTimeExceeded) {
-            break;
-        }
+        widths.insert(visibleRole, qMax(headerWidth, widths.value(visibleRole)));
     }
 
     return widths;
@@ -2235,45 +2288,16 @@ void KItemListView::updateWidgetColumnWidths(KItemListWidget* widget)
     }
 }
 
-void KItemListView::updatePreferredColumnWidths(const KItemRangeList& itemRanges)
+void KItemListView::updatePreferredColumnWidths()
 {
-    Q_ASSERT(m_itemSize.isEmpty());
-    const int itemCount = m_model->count();
-    int rangesItemCount = 0;
-    foreach (const KItemRange& range, itemRanges) {
-        rangesItemCount += range.count;
+    if (!m_model) {
+        return;
     }
 
-    if (itemCount == rangesItemCount) {
-        const QHash<QByteArray, qreal> preferredWidths = preferredColumnWidths(itemRanges);
-        foreach (const QByteArray& role, m_visibleRoles) {
-            m_headerWidget->setPreferredColumnWidth(role, preferredWidths.value(role));
-        }
-    } else {
-        // Only a sub range of the roles need to be determined.
-        // The chances are good that the widths of the sub ranges
-        // already fit into the available widths and hence no
-        // expensive update might be required.
-        bool changed = false;
-
-        const QHash<QByteArray, qreal> updatedWidths = preferredColumnWidths(itemRanges);
-        QHashIterator<QByteArray, qreal> it(updatedWidths);
-        while (it.hasNext()) {
-            it.next();
-            const QByteArray& role = it.key();
-            const qreal updatedWidth = it.value();
-            const qreal currentWidth = m_headerWidget->preferredColumnWidth(role);
-            if (updatedWidth > currentWidth) {
-                m_headerWidget->setPreferredColumnWidth(role, updatedWidth);
-                changed = true;
-            }
-        }
-
-        if (!changed) {
-            // All the updated sizes are smaller than the current sizes and no change
-            // of the stretched roles-widths is required
-            return;
-        }
+    Q_ASSERT(m_itemSize.isEmpty());
+    const QHash<QByteArray, qreal> preferredWidths = preferredColumnWidths();
+    foreach (const QByteArray& role, m_visibleRoles) {
+        m_headerWidget->setPreferredColumnWidth(role, preferredWidths.value(role));
     }
 
     if (m_headerWidget->automaticColumnResizing()) {
@@ -2281,10 +2305,26 @@ void KItemListView::updatePreferredColumnWidths(const KItemRangeList& itemRanges
     }
 }
 
-void KItemListView::updatePreferredColumnWidths()
+void KItemListView::updateChangedPreferredColumnWidths()
 {
-    if (m_model) {
-        updatePreferredColumnWidths(KItemRangeList() << KItemRange(0, m_model->count()));
+    Q_ASSERT(m_itemSize.isEmpty());
+
+    // The widths of the unchanged items are cached, so only the widths
+    // of the inserted or changed items must be determined. Usually the
+    // preferred widths are not affected and no expensive update is required.
+    bool changed = false;
+
+    const QHash<QByteArray, qreal> preferredWidths = preferredColumnWidths();
+    foreach (const QByteArray& role, m_visibleRoles) {
+        const qreal preferredWidth = preferredWidths.value(role);
+        if (preferredWidth != m_headerWidget->preferredColumnWidth(role)) {
+            m_headerWidget->setPreferredColumnWidth(role, preferredWidth);
+            changed = true;
+        }
+    }
+
+    if (changed && m_headerWidget->automaticColumnResizing()) {
+        applyAutomaticColumnWidths();
     }
 }
 
@@ -2418,6 +2458,64 @@ bool KItemListView::animateChangedItemCount(int changedItemCount) const
 }
 
 
+void KItemListView::beginModelChange(int changedItemCount)
+{
+    const bool sameFrame = m_modelChangeTime.isValid() && m_modelChangeTime.elapsed() < FrameTimeout;
+    if (!sameFrame) {
+        m_modelChangeTime.start();
+    }
+
+    if (sameFrame || m_modelChangeTimer->isActive()) {
+        if (!m_modelChangeTimer->isActive()) {
+            m_postponedItemCount = 0;
+            m_postponedLayoutAnimationHint = Animation;
+            m_postponedChangedIndex = 0;
+            m_postponedChangedCount = 0;
+            m_modelChangeTimer->start();
+        }
+        m_postponedItemCount += changedItemCount;
+        m_postponeLayout = true;
+    }
+}
+
+void KItemListView::endModelChange()
+{
+    m_postponeLayout = false;
+}
+
+void KItemListView::postponeLayoutChange(int changedIndex, int changedCount)
+{
+    if (changedCount == 0) {
+        return;
+    }
+
+    if (m_postponedChangedCount == 0) {
+        m_postponedChangedIndex = changedIndex;
+        m_postponedChangedCount = changedCount;
+        return;
+    }
+
+    if ((changedCount > 0) != (m_postponedChangedCount > 0)) {
+        // Inserted and removed items cannot be described by one changed range,
+        // so the moving of the items cannot be animated correctly.
+        m_postponedLayoutAnimationHint = NoAnimation;
+        return;
+    }
+
+    const int firstChangedIndex = qMin(m_postponedChangedIndex, changedIndex);
+    if (changedCount > 0) {
+        // The indexes of the inserted items are related to the model after the
+        // previous insertions. Extend the range so that it covers all inserted items.
+        int endIndex = m_postponedChangedIndex + m_postponedChangedCount;
+        endIndex = (changedIndex <= endIndex) ? endIndex + changedCount : changedIndex + changedCount;
+        m_postponedChangedCount = endIndex - firstChangedIndex;
+    } else {
+        // The items behind all removed items have been moved by the number of removed items.
+        m_postponedChangedCount += changedCount;
+    }
+    m_postponedChangedIndex = firstChangedIndex;
+}
+
 bool KItemListView::scrollBarRequired(const QSizeF& size) const
 {
     const QSizeF oldSize = m_layouter->size();
@@ -30,9 +30,11 @@
 #include <kitemviews/kitemlistwidget.h>
 #include <kitemviews/kitemmodelbase.h>
 #include <kitemviews/private/kitemlistviewanimation.h>
+#include <QElapsedTimer>
 #include <QGraphicsWidget>
 #include <QSet>
 
+class KItemListColumnWidthResolver;
 class KItemListController;
 class KItemListGroupHeaderCreatorBase;
 class KItemListHeader;
@@ -394,6 +396,13 @@ protected:
     virtual void updateFont();
     virtual void updatePalette();
 
+    /**
+     * Calculates all item-size hints again, which have only been estimated
+     * by the widget-informant (see KItemListWidgetInformant::calculateItemSizeHints()),
+     * and updates the layout if there are any.
+     */
+    void updateEstimatedItemSizeHints();
+
 protected slots:
     virtual void slotItemsInserted(const KItemRangeList& itemRanges);
     virtual void slotItemsRemoved(const KItemRangeList& itemRanges);
@@ -412,6 +421,7 @@ private slots:
     void slotAnimationFinished(QGraphicsWidget* widget,
                                KItemListViewAnimation::AnimationType type);
     void slotLayoutTimerFinished();
+    void slotModelChangeTimerFinished();
 
     void slotRubberBandPosChanged();
     void slotRubberBandActivationChanged(bool active);
@@ -574,13 +584,12 @@ private:
     bool useAlternateBackgrounds() const;
 
     /**
-     * @param itemRanges Items that must be checked for getting the widths of columns.
-     * @return           The preferred width of the column of each visible role. The width will
-     *                   be respected if the width of the item size is <= 0 (see
-     *                   KItemListView::setItemSize()). Per default an empty hash
-     *                   is returned.
+     * @return The preferred width of the column of each visible role. The width will
+     *         be respected if the width of the item size is <= 0 (see
+     *         KItemListView::setItemSize()). The widths of the items are cached
+     *         by m_columnWidthResolver.
      */
-    QHash<QByteArray, qreal> preferredColumnWidths(const KItemRangeList& itemRanges) const;
+    QHash<QByteArray, qreal> preferredColumnWidths() const;
 
     /**
      * Applies the column-widths from m_headerWidget to the layout
@@ -594,16 +603,18 @@ private:
     void updateWidgetColumnWidths(KItemListWidget* widget);
 
     /**
-     * Updates the preferred column-widths of m_groupHeaderWidget by
-     * invoking KItemListView::columnWidths().
+     * Updates the preferred column-widths of m_headerWidget by
+     * invoking KItemListView::preferredColumnWidths() and applies
+     * the automatic column-widths.
      */
-    void updatePreferredColumnWidths(const KItemRangeList& itemRanges);
+    void updatePreferredColumnWidths();
 
     /**
-     * Convenience method for
-     * updatePreferredColumnWidths(KItemRangeList() << KItemRange(0, m_model->count()).
+     * Like updatePreferredColumnWidths(), but the automatic column-widths
+     * are only applied if a preferred column-width has been changed. Is
+     * invoked after items have been inserted, removed or changed.
      */
-    void updatePreferredColumnWidths();
+    void updateChangedPreferredColumnWidths();
 
     /**
      * Resizes the column-widths of m_headerWidget based on the preferred widths
@@ -639,6 +650,24 @@ private:
      */
     bool animateChangedItemCount(int changedItemCount) const;
 
+    /**
+     * Must be invoked before applying \p changedItemCount inserted, removed or
+     * moved items of the model and must be followed by endModelChange(). If the
+     * model has already been changed within the current frame, the layout is
+     * postponed until the end of the frame. This assures that a burst of model
+     * changes results in at most one layout per frame.
+     */
+    void beginModelChange(int changedItemCount);
+    void endModelChange();
+
+    /**
+     * Merges the \p changedIndex and \p changedCount of a postponed doLayout()
+     * call into the range that is passed to doLayout() at the end of the frame.
+     * The range starts at the minimum changed index and covers all inserted or
+     * removed items, so that only the following items are animated.
+     */
+    void postponeLayoutChange(int changedIndex, int changedCount);
+
     /**
      * @return True if a scrollbar for the given scroll-orientation is required
      *         when using a size of \p size for the view. Calling the method is rather
@@ -712,6 +741,14 @@ private:
     int m_activeTransactions; // Counter for beginTransaction()/endTransaction()
     LayoutAnimationHint m_endTransactionAnimationHint;
 
+    QElapsedTimer m_modelChangeTime;
+    QTimer* m_modelChangeTimer; // Triggers the postponed doLayout() of coalesced model changes.
+    bool m_postponeLayout;
+    int m_postponedItemCount;
+    LayoutAnimationHint m_postponedLayoutAnimationHint;
+    int m_postponedChangedIndex;
+    int m_postponedChangedCount;
+
     QSizeF m_itemSize;
     KItemListController* m_controller;
     KItemModelBase* m_model;
@@ -720,6 +757,10 @@ private:
     mutable KItemListGroupHeaderCreatorBase* m_groupHeaderCreator;
     KItemListStyleOption m_styleOption;
 
+    // TODO: Each visible item is represented by a widget, which is positioned
+    // and painted separately by the scene. With thousands of visible items it
+    // would be faster if the view painted the items that are neither hovered,
+    // edited nor animated in one pass, and only kept widgets for the others.
     QHash<int, KItemListWidget*> m_visibleItems;
     QHash<KItemListWidget*, KItemListGroupHeader*> m_visibleGroups;
 
@@ -734,6 +775,7 @@ private:
 
     int m_scrollBarExtent;
     KItemListSizeHintResolver* m_sizeHintResolver;
+    KItemListColumnWidthResolver* m_columnWidthResolver;
     KItemListViewLayouter* m_layouter;
     KItemListViewAnimation* m_animation;
 
@@ -765,6 +807,7 @@ private:
     friend class KItemListHeader;    // Accesses m_headerWidget
     friend class KItemListController;
     friend class KItemListControllerTest;
+    friend class KFileItemListViewTest;
     friend class KItemListViewAccessible;
     friend class KItemListAccessibleCell;
 };
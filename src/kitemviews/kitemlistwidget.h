@@ -49,6 +49,12 @@ public:
     KItemListWidgetInformant();
     virtual ~KItemListWidgetInformant();
 
+    /**
+     * Calculates the logical heights of all items whose entry in \a logicalHeightHints
+     * is 0. A negative height marks a size hint which has only been estimated. The
+     * absolute value is used until KItemListView::updateEstimatedItemSizeHints() is
+     * invoked, which calculates the estimated size hints again.
+     */
     virtual void calculateItemSizeHints(QVector<qreal>& logicalHeightHints, qreal& logicalWidthHint, const KItemListView* view) const = 0;
 
     virtual qreal preferredRoleColumnWidth(const QByteArray& role,
@@ -22,6 +22,20 @@
 
 #include "kitemmodelbase.h"
 
+#include <QMutex>
+#include <QVector>
+
+namespace {
+    struct RoleIds
+    {
+        QMutex mutex;
+        QHash<QByteArray, int> idsForRoles;
+        QVector<QByteArray> roles;
+    };
+}
+
+Q_GLOBAL_STATIC(RoleIds, s_roleIds)
+
 KItemModelBase::KItemModelBase(QObject* parent) :
     QObject(parent),
     m_groupedSorting(false),
@@ -49,6 +63,34 @@ bool KItemModelBase::setData(int index, const QHash<QByteArray, QVariant> &value
     return false;
 }
 
+QVariant KItemModelBase::roleValue(int index, int roleId) const
+{
+    return data(index).value(roleForId(roleId));
+}
+
+int KItemModelBase::roleId(const QByteArray& role)
+{
+    RoleIds* roleIds = s_roleIds();
+    QMutexLocker locker(&roleIds->mutex);
+
+    const QHash<QByteArray, int>::const_iterator it = roleIds->idsForRoles.constFind(role);
+    if (it != roleIds->idsForRoles.constEnd()) {
+        return it.value();
+    }
+
+    const int id = roleIds->roles.count();
+    roleIds->roles.append(role);
+    roleIds->idsForRoles.insert(role, id);
+    return id;
+}
+
+QByteArray KItemModelBase::roleForId(int roleId)
+{
+    RoleIds* roleIds = s_roleIds();
+    QMutexLocker locker(&roleIds->mutex);
+    return roleIds->roles.value(roleId);
+}
+
 void KItemModelBase::setGroupedSorting(bool grouped)
 {
     if (m_groupedSorting != grouped) {
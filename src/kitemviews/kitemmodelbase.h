@@ -63,6 +63,32 @@ public:
 
     virtual QHash<QByteArray, QVariant> data(int index) const = 0;
 
+    /**
+     * @return The value of the role with the id \a roleId for the item with
+     *         the index \a index. The id of a role can be resolved once by
+     *         KItemModelBase::roleId().
+     *
+     *         Contrary to data() no QHash with the values of all roles must
+     *         be constructed, which makes this method the preferred way to
+     *         read one role for a large number of items. The default
+     *         implementation returns data(index).value(roleForId(roleId)),
+     *         models should reimplement it if they can provide the value
+     *         more efficiently.
+     */
+    virtual QVariant roleValue(int index, int roleId) const;
+
+    /**
+     * @return Id for the role \a role that can be passed to roleValue(). The
+     *         ids are shared by all models and stay valid for the lifetime of
+     *         the application.
+     */
+    static int roleId(const QByteArray& role);
+
+    /**
+     * @return Role for the id \a roleId that has been returned by roleId().
+     */
+    static QByteArray roleForId(int roleId);
+
     /**
      * Sets the data for the item at \a index to the given \a values. Returns true
      * if the data was set on the item; returns false otherwise.
@@ -22,6 +22,7 @@
 #include <KIconLoader>
 #include "kstandarditemlistwidget.h"
 #include "kstandarditemlistgroupheader.h"
+#include "private/kitemlisttextheightmeasurer.h"
 
 KStandardItemListView::KStandardItemListView(QGraphicsWidget* parent) :
     KItemListView(parent),
@@ -30,6 +31,9 @@ KStandardItemListView::KStandardItemListView(QGraphicsWidget* parent) :
     setAcceptDrops(true);
     setScrollOrientation(Qt::Vertical);
     setVisibleRoles({"text"});
+
+    connect(KItemListTextHeightMeasurer::instance(), &KItemListTextHeightMeasurer::textHeightsMeasured,
+            this, &KStandardItemListView::slotTextHeightsMeasured);
 }
 
 KStandardItemListView::~KStandardItemListView()
@@ -139,6 +143,14 @@ void KStandardItemListView::polishEvent()
     QGraphicsWidget::polishEvent();
 }
 
+void KStandardItemListView::slotTextHeightsMeasured()
+{
+    // Only the icons layout estimates the heights of the items.
+    if (m_itemLayout == IconsLayout && model()) {
+        updateEstimatedItemSizeHints();
+    }
+}
+
 void KStandardItemListView::applyDefaultStyleOption(int iconSize,
                                                     int padding,
                                                     int horizontalMargin,
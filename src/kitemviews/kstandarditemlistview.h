@@ -69,6 +69,9 @@ protected:
     virtual void onSupportsItemExpandingChanged(bool supportsExpanding) Q_DECL_OVERRIDE;
     virtual void polishEvent() Q_DECL_OVERRIDE;
 
+private slots:
+    void slotTextHeightsMeasured();
+
 private:
     void applyDefaultStyleOption(int iconSize, int padding, int horizontalMargin, int verticalMargin);
     void updateLayoutOfVisibleItems();
@@ -29,7 +29,9 @@
 #include <KStringHandler>
 
 #include "private/kfileitemclipboard.h"
+#include "private/kitemlisticoncache.h"
 #include "private/kitemlistroleeditor.h"
+#include "private/kitemlisttextheightmeasurer.h"
 #include "private/kpixmapmodifier.h"
 
 #include <QGraphicsScene>
@@ -45,7 +47,8 @@
 // #define KSTANDARDITEMLISTWIDGET_DEBUG
 
 KStandardItemListWidgetInformant::KStandardItemListWidgetInformant() :
-    KItemListWidgetInformant()
+    KItemListWidgetInformant(),
+    m_roleIds()
 {
 }
 
@@ -78,27 +81,26 @@ qreal KStandardItemListWidgetInformant::preferredRoleColumnWidth(const QByteArra
                                                                  int index,
                                                                  const KItemListView* view) const
 {
-    const QHash<QByteArray, QVariant> values = view->model()->data(index);
     const KItemListStyleOption& option = view->styleOption();
 
-    const QString text = roleText(role, values);
+    const QString text = itemRoleText(index, role, view);
     qreal width = KStandardItemListWidget::columnPadding(option);
 
-    const QFontMetrics& normalFontMetrics = option.fontMetrics;
-    const QFontMetrics linkFontMetrics(customizedFontForLinks(option.font));
-
     if (role == "rating") {
         width += KStandardItemListWidget::preferredRatingSize(option).width();
     } else {
         // If current item is a link, we use the customized link font metrics instead of the normal font metrics.
-        const QFontMetrics& fontMetrics = itemIsLink(index, view) ? linkFontMetrics : normalFontMetrics;
+        // The font metrics for links are only created if required, as this is invoked for each item.
+        const QFontMetrics fontMetrics = itemIsLink(index, view) ? QFontMetrics(customizedFontForLinks(option.font))
+                                                                 : option.fontMetrics;
 
         width += fontMetrics.width(text);
 
         if (role == "text") {
             if (view->supportsItemExpanding()) {
                 // Increase the width by the expansion-toggle and the current expansion level
-                const int expandedParentsCount = values.value("expandedParentsCount", 0).toInt();
+                static const int expandedParentsCountRoleId = KItemModelBase::roleId("expandedParentsCount");
+                const int expandedParentsCount = view->model()->roleValue(index, expandedParentsCountRoleId).toInt();
                 const qreal height = option.padding * 2 + qMax(option.iconSize, fontMetrics.height());
                 width += (expandedParentsCount + 1) * height;
             }
@@ -113,7 +115,8 @@ qreal KStandardItemListWidgetInformant::preferredRoleColumnWidth(const QByteArra
 
 QString KStandardItemListWidgetInformant::itemText(int index, const KItemListView* view) const
 {
-    return view->model()->data(index).value("text").toString();
+    static const int textRoleId = KItemModelBase::roleId("text");
+    return view->model()->roleValue(index, textRoleId).toString();
 }
 
 bool KStandardItemListWidgetInformant::itemIsLink(int index, const KItemListView* view) const
@@ -133,11 +136,29 @@ QString KStandardItemListWidgetInformant::roleText(const QByteArray& role,
     return values.value(role).toString();
 }
 
+QString KStandardItemListWidgetInformant::itemRoleText(int index, const QByteArray& role, const KItemListView* view) const
+{
+    if (role == "rating") {
+        // Always use an empty text, as the rating is shown by the image m_rating.
+        return QString();
+    }
+    return view->model()->roleValue(index, cachedRoleId(role)).toString();
+}
+
 QFont KStandardItemListWidgetInformant::customizedFontForLinks(const QFont& baseFont) const
 {
     return baseFont;
 }
 
+int KStandardItemListWidgetInformant::cachedRoleId(const QByteArray& role) const
+{
+    QHash<QByteArray, int>::const_iterator it = m_roleIds.constFind(role);
+    if (it == m_roleIds.constEnd()) {
+        it = m_roleIds.insert(role, KItemModelBase::roleId(role));
+    }
+    return it.value();
+}
+
 void KStandardItemListWidgetInformant::calculateIconsLayoutItemSizeHints(QVector<qreal>& logicalHeightHints, qreal& logicalWidthHint, const KItemListView* view) const
 {
     const KItemListStyleOption& option = view->styleOption();
@@ -151,42 +172,48 @@ void KStandardItemListWidgetInformant::calculateIconsLayoutItemSizeHints(QVector
 
     const QFont linkFont = customizedFontForLinks(normalFont);
 
-    QTextOption textOption(Qt::AlignHCenter);
-    textOption.setWrapMode(QTextOption::WrapAtWordBoundaryOrAnywhere);
+    KItemListTextHeightMeasurer* measurer = KItemListTextHeightMeasurer::instance();
+    const int normalFormat = measurer->format(normalFont, maxWidth, option.maxTextLines);
+    const int linkFormat = measurer->format(linkFont, maxWidth, option.maxTextLines);
+
+    // Only the text heights of the items on the current screen are measured
+    // synchronously. The other heights are estimated until they have been measured
+    // by the worker threads of KItemListTextHeightMeasurer. The range is determined
+    // without the layouter, as the layouter itself requests the size hints.
+    const int columnCount = qMax(1, int(view->size().width() / itemWidth));
+    const qreal minItemHeight = qMax(qreal(1.0), view->itemSize().height());
+    const int firstExactIndex = int(view->scrollOffset() / minItemHeight) * columnCount;
+    const int lastExactIndex = firstExactIndex + (int(view->size().height() / minItemHeight) + 2) * columnCount - 1;
 
     for (int index = 0; index < logicalHeightHints.count(); ++index) {
-        if (logicalHeightHints.at(index) > 0.0) {
+        // Negative hints have been estimated and are kept until
+        // KItemListView::updateEstimatedItemSizeHints() is invoked.
+        if (logicalHeightHints.at(index) != 0.0) {
             continue;
         }
 
         // If the current item is a link, we use the customized link font instead of the normal font.
-        const QFont& font = itemIsLink(index, view) ? linkFont : normalFont;
+        const int format = itemIsLink(index, view) ? linkFormat : normalFormat;
 
         const QString& text = KStringHandler::preProcessWrap(itemText(index, view));
 
         // Calculate the number of lines required for wrapping the name
-        qreal textHeight = 0;
-        QTextLayout layout(text, font);
-        layout.setTextOption(textOption);
-        layout.beginLayout();
-        QTextLine line;
-        int lineCount = 0;
-        while ((line = layout.createLine()).isValid()) {
-            line.setLineWidth(maxWidth);
-            line.naturalTextWidth();
-            textHeight += line.height();
-
-            ++lineCount;
-            if (lineCount == option.maxTextLines) {
-                break;
+        bool estimated = false;
+        qreal textHeight = measurer->cachedTextHeight(text, format);
+        if (textHeight < 0) {
+            if (index >= firstExactIndex && index <= lastExactIndex) {
+                textHeight = measurer->textHeight(text, format);
+            } else {
+                textHeight = measurer->estimatedTextHeight(text, format);
+                estimated = true;
             }
         }
-        layout.endLayout();
 
         // Add one line for each additional information
         textHeight += additionalRolesSpacing;
 
-        logicalHeightHints[index] = textHeight + spacingAndIconHeight;
+        const qreal heightHint = textHeight + spacingAndIconHeight;
+        logicalHeightHints[index] = estimated ? -heightHint : heightHint;
     }
 
     logicalWidthHint = itemWidth;
@@ -221,9 +248,8 @@ void KStandardItemListWidgetInformant::calculateCompactLayoutItemSizeHints(QVect
         if (showOnlyTextRole) {
             maximumRequiredWidth = fontMetrics.width(itemText(index, view));
         } else {
-            const QHash<QByteArray, QVariant>& values = view->model()->data(index);
             foreach (const QByteArray& role, visibleRoles) {
-                const QString& text = roleText(role, values);
+                const QString& text = itemRoleText(index, role, view);
                 const qreal requiredWidth = fontMetrics.width(text);
                 maximumRequiredWidth = qMax(maximumRequiredWidth, requiredWidth);
             }
@@ -262,6 +288,7 @@ KStandardItemListWidget::KStandardItemListWidget(KItemListWidgetInformant* infor
     m_layout(IconsLayout),
     m_pixmapPos(),
     m_pixmap(),
+    m_pixmapCacheKey(),
     m_scaledPixmapSize(),
     m_iconRect(),
     m_hoverPixmap(),
@@ -840,12 +867,18 @@ void KStandardItemListWidget::showEvent(QShowEvent* event)
 
     connect(clipboard, &KFileItemClipboard::cutItemsChanged,
             this, &KStandardItemListWidget::slotCutItemsChanged);
+
+    // Listen to changes of the icon theme to render the icon again
+    connect(KIconLoader::global(), &KIconLoader::iconLoaderSettingsChanged,
+            this, &KStandardItemListWidget::slotIconLoaderSettingsChanged);
 }
 
 void KStandardItemListWidget::hideEvent(QHideEvent* event)
 {
     disconnect(KFileItemClipboard::instance(), &KFileItemClipboard::cutItemsChanged,
                this, &KStandardItemListWidget::slotCutItemsChanged);
+    disconnect(KIconLoader::global(), &KIconLoader::iconLoaderSettingsChanged,
+               this, &KStandardItemListWidget::slotIconLoaderSettingsChanged);
 
     KItemListWidget::hideEvent(event);
 }
@@ -872,6 +905,15 @@ void KStandardItemListWidget::slotCutItemsChanged()
     }
 }
 
+void KStandardItemListWidget::slotIconLoaderSettingsChanged()
+{
+    // The rendered icons are removed from the caches by DolphinView,
+    // so the icon is rendered again with the new theme when painting.
+    m_pixmap = QPixmap();
+    m_dirtyContent = true;
+    update();
+}
+
 void KStandardItemListWidget::slotRoleEditingCanceled(const QByteArray& role,
                                                       const QVariant& value)
 {
@@ -955,6 +997,7 @@ void KStandardItemListWidget::updatePixmapCache()
 
     if (updatePixmap) {
         m_pixmap = values["iconPixmap"].value<QPixmap>();
+        m_pixmapCacheKey.clear();
         if (m_pixmap.isNull()) {
             // Use the icon that fits to the MIME-type
             QString iconName = values["iconName"].toString();
@@ -964,7 +1007,11 @@ void KStandardItemListWidget::updatePixmapCache()
                 iconName = QStringLiteral("unknown");
             }
             const QStringList overlays = values["iconOverlays"].toStringList();
-            m_pixmap = pixmapForIcon(iconName, overlays, maxIconHeight, isSelected() && isActiveWindow() ? QIcon::Selected : QIcon::Normal);
+            const QIcon::Mode mode = isSelected() && isActiveWindow() ? QIcon::Selected : QIcon::Normal;
+            m_pixmap = pixmapForIcon(iconName, overlays, maxIconHeight, mode);
+            m_pixmapCacheKey = "KStandardItemListWidget:" % iconName % ":" % overlays.join(QLatin1Char(',')) %
+                               ":" % QString::number(maxIconHeight) % ":" % QString::number(mode) %
+                               ":" % QString::number(m_pixmap.devicePixelRatio());
 
         } else if (m_pixmap.width() / m_pixmap.devicePixelRatio() != maxIconWidth || m_pixmap.height() / m_pixmap.devicePixelRatio() != maxIconHeight) {
             // A custom pixmap has been applied. Assure that the pixmap
@@ -972,24 +1019,29 @@ void KStandardItemListWidget::updatePixmapCache()
             KPixmapModifier::scale(m_pixmap, QSize(maxIconWidth, maxIconHeight) * qApp->devicePixelRatio());
         }
 
+        int effects = NoEffect;
         if (m_isCut) {
-            KIconEffect* effect = KIconLoader::global()->iconEffect();
-            m_pixmap = effect->apply(m_pixmap, KIconLoader::Desktop, KIconLoader::DisabledState);
+            effects |= CutEffect;
         }
-
         if (m_isHidden) {
-            KIconEffect::semiTransparent(m_pixmap);
+            effects |= HiddenEffect;
         }
-
         if (m_layout == IconsLayout && isSelected()) {
+            effects |= SelectedEffect;
+        }
+
+        if (effects != NoEffect) {
             const QColor color = palette().brush(QPalette::Normal, QPalette::Highlight).color();
-            QImage image = m_pixmap.toImage();
-            KIconEffect::colorize(image, color, 0.8f);
-            m_pixmap = QPixmap::fromImage(image);
+            m_pixmap = pixmapWithEffects(m_pixmap, effects, color, m_pixmapCacheKey);
+            if (!m_pixmapCacheKey.isEmpty()) {
+                m_pixmapCacheKey = pixmapWithEffectsCacheKey(m_pixmapCacheKey, effects, color);
+            }
         }
     }
 
     if (!m_overlay.isNull()) {
+        // The overlay is specific to this item.
+        m_pixmapCacheKey.clear();
         QPainter painter(&m_pixmap);
         painter.drawPixmap(0, m_pixmap.height() - m_overlay.height(), m_overlay);
     }
@@ -1028,14 +1080,7 @@ void KStandardItemListWidget::updatePixmapCache()
 
     // Prepare the pixmap that is used when the item gets hovered
     if (isHovered()) {
-        m_hoverPixmap = m_pixmap;
-        KIconEffect* effect = KIconLoader::global()->iconEffect();
-        // In the KIconLoader terminology, active = hover.
-        if (effect->hasEffect(KIconLoader::Desktop, KIconLoader::ActiveState)) {
-            m_hoverPixmap = effect->apply(m_pixmap, KIconLoader::Desktop, KIconLoader::ActiveState);
-        } else {
-            m_hoverPixmap = m_pixmap;
-        }
+        m_hoverPixmap = pixmapWithEffects(m_pixmap, HoverEffect, QColor(), m_pixmapCacheKey);
     } else if (hoverOpacity() <= 0.0) {
         // No hover animation is ongoing. Clear m_hoverPixmap to save memory.
         m_hoverPixmap = QPixmap();
@@ -1452,10 +1497,11 @@ QPixmap KStandardItemListWidget::pixmapForIcon(const QString& name, const QStrin
 {
     static const QIcon fallbackIcon = QIcon::fromTheme(QStringLiteral("unknown"));
     size *= qApp->devicePixelRatio();
-    const QString key = "KStandardItemListWidget:" % name % ":" % overlays.join(QStringLiteral(":")) % ":" % QString::number(size) % ":" % QString::number(mode);
-    QPixmap pixmap;
+    KItemListIconCache* iconCache = KItemListIconCache::instance();
+    const KItemListIconCache::Key key = iconCache->key(name, overlays, size, mode);
+    QPixmap pixmap = iconCache->find(key);
 
-    if (!QPixmapCache::find(key, pixmap)) {
+    if (pixmap.isNull()) {
         const QIcon icon = QIcon::fromTheme(name, fallbackIcon);
 
         int requestedSize;
@@ -1496,13 +1542,87 @@ QPixmap KStandardItemListWidget::pixmapForIcon(const QString& name, const QStrin
             }
         }
 
-        QPixmapCache::insert(key, pixmap);
+        // Set the device pixel ratio before inserting the pixmap, so that
+        // the cached pixmap is shared without a detach.
+        pixmap.setDevicePixelRatio(qApp->devicePixelRatio());
+        iconCache->insert(key, pixmap);
     }
     pixmap.setDevicePixelRatio(qApp->devicePixelRatio());
 
     return pixmap;
 }
 
+QPixmap KStandardItemListWidget::pixmapWithEffects(const QPixmap& pixmap, int effects, const QColor& selectionColor,
+                                                   const QString& cacheKey)
+{
+    if (pixmap.isNull() || effects == NoEffect) {
+        return pixmap;
+    }
+
+    KIconEffect* iconEffect = KIconLoader::global()->iconEffect();
+    // In the KIconLoader terminology, active = hover.
+    if ((effects & HoverEffect) && !iconEffect->hasEffect(KIconLoader::Desktop, KIconLoader::ActiveState)) {
+        effects &= ~HoverEffect;
+        if (effects == NoEffect) {
+            return pixmap;
+        }
+    }
+
+    QString resultCacheKey;
+    if (!cacheKey.isEmpty()) {
+        resultCacheKey = pixmapWithEffectsCacheKey(cacheKey, effects, selectionColor);
+
+        QPixmap result;
+        if (QPixmapCache::find(resultCacheKey, result)) {
+            return result;
+        }
+    }
+
+    QPixmap result = pixmap;
+
+    if (effects & CutEffect) {
+        result = iconEffect->apply(result, KIconLoader::Desktop, KIconLoader::DisabledState);
+    }
+
+    if (effects & HiddenEffect) {
+        KIconEffect::semiTransparent(result);
+    }
+
+    if (effects & SelectedEffect) {
+        QImage image = result.toImage();
+        KIconEffect::colorize(image, selectionColor, 0.8f);
+        result = QPixmap::fromImage(image);
+    }
+
+    if (effects & HoverEffect) {
+        result = iconEffect->apply(result, KIconLoader::Desktop, KIconLoader::ActiveState);
+    }
+
+    result.setDevicePixelRatio(pixmap.devicePixelRatio());
+    if (!resultCacheKey.isEmpty()) {
+        QPixmapCache::insert(resultCacheKey, result);
+    }
+    return result;
+}
+
+QString KStandardItemListWidget::pixmapWithEffectsCacheKey(const QString& cacheKey, int effects,
+                                                           const QColor& selectionColor)
+{
+    const KIconEffect* iconEffect = KIconLoader::global()->iconEffect();
+
+    QString key = cacheKey % ":effects:" % QString::number(effects);
+    if (effects & CutEffect) {
+        key += ":" % iconEffect->fingerprint(KIconLoader::Desktop, KIconLoader::DisabledState);
+    }
+    if (effects & SelectedEffect) {
+        key += ":" % QString::number(selectionColor.rgba());
+    }
+    if (effects & HoverEffect) {
+        key += ":" % iconEffect->fingerprint(KIconLoader::Desktop, KIconLoader::ActiveState);
+    }
+    return key;
+}
+
 QSizeF KStandardItemListWidget::preferredRatingSize(const KItemListStyleOption& option)
 {
     const qreal height = option.fontMetrics.ascent();
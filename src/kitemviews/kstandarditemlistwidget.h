@@ -24,6 +24,7 @@
 
 #include <kitemviews/kitemlistwidget.h>
 
+#include <QHash>
 #include <QPixmap>
 #include <QPointF>
 #include <QStaticText>
@@ -46,10 +47,9 @@ public:
 protected:
     /**
      * @return The value of the "text" role. The default implementation returns
-     *         view->model()->data(index)["text"]. If a derived class can
-     *         prevent the (possibly expensive) construction of the
-     *         QHash<QByteArray, QVariant> returned by KItemModelBase::data(int),
-     *         it can reimplement this function.
+     *         the value provided by KItemModelBase::roleValue(), which does not
+     *         require the (possibly expensive) construction of the
+     *         QHash<QByteArray, QVariant> returned by KItemModelBase::data(int).
      */
     virtual QString itemText(int index, const KItemListView* view) const;
 
@@ -68,6 +68,16 @@ protected:
     virtual QString roleText(const QByteArray& role,
                              const QHash<QByteArray, QVariant>& values) const;
 
+    /**
+     * @return String representation of the role \a role for the item with the
+     *         index \a index. Contrary to roleText() only the values that are
+     *         required for the representation are read from the model by
+     *         KItemModelBase::roleValue(). The default implementation returns
+     *         the same text as roleText() for the values of the "rating" role
+     *         and of roles whose representation does not depend on other roles.
+     */
+    virtual QString itemRoleText(int index, const QByteArray& role, const KItemListView* view) const;
+
     /**
     * @return A font based on baseFont which is customized for symlinks.
     */
@@ -77,7 +87,17 @@ protected:
     void calculateCompactLayoutItemSizeHints(QVector<qreal>& logicalHeightHints, qreal& logicalWidthHint, const KItemListView* view) const;
     void calculateDetailsLayoutItemSizeHints(QVector<qreal>& logicalHeightHints, qreal& logicalWidthHint, const KItemListView* view) const;
 
+    /**
+     * @return The id of the role \a role. Contrary to KItemModelBase::roleId()
+     *         no lock must be acquired for roles that have been looked up already,
+     *         so this method is suitable for loops over all items.
+     */
+    int cachedRoleId(const QByteArray& role) const;
+
     friend class KStandardItemListWidget; // Accesses roleText()
+
+private:
+    mutable QHash<QByteArray, int> m_roleIds;
 };
 
 /**
@@ -187,6 +207,7 @@ protected:
 
 private slots:
     void slotCutItemsChanged();
+    void slotIconLoaderSettingsChanged();
     void slotRoleEditingCanceled(const QByteArray& role, const QVariant& value);
     void slotRoleEditingFinished(const QByteArray& role, const QVariant& value);
 
@@ -215,6 +236,37 @@ private:
 
     static QPixmap pixmapForIcon(const QString& name, const QStringList& overlays, int size, QIcon::Mode mode);
 
+    enum PixmapEffect
+    {
+        NoEffect = 0,
+        CutEffect = 1,
+        HiddenEffect = 2,
+        SelectedEffect = 4,
+        HoverEffect = 8
+    };
+
+    /**
+     * @return A copy of \a pixmap with the given \a effects applied, which
+     *         are a combination of PixmapEffect values. \a selectionColor is
+     *         only used for SelectedEffect.
+     *
+     * If \a cacheKey is not empty, it must identify the contents of \a pixmap,
+     * e.g., by the icon name and size. The result is stored in the QPixmapCache
+     * then, so all items with the same theme icon share one pixmap per
+     * combination of effects. Pixmaps that are specific to one item like
+     * previews are not cached.
+     */
+    static QPixmap pixmapWithEffects(const QPixmap& pixmap, int effects, const QColor& selectionColor,
+                                     const QString& cacheKey);
+
+    /**
+     * @return Key that identifies the result of pixmapWithEffects() for the
+     *         pixmap identified by \a cacheKey. Besides the effects, the key
+     *         contains the configuration of the KIconEffect, so that changing
+     *         the icon effects in the settings does not show outdated pixmaps.
+     */
+    static QString pixmapWithEffectsCacheKey(const QString& cacheKey, int effects, const QColor& selectionColor);
+
     /**
      * @return Preferred size of the rating-image based on the given
      *         style-option. The height of the font is taken as
@@ -243,6 +295,7 @@ private:
     Layout m_layout;
     QPointF m_pixmapPos;
     QPixmap m_pixmap;
+    QString m_pixmapCacheKey;   // Identifies m_pixmap if it is a shared theme icon, see pixmapWithEffects()
     QSize m_scaledPixmapSize; //Size of the pixmap in device independent pixels
 
     QRectF m_iconRect;          // Cache for KItemListWidget::iconRect()
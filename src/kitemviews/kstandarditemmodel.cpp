@@ -25,7 +25,8 @@
 KStandardItemModel::KStandardItemModel(QObject* parent) :
     KItemModelBase(parent),
     m_items(),
-    m_indexesForItems()
+    m_indexesForItems(),
+    m_rolesForIds()
 {
 }
 
@@ -165,6 +166,24 @@ QHash<QByteArray, QVariant> KStandardItemModel::data(int index) const
     return QHash<QByteArray, QVariant>();
 }
 
+QVariant KStandardItemModel::roleValue(int index, int roleId) const
+{
+    if (index >= 0 && index < count() && roleId >= 0) {
+        const KStandardItem* item = m_items[index];
+        if (item) {
+            if (roleId >= m_rolesForIds.count()) {
+                const int previousCount = m_rolesForIds.count();
+                m_rolesForIds.resize(roleId + 1);
+                for (int id = previousCount; id <= roleId; ++id) {
+                    m_rolesForIds[id] = roleForId(id);
+                }
+            }
+            return item->dataValue(m_rolesForIds.at(roleId));
+        }
+    }
+    return QVariant();
+}
+
 bool KStandardItemModel::setData(int index, const QHash<QByteArray, QVariant>& values)
 {
     Q_UNUSED(values);
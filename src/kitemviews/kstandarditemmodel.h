@@ -24,6 +24,7 @@
 #include <kitemviews/kitemmodelbase.h>
 #include <QHash>
 #include <QList>
+#include <QVector>
 
 class KStandardItem;
 
@@ -71,6 +72,7 @@ public:
 
     virtual int count() const Q_DECL_OVERRIDE;
     virtual QHash<QByteArray, QVariant> data(int index) const Q_DECL_OVERRIDE;
+    virtual QVariant roleValue(int index, int roleId) const Q_DECL_OVERRIDE;
     virtual bool setData(int index, const QHash<QByteArray, QVariant>& values) Q_DECL_OVERRIDE;
     virtual QMimeData* createMimeData(const KItemSet& indexes) const Q_DECL_OVERRIDE;
     virtual int indexForKeyboardSearch(const QString& text, int startFromIndex = 0) const Q_DECL_OVERRIDE;
@@ -104,6 +106,10 @@ private:
     QList<KStandardItem*> m_items;
     QHash<const KStandardItem*, int> m_indexesForItems;
 
+    // Roles for the ids passed to roleValue(). Caching them avoids locking
+    // the global role registry of KItemModelBase for each call.
+    mutable QVector<QByteArray> m_rolesForIds;
+
     friend class KStandardItem;
     friend class KStandardItemModelTest;  // For unit testing
 };
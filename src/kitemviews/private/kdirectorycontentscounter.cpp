@@ -24,33 +24,50 @@
 #include <kitemviews/kfileitemmodel.h>
 
 #include <KDirWatch>
-#include <QThread>
+#include <QPair>
+#include <QStringList>
+#include <QThreadPool>
+#include <QTimer>
+#include <QtConcurrent/QtConcurrentRun>
+
+namespace {
+    // Maximum number of directories that are counted at the same time
+    // by one KDirectoryContentsCounter. Counting is mostly limited by the
+    // latency of the file system, so several directories are counted in
+    // parallel even on machines with few cores.
+    const int MaxWorkers = 4;
+
+    // Interval in milliseconds in which the partial totals of the
+    // recursive sizes are announced.
+    const int SizeScanProgressInterval = 300;
+}
 
 KDirectoryContentsCounter::KDirectoryContentsCounter(KFileItemModel* model, QObject* parent) :
     QObject(parent),
     m_model(model),
+    m_threadPool(0),
+    m_highPriorityQueue(),
     m_queue(),
-    m_worker(0),
-    m_workerIsBusy(false),
+    m_queuedPaths(),
+    m_workers(),
+    m_countedPaths(),
+    m_changedPaths(),
+    m_recursiveSizesEnabled(false),
+    m_sizeScans(),
+    m_sizeScanProgressTimer(0),
     m_dirWatcher(0),
     m_watchedDirs()
 {
     connect(m_model, &KFileItemModel::itemsRemoved,
             this,    &KDirectoryContentsCounter::slotItemsRemoved);
 
-    if (!m_workerThread) {
-        m_workerThread = new QThread();
-        m_workerThread->start();
-    }
-
-    m_worker = new KDirectoryContentsCounterWorker();
-    m_worker->moveToThread(m_workerThread);
-    ++m_workersCount;
+    m_threadPool = new QThreadPool(this);
+    m_threadPool->setMaxThreadCount(MaxWorkers);
 
-    connect(this,     &KDirectoryContentsCounter::requestDirectoryContentsCount,
-            m_worker, &KDirectoryContentsCounterWorker::countDirectoryContents);
-    connect(m_worker, &KDirectoryContentsCounterWorker::result,
-            this,     &KDirectoryContentsCounter::slotResult);
+    m_sizeScanProgressTimer = new QTimer(this);
+    m_sizeScanProgressTimer->setInterval(SizeScanProgressInterval);
+    connect(m_sizeScanProgressTimer, &QTimer::timeout,
+            this, &KDirectoryContentsCounter::slotSizeScanProgress);
 
     m_dirWatcher = new KDirWatch(this);
     connect(m_dirWatcher, &KDirWatch::dirty, this, &KDirectoryContentsCounter::slotDirWatchDirty);
@@ -58,30 +75,34 @@ KDirectoryContentsCounter::KDirectoryContentsCounter(KFileItemModel* model, QObj
 
 KDirectoryContentsCounter::~KDirectoryContentsCounter()
 {
-    --m_workersCount;
+    // Running scans of recursive sizes are stopped. The thread pool waits
+    // for the running workers when it is deleted. Their results are lost,
+    // but they are stored in the cache of KDirectoryContentsCounterWorker
+    // nevertheless.
+    cancelSizeScans(true);
+}
 
-    if (m_workersCount > 0) {
-        // The worker thread will continue running. It could even be running
-        // a method of m_worker at the moment, so we delete it using
-        // deleteLater() to prevent a crash.
-        m_worker->deleteLater();
-    } else {
-        // There are no remaining workers -> stop the worker thread.
-        m_workerThread->quit();
-        m_workerThread->wait();
-        delete m_workerThread;
-        m_workerThread = 0;
+void KDirectoryContentsCounter::addDirectory(const QString& path, bool highPriority)
+{
+    if (m_queuedPaths.contains(path)) {
+        if (highPriority && m_queue.removeOne(path)) {
+            m_highPriorityQueue.append(path);
+        }
+        return;
+    }
 
-        // The worker thread has finished running now, so it's safe to delete
-        // m_worker. deleteLater() would not work at all because the event loop
-        // which would deliver the event to m_worker is not running any more.
-        delete m_worker;
+    if (m_countedPaths.contains(path)) {
+        // The result will be announced when the running worker is finished.
+        return;
     }
-}
 
-void KDirectoryContentsCounter::addDirectory(const QString& path)
-{
-    startWorker(path);
+    m_queuedPaths.insert(path);
+    if (highPriority) {
+        m_highPriorityQueue.append(path);
+    } else {
+        m_queue.append(path);
+    }
+    startWorkers();
 }
 
 int KDirectoryContentsCounter::countDirectoryContentsSynchronously(const QString& path)
@@ -91,47 +112,129 @@ int KDirectoryContentsCounter::countDirectoryContentsSynchronously(const QString
         m_watchedDirs.insert(path);
     }
 
-    KDirectoryContentsCounterWorker::Options options;
+    return KDirectoryContentsCounterWorker::cachedSubItemsCount(path, countOptions());
+}
 
-    if (m_model->showHiddenFiles()) {
-        options |= KDirectoryContentsCounterWorker::CountHiddenFiles;
+void KDirectoryContentsCounter::setRecursiveSizesEnabled(bool enabled)
+{
+    if (enabled == m_recursiveSizesEnabled) {
+        return;
     }
 
-    if (m_model->showDirectoriesOnly()) {
-        options |= KDirectoryContentsCounterWorker::CountDirectoriesOnly;
-    }
+    m_recursiveSizesEnabled = enabled;
 
-    return KDirectoryContentsCounterWorker::subItemsCount(path, options);
+    // The directories that are counted at the moment must be counted
+    // again in the new mode.
+    cancelSizeScans(true);
+    m_changedPaths.unite(m_countedPaths);
 }
 
-void KDirectoryContentsCounter::slotResult(const QString& path, int count)
+bool KDirectoryContentsCounter::recursiveSizesEnabled() const
 {
-    m_workerIsBusy = false;
+    return m_recursiveSizesEnabled;
+}
 
-    if (!m_dirWatcher->contains(path)) {
-        m_dirWatcher->addDir(path);
-        m_watchedDirs.insert(path);
+void KDirectoryContentsCounter::slotWorkerFinished()
+{
+    QList<QPair<QString, int> > results;
+    QList<QPair<QString, int> > sizeResults;
+    QList<KIO::filesize_t> sizes;
+    QStringList changedPaths;
+
+    QHash<QFutureWatcher<int>*, QString>::iterator it = m_workers.begin();
+    while (it != m_workers.end()) {
+        QFutureWatcher<int>* watcher = it.key();
+        if (!watcher->isFinished()) {
+            ++it;
+            continue;
+        }
+
+        const QString path = it.value();
+        const QSharedPointer<KDirectoryContentsCounterWorker::SizeScan> scan = m_sizeScans.take(watcher);
+        watcher->deleteLater();
+        it = m_workers.erase(it);
+
+        if (scan && scan->isCancelled()) {
+            // cancelSizeScans() has already removed the path from m_countedPaths
+            continue;
+        }
+
+        if (scan) {
+            sizeResults.append(qMakePair(path, watcher->result()));
+            sizes.append(scan->size());
+        } else {
+            results.append(qMakePair(path, watcher->result()));
+        }
+
+        m_countedPaths.remove(path);
+        if (m_changedPaths.remove(path)) {
+            // The directory has been changed while it was counted
+            changedPaths.append(path);
+        }
+
+        if (!m_dirWatcher->contains(path)) {
+            m_dirWatcher->addDir(path);
+            m_watchedDirs.insert(path);
+        }
     }
 
-    if (!m_queue.isEmpty()) {
-        startWorker(m_queue.dequeue());
+    foreach (const QString& path, changedPaths) {
+        // The finished worker might have cached the count of the
+        // directory before it has been changed
+        KDirectoryContentsCounterWorker::invalidateCount(path);
+        addDirectory(path);
     }
+    startWorkers();
 
-    emit result(path, count);
+    if (m_sizeScans.isEmpty()) {
+        m_sizeScanProgressTimer->stop();
+    }
+
+    for (int i = 0; i < results.count(); ++i) {
+        emit result(results.at(i).first, results.at(i).second);
+    }
+    for (int i = 0; i < sizeResults.count(); ++i) {
+        emit sizeResult(sizeResults.at(i).first, sizeResults.at(i).second, sizes.at(i));
+    }
+}
+
+void KDirectoryContentsCounter::slotSizeScanProgress()
+{
+    QHash<QFutureWatcher<int>*, QSharedPointer<KDirectoryContentsCounterWorker::SizeScan> >::const_iterator it = m_sizeScans.constBegin();
+    for (; it != m_sizeScans.constEnd(); ++it) {
+        if (!it.value()->isCancelled()) {
+            emit sizeResult(m_workers.value(it.key()), -1, it.value()->size());
+        }
+    }
 }
 
 void KDirectoryContentsCounter::slotDirWatchDirty(const QString& path)
 {
     const int index = m_model->index(QUrl::fromLocalFile(path));
-    if (index >= 0) {
-        if (!m_model->fileItem(index).isDir()) {
-            // If INotify is used, KDirWatch issues the dirty() signal
-            // also for changed files inside the directory, even if we
-            // don't enable this behavior explicitly (see bug 309740).
-            return;
+    if (index < 0 || !m_model->fileItem(index).isDir()) {
+        // If INotify is used, KDirWatch issues the dirty() signal
+        // also for changed files inside the directory, even if we
+        // don't enable this behavior explicitly (see bug 309740).
+        if (m_recursiveSizesEnabled) {
+            // The size of the file might have been changed, which does not
+            // change the modification time of the directory.
+            const QString dirPath = path.left(path.lastIndexOf(QLatin1Char('/')));
+            if (dirPath != path && m_watchedDirs.contains(dirPath)) {
+                slotDirWatchDirty(dirPath);
+            }
         }
+        return;
+    }
 
-        startWorker(path);
+    KDirectoryContentsCounterWorker::invalidateCount(path);
+    if (m_recursiveSizesEnabled) {
+        KDirectoryContentsCounterWorker::invalidateDirectorySize(path);
+    }
+
+    if (m_countedPaths.contains(path)) {
+        m_changedPaths.insert(path);
+    } else {
+        addDirectory(path);
     }
 }
 
@@ -139,6 +242,14 @@ void KDirectoryContentsCounter::slotItemsRemoved()
 {
     const bool allItemsRemoved = (m_model->count() == 0);
 
+    if (allItemsRemoved) {
+        m_highPriorityQueue.clear();
+        m_queue.clear();
+        m_queuedPaths.clear();
+        m_changedPaths.clear();
+    }
+    cancelSizeScans(allItemsRemoved);
+
     if (!m_watchedDirs.isEmpty()) {
         // Don't let KDirWatch watch for removed items
         if (allItemsRemoved) {
@@ -146,7 +257,6 @@ void KDirectoryContentsCounter::slotItemsRemoved()
                 m_dirWatcher->removeDir(path);
             }
             m_watchedDirs.clear();
-            m_queue.clear();
         } else {
             QMutableSetIterator<QString> it(m_watchedDirs);
             while (it.hasNext()) {
@@ -160,25 +270,62 @@ void KDirectoryContentsCounter::slotItemsRemoved()
     }
 }
 
-void KDirectoryContentsCounter::startWorker(const QString& path)
+void KDirectoryContentsCounter::startWorkers()
 {
-    if (m_workerIsBusy) {
-        m_queue.enqueue(path);
-    } else {
-        KDirectoryContentsCounterWorker::Options options;
+    const KDirectoryContentsCounterWorker::Options options = countOptions();
 
-        if (m_model->showHiddenFiles()) {
-            options |= KDirectoryContentsCounterWorker::CountHiddenFiles;
+    while (m_workers.count() < MaxWorkers && !m_queuedPaths.isEmpty()) {
+        const QString path = m_highPriorityQueue.isEmpty() ? m_queue.takeFirst()
+                                                           : m_highPriorityQueue.takeFirst();
+        m_queuedPaths.remove(path);
+        m_countedPaths.insert(path);
+
+        QFutureWatcher<int>* watcher = new QFutureWatcher<int>(this);
+        connect(watcher, &QFutureWatcher<int>::finished,
+                this, &KDirectoryContentsCounter::slotWorkerFinished);
+        if (m_recursiveSizesEnabled) {
+            QSharedPointer<KDirectoryContentsCounterWorker::SizeScan> scan(new KDirectoryContentsCounterWorker::SizeScan());
+            m_sizeScans.insert(watcher, scan);
+            watcher->setFuture(QtConcurrent::run(m_threadPool, &KDirectoryContentsCounterWorker::directorySize,
+                                                 path, options, scan));
+            if (!m_sizeScanProgressTimer->isActive()) {
+                m_sizeScanProgressTimer->start();
+            }
+        } else {
+            watcher->setFuture(QtConcurrent::run(m_threadPool, &KDirectoryContentsCounterWorker::cachedSubItemsCount,
+                                                 path, options));
         }
+        m_workers.insert(watcher, path);
+    }
+}
 
-        if (m_model->showDirectoriesOnly()) {
-            options |= KDirectoryContentsCounterWorker::CountDirectoriesOnly;
+void KDirectoryContentsCounter::cancelSizeScans(bool all)
+{
+    QHash<QFutureWatcher<int>*, QSharedPointer<KDirectoryContentsCounterWorker::SizeScan> >::const_iterator it = m_sizeScans.constBegin();
+    for (; it != m_sizeScans.constEnd(); ++it) {
+        const QSharedPointer<KDirectoryContentsCounterWorker::SizeScan>& scan = it.value();
+        const QString path = m_workers.value(it.key());
+        if (scan->isCancelled() || (!all && m_model->index(QUrl::fromLocalFile(path)) >= 0)) {
+            continue;
         }
 
-        emit requestDirectoryContentsCount(path, options);
-        m_workerIsBusy = true;
+        scan->cancel();
+        m_countedPaths.remove(path);
+        m_changedPaths.remove(path);
     }
 }
 
-QThread* KDirectoryContentsCounter::m_workerThread = 0;
-int KDirectoryContentsCounter::m_workersCount = 0;
+KDirectoryContentsCounterWorker::Options KDirectoryContentsCounter::countOptions() const
+{
+    KDirectoryContentsCounterWorker::Options options;
+
+    if (m_model->showHiddenFiles()) {
+        options |= KDirectoryContentsCounterWorker::CountHiddenFiles;
+    }
+
+    if (m_model->showDirectoriesOnly()) {
+        options |= KDirectoryContentsCounterWorker::CountDirectoriesOnly;
+    }
+
+    return options;
+}
@@ -23,12 +23,16 @@
 
 #include "kdirectorycontentscounterworker.h"
 
+#include <QFutureWatcher>
+#include <QHash>
+#include <QList>
 #include <QSet>
-#include <QQueue>
 
 class KDirWatch;
 class KFileItemModel;
 class QString;
+class QThreadPool;
+class QTimer;
 
 class KDirectoryContentsCounter : public QObject
 {
@@ -45,44 +49,87 @@ public:
      *
      * The directory \a path is watched for changes, and the signal is emitted
      * again if a change occurs.
+     *
+     * If \a highPriority is true, the directory is counted before the
+     * directories that have been added with a normal priority. This
+     * should be used for visible items.
      */
-    void addDirectory(const QString& path);
+    void addDirectory(const QString& path, bool highPriority = false);
 
     /**
      * In contrast to \a addDirectory, this function counts the items inside
      * the directory \a path synchronously and returns the result.
      *
      * The directory is watched for changes, and the signal \a result is
-     * emitted if a change occurs.
+     * emitted if a change occurs. If the directory has not been changed since
+     * it has been counted the last time, the cached result is returned.
      */
     int countDirectoryContentsSynchronously(const QString& path);
 
+    /**
+     * If enabled, addDirectory() also determines the disk usage of the
+     * directory including all sub directories, which is announced via the
+     * signal \a sizeResult instead of \a result. As this might take a long
+     * time, partial totals are announced while the directory is scanned.
+     * Per default the recursive sizes are disabled.
+     */
+    void setRecursiveSizesEnabled(bool enabled);
+    bool recursiveSizesEnabled() const;
+
 signals:
     /**
      * Signals that the directory \a path contains \a count items.
      */
     void result(const QString& path, int count);
 
-    void requestDirectoryContentsCount(const QString& path, KDirectoryContentsCounterWorker::Options options);
+    /**
+     * Signals that the directory \a path contains \a count items, which
+     * use \a size bytes on the disk. If the directory is still scanned,
+     * \a size is a partial total and \a count is -1.
+     */
+    void sizeResult(const QString& path, int count, KIO::filesize_t size);
 
 private slots:
-    void slotResult(const QString& path, int count);
+    void slotWorkerFinished();
+    void slotSizeScanProgress();
     void slotDirWatchDirty(const QString& path);
     void slotItemsRemoved();
 
 private:
-    void startWorker(const QString& path);
+    void startWorkers();
 
-private:
-    KFileItemModel* m_model;
+    /**
+     * Cancels the scans of the directories that are not part
+     * of the model anymore, or of all directories if \a all is true.
+     */
+    void cancelSizeScans(bool all);
 
-    QQueue<QString> m_queue;
+    KDirectoryContentsCounterWorker::Options countOptions() const;
 
-    static QThread* m_workerThread;
-    static int m_workersCount;
+private:
+    KFileItemModel* m_model;
 
-    KDirectoryContentsCounterWorker* m_worker;
-    bool m_workerIsBusy;
+    // Runs the workers, so that counting directories does not
+    // occupy the threads of the global thread pool.
+    QThreadPool* m_threadPool;
+
+    // Directories that wait for being counted. Each directory is
+    // contained only once in one of the queues.
+    QList<QString> m_highPriorityQueue;
+    QList<QString> m_queue;
+    QSet<QString> m_queuedPaths;
+
+    // Directories that are counted at the moment. If a directory gets
+    // changed while it is counted, it is counted again afterwards.
+    QHash<QFutureWatcher<int>*, QString> m_workers;
+    QSet<QString> m_countedPaths;
+    QSet<QString> m_changedPaths;
+
+    // Workers that determine the recursive size of a directory. A cancelled
+    // scan stays here until its worker is finished.
+    bool m_recursiveSizesEnabled;
+    QHash<QFutureWatcher<int>*, QSharedPointer<KDirectoryContentsCounterWorker::SizeScan> > m_sizeScans;
+    QTimer* m_sizeScanProgressTimer;
 
     KDirWatch* m_dirWatcher;
     QSet<QString> m_watchedDirs;    // Required as sadly KDirWatch does not offer a getter method
@@ -20,14 +20,331 @@
 
 #include "kdirectorycontentscounterworker.h"
 
-// Required includes for subItemsCount():
+#include <QDateTime>
+#include <QFileInfo>
+#include <QHash>
+#include <QList>
+#include <QMutexLocker>
+#include <QPair>
+#include <QVector>
+
+// Required includes for subItemsCount() and directorySize():
 #ifdef Q_WS_WIN
     #include <QDir>
+    #include <QDirIterator>
 #else
     #include <dirent.h>
+    #include <fcntl.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
     #include <QFile>
 #endif
 
+namespace {
+    // Maximum number of directories in the cache. The cache is
+    // cleared if this limit is exceeded.
+    const int MaxCachedCounts = 10000;
+
+    /**
+     * Stores the number of items of the counted directories together
+     * with their modification times. As adding or removing an item
+     * changes the modification time of a directory, a cached count is
+     * valid as long as the modification time is unchanged.
+     */
+    class CountCache
+    {
+    public:
+        CountCache() :
+            m_mutex(),
+            m_counts()
+        {
+        }
+
+        int count(const QString& path, KDirectoryContentsCounterWorker::Options options, qint64 modificationTime)
+        {
+            QMutexLocker locker(&m_mutex);
+            const QHash<Key, Entry>::const_iterator it = m_counts.constFind(Key(path, options));
+            if (it == m_counts.constEnd() || it->modificationTime != modificationTime) {
+                return -1;
+            }
+            return it->count;
+        }
+
+        void insert(const QString& path, KDirectoryContentsCounterWorker::Options options, qint64 modificationTime, int count)
+        {
+            QMutexLocker locker(&m_mutex);
+            if (m_counts.count() >= MaxCachedCounts) {
+                m_counts.clear();
+            }
+
+            Entry entry;
+            entry.modificationTime = modificationTime;
+            entry.count = count;
+            m_counts.insert(Key(path, options), entry);
+        }
+
+        void remove(const QString& path)
+        {
+            QMutexLocker locker(&m_mutex);
+            QHash<Key, Entry>::iterator it = m_counts.begin();
+            while (it != m_counts.end()) {
+                if (it.key().first == path) {
+                    it = m_counts.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+
+    private:
+        typedef QPair<QString, int> Key;
+
+        struct Entry
+        {
+            qint64 modificationTime;
+            int count;
+        };
+
+        QMutex m_mutex;
+        QHash<Key, Entry> m_counts;
+    };
+
+    Q_GLOBAL_STATIC(CountCache, s_countCache)
+
+    // Maximum number of directories in the cache of the disk usages, and
+    // the time in milliseconds after which a cached disk usage is read again.
+    // Changing the size of a file does not change the modification time of
+    // its directory, so the cached results must expire.
+    const int MaxCachedDirectories = 50000;
+    const qint64 MaxDirectoryAge = 10 * 60 * 1000;
+
+    /**
+     * A file with more than one hard link, which might
+     * be found in several directories.
+     */
+    struct HardLink
+    {
+        quint64 inode;
+        KIO::filesize_t size;
+    };
+
+    /**
+     * The disk usage of the files directly inside a directory,
+     * and the names of its sub directories. The files with
+     * several hard links are not part of the size.
+     */
+    struct DirectoryEntry
+    {
+        qint64 modificationTime;
+        qint64 scanTime;
+        KIO::filesize_t size;
+        QList<QByteArray> subDirectories;
+        QVector<HardLink> hardLinks;
+    };
+
+    class DirectoryCache
+    {
+    public:
+        DirectoryCache() :
+            m_mutex(),
+            m_entries()
+        {
+        }
+
+        bool entry(const QString& path, qint64 modificationTime, DirectoryEntry& entry)
+        {
+            QMutexLocker locker(&m_mutex);
+            const QHash<QString, DirectoryEntry>::const_iterator it = m_entries.constFind(path);
+            if (it == m_entries.constEnd() || it->modificationTime != modificationTime ||
+                QDateTime::currentMSecsSinceEpoch() - it->scanTime > MaxDirectoryAge) {
+                return false;
+            }
+            entry = it.value();
+            return true;
+        }
+
+        void insert(const QString& path, const DirectoryEntry& entry)
+        {
+            QMutexLocker locker(&m_mutex);
+            if (m_entries.count() >= MaxCachedDirectories) {
+                m_entries.clear();
+            }
+            m_entries.insert(path, entry);
+        }
+
+        void remove(const QString& path)
+        {
+            QMutexLocker locker(&m_mutex);
+            m_entries.remove(path);
+        }
+
+    private:
+        QMutex m_mutex;
+        QHash<QString, DirectoryEntry> m_entries;
+    };
+
+    Q_GLOBAL_STATIC(DirectoryCache, s_directoryCache)
+
+#ifndef Q_WS_WIN
+    /**
+     * Reads the directory \a fd and returns the disk usage of the files
+     * directly inside the directory and the names of the sub directories.
+     */
+    DirectoryEntry readDirectory(int fd, KDirectoryContentsCounterWorker::SizeScan* scan)
+    {
+        DirectoryEntry entry;
+        entry.size = 0;
+
+        // fdopendir() takes the ownership of the file descriptor, but
+        // fd is still needed for the sub directories.
+        const int dirFd = ::dup(fd);
+        DIR* dir = (dirFd >= 0) ? ::fdopendir(dirFd) : 0;
+        if (!dir) {
+            if (dirFd >= 0) {
+                ::close(dirFd);
+            }
+            return entry;
+        }
+
+        struct dirent* dirEntry = 0;
+        while ((dirEntry = ::readdir(dir)) && !scan->isCancelled()) {
+            const char* name = dirEntry->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                // Skip "." and ".."
+                continue;
+            }
+
+            struct stat buf;
+            if (::fstatat(fd, name, &buf, AT_SYMLINK_NOFOLLOW) != 0) {
+                continue;
+            }
+
+            const KIO::filesize_t size = KIO::filesize_t(buf.st_blocks) * 512;
+            if (S_ISDIR(buf.st_mode)) {
+                entry.subDirectories.append(QByteArray(name));
+            } else if (buf.st_nlink > 1) {
+                // Counted by addHardLinks(), as the file might also be
+                // part of another directory.
+                HardLink hardLink;
+                hardLink.inode = buf.st_ino;
+                hardLink.size = size;
+                entry.hardLinks.append(hardLink);
+            } else {
+                entry.size += size;
+                scan->addSize(size);
+            }
+        }
+        ::closedir(dir);
+
+        return entry;
+    }
+
+    /**
+     * Adds the sizes of the files with several hard links of \a entry
+     * to \a scan, unless they have already been counted by the scan.
+     */
+    void addHardLinks(const DirectoryEntry& entry, dev_t device,
+                      KDirectoryContentsCounterWorker::SizeScan* scan)
+    {
+        foreach (const HardLink& hardLink, entry.hardLinks) {
+            if (scan->addHardLink(device, hardLink.inode)) {
+                scan->addSize(hardLink.size);
+            }
+        }
+    }
+
+    /**
+     * Adds the disk usage of the directory \a name inside the directory
+     * \a parentFd, including all sub directories, to \a scan. \a path is
+     * the full path of the directory, which is used as key for the cache.
+     */
+    void scanDirectory(int parentFd, const QByteArray& name, const QString& path, dev_t device,
+                       KDirectoryContentsCounterWorker::SizeScan* scan)
+    {
+        if (scan->isCancelled()) {
+            return;
+        }
+
+        const int fd = ::openat(parentFd, name.constData(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+
+        struct stat buf;
+        if (::fstat(fd, &buf) != 0 || buf.st_dev != device) {
+            // Don't descend into other file systems like "du -x"
+            ::close(fd);
+            return;
+        }
+        scan->addSize(KIO::filesize_t(buf.st_blocks) * 512);
+
+        DirectoryEntry entry;
+        if (s_directoryCache->entry(path, buf.st_mtime, entry)) {
+            scan->addSize(entry.size);
+        } else {
+            entry = readDirectory(fd, scan);
+            if (scan->isCancelled()) {
+                // The entry might be incomplete
+                ::close(fd);
+                return;
+            }
+
+            entry.modificationTime = buf.st_mtime;
+            entry.scanTime = QDateTime::currentMSecsSinceEpoch();
+            s_directoryCache->insert(path, entry);
+        }
+        addHardLinks(entry, device, scan);
+
+        foreach (const QByteArray& subDirectory, entry.subDirectories) {
+            scanDirectory(fd, subDirectory, path + QLatin1Char('/') + QFile::decodeName(subDirectory),
+                          device, scan);
+        }
+
+        ::close(fd);
+    }
+#endif
+}
+
+KDirectoryContentsCounterWorker::SizeScan::SizeScan() :
+    m_cancelled(0),
+    m_mutex(),
+    m_size(0),
+    m_hardLinks()
+{
+}
+
+void KDirectoryContentsCounterWorker::SizeScan::cancel()
+{
+    m_cancelled.storeRelease(1);
+}
+
+bool KDirectoryContentsCounterWorker::SizeScan::isCancelled() const
+{
+    return m_cancelled.loadAcquire() != 0;
+}
+
+KIO::filesize_t KDirectoryContentsCounterWorker::SizeScan::size() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_size;
+}
+
+void KDirectoryContentsCounterWorker::SizeScan::addSize(KIO::filesize_t size)
+{
+    QMutexLocker locker(&m_mutex);
+    m_size += size;
+}
+
+bool KDirectoryContentsCounterWorker::SizeScan::addHardLink(quint64 device, quint64 inode)
+{
+    const QPair<quint64, quint64> hardLink(device, inode);
+    if (m_hardLinks.contains(hardLink)) {
+        return false;
+    }
+    m_hardLinks.insert(hardLink);
+    return true;
+}
+
 KDirectoryContentsCounterWorker::KDirectoryContentsCounterWorker(QObject* parent) :
     QObject(parent)
 {
@@ -89,7 +406,58 @@ int KDirectoryContentsCounterWorker::subItemsCount(const QString& path, Options
 #endif
 }
 
+int KDirectoryContentsCounterWorker::cachedSubItemsCount(const QString& path, Options options)
+{
+    const QDateTime modificationTime = QFileInfo(path).lastModified();
+    if (!modificationTime.isValid()) {
+        return subItemsCount(path, options);
+    }
+
+    const qint64 msecs = modificationTime.toMSecsSinceEpoch();
+    int count = s_countCache->count(path, options, msecs);
+    if (count < 0) {
+        count = subItemsCount(path, options);
+        if (count >= 0) {
+            s_countCache->insert(path, options, msecs, count);
+        }
+    }
+    return count;
+}
+
+int KDirectoryContentsCounterWorker::directorySize(const QString& path, Options options, QSharedPointer<SizeScan> scan)
+{
+    const int count = cachedSubItemsCount(path, options);
+
+#ifdef Q_WS_WIN
+    QDirIterator it(path, QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden | QDir::System,
+                    QDirIterator::Subdirectories);
+    while (it.hasNext() && !scan->isCancelled()) {
+        it.next();
+        if (!it.fileInfo().isDir()) {
+            scan->addSize(it.fileInfo().size());
+        }
+    }
+#else
+    struct stat buf;
+    if (::stat(QFile::encodeName(path).constData(), &buf) == 0) {
+        scanDirectory(AT_FDCWD, QFile::encodeName(path), path, buf.st_dev, scan.data());
+    }
+#endif
+
+    return count;
+}
+
+void KDirectoryContentsCounterWorker::invalidateCount(const QString& path)
+{
+    s_countCache->remove(path);
+}
+
+void KDirectoryContentsCounterWorker::invalidateDirectorySize(const QString& path)
+{
+    s_directoryCache->remove(path);
+}
+
 void KDirectoryContentsCounterWorker::countDirectoryContents(const QString& path, Options options)
 {
-    emit result(path, subItemsCount(path, options));
+    emit result(path, cachedSubItemsCount(path, options));
 }
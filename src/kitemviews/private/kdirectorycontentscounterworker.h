@@ -20,12 +20,21 @@
 #ifndef KDIRECTORYCONTENTENTSCOUNTERWORKER_H
 #define KDIRECTORYCONTENTENTSCOUNTERWORKER_H
 
+#include "dolphin_export.h"
+
+#include <KIO/Global>
+
+#include <QAtomicInt>
 #include <QMetaType>
+#include <QMutex>
 #include <QObject>
+#include <QPair>
+#include <QSet>
+#include <QSharedPointer>
 
 class QString;
 
-class KDirectoryContentsCounterWorker : public QObject
+class DOLPHIN_EXPORT KDirectoryContentsCounterWorker : public QObject
 {
     Q_OBJECT
 
@@ -37,6 +46,39 @@ public:
     };
     Q_DECLARE_FLAGS(Options, Option)
 
+    /**
+     * @brief State of a running directorySize() call.
+     *
+     * It is shared between the thread that requested the size and the
+     * worker thread: the size is increased by the worker while the directory
+     * tree is scanned and can be read at any time to show a partial total.
+     */
+    class SizeScan
+    {
+    public:
+        SizeScan();
+
+        void cancel();
+        bool isCancelled() const;
+
+        KIO::filesize_t size() const;
+        void addSize(KIO::filesize_t size);
+
+        /**
+         * Remembers the file \a inode on the device \a device, which has
+         * more than one hard link. Like "du", the size of such a file is
+         * only counted for its first link found by the scan.
+         * @return True if the file has not been added before.
+         */
+        bool addHardLink(quint64 device, quint64 inode);
+
+    private:
+        QAtomicInt m_cancelled;
+        mutable QMutex m_mutex;
+        KIO::filesize_t m_size;
+        QSet<QPair<quint64, quint64> > m_hardLinks; // Only used by the worker thread
+    };
+
     explicit KDirectoryContentsCounterWorker(QObject* parent = 0);
 
     /**
@@ -47,6 +89,38 @@ public:
      */
     static int subItemsCount(const QString& path, Options options);
 
+    /**
+     * Like subItemsCount(), but returns the cached number of items if the
+     * directory \a path has not been modified since it has been counted.
+     * Can be invoked from several threads at the same time.
+     */
+    static int cachedSubItemsCount(const QString& path, Options options);
+
+    /**
+     * Removes the cached numbers of items of the directory \a path for all
+     * options. Must be invoked if the directory might have been changed
+     * without changing its modification time, e. g. if the file system
+     * only stores the modification time in seconds.
+     */
+    static void invalidateCount(const QString& path);
+
+    /**
+     * Determines the disk usage of the directory \a path including all
+     * sub directories, and adds it to \a scan. Symbolic links are not
+     * followed, and sub directories on other file systems are skipped. The
+     * results are cached per directory, so that only changed directories
+     * are read again. Returns early if \a scan gets cancelled.
+     *
+     * @return The number of items inside \a path, like cachedSubItemsCount().
+     */
+    static int directorySize(const QString& path, Options options, QSharedPointer<SizeScan> scan);
+
+    /**
+     * Removes the cached disk usage of the directory \a path, which must be
+     * invoked if the size of a file inside the directory has been changed.
+     */
+    static void invalidateDirectorySize(const QString& path);
+
 signals:
     /**
      * Signals that the directory \a path contains \a count items.
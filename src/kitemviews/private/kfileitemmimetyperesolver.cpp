@@ -0,0 +1,306 @@
+/***************************************************************************
+ *   Copyright (C) 2017 by agent <agent@local>                             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA            *
+ ***************************************************************************/
+
+#include "kfileitemmimetyperesolver.h"
+
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QMimeDatabase>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QThread>
+#include <QtConcurrent/QtConcurrentRun>
+
+#include <qplatformdefs.h>
+
+namespace {
+    // Maximum number of MIME types in the persistent cache. The
+    // cache is cleared if this limit is exceeded.
+    const int MaxCachedMimeTypes = 100000;
+
+    // Version of the file format of the persistent cache.
+    const qint32 CacheVersion = 1;
+
+    struct CacheKey
+    {
+        quint64 device;
+        quint64 inode;
+        qint64 modificationTime;
+        qint64 size;
+    };
+
+    bool operator==(const CacheKey& a, const CacheKey& b)
+    {
+        return a.inode == b.inode && a.device == b.device &&
+               a.modificationTime == b.modificationTime && a.size == b.size;
+    }
+
+    uint qHash(const CacheKey& key)
+    {
+        return ::qHash(key.inode) ^ ::qHash(key.device) ^
+               ::qHash(key.modificationTime) ^ ::qHash(key.size);
+    }
+
+    QDataStream& operator<<(QDataStream& stream, const CacheKey& key)
+    {
+        stream << key.device << key.inode << key.modificationTime << key.size;
+        return stream;
+    }
+
+    QDataStream& operator>>(QDataStream& stream, CacheKey& key)
+    {
+        stream >> key.device >> key.inode >> key.modificationTime >> key.size;
+        return stream;
+    }
+
+    /**
+     * Stores the MIME types that have been determined by reading the
+     * contents of files. The cache is loaded from the disk when it is
+     * accessed for the first time. It may be accessed by several worker
+     * threads at the same time.
+     */
+    class MimeTypeCache
+    {
+    public:
+        MimeTypeCache() :
+            m_mutex(),
+            m_loaded(false),
+            m_modified(false),
+            m_mimeTypes()
+        {
+        }
+
+        QString mimeType(const CacheKey& key)
+        {
+            QMutexLocker locker(&m_mutex);
+            load();
+            return m_mimeTypes.value(key);
+        }
+
+        void insert(const CacheKey& key, const QString& mimeType)
+        {
+            QMutexLocker locker(&m_mutex);
+            load();
+            if (m_mimeTypes.count() >= MaxCachedMimeTypes) {
+                m_mimeTypes.clear();
+            }
+            m_mimeTypes.insert(key, mimeType);
+            m_modified = true;
+        }
+
+        void save()
+        {
+            QMutexLocker locker(&m_mutex);
+            if (!m_modified) {
+                return;
+            }
+
+            const QString path = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+            if (!QDir().mkpath(path)) {
+                return;
+            }
+
+            QSaveFile file(path + QLatin1String("/mimetypes"));
+            if (file.open(QIODevice::WriteOnly)) {
+                QDataStream stream(&file);
+                stream << CacheVersion << m_mimeTypes;
+                if (file.commit()) {
+                    m_modified = false;
+                }
+            }
+        }
+
+    private:
+        void load()
+        {
+            if (m_loaded) {
+                return;
+            }
+            m_loaded = true;
+
+            const QString path = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+            QFile file(path + QLatin1String("/mimetypes"));
+            if (!file.open(QIODevice::ReadOnly)) {
+                return;
+            }
+
+            QDataStream stream(&file);
+            qint32 version = 0;
+            stream >> version;
+            if (version == CacheVersion) {
+                stream >> m_mimeTypes;
+                if (stream.status() != QDataStream::Ok) {
+                    m_mimeTypes.clear();
+                }
+            }
+        }
+
+        QMutex m_mutex;
+        bool m_loaded;
+        bool m_modified;
+        QHash<CacheKey, QString> m_mimeTypes;
+    };
+
+    Q_GLOBAL_STATIC(MimeTypeCache, s_mimeTypeCache)
+}
+
+KFileItemMimeTypeResolver::KFileItemMimeTypeResolver(QObject* parent) :
+    QObject(parent),
+    m_queue(),
+    m_pendingItems(),
+    m_workers()
+{
+}
+
+KFileItemMimeTypeResolver::~KFileItemMimeTypeResolver()
+{
+    // The running workers are not waited for. Their results are lost,
+    // but they are stored in the cache nevertheless.
+    s_mimeTypeCache->save();
+}
+
+bool KFileItemMimeTypeResolver::canResolve(const KFileItem& item)
+{
+    return !item.isNull() && !item.isMimeTypeKnown() && !item.isDir() &&
+           item.isLocalFile() && item.entry().count() > 0;
+}
+
+void KFileItemMimeTypeResolver::addItem(const KFileItem& item)
+{
+    Q_ASSERT(canResolve(item));
+    if (m_pendingItems.contains(item)) {
+        return;
+    }
+
+    m_pendingItems.insert(item);
+    m_queue.append(item);
+    startWorkers();
+}
+
+bool KFileItemMimeTypeResolver::isPending(const KFileItem& item) const
+{
+    return m_pendingItems.contains(item);
+}
+
+void KFileItemMimeTypeResolver::clear()
+{
+    foreach (const KFileItem& item, m_queue) {
+        m_pendingItems.remove(item);
+    }
+    m_queue.clear();
+}
+
+KFileItem KFileItemMimeTypeResolver::itemWithMimeType(const KFileItem& item, const QString& mimeType)
+{
+    KIO::UDSEntry entry = item.entry();
+    entry.insert(KIO::UDSEntry::UDS_MIME_TYPE, mimeType);
+    return KFileItem(entry, item.url());
+}
+
+void KFileItemMimeTypeResolver::slotWorkerFinished()
+{
+    QHash<QFutureWatcher<QString>*, KFileItem>::iterator it = m_workers.begin();
+    while (it != m_workers.end()) {
+        QFutureWatcher<QString>* watcher = it.key();
+        if (!watcher->isFinished()) {
+            ++it;
+            continue;
+        }
+
+        const KFileItem item = it.value();
+        const QString mimeType = watcher->result();
+        watcher->deleteLater();
+        it = m_workers.erase(it);
+
+        m_pendingItems.remove(item);
+
+        // The item must always be announced, otherwise it would
+        // keep its unknown MIME type forever.
+        emit mimeTypeResolved(item, mimeType.isEmpty() ? QStringLiteral("application/octet-stream") : mimeType);
+    }
+
+    startWorkers();
+}
+
+void KFileItemMimeTypeResolver::startWorkers()
+{
+    const int maxWorkers = qMax(1, QThread::idealThreadCount());
+    while (!m_queue.isEmpty() && m_workers.count() < maxWorkers) {
+        const KFileItem item = m_queue.takeFirst();
+
+        QFutureWatcher<QString>* watcher = new QFutureWatcher<QString>(this);
+        connect(watcher, &QFutureWatcher<QString>::finished,
+                this, &KFileItemMimeTypeResolver::slotWorkerFinished);
+        watcher->setFuture(QtConcurrent::run(&KFileItemMimeTypeResolver::determineMimeType, item.localPath()));
+        m_workers.insert(watcher, item);
+    }
+}
+
+QString KFileItemMimeTypeResolver::determineMimeType(const QString& path)
+{
+    QMimeDatabase db;
+
+    QT_STATBUF buf;
+    if (QT_STAT(QFile::encodeName(path).constData(), &buf) != 0) {
+        // E.g. a broken symbolic link or a file that has been removed in the
+        // meantime. QMimeDatabase falls back to the file name in this case
+        // and returns at least the default MIME type.
+        return db.mimeTypeForFile(path).name();
+    }
+
+    if ((buf.st_mode & QT_STAT_MASK) != QT_STAT_REG) {
+        // Special files like sockets or devices are not cached, and
+        // their contents must not be read.
+        return db.mimeTypeForFile(path).name();
+    }
+
+    // Try to determine the MIME type from the file name only, which
+    // does not require any disk access.
+    const QString fileName = path.mid(path.lastIndexOf(QLatin1Char('/')) + 1);
+    const QList<QMimeType> mimeTypes = db.mimeTypesForFileName(fileName);
+    if (mimeTypes.count() == 1) {
+        return mimeTypes.first().name();
+    }
+
+    // The contents of the file must be checked. Use the cached result
+    // if the file has not been changed since it has been checked.
+    CacheKey key;
+    key.device = buf.st_dev;
+    key.inode = buf.st_ino;
+    key.modificationTime = buf.st_mtime;
+    key.size = buf.st_size;
+
+    // st_ino is always 0 on platforms without inodes.
+    const bool useCache = (key.inode != 0);
+    if (useCache) {
+        const QString mimeType = s_mimeTypeCache->mimeType(key);
+        if (!mimeType.isEmpty()) {
+            return mimeType;
+        }
+    }
+
+    const QString mimeType = db.mimeTypeForFile(path, QMimeDatabase::MatchDefault).name();
+    if (useCache) {
+        s_mimeTypeCache->insert(key, mimeType);
+    }
+    return mimeType;
+}
@@ -0,0 +1,111 @@
+/***************************************************************************
+ *   Copyright (C) 2017 by agent <agent@local>                             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA            *
+ ***************************************************************************/
+
+#ifndef KFILEITEMMIMETYPERESOLVER_H
+#define KFILEITEMMIMETYPERESOLVER_H
+
+#include "dolphin_export.h"
+
+#include <KFileItem>
+
+#include <QFutureWatcher>
+#include <QHash>
+#include <QObject>
+#include <QSet>
+
+/**
+ * @brief Determines the MIME types of local files in worker threads.
+ *
+ * KFileItem::determineMimeType() might read the contents of the file,
+ * which can block the GUI thread for a long time. KFileItemMimeTypeResolver
+ * determines the MIME types in a pool of worker threads instead. A file
+ * whose extension matches exactly one MIME type is not read at all; the
+ * contents are only checked if the extension is unknown or ambiguous.
+ *
+ * The results are stored in a persistent cache, which is keyed by the inode,
+ * the modification time and the size of the file. Hence the contents of an
+ * unchanged file are only read once, even if the directory is opened again
+ * after restarting Dolphin.
+ *
+ * As the MIME type of a KFileItem cannot be changed afterwards,
+ * itemWithMimeType() creates a new item with the resolved MIME type, which
+ * should replace the original item.
+ */
+class DOLPHIN_EXPORT KFileItemMimeTypeResolver : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit KFileItemMimeTypeResolver(QObject* parent = 0);
+    virtual ~KFileItemMimeTypeResolver();
+
+    /**
+     * @return True if the MIME type of \a item is unknown and can be
+     *         determined by KFileItemMimeTypeResolver. This is the case
+     *         for local files which are no directories.
+     */
+    static bool canResolve(const KFileItem& item);
+
+    /**
+     * Requests the MIME type of \a item. The items are handled in the order
+     * in which they have been added. The result is announced via the
+     * signal \a mimeTypeResolved.
+     */
+    void addItem(const KFileItem& item);
+
+    /**
+     * @return True if the MIME type of \a item has been requested by
+     *         addItem(), but has not been announced yet.
+     */
+    bool isPending(const KFileItem& item) const;
+
+    /**
+     * Removes all items from the queue, which are not handled by a
+     * worker thread already.
+     */
+    void clear();
+
+    /**
+     * @return A copy of \a item with the MIME type \a mimeType.
+     */
+    static KFileItem itemWithMimeType(const KFileItem& item, const QString& mimeType);
+
+signals:
+    void mimeTypeResolved(const KFileItem& item, const QString& mimeType);
+
+private slots:
+    void slotWorkerFinished();
+
+private:
+    void startWorkers();
+
+    /**
+     * Determines the MIME type of the local file \a path. Is invoked
+     * in a worker thread. The result is never empty, even if the file
+     * cannot be accessed.
+     */
+    static QString determineMimeType(const QString& path);
+
+private:
+    QList<KFileItem> m_queue;
+    QSet<KFileItem> m_pendingItems;
+    QHash<QFutureWatcher<QString>*, KFileItem> m_workers;
+};
+
+#endif
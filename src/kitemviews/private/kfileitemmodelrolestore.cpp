@@ -0,0 +1,155 @@
+/***************************************************************************
+ *   Copyright (C) 2017 by agent <agent@local>                             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA            *
+ ***************************************************************************/
+
+#include "kfileitemmodelrolestore.h"
+
+const qint64 KFileItemModelRoleStore::NoNumber;
+const qint64 KFileItemModelRoleStore::InvalidDateTime;
+
+KFileItemModelRoleStore::KFileItemModelRoleStore() :
+    m_flags(),
+    m_expandedParentsCounts(),
+    m_freeSlots(),
+    m_strings(),
+    m_idsForStrings()
+{
+}
+
+KFileItemModelRoleStore::~KFileItemModelRoleStore()
+{
+}
+
+int KFileItemModelRoleStore::allocate()
+{
+    if (!m_freeSlots.isEmpty()) {
+        const int slot = m_freeSlots.takeLast();
+        reset(slot);
+        return slot;
+    }
+
+    const int slot = m_flags.count();
+    m_flags.append(0);
+    for (int column = 0; column < NumberColumnCount; ++column) {
+        m_numbers[column].append(NoNumber);
+    }
+    m_expandedParentsCounts.append(-1);
+    for (int column = 0; column < StringColumnCount; ++column) {
+        m_stringIds[column].append(-1);
+    }
+
+    return slot;
+}
+
+void KFileItemModelRoleStore::release(int slot)
+{
+    Q_ASSERT(slot >= 0 && slot < m_flags.count());
+    m_freeSlots.append(slot);
+}
+
+void KFileItemModelRoleStore::reset(int slot)
+{
+    m_flags[slot] = 0;
+    for (int column = 0; column < NumberColumnCount; ++column) {
+        m_numbers[column][slot] = NoNumber;
+    }
+    m_expandedParentsCounts[slot] = -1;
+    for (int column = 0; column < StringColumnCount; ++column) {
+        m_stringIds[column][slot] = -1;
+    }
+}
+
+void KFileItemModelRoleStore::clear()
+{
+    m_flags.clear();
+    for (int column = 0; column < NumberColumnCount; ++column) {
+        m_numbers[column].clear();
+    }
+    m_expandedParentsCounts.clear();
+    for (int column = 0; column < StringColumnCount; ++column) {
+        m_stringIds[column].clear();
+    }
+    m_freeSlots.clear();
+
+    // The interned strings are kept: Owners, groups, types and
+    // icon names are very likely to be used again when the next
+    // directory is loaded.
+}
+
+void KFileItemModelRoleStore::setFlag(int slot, Flag flag, bool enabled)
+{
+    quint16& flags = m_flags[slot];
+    flags |= (flag << 8);
+    if (enabled) {
+        flags |= flag;
+    } else {
+        flags &= ~flag;
+    }
+}
+
+void KFileItemModelRoleStore::unsetFlag(int slot, Flag flag)
+{
+    m_flags[slot] &= ~(flag | (flag << 8));
+}
+
+void KFileItemModelRoleStore::setNumber(NumberColumn column, int slot, qint64 value)
+{
+    m_numbers[column][slot] = value;
+}
+
+QDateTime KFileItemModelRoleStore::dateTime(NumberColumn column, int slot) const
+{
+    const qint64 value = m_numbers[column].at(slot);
+    if (value == NoNumber || value == InvalidDateTime) {
+        return QDateTime();
+    }
+    return QDateTime::fromMSecsSinceEpoch(value);
+}
+
+void KFileItemModelRoleStore::setDateTime(NumberColumn column, int slot, const QDateTime& dateTime)
+{
+    m_numbers[column][slot] = dateTime.isValid() ? dateTime.toMSecsSinceEpoch() : InvalidDateTime;
+}
+
+void KFileItemModelRoleStore::setExpandedParentsCount(int slot, int count)
+{
+    m_expandedParentsCounts[slot] = count;
+}
+
+void KFileItemModelRoleStore::setString(StringColumn column, int slot, const QString& value)
+{
+    m_stringIds[column][slot] = internString(value);
+}
+
+void KFileItemModelRoleStore::unsetString(StringColumn column, int slot)
+{
+    m_stringIds[column][slot] = -1;
+}
+
+int KFileItemModelRoleStore::internString(const QString& value)
+{
+    const QHash<QString, int>::const_iterator it = m_idsForStrings.constFind(value);
+    if (it != m_idsForStrings.constEnd()) {
+        return it.value();
+    }
+
+    const int id = m_strings.count();
+    m_strings.append(value);
+    m_idsForStrings.insert(value, id);
+    return id;
+}
@@ -0,0 +1,220 @@
+/***************************************************************************
+ *   Copyright (C) 2017 by agent <agent@local>                             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA            *
+ ***************************************************************************/
+
+#ifndef KFILEITEMMODELROLESTORE_H
+#define KFILEITEMMODELROLESTORE_H
+
+#include "dolphin_export.h"
+
+#include <QDateTime>
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+#include <limits>
+
+/**
+ * @brief Column-oriented storage for the role values of KFileItemModel.
+ *
+ * Storing the values of each item in a QHash<QByteArray, QVariant> requires
+ * a heap allocation per item and a QVariant per value. Instead, the frequently
+ * used roles are stored in dense arrays ("columns"): numbers and times are
+ * stored as qint64, boolean roles as bits, and strings with only few distinct
+ * values (e.g. owner, group and type) as ids of interned strings.
+ *
+ * Each item gets a slot by allocate(), which is the index of the item's
+ * values in all columns. The slot stays valid until it is passed to
+ * release(), i.e., it does not change if the item is moved inside the model.
+ */
+class DOLPHIN_EXPORT KFileItemModelRoleStore
+{
+
+public:
+    enum Flag {
+        RetrievedFlag = 0x01,    // The values have been determined by KFileItemModel::retrieveData()
+        IsDirFlag = 0x02,
+        IsLinkFlag = 0x04,
+        IsHiddenFlag = 0x08,
+        IsExpandedFlag = 0x10,
+        IsExpandableFlag = 0x20,
+        IsRecursiveSizeFlag = 0x40  // The size of a directory is the size of its contents instead of the number of items
+    };
+
+    enum NumberColumn {
+        SizeColumn,
+        ModificationTimeColumn,
+        CreationTimeColumn,
+        AccessTimeColumn,
+        DeletionTimeColumn,
+        RatingColumn,
+        NumberColumnCount
+    };
+
+    enum StringColumn {
+        OwnerColumn,
+        GroupColumn,
+        TypeColumn,
+        PermissionsColumn,
+        IconNameColumn,
+        StringColumnCount
+    };
+
+    /**
+     * Value of a number column if no value has been set.
+     */
+    static const qint64 NoNumber = std::numeric_limits<qint64>::min();
+
+    /**
+     * Value of a time column that represents an invalid QDateTime.
+     */
+    static const qint64 InvalidDateTime = std::numeric_limits<qint64>::min() + 1;
+
+    KFileItemModelRoleStore();
+    ~KFileItemModelRoleStore();
+
+    /**
+     * @return A new slot without any values.
+     */
+    int allocate();
+
+    /**
+     * Marks \a slot as unused. It might be returned again by allocate().
+     */
+    void release(int slot);
+
+    /**
+     * Resets all values of \a slot.
+     */
+    void reset(int slot);
+
+    /**
+     * Releases all slots.
+     */
+    void clear();
+
+    /**
+     * @return True if the boolean value \a flag has been set for \a slot.
+     */
+    bool hasFlag(int slot, Flag flag) const;
+
+    /**
+     * @return The boolean value \a flag of \a slot. False is returned
+     *         if no value has been set.
+     */
+    bool testFlag(int slot, Flag flag) const;
+
+    void setFlag(int slot, Flag flag, bool enabled);
+    void unsetFlag(int slot, Flag flag);
+
+    /**
+     * @return The value of \a column for \a slot, or NoNumber if
+     *         no value has been set.
+     */
+    qint64 number(NumberColumn column, int slot) const;
+    void setNumber(NumberColumn column, int slot, qint64 value);
+
+    /**
+     * Helper methods to store a QDateTime in one of the time columns. The
+     * times are stored as milliseconds since the epoch, which allows to
+     * compare them without any conversion.
+     */
+    QDateTime dateTime(NumberColumn column, int slot) const;
+    void setDateTime(NumberColumn column, int slot, const QDateTime& dateTime);
+
+    /**
+     * @return The number of expanded parents of \a slot, or -1 if no
+     *         value has been set.
+     */
+    int expandedParentsCount(int slot) const;
+    void setExpandedParentsCount(int slot, int count);
+
+    /**
+     * @return The id of the interned string in \a column for \a slot, or -1
+     *         if no value has been set. Equal strings always have the same id.
+     */
+    int stringId(StringColumn column, int slot) const;
+
+    /**
+     * @return The string in \a column for \a slot. A null string is returned
+     *         if no value has been set.
+     */
+    QString string(StringColumn column, int slot) const;
+
+    void setString(StringColumn column, int slot, const QString& value);
+    void unsetString(StringColumn column, int slot);
+
+    /**
+     * @return The interned string with the id \a id, or a null string if
+     *         \a id is -1.
+     */
+    QString stringForId(int id) const;
+
+private:
+    int internString(const QString& value);
+
+private:
+    // Each flag uses two bits: The lower byte contains the value of the flag,
+    // the upper byte indicates whether the value has been set at all.
+    QVector<quint16> m_flags;
+    QVector<qint64> m_numbers[NumberColumnCount];
+    QVector<qint16> m_expandedParentsCounts;
+    QVector<int> m_stringIds[StringColumnCount];
+
+    QVector<int> m_freeSlots;
+
+    QVector<QString> m_strings;
+    QHash<QString, int> m_idsForStrings;
+};
+
+inline bool KFileItemModelRoleStore::hasFlag(int slot, Flag flag) const
+{
+    return m_flags.at(slot) & (flag << 8);
+}
+
+inline bool KFileItemModelRoleStore::testFlag(int slot, Flag flag) const
+{
+    return m_flags.at(slot) & flag;
+}
+
+inline qint64 KFileItemModelRoleStore::number(NumberColumn column, int slot) const
+{
+    return m_numbers[column].at(slot);
+}
+
+inline int KFileItemModelRoleStore::expandedParentsCount(int slot) const
+{
+    return m_expandedParentsCounts.at(slot);
+}
+
+inline int KFileItemModelRoleStore::stringId(StringColumn column, int slot) const
+{
+    return m_stringIds[column].at(slot);
+}
+
+inline QString KFileItemModelRoleStore::stringForId(int id) const
+{
+    return id < 0 ? QString() : m_strings.at(id);
+}
+
+inline QString KFileItemModelRoleStore::string(StringColumn column, int slot) const
+{
+    return stringForId(m_stringIds[column].at(slot));
+}
+
+#endif
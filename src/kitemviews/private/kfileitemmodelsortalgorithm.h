@@ -22,6 +22,8 @@
 #ifndef KFILEITEMMODELSORTALGORITHM_H
 #define KFILEITEMMODELSORTALGORITHM_H
 
+#include <QAtomicInt>
+#include <QVector>
 #include <QtConcurrent/QtConcurrent>
 
 #include <algorithm>
@@ -53,13 +55,60 @@ static void mergeSort(RandomAccessIterator begin,
     merge(begin, middle, end, lessThan);
 }
 
+/**
+ * Executes \a task for the indexes 0 to \a taskCount - 1 with up to
+ * \a numberOfThreads threads, including the calling thread. Each thread
+ * takes the next task that has not been started yet as soon as it has
+ * finished its previous task. This assures that no thread is idle while
+ * other threads still have a lot of work to do, even if the tasks need
+ * different amounts of time.
+ *
+ * Each thread passes its own copy of \a lessThan to \a task, such that
+ * \a lessThan may use members which are not thread-safe (e.g. a QCollator).
+ */
+
+template <typename LessThan, typename Task>
+static void runParallelSortTasks(int taskCount,
+                                 int numberOfThreads,
+                                 const LessThan& lessThan,
+                                 const Task& task)
+{
+    QAtomicInt nextTask(0);
+    auto processTasks = [&nextTask, taskCount, &task](LessThan threadLessThan) {
+        int index;
+        while ((index = nextTask.fetchAndAddRelaxed(1)) < taskCount) {
+            task(index, threadLessThan);
+        }
+    };
+
+    const int threadCount = qMin(numberOfThreads, taskCount);
+    QVector<QFuture<void> > futures;
+    futures.reserve(threadCount - 1);
+    for (int i = 1; i < threadCount; ++i) {
+        futures.append(QtConcurrent::run([&processTasks, lessThan]() {
+            processTasks(lessThan);
+        }));
+    }
+
+    processTasks(lessThan);
+
+    foreach (QFuture<void> future, futures) {
+        future.waitForFinished();
+    }
+}
+
 /**
  * Uses up to \a numberOfThreads threads to sort the items between
- * \a begin and \a end. Only item ranges longer than
- * \a parallelMergeSortingThreshold are split to be sorted by two different
- * threads.
+ * \a begin and \a end. The sorting is stable.
  *
- * The comparison function \a lessThan must be reentrant.
+ * The items are split into a few runs per thread, which are at least
+ * \a parallelMergeSortingThreshold items long. The runs are sorted by
+ * runParallelSortTasks(), and pairs of adjacent runs are merged until a
+ * single run is left. If fewer pairs than threads are left, each merge is
+ * split into independent merges of smaller ranges, such that all threads
+ * are used until the end.
+ *
+ * The comparison function \a lessThan must be reentrant if it is copied.
  */
 
 template <typename RandomAccessIterator, typename LessThan>
@@ -70,19 +119,83 @@ static void parallelMergeSort(RandomAccessIterator begin,
                               int parallelMergeSortingThreshold = 100)
 {
     const int span = end - begin;
+    if (numberOfThreads < 2 || span <= parallelMergeSortingThreshold) {
+        mergeSort(begin, end, lessThan);
+        return;
+    }
 
-    if (numberOfThreads > 1 && span > parallelMergeSortingThreshold) {
-        const int newNumberOfThreads = numberOfThreads / 2;
-        const RandomAccessIterator middle = begin + span / 2;
+    // Using more runs than threads assures that a thread which has
+    // finished early can take over a run that has not been started yet.
+    const int runCount = qMin(numberOfThreads * 4, span / parallelMergeSortingThreshold);
 
-        QFuture<void> future = QtConcurrent::run(parallelMergeSort<RandomAccessIterator, LessThan>, begin, middle, lessThan, newNumberOfThreads, parallelMergeSortingThreshold);
-        parallelMergeSort(middle, end, lessThan, newNumberOfThreads, parallelMergeSortingThreshold);
+    QVector<RandomAccessIterator> bounds;
+    bounds.reserve(runCount + 1);
+    for (int i = 0; i < runCount; ++i) {
+        bounds.append(begin + static_cast<int>(static_cast<qint64>(span) * i / runCount));
+    }
+    bounds.append(end);
 
-        future.waitForFinished();
+    runParallelSortTasks(runCount, numberOfThreads, lessThan,
+                         [&bounds](int index, const LessThan& threadLessThan) {
+        mergeSort(bounds.at(index), bounds.at(index + 1), threadLessThan);
+    });
 
-        merge(begin, middle, end, lessThan);
-    } else {
-        mergeSort(begin, end, lessThan);
+    struct MergeTask {
+        RandomAccessIterator begin;
+        RandomAccessIterator pivot;
+        RandomAccessIterator end;
+    };
+
+    while (bounds.count() > 2) {
+        QVector<MergeTask> tasks;
+        QVector<RandomAccessIterator> mergedBounds;
+        const int lastBound = bounds.count() - 1;
+        for (int i = 0; i < lastBound; i += 2) {
+            mergedBounds.append(bounds.at(i));
+            if (i + 2 <= lastBound) {
+                tasks.append({bounds.at(i), bounds.at(i + 1), bounds.at(i + 2)});
+            }
+        }
+        mergedBounds.append(end);
+
+        // Split the merges until there is enough work for all threads. A merge
+        // of the ranges [begin, pivot) and [pivot, end) is split by moving the
+        // items of the second range that belong in front of the middle of the
+        // first range there. This results in two independent merges, see merge().
+        while (tasks.count() < numberOfThreads) {
+            QVector<MergeTask> splitTasks;
+            foreach (const MergeTask& task, tasks) {
+                const int len1 = task.pivot - task.begin;
+                const int len2 = task.end - task.pivot;
+                if (len1 + len2 <= parallelMergeSortingThreshold || len1 == 0 || len2 == 0) {
+                    splitTasks.append(task);
+                    continue;
+                }
+
+                const RandomAccessIterator firstCut = task.begin + len1 / 2;
+                const RandomAccessIterator secondCut = std::lower_bound<RandomAccessIterator,
+                    decltype(*firstCut), const LessThan&>(task.pivot, task.end, *firstCut, lessThan);
+                std::rotate(firstCut, task.pivot, secondCut);
+
+                const RandomAccessIterator newPivot = firstCut + (secondCut - task.pivot);
+                splitTasks.append({task.begin, firstCut, newPivot});
+                splitTasks.append({newPivot, secondCut, task.end});
+            }
+
+            if (splitTasks.count() == tasks.count()) {
+                // All merges are too small to be split.
+                break;
+            }
+            tasks = splitTasks;
+        }
+
+        runParallelSortTasks(tasks.count(), numberOfThreads, lessThan,
+                             [&tasks](int index, const LessThan& threadLessThan) {
+            const MergeTask& task = tasks.at(index);
+            merge(task.begin, task.pivot, task.end, threadLessThan);
+        });
+
+        bounds = mergedBounds;
     }
 }
 
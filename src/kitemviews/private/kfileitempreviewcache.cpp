@@ -0,0 +1,310 @@
+/***************************************************************************
+ *   Copyright (C) 2017 by agent <agent@local>                             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA            *
+ ***************************************************************************/
+
+#include "kfileitempreviewcache.h"
+
+#include <KFileItem>
+
+#include <QApplication>
+#include <QAtomicInt>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QImage>
+#include <QPixmap>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QtConcurrent/QtConcurrentRun>
+
+#include <cmath>
+#include <cstring>
+
+#ifdef Q_OS_UNIX
+#include <utime.h>
+#else
+#include <sys/utime.h>
+#endif
+
+namespace {
+    // Maximum size in bytes of all cached previews. The oldest previews are
+    // removed when the cache is opened the first time, and each time after
+    // CleanUpInterval previews have been added.
+    const qint64 MaxCacheSize = 512 * 1024 * 1024;
+    const int CleanUpInterval = 1000;
+
+    // Number of files used by pixmap() whose access times are
+    // updated together by a worker thread.
+    const int UsedFilesBatchSize = 100;
+
+    const quint32 CacheFileMagic = 0x44505643; // "DPVC"
+    const quint32 CacheFileVersion = 1;
+
+    // Limits for the values of a cache file header. Files with other
+    // values are corrupt and are ignored.
+    const qint32 MaxPreviewExtent = 4096;
+    const double MaxDevicePixelRatio = 16.0;
+
+    // Header of each cache file, which is followed by the
+    // pixel data of the image.
+    struct CacheFileHeader
+    {
+        quint32 magic;
+        quint32 version;
+        qint32 width;
+        qint32 height;
+        qint32 bytesPerLine;
+        qint32 format;
+        double devicePixelRatio;
+    };
+
+    QAtomicInt s_cacheCleanedUp(0);
+    QAtomicInt s_insertedPreviews(0);
+
+    bool isValid(const CacheFileHeader& header, qint64 fileSize)
+    {
+        if (header.magic != CacheFileMagic || header.version != CacheFileVersion) {
+            return false;
+        }
+
+        // insert() only stores images with this format.
+        if (header.format != QImage::Format_ARGB32_Premultiplied) {
+            return false;
+        }
+
+        if (header.width <= 0 || header.width > MaxPreviewExtent ||
+            header.height <= 0 || header.height > MaxPreviewExtent ||
+            header.bytesPerLine < header.width * 4 || header.bytesPerLine % 4 != 0 ||
+            header.bytesPerLine > MaxPreviewExtent * 4) {
+            return false;
+        }
+
+        if (!std::isfinite(header.devicePixelRatio) || header.devicePixelRatio <= 0 ||
+            header.devicePixelRatio > MaxDevicePixelRatio) {
+            return false;
+        }
+
+        return fileSize == qint64(sizeof(CacheFileHeader)) + qint64(header.bytesPerLine) * header.height;
+    }
+
+    /**
+     * Sets the modification time of the file \a path to the current time,
+     * so that removeOldestFiles() removes the least recently used files.
+     */
+    void touch(const QString& path)
+    {
+#ifdef Q_OS_UNIX
+        utime(QFile::encodeName(path).constData(), 0);
+#elif defined(Q_OS_WIN)
+        _wutime(reinterpret_cast<const wchar_t *>(path.utf16()), 0);
+#endif
+    }
+}
+
+KFileItemPreviewCache::KFileItemPreviewCache() :
+    m_path(),
+    m_iconSize(),
+    m_enlargeSmallPreviews(true),
+    m_enabledPlugins(),
+    m_maximumRemoteSize(0),
+    m_usedFiles()
+{
+    m_path = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + QLatin1String("/previews/");
+    QDir().mkpath(m_path);
+
+    if (s_cacheCleanedUp.testAndSetRelaxed(0, 1)) {
+        QtConcurrent::run(&KFileItemPreviewCache::removeOldestFiles, m_path, MaxCacheSize);
+    }
+}
+
+KFileItemPreviewCache::~KFileItemPreviewCache()
+{
+    flushUsedFiles();
+}
+
+void KFileItemPreviewCache::setIconSize(const QSize& size)
+{
+    m_iconSize = size;
+}
+
+void KFileItemPreviewCache::setEnlargeSmallPreviews(bool enlarge)
+{
+    m_enlargeSmallPreviews = enlarge;
+}
+
+void KFileItemPreviewCache::setEnabledPlugins(const QStringList& list)
+{
+    m_enabledPlugins = list;
+}
+
+void KFileItemPreviewCache::setMaximumRemoteSize(KIO::filesize_t size)
+{
+    m_maximumRemoteSize = size;
+}
+
+QPixmap KFileItemPreviewCache::pixmap(const KFileItem& item)
+{
+    const QString name = fileName(item);
+    if (name.isEmpty()) {
+        return QPixmap();
+    }
+
+    QFile file(name);
+    if (!file.open(QIODevice::ReadOnly) || file.size() < qint64(sizeof(CacheFileHeader))) {
+        return QPixmap();
+    }
+
+    const uchar* data = file.map(0, file.size());
+    if (!data) {
+        return QPixmap();
+    }
+
+    CacheFileHeader header;
+    memcpy(&header, data, sizeof(CacheFileHeader));
+
+    if (!isValid(header, file.size())) {
+        file.unmap(const_cast<uchar*>(data));
+        file.close();
+        file.remove();
+        return QPixmap();
+    }
+
+    // The image uses the memory mapped data without copying it. Converting
+    // the image to a pixmap creates a copy, so the file can be unmapped afterwards.
+    const QImage image(data + sizeof(CacheFileHeader), header.width, header.height,
+                       header.bytesPerLine, static_cast<QImage::Format>(header.format));
+    QPixmap pixmap = QPixmap::fromImage(image);
+    pixmap.setDevicePixelRatio(header.devicePixelRatio);
+
+    file.unmap(const_cast<uchar*>(data));
+    file.close();
+
+    m_usedFiles.append(name);
+    if (m_usedFiles.count() >= UsedFilesBatchSize) {
+        flushUsedFiles();
+    }
+
+    return pixmap;
+}
+
+void KFileItemPreviewCache::flushUsedFiles()
+{
+    if (!m_usedFiles.isEmpty()) {
+        QtConcurrent::run(&KFileItemPreviewCache::touchFiles, m_usedFiles);
+        m_usedFiles.clear();
+    }
+}
+
+void KFileItemPreviewCache::insert(const KFileItem& item, const QImage& image)
+{
+    const QString name = fileName(item);
+    if (image.isNull() || name.isEmpty()) {
+        return;
+    }
+
+    QImage convertedImage = image;
+    if (convertedImage.format() != QImage::Format_ARGB32_Premultiplied) {
+        convertedImage = convertedImage.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+        convertedImage.setDevicePixelRatio(image.devicePixelRatio());
+    }
+
+    QtConcurrent::run(&KFileItemPreviewCache::writeImage, name, convertedImage);
+
+    if (s_insertedPreviews.fetchAndAddRelaxed(1) % CleanUpInterval == CleanUpInterval - 1) {
+        QtConcurrent::run(&KFileItemPreviewCache::removeOldestFiles, m_path, MaxCacheSize);
+    }
+}
+
+QString KFileItemPreviewCache::fileName(const KFileItem& item) const
+{
+    // Like KIO::PreviewJob, don't store previews of remote files or of
+    // files inside a cache, as this would copy their contents to the disk.
+    if (!item.url().isLocalFile()) {
+        return QString();
+    }
+
+    const QString localPath = item.url().toLocalFile();
+    const QString genericCachePath = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + QLatin1Char('/');
+    if (localPath.startsWith(m_path) || localPath.startsWith(genericCachePath)) {
+        return QString();
+    }
+
+    if (item.isSlow() && (m_maximumRemoteSize == 0 || item.size() > m_maximumRemoteSize)) {
+        // The file is on a network mount.
+        return QString();
+    }
+
+    // Without a modification time, it cannot be checked whether a cached
+    // preview is up-to-date.
+    const QDateTime modificationTime = item.time(KFileItem::ModificationTime);
+    if (!modificationTime.isValid()) {
+        return QString();
+    }
+
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    hash.addData(item.url().toEncoded());
+    hash.addData(QByteArray::number(modificationTime.toMSecsSinceEpoch()));
+    hash.addData(QByteArray::number(m_iconSize.width()));
+    hash.addData(QByteArray::number(m_iconSize.height()));
+    hash.addData(QByteArray::number(qApp->devicePixelRatio()));
+    hash.addData(m_enlargeSmallPreviews ? "1" : "0");
+    hash.addData(m_enabledPlugins.join(QLatin1Char(',')).toUtf8());
+
+    return m_path + QString::fromLatin1(hash.result().toHex());
+}
+
+void KFileItemPreviewCache::writeImage(const QString& fileName, const QImage& image)
+{
+    CacheFileHeader header;
+    header.magic = CacheFileMagic;
+    header.version = CacheFileVersion;
+    header.width = image.width();
+    header.height = image.height();
+    header.bytesPerLine = image.bytesPerLine();
+    header.format = image.format();
+    header.devicePixelRatio = image.devicePixelRatio();
+
+    QSaveFile file(fileName);
+    if (file.open(QIODevice::WriteOnly)) {
+        file.write(reinterpret_cast<const char*>(&header), sizeof(CacheFileHeader));
+        file.write(reinterpret_cast<const char*>(image.constBits()), qint64(image.bytesPerLine()) * image.height());
+        file.commit();
+    }
+}
+
+void KFileItemPreviewCache::touchFiles(const QStringList& fileNames)
+{
+    foreach (const QString& fileName, fileNames) {
+        touch(fileName);
+    }
+}
+
+void KFileItemPreviewCache::removeOldestFiles(const QString& path, qint64 maximumSize)
+{
+    // The files are sorted by their modification time, the newest file first.
+    const QFileInfoList files = QDir(path).entryInfoList(QDir::Files, QDir::Time);
+
+    qint64 cacheSize = 0;
+    foreach (const QFileInfo& fileInfo, files) {
+        cacheSize += fileInfo.size();
+        if (cacheSize > maximumSize) {
+            QFile::remove(fileInfo.absoluteFilePath());
+        }
+    }
+}
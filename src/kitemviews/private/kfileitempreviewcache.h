@@ -0,0 +1,129 @@
+/***************************************************************************
+ *   Copyright (C) 2017 by agent <agent@local>                             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA            *
+ ***************************************************************************/
+
+#ifndef KFILEITEMPREVIEWCACHE_H
+#define KFILEITEMPREVIEWCACHE_H
+
+#include "dolphin_export.h"
+
+#include <KIO/Global>
+
+#include <QSize>
+#include <QString>
+#include <QStringList>
+
+class KFileItem;
+class QImage;
+class QPixmap;
+
+/**
+ * @brief Persistent cache for the previews shown by KFileItemModelRolesUpdater.
+ *
+ * KIO::PreviewJob only caches thumbnails with a size of 128 x 128 or
+ * 256 x 256 pixels, which must be scaled and framed again each time a
+ * directory is opened. KFileItemPreviewCache stores the final pixmaps
+ * instead, i.e., after they have been scaled and framed for the current
+ * icon size and device pixel ratio. Icon overlays are not part of the
+ * cached pixmaps, as they might change independently of the file.
+ *
+ * Each pixmap is stored uncompressed in a separate file, which is memory
+ * mapped when the pixmap is loaded. Hence loading a pixmap does not require
+ * any decoding or scaling. The key of a pixmap contains the URL and the
+ * modification time of the file, so a preview is not used anymore after
+ * the file has been changed. If the cache exceeds its maximum size,
+ * the pixmaps that have not been used for the longest time are removed.
+ * Cache files with an invalid header are ignored and removed.
+ *
+ * Like the thumbnail cache of KIO, only previews of local files are cached,
+ * but not of files inside a cache directory. Previews of files on network
+ * mounts are only cached if the file does not exceed the maximum size
+ * for remote previews.
+ */
+class DOLPHIN_EXPORT KFileItemPreviewCache
+{
+
+public:
+    KFileItemPreviewCache();
+    ~KFileItemPreviewCache();
+
+    /**
+     * Sets the parameters that affect the look of the previews. They
+     * are part of the key of each pixmap.
+     */
+    void setIconSize(const QSize& size);
+    void setEnlargeSmallPreviews(bool enlarge);
+    void setEnabledPlugins(const QStringList& list);
+
+    /**
+     * Sets the maximum size of files on network mounts whose previews are
+     * cached. If \a size is 0, no previews of such files are cached.
+     */
+    void setMaximumRemoteSize(KIO::filesize_t size);
+
+    /**
+     * @return The cached preview for \a item, or a null pixmap if
+     *         there is no up-to-date preview in the cache. The access times of
+     *         the used files are updated in a worker thread for several files
+     *         at once, see flushUsedFiles().
+     */
+    QPixmap pixmap(const KFileItem& item);
+
+    /**
+     * Updates the access times of the files that have been used by pixmap()
+     * in a worker thread. This is done automatically if enough files have
+     * been used, and when the cache is destroyed.
+     */
+    void flushUsedFiles();
+
+    /**
+     * Stores the preview \a image for \a item. The file is written
+     * in a worker thread.
+     */
+    void insert(const KFileItem& item, const QImage& image);
+
+private:
+    /**
+     * @return The name of the file that contains the preview for \a item, or
+     *         an empty string if the preview of \a item cannot be cached.
+     */
+    QString fileName(const KFileItem& item) const;
+
+    static void writeImage(const QString& fileName, const QImage& image);
+    static void touchFiles(const QStringList& fileNames);
+
+    /**
+     * Removes the least recently used files inside the directory \a path
+     * until the size of all files does not exceed \a maximumSize.
+     */
+    static void removeOldestFiles(const QString& path, qint64 maximumSize);
+
+private:
+    QString m_path;
+    QSize m_iconSize;
+    bool m_enlargeSmallPreviews;
+    QStringList m_enabledPlugins;
+    KIO::filesize_t m_maximumRemoteSize;
+
+    // Files which have been used by pixmap() since the last flushUsedFiles()
+    QStringList m_usedFiles;
+
+    friend class KFileItemPreviewCacheTest; // For accessing fileName() and removeOldestFiles()
+};
+
+#endif
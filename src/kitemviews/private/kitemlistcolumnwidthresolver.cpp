@@ -0,0 +1,179 @@
+/***************************************************************************
+ *   Copyright (C) 2017 by agent <agent@local>                             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA            *
+ ***************************************************************************/
+
+#include "kitemlistcolumnwidthresolver.h"
+
+#include <kitemviews/kitemlistview.h>
+
+#include <QElapsedTimer>
+
+namespace {
+    // Maximum time in ms for calculating the widths of items. When having
+    // several thousands of items calculating the widths can get very expensive.
+    // We accept a possibly too small column width in favour of having no
+    // blocking user interface.
+    const int MaxCalculationTime = 200;
+}
+
+KItemListColumnWidthResolver::KItemListColumnWidthResolver(const KItemListView* itemListView) :
+    m_itemListView(itemListView),
+    m_roleWidths()
+{
+}
+
+KItemListColumnWidthResolver::~KItemListColumnWidthResolver()
+{
+}
+
+QHash<QByteArray, qreal> KItemListColumnWidthResolver::preferredColumnWidths(const QList<QByteArray>& roles)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    const KItemListWidgetCreatorBase* creator = m_itemListView->widgetCreator();
+    const int itemCount = m_itemListView->model()->count();
+
+    // The cached widths of other roles are not updated when items are
+    // changed, so they must be removed.
+    QHash<QByteArray, RoleWidths>::iterator cachedIt = m_roleWidths.begin();
+    while (cachedIt != m_roleWidths.end()) {
+        if (roles.contains(cachedIt.key())) {
+            ++cachedIt;
+        } else {
+            cachedIt = m_roleWidths.erase(cachedIt);
+        }
+    }
+
+    QHash<QByteArray, qreal> widths;
+    int calculatedItemCount = 0;
+    bool maxTimeExceeded = false;
+    foreach (const QByteArray& role, roles) {
+        QHash<QByteArray, RoleWidths>::iterator it = m_roleWidths.find(role);
+        if (it == m_roleWidths.end()) {
+            it = m_roleWidths.insert(role, RoleWidths());
+            it->itemWidths.fill(-1, itemCount);
+        }
+
+        RoleWidths& roleWidths = it.value();
+        Q_ASSERT(roleWidths.itemWidths.count() == itemCount);
+
+        for (int i = 0; i < itemCount && !maxTimeExceeded; ++i) {
+            if (roleWidths.itemWidths.at(i) >= 0) {
+                continue;
+            }
+
+            const qreal width = creator->preferredRoleColumnWidth(role, i, m_itemListView);
+            roleWidths.itemWidths[i] = width;
+            addWidth(roleWidths, width);
+
+            ++calculatedItemCount;
+            if (calculatedItemCount > 100 && timer.elapsed() > MaxCalculationTime) {
+                maxTimeExceeded = true;
+            }
+        }
+
+        widths.insert(role, roleWidths.itemCounts.isEmpty() ? 0.0 : roleWidths.itemCounts.lastKey());
+    }
+
+    return widths;
+}
+
+void KItemListColumnWidthResolver::itemsInserted(const KItemRangeList& itemRanges)
+{
+    QHash<QByteArray, RoleWidths>::iterator it = m_roleWidths.begin();
+    for (; it != m_roleWidths.end(); ++it) {
+        QVector<qreal>& itemWidths = it->itemWidths;
+
+        // The ranges are sorted and range.index is related to the model
+        // before anything has been inserted.
+        int previouslyInsertedCount = 0;
+        foreach (const KItemRange& range, itemRanges) {
+            itemWidths.insert(range.index + previouslyInsertedCount, range.count, -1);
+            previouslyInsertedCount += range.count;
+        }
+    }
+}
+
+void KItemListColumnWidthResolver::itemsRemoved(const KItemRangeList& itemRanges)
+{
+    QHash<QByteArray, RoleWidths>::iterator it = m_roleWidths.begin();
+    for (; it != m_roleWidths.end(); ++it) {
+        RoleWidths& roleWidths = it.value();
+        QVector<qreal>& itemWidths = roleWidths.itemWidths;
+
+        // Remove the ranges from the end to keep the indexes of the
+        // remaining ranges valid.
+        for (int i = itemRanges.count() - 1; i >= 0; --i) {
+            const KItemRange& range = itemRanges.at(i);
+            for (int index = range.index; index < range.index + range.count; ++index) {
+                removeWidth(roleWidths, itemWidths.at(index));
+            }
+            itemWidths.remove(range.index, range.count);
+        }
+    }
+}
+
+void KItemListColumnWidthResolver::itemsMoved(const KItemRange& range, const QList<int>& movedToIndexes)
+{
+    QHash<QByteArray, RoleWidths>::iterator it = m_roleWidths.begin();
+    for (; it != m_roleWidths.end(); ++it) {
+        QVector<qreal>& itemWidths = it->itemWidths;
+        const QVector<qreal> previousItemWidths = itemWidths;
+
+        for (int i = range.index; i < range.index + range.count; ++i) {
+            itemWidths[movedToIndexes.at(i - range.index)] = previousItemWidths.at(i);
+        }
+    }
+}
+
+void KItemListColumnWidthResolver::itemsChanged(int index, int count)
+{
+    QHash<QByteArray, RoleWidths>::iterator it = m_roleWidths.begin();
+    for (; it != m_roleWidths.end(); ++it) {
+        RoleWidths& roleWidths = it.value();
+        for (int i = index; i < index + count; ++i) {
+            removeWidth(roleWidths, roleWidths.itemWidths.at(i));
+            roleWidths.itemWidths[i] = -1;
+        }
+    }
+}
+
+void KItemListColumnWidthResolver::clearCache()
+{
+    m_roleWidths.clear();
+}
+
+void KItemListColumnWidthResolver::addWidth(RoleWidths& roleWidths, qreal width)
+{
+    ++roleWidths.itemCounts[width];
+}
+
+void KItemListColumnWidthResolver::removeWidth(RoleWidths& roleWidths, qreal width)
+{
+    if (width < 0) {
+        // The width has not been calculated yet.
+        return;
+    }
+
+    QMap<qreal, int>::iterator it = roleWidths.itemCounts.find(width);
+    Q_ASSERT(it != roleWidths.itemCounts.end());
+    if (--it.value() == 0) {
+        roleWidths.itemCounts.erase(it);
+    }
+}
@@ -0,0 +1,79 @@
+/***************************************************************************
+ *   Copyright (C) 2017 by agent <agent@local>                             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA            *
+ ***************************************************************************/
+
+#ifndef KITEMLISTCOLUMNWIDTHRESOLVER_H
+#define KITEMLISTCOLUMNWIDTHRESOLVER_H
+
+#include "dolphin_export.h"
+
+#include <kitemviews/kitemmodelbase.h>
+
+#include <QHash>
+#include <QMap>
+#include <QVector>
+
+class KItemListView;
+
+/**
+ * @brief Calculates and caches the preferred column widths of the items in KItemListView.
+ *
+ * The preferred width of each role is remembered for each item, and the
+ * number of items per width is kept in a sorted map. Hence the maximum width
+ * of a role is known without checking all items again, and only the widths of
+ * inserted or changed items must be calculated. Removing an item only
+ * requires decreasing the number of items with its width.
+ */
+class DOLPHIN_EXPORT KItemListColumnWidthResolver
+{
+public:
+    KItemListColumnWidthResolver(const KItemListView* itemListView);
+    virtual ~KItemListColumnWidthResolver();
+
+    /**
+     * @return The maximum preferred width of the items for each role of \a roles.
+     *         The widths of items that are not cached yet are calculated. If this
+     *         takes too long, some items are skipped and are calculated by the next
+     *         call. The cached widths of roles that are not part of \a roles are
+     *         removed.
+     */
+    QHash<QByteArray, qreal> preferredColumnWidths(const QList<QByteArray>& roles);
+
+    void itemsInserted(const KItemRangeList& itemRanges);
+    void itemsRemoved(const KItemRangeList& itemRanges);
+    void itemsMoved(const KItemRange& range, const QList<int>& movedToIndexes);
+    void itemsChanged(int index, int count);
+
+    void clearCache();
+
+private:
+    struct RoleWidths
+    {
+        QVector<qreal> itemWidths; // Contains -1 for items that must be calculated.
+        QMap<qreal, int> itemCounts; // Number of items for each width.
+    };
+
+    static void addWidth(RoleWidths& roleWidths, qreal width);
+    static void removeWidth(RoleWidths& roleWidths, qreal width);
+
+private:
+    const KItemListView* m_itemListView;
+    QHash<QByteArray, RoleWidths> m_roleWidths;
+};
+
+#endif
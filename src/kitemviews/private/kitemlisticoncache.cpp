@@ -0,0 +1,131 @@
+/***************************************************************************
+ *   Copyright (C) 2017 by agent <agent@local>                             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA            *
+ ***************************************************************************/
+
+#include "kitemlisticoncache.h"
+
+#include "dolphindebug.h"
+
+#include <QStringList>
+
+namespace {
+    // Default memory budget of the cache in kilobytes.
+    const int DefaultMaximumSize = 64 * 1024;
+
+    // Number of lookups after which the statistics are reported.
+    const int ReportInterval = 1000;
+}
+
+class KItemListIconCacheSingleton
+{
+public:
+    KItemListIconCache instance;
+};
+Q_GLOBAL_STATIC(KItemListIconCacheSingleton, s_iconCache)
+
+KItemListIconCache* KItemListIconCache::instance()
+{
+    return &s_iconCache->instance;
+}
+
+KItemListIconCache::KItemListIconCache() :
+    m_nameIds(),
+    m_overlaysIds(),
+    m_pixmaps(DefaultMaximumSize),
+    m_hits(0),
+    m_misses(0)
+{
+}
+
+KItemListIconCache::~KItemListIconCache()
+{
+}
+
+KItemListIconCache::Key KItemListIconCache::key(const QString& name, const QStringList& overlays, int size, QIcon::Mode mode)
+{
+    Key key;
+
+    QHash<QString, quint32>::const_iterator it = m_nameIds.constFind(name);
+    if (it == m_nameIds.constEnd()) {
+        it = m_nameIds.insert(name, m_nameIds.count());
+    }
+    key.name = it.value();
+
+    // Most items don't have any overlays. The ID 0 is reserved
+    // for them, so that no string must be built.
+    key.overlays = 0;
+    if (!overlays.isEmpty()) {
+        const QString joinedOverlays = overlays.join(QLatin1Char(':'));
+        it = m_overlaysIds.constFind(joinedOverlays);
+        if (it == m_overlaysIds.constEnd()) {
+            it = m_overlaysIds.insert(joinedOverlays, m_overlaysIds.count() + 1);
+        }
+        key.overlays = it.value();
+    }
+
+    key.size = size;
+    key.mode = mode;
+    return key;
+}
+
+QPixmap KItemListIconCache::find(const Key& key)
+{
+    const QPixmap* pixmap = m_pixmaps.object(key);
+    if (pixmap) {
+        ++m_hits;
+    } else {
+        ++m_misses;
+    }
+
+    if (m_hits + m_misses >= ReportInterval) {
+        reportStatistics();
+    }
+
+    return pixmap ? *pixmap : QPixmap();
+}
+
+void KItemListIconCache::insert(const Key& key, const QPixmap& pixmap)
+{
+    const int cost = qMax(1, pixmap.width() * pixmap.height() * pixmap.depth() / (8 * 1024));
+    m_pixmaps.insert(key, new QPixmap(pixmap), cost);
+}
+
+void KItemListIconCache::clear()
+{
+    // The ids of the names and overlays stay valid.
+    m_pixmaps.clear();
+}
+
+void KItemListIconCache::setMaximumSize(int kiloBytes)
+{
+    m_pixmaps.setMaxCost(kiloBytes);
+}
+
+int KItemListIconCache::maximumSize() const
+{
+    return m_pixmaps.maxCost();
+}
+
+void KItemListIconCache::reportStatistics()
+{
+    qCDebug(DolphinDebug) << "Icon cache:" << m_hits << "hits," << m_misses << "misses,"
+                          << m_pixmaps.count() << "icons using" << m_pixmaps.totalCost()
+                          << "of" << m_pixmaps.maxCost() << "KB";
+    m_hits = 0;
+    m_misses = 0;
+}
@@ -0,0 +1,120 @@
+/***************************************************************************
+ *   Copyright (C) 2017 by agent <agent@local>                             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA            *
+ ***************************************************************************/
+
+#ifndef KITEMLISTICONCACHE_H
+#define KITEMLISTICONCACHE_H
+
+#include "dolphin_export.h"
+
+#include <QCache>
+#include <QHash>
+#include <QIcon>
+#include <QPixmap>
+#include <QString>
+
+class QStringList;
+
+/**
+ * @brief Cache for the rendered theme icons of KStandardItemListWidget.
+ *
+ * Rendering an SVG icon of the theme is expensive. KItemListIconCache keeps
+ * the rendered icons of the whole session, so that switching between the
+ * view modes or zoom levels does not render an icon again. In contrast to
+ * the global QPixmapCache, the cache is not shared with the rest of Qt and
+ * has a memory budget that fits many icons in several sizes.
+ *
+ * The icons are identified by integer keys: The icon names and the
+ * combinations of overlays are mapped to numbers, which avoids building a
+ * string key for each lookup. If the memory budget is exceeded, the least
+ * recently used icons are removed.
+ *
+ * The numbers of hits and misses are reported to the DolphinDebug category
+ * from time to time.
+ */
+class DOLPHIN_EXPORT KItemListIconCache
+{
+public:
+    struct Key
+    {
+        quint32 name;
+        quint32 overlays;
+        quint32 size;
+        quint32 mode;
+    };
+
+    static KItemListIconCache* instance();
+
+    /**
+     * @return Key for the icon \a name with the overlays \a overlays,
+     *         the size \a size in device pixels and the mode \a mode.
+     */
+    Key key(const QString& name, const QStringList& overlays, int size, QIcon::Mode mode);
+
+    /**
+     * @return The cached icon for \a key, or a null pixmap if the
+     *         icon is not cached.
+     */
+    QPixmap find(const Key& key);
+
+    void insert(const Key& key, const QPixmap& pixmap);
+
+    /**
+     * Removes all icons from the cache. Must be invoked if the rendered
+     * icons are outdated, e.g., after the icon theme or the palette
+     * has been changed.
+     */
+    void clear();
+
+    /**
+     * Sets the memory budget of the cache in kilobytes. The default
+     * budget is 64 MB.
+     */
+    void setMaximumSize(int kiloBytes);
+    int maximumSize() const;
+
+protected:
+    virtual ~KItemListIconCache();
+
+private:
+    KItemListIconCache();
+
+    void reportStatistics();
+
+private:
+    QHash<QString, quint32> m_nameIds;
+    QHash<QString, quint32> m_overlaysIds;
+    QCache<Key, QPixmap> m_pixmaps;
+
+    int m_hits;
+    int m_misses;
+
+    friend class KItemListIconCacheSingleton;
+};
+
+inline bool operator==(const KItemListIconCache::Key& a, const KItemListIconCache::Key& b)
+{
+    return a.name == b.name && a.overlays == b.overlays && a.size == b.size && a.mode == b.mode;
+}
+
+inline uint qHash(const KItemListIconCache::Key& key)
+{
+    return key.name ^ (key.overlays << 12) ^ (key.size << 20) ^ (key.mode << 28);
+}
+
+#endif
@@ -43,7 +43,8 @@ QSizeF KItemListSizeHintResolver::maxSizeHint()
 QSizeF KItemListSizeHintResolver::sizeHint(int index)
 {
     updateCache();
-    return QSizeF(m_logicalWidthHint, m_logicalHeightHintCache.at(index));
+    // Estimated size hints are stored as negative values.
+    return QSizeF(m_logicalWidthHint, qAbs(m_logicalHeightHintCache.at(index)));
 }
 
 void KItemListSizeHintResolver::itemsInserted(const KItemRangeList& itemRanges)
@@ -152,6 +153,22 @@ void KItemListSizeHintResolver::clearCache()
     m_needsResolving = true;
 }
 
+bool KItemListSizeHintResolver::clearEstimatedSizeHints()
+{
+    bool cleared = false;
+    for (int i = 0; i < m_logicalHeightHintCache.count(); ++i) {
+        if (m_logicalHeightHintCache.at(i) < 0.0) {
+            m_logicalHeightHintCache[i] = 0.0;
+            cleared = true;
+        }
+    }
+
+    if (cleared) {
+        m_needsResolving = true;
+    }
+    return cleared;
+}
+
 void KItemListSizeHintResolver::updateCache()
 {
     if (m_needsResolving) {
@@ -160,7 +177,10 @@ void KItemListSizeHintResolver::updateCache()
         if (m_logicalHeightHintCache.isEmpty()) {
             m_logicalHeightHint = 0.0;
         } else {
-            m_logicalHeightHint = *std::max_element(m_logicalHeightHintCache.begin(), m_logicalHeightHintCache.end());
+            m_logicalHeightHint = 0.0;
+            foreach (qreal heightHint, m_logicalHeightHintCache) {
+                m_logicalHeightHint = qMax(m_logicalHeightHint, qAbs(heightHint));
+            }
         }
         m_needsResolving = false;
     }
@@ -47,6 +47,14 @@ public:
     void clearCache();
     void updateCache();
 
+    /**
+     * Resets all size hints which have only been estimated (see
+     * KItemListWidgetInformant::calculateItemSizeHints()), so that they
+     * are calculated again by the next updateCache().
+     * @return True if at least one estimated size hint has been reset.
+     */
+    bool clearEstimatedSizeHints();
+
 private:
     const KItemListView* m_itemListView;
     mutable QVector<qreal> m_logicalHeightHintCache;
@@ -0,0 +1,231 @@
+/***************************************************************************
+ *   Copyright (C) 2017 by agent <agent@local>                             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA            *
+ ***************************************************************************/
+
+
+#include "kitemlisttextheightmeasurer.h"
+
+#include <QTextLayout>
+#include <QTextLine>
+#include <QTextOption>
+#include <QThread>
+#include <QTimer>
+#include <QtConcurrent/QtConcurrentRun>
+
+#include <cmath>
+
+namespace {
+    // Maximum number of cached text heights. The cache is
+    // cleared if this limit is exceeded.
+    const int MaxCachedTextHeights = 200000;
+
+    // Number of texts which are measured by one worker.
+    const int TextsPerWorker = 250;
+
+    // Minimum interval in ms between two textHeightsMeasured() signals.
+    const int NotifyInterval = 100;
+}
+
+class KItemListTextHeightMeasurerSingleton
+{
+public:
+    KItemListTextHeightMeasurer instance;
+};
+Q_GLOBAL_STATIC(KItemListTextHeightMeasurerSingleton, s_textHeightMeasurer)
+
+KItemListTextHeightMeasurer* KItemListTextHeightMeasurer::instance()
+{
+    return &s_textHeightMeasurer->instance;
+}
+
+KItemListTextHeightMeasurer::KItemListTextHeightMeasurer() :
+    QObject(0),
+    m_formats(),
+    m_textHeights(),
+    m_queue(),
+    m_pendingKeys(),
+    m_workers(),
+    m_notifyTimer(0)
+{
+    m_notifyTimer = new QTimer(this);
+    m_notifyTimer->setInterval(NotifyInterval);
+    m_notifyTimer->setSingleShot(true);
+    connect(m_notifyTimer, &QTimer::timeout, this, &KItemListTextHeightMeasurer::textHeightsMeasured);
+}
+
+KItemListTextHeightMeasurer::~KItemListTextHeightMeasurer()
+{
+}
+
+int KItemListTextHeightMeasurer::format(const QFont& font, qreal maxWidth, int maxLines)
+{
+    for (int i = 0; i < m_formats.count(); ++i) {
+        const Format& format = m_formats.at(i);
+        if (format.maxWidth == maxWidth && format.maxLines == maxLines && format.font == font) {
+            return i;
+        }
+    }
+
+    Format format = { font, font.toString(), QFontMetricsF(font), maxWidth, maxLines };
+    m_formats.append(format);
+    return m_formats.count() - 1;
+}
+
+qreal KItemListTextHeightMeasurer::cachedTextHeight(const QString& text, int format) const
+{
+    return m_textHeights.value(qMakePair(text, format), -1);
+}
+
+qreal KItemListTextHeightMeasurer::textHeight(const QString& text, int format)
+{
+    const TextKey key = qMakePair(text, format);
+    QHash<TextKey, qreal>::const_iterator it = m_textHeights.constFind(key);
+    if (it != m_textHeights.constEnd()) {
+        return it.value();
+    }
+
+    const Format& f = m_formats.at(format);
+    const qreal height = layoutTextHeight(text, f.font, f.maxWidth, f.maxLines);
+    if (m_textHeights.count() >= MaxCachedTextHeights) {
+        m_textHeights.clear();
+    }
+    m_textHeights.insert(key, height);
+    return height;
+}
+
+qreal KItemListTextHeightMeasurer::estimatedTextHeight(const QString& text, int format)
+{
+    const TextKey key = qMakePair(text, format);
+    if (!m_pendingKeys.contains(key)) {
+        m_pendingKeys.insert(key);
+        m_queue.append(key);
+        startWorkers();
+    }
+
+    // Assume that the text can be wrapped anywhere.
+    const Format& f = m_formats.at(format);
+    const qreal textWidth = f.fontMetrics.width(text);
+    int lineCount = 1;
+    if (f.maxWidth > 0) {
+        lineCount = qMax(1, static_cast<int>(std::ceil(textWidth / f.maxWidth)));
+    }
+    if (f.maxLines > 0) {
+        lineCount = qMin(lineCount, f.maxLines);
+    }
+    return lineCount * f.fontMetrics.height();
+}
+
+void KItemListTextHeightMeasurer::slotWorkerFinished()
+{
+    bool measured = false;
+
+    QHash<QFutureWatcher<QVector<qreal> >*, Batch>::iterator it = m_workers.begin();
+    while (it != m_workers.end()) {
+        QFutureWatcher<QVector<qreal> >* watcher = it.key();
+        if (!watcher->isFinished()) {
+            ++it;
+            continue;
+        }
+
+        const Batch& batch = it.value();
+        const QVector<qreal> heights = watcher->result();
+        for (int i = 0; i < batch.texts.count(); ++i) {
+            const TextKey key = qMakePair(batch.texts.at(i), batch.format);
+            if (m_textHeights.count() >= MaxCachedTextHeights) {
+                m_textHeights.clear();
+            }
+            m_textHeights.insert(key, heights.at(i));
+            m_pendingKeys.remove(key);
+        }
+        measured = true;
+
+        watcher->deleteLater();
+        it = m_workers.erase(it);
+    }
+
+    startWorkers();
+
+    if (measured && !m_notifyTimer->isActive()) {
+        m_notifyTimer->start();
+    }
+}
+
+void KItemListTextHeightMeasurer::startWorkers()
+{
+    const int maxWorkers = qMax(1, QThread::idealThreadCount());
+    while (!m_queue.isEmpty() && m_workers.count() < maxWorkers) {
+        // Each worker measures texts with the same format only.
+        Batch batch;
+        batch.format = m_queue.first().second;
+        while (!m_queue.isEmpty() && m_queue.first().second == batch.format &&
+               batch.texts.count() < TextsPerWorker) {
+            batch.texts.append(m_queue.takeFirst().first);
+        }
+
+        const Format& f = m_formats.at(batch.format);
+
+        QFutureWatcher<QVector<qreal> >* watcher = new QFutureWatcher<QVector<qreal> >(this);
+        connect(watcher, &QFutureWatcher<QVector<qreal> >::finished,
+                this, &KItemListTextHeightMeasurer::slotWorkerFinished);
+        watcher->setFuture(QtConcurrent::run(&KItemListTextHeightMeasurer::measureTextHeights,
+                                             batch.texts, f.fontDescription, f.maxWidth, f.maxLines));
+        m_workers.insert(watcher, batch);
+    }
+}
+
+qreal KItemListTextHeightMeasurer::layoutTextHeight(const QString& text, const QFont& font, qreal maxWidth, int maxLines)
+{
+    QTextOption textOption(Qt::AlignHCenter);
+    textOption.setWrapMode(QTextOption::WrapAtWordBoundaryOrAnywhere);
+
+    qreal textHeight = 0;
+    QTextLayout layout(text, font);
+    layout.setTextOption(textOption);
+    layout.beginLayout();
+    QTextLine line;
+    int lineCount = 0;
+    while ((line = layout.createLine()).isValid()) {
+        line.setLineWidth(maxWidth);
+        line.naturalTextWidth();
+        textHeight += line.height();
+
+        ++lineCount;
+        if (lineCount == maxLines) {
+            break;
+        }
+    }
+    layout.endLayout();
+
+    return textHeight;
+}
+
+QVector<qreal> KItemListTextHeightMeasurer::measureTextHeights(const QStringList& texts, const QString& fontDescription,
+                                                              qreal maxWidth, int maxLines)
+{
+    // The font is created by the worker thread itself, so that
+    // it does not share any data with the font of the GUI thread.
+    QFont font;
+    font.fromString(fontDescription);
+
+    QVector<qreal> heights;
+    heights.reserve(texts.count());
+    foreach (const QString& text, texts) {
+        heights.append(layoutTextHeight(text, font, maxWidth, maxLines));
+    }
+    return heights;
+}
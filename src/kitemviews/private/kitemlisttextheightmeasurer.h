@@ -0,0 +1,144 @@
+/***************************************************************************
+ *   Copyright (C) 2017 by agent <agent@local>                             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA            *
+ ***************************************************************************/
+
+
+#ifndef KITEMLISTTEXTHEIGHTMEASURER_H
+#define KITEMLISTTEXTHEIGHTMEASURER_H
+
+#include "dolphin_export.h"
+
+#include <QFont>
+#include <QFontMetricsF>
+#include <QFutureWatcher>
+#include <QHash>
+#include <QObject>
+#include <QPair>
+#include <QSet>
+#include <QStringList>
+#include <QVector>
+
+class QTimer;
+
+/**
+ * @brief Measures the heights of wrapped item texts for the size hints of the icons view.
+ *
+ * Determining the number of lines of a wrapped text with QTextLayout is
+ * expensive. KItemListTextHeightMeasurer caches the text heights by the text,
+ * the font, the available width and the maximum number of lines, so that they
+ * are shared by all views and folders.
+ *
+ * Texts whose height is not needed immediately are measured by a pool of
+ * worker threads, each of them using its own copy of the font. Until then, the
+ * height is estimated from the width of the text (see estimatedTextHeight()).
+ * The signal textHeightsMeasured() is emitted at most every 100 ms when
+ * new heights are available.
+ *
+ * The measurer may only be used by the GUI thread.
+ */
+class DOLPHIN_EXPORT KItemListTextHeightMeasurer : public QObject
+{
+    Q_OBJECT
+
+public:
+    static KItemListTextHeightMeasurer* instance();
+
+    /**
+     * @return Identifier for the combination of \a font, \a maxWidth and
+     *         \a maxLines, which must be passed to the other methods.
+     */
+    int format(const QFont& font, qreal maxWidth, int maxLines);
+
+    /**
+     * @return The cached height of \a text, or -1 if the height
+     *         has not been measured yet.
+     */
+    qreal cachedTextHeight(const QString& text, int format) const;
+
+    /**
+     * @return The height of \a text, which is measured synchronously
+     *         if it is not cached yet.
+     */
+    qreal textHeight(const QString& text, int format);
+
+    /**
+     * @return An estimation of the height of \a text, which does not require
+     *         a text layout. The exact height is measured by a worker thread.
+     */
+    qreal estimatedTextHeight(const QString& text, int format);
+
+signals:
+    /**
+     * Is emitted if heights which have been estimated by
+     * estimatedTextHeight() have been measured.
+     */
+    void textHeightsMeasured();
+
+protected:
+    virtual ~KItemListTextHeightMeasurer();
+
+private slots:
+    void slotWorkerFinished();
+
+private:
+    KItemListTextHeightMeasurer();
+
+    void startWorkers();
+
+    /**
+     * @return The height of \a text, which is wrapped at \a maxWidth
+     *         and shortened to \a maxLines lines.
+     */
+    static qreal layoutTextHeight(const QString& text, const QFont& font, qreal maxWidth, int maxLines);
+
+    /**
+     * Measures the heights of \a texts. Is invoked in a worker thread.
+     */
+    static QVector<qreal> measureTextHeights(const QStringList& texts, const QString& fontDescription,
+                                             qreal maxWidth, int maxLines);
+
+private:
+    struct Format
+    {
+        QFont font;
+        QString fontDescription;
+        QFontMetricsF fontMetrics;
+        qreal maxWidth;
+        int maxLines;
+    };
+
+    struct Batch
+    {
+        int format;
+        QStringList texts;
+    };
+
+    typedef QPair<QString, int> TextKey;
+
+    QList<Format> m_formats;
+
+    QHash<TextKey, qreal> m_textHeights;
+    QList<TextKey> m_queue;
+    QSet<TextKey> m_pendingKeys;
+    QHash<QFutureWatcher<QVector<qreal> >*, Batch> m_workers;
+    QTimer* m_notifyTimer;
+
+    friend class KItemListTextHeightMeasurerSingleton;
+};
+
+#endif
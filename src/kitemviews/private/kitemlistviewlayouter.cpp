@@ -24,8 +24,64 @@
 
 #include "dolphindebug.h"
 
+#include <algorithm>
+
 // #define KITEMLISTVIEWLAYOUTER_DEBUG
 
+namespace {
+    /**
+     * Maps the indexes of the items after inserting or removing the item
+     * ranges to the indexes before the change. The indexes passed to
+     * previousIndex() must be ascending.
+     */
+    class PreviousIndexMapper
+    {
+    public:
+        PreviousIndexMapper(const KItemRangeList& itemRanges, bool inserted) :
+            m_itemRanges(itemRanges),
+            m_inserted(inserted),
+            m_range(0),
+            m_offset(0)
+        {
+        }
+
+        /**
+         * @return The index of the item with the index \a index before the
+         *         change, or -1 if the item has been inserted.
+         */
+        int previousIndex(int index)
+        {
+            if (m_inserted) {
+                while (m_range < m_itemRanges.count()) {
+                    const KItemRange& range = m_itemRanges.at(m_range);
+                    const int first = range.index + m_offset;
+                    if (index < first) {
+                        break;
+                    }
+                    if (index < first + range.count) {
+                        return -1;
+                    }
+                    m_offset += range.count;
+                    ++m_range;
+                }
+                return index - m_offset;
+            }
+
+            while (m_range < m_itemRanges.count() && m_itemRanges.at(m_range).index - m_offset <= index) {
+                m_offset += m_itemRanges.at(m_range).count;
+                ++m_range;
+            }
+            return index + m_offset;
+        }
+
+    private:
+        const KItemRangeList& m_itemRanges;
+        const bool m_inserted;
+        int m_range;
+        int m_offset;
+    };
+}
+
 KItemListViewLayouter::KItemListViewLayouter(KItemListSizeHintResolver* sizeHintResolver, QObject* parent) :
     QObject(parent),
     m_dirty(true),
@@ -46,12 +102,20 @@ KItemListViewLayouter::KItemListViewLayouter(KItemListSizeHintResolver* sizeHint
     m_columnWidth(0),
     m_xPosInc(0),
     m_columnCount(0),
-    m_rowOffsets(),
     m_columnOffsets(),
-    m_groupItemIndexes(),
+    m_itemCount(0),
+    m_logicalItemSize(),
+    m_logicalItemMargin(),
+    m_groupFirstIndexes(),
+    m_groupFirstRows(),
+    m_grouped(false),
     m_groupHeaderHeight(0),
     m_groupHeaderMargin(0),
-    m_itemInfos()
+    m_rowCount(0),
+    m_firstRowOffset(0),
+    m_rowSpans(),
+    m_rowSpanTree(),
+    m_dirtyRows()
 {
     Q_ASSERT(m_sizeHintResolver);
 }
@@ -225,14 +289,14 @@ int KItemListViewLayouter::lastVisibleIndex() const
 QRectF KItemListViewLayouter::itemRect(int index) const
 {
     const_cast<KItemListViewLayouter*>(this)->doLayout();
-    if (index < 0 || index >= m_itemInfos.count()) {
+    if (index < 0 || index >= m_itemCount) {
         return QRectF();
     }
 
     QSizeF sizeHint = m_sizeHintResolver->sizeHint(index);
 
-    const qreal x = m_columnOffsets.at(m_itemInfos.at(index).column);
-    const qreal y = m_rowOffsets.at(m_itemInfos.at(index).row);
+    const qreal x = m_columnOffsets.at(columnOfItem(index));
+    const qreal y = rowOffset(rowOfItem(index));
 
     if (m_scrollOrientation == Qt::Horizontal) {
         // Rotate the logical direction which is always vertical by 90°
@@ -276,13 +340,8 @@ QRectF KItemListViewLayouter::groupHeaderRect(int index) const
         // directly, the logical height represents the visual width, and
         // the logical row represents the column.
         qreal headerWidth = minimumGroupHeaderWidth();
-        const int row = m_itemInfos[index].row;
-        const int maxIndex = m_itemInfos.count() - 1;
+        const int maxIndex = lastIndexOfRow(rowOfItem(index));
         while (index <= maxIndex) {
-            if (m_itemInfos[index].row != row) {
-                break;
-            }
-
             const qreal itemWidth = (m_scrollOrientation == Qt::Vertical)
                                      ? m_sizeHintResolver->sizeHint(index).width()
                                      : m_sizeHintResolver->sizeHint(index).height();
@@ -302,25 +361,25 @@ QRectF KItemListViewLayouter::groupHeaderRect(int index) const
 int KItemListViewLayouter::itemColumn(int index) const
 {
     const_cast<KItemListViewLayouter*>(this)->doLayout();
-    if (index < 0 || index >= m_itemInfos.count()) {
+    if (index < 0 || index >= m_itemCount) {
         return -1;
     }
 
     return (m_scrollOrientation == Qt::Vertical)
-            ? m_itemInfos[index].column
-            : m_itemInfos[index].row;
+            ? columnOfItem(index)
+            : rowOfItem(index);
 }
 
 int KItemListViewLayouter::itemRow(int index) const
 {
     const_cast<KItemListViewLayouter*>(this)->doLayout();
-    if (index < 0 || index >= m_itemInfos.count()) {
+    if (index < 0 || index >= m_itemCount) {
         return -1;
     }
 
     return (m_scrollOrientation == Qt::Vertical)
-            ? m_itemInfos[index].row
-            : m_itemInfos[index].column;
+            ? rowOfItem(index)
+            : columnOfItem(index);
 }
 
 int KItemListViewLayouter::maximumVisibleItems() const
@@ -340,7 +399,9 @@ int KItemListViewLayouter::maximumVisibleItems() const
 bool KItemListViewLayouter::isFirstGroupItem(int itemIndex) const
 {
     const_cast<KItemListViewLayouter*>(this)->doLayout();
-    return m_groupItemIndexes.contains(itemIndex);
+    return m_grouped && std::binary_search(m_groupFirstIndexes.constBegin(),
+                                           m_groupFirstIndexes.constEnd(),
+                                           itemIndex);
 }
 
 void KItemListViewLayouter::markAsDirty()
@@ -348,6 +409,35 @@ void KItemListViewLayouter::markAsDirty()
     m_dirty = true;
 }
 
+void KItemListViewLayouter::markItemsAsDirty(int index, int count)
+{
+    if (m_dirty) {
+        // All rows will be updated anyway.
+        return;
+    }
+
+    const int lastIndex = qMin(index + count, m_itemCount) - 1;
+    index = qMax(0, index);
+    while (index <= lastIndex) {
+        const int row = rowOfItem(index);
+        m_dirtyRows.insert(row);
+        index = lastIndexOfRow(row) + 1;
+    }
+
+    if (!m_dirtyRows.isEmpty()) {
+        m_visibleIndexesDirty = true;
+    }
+}
+
+void KItemListViewLayouter::itemsInserted(const KItemRangeList& itemRanges)
+{
+    updateRowsForChangedItems(itemRanges, true);
+}
+
+void KItemListViewLayouter::itemsRemoved(const KItemRangeList& itemRanges)
+{
+    updateRowsForChangedItems(itemRanges, false);
+}
 
 #ifndef QT_NO_DEBUG
     bool KItemListViewLayouter::isDirty()
@@ -369,7 +459,7 @@ void KItemListViewLayouter::doLayout()
         QSizeF itemMargin = m_itemMargin;
         QSizeF size = m_size;
 
-        const bool grouped = createGroupHeaders();
+        m_grouped = createGroupHeaders();
 
         const bool horizontalScrolling = (m_scrollOrientation == Qt::Horizontal);
         if (horizontalScrolling) {
@@ -379,7 +469,7 @@ void KItemListViewLayouter::doLayout()
             itemMargin.transpose();
             size.transpose();
 
-            if (grouped) {
+            if (m_grouped) {
                 // In the horizontal scrolling case all groups are aligned
                 // at the top, which decreases the available height. For the
                 // flipped data this means that the width must be decreased.
@@ -387,6 +477,9 @@ void KItemListViewLayouter::doLayout()
             }
         }
 
+        m_logicalItemSize = itemSize;
+        m_logicalItemMargin = itemMargin;
+
         m_columnWidth = itemSize.width() + itemMargin.width();
         const qreal widthForColumns = size.width() - itemMargin.width();
         m_columnCount = qMax(1, int(widthForColumns / m_columnWidth));
@@ -403,13 +496,13 @@ void KItemListViewLayouter::doLayout()
             }
         }
 
-        m_itemInfos.resize(itemCount);
+        m_itemCount = itemCount;
 
         // Calculate the offset of each column, i.e., the x-coordinate where the column starts.
         m_columnOffsets.resize(m_columnCount);
         qreal currentOffset = m_xPosInc;
 
-        if (grouped && horizontalScrolling) {
+        if (m_grouped && horizontalScrolling) {
             // All group headers will always be aligned on the top and not
             // flipped like the other properties.
             currentOffset += m_groupHeaderHeight;
@@ -420,95 +513,36 @@ void KItemListViewLayouter::doLayout()
             currentOffset += m_columnWidth;
         }
 
-        // Prepare the QVector which stores the y-coordinate for each new row.
-        int numberOfRows = (itemCount + m_columnCount - 1) / m_columnCount;
-        if (grouped && m_columnCount > 1) {
-            // In the worst case, a new row will be started for every group.
-            // We could calculate the exact number of rows now to prevent that we reserve
-            // too much memory, but the code required to do that might need much more
-            // memory than it would save in the average case.
-            numberOfRows += m_groupItemIndexes.count();
-        }
-        m_rowOffsets.resize(numberOfRows);
-
-        qreal y = m_headerHeight + itemMargin.height();
-        int row = 0;
-
-        int index = 0;
-        while (index < itemCount) {
-            qreal maxItemHeight = itemSize.height();
-
-            if (grouped) {
-                if (m_groupItemIndexes.contains(index)) {
-                    // The item is the first item of a group.
-                    // Increase the y-position to provide space
-                    // for the group header.
-                    if (index > 0) {
-                        // Only add a margin if there has been added another
-                        // group already before
-                        y += m_groupHeaderMargin;
-                    } else if (!horizontalScrolling) {
-                        // The first group header should be aligned on top
-                        y -= itemMargin.height();
-                    }
-
-                    if (!horizontalScrolling) {
-                        y += m_groupHeaderHeight;
-                    }
-                }
+        // Each group starts with a new row. Without grouping, all
+        // items belong to one group.
+        if (!m_grouped) {
+            m_groupFirstIndexes.clear();
+            if (itemCount > 0) {
+                m_groupFirstIndexes.append(0);
             }
+        }
 
-            m_rowOffsets[row] = y;
-
-            int column = 0;
-            while (index < itemCount && column < m_columnCount) {
-                qreal requiredItemHeight = itemSize.height();
-                const QSizeF sizeHint = m_sizeHintResolver->sizeHint(index);
-                const qreal sizeHintHeight = sizeHint.height();
-                if (sizeHintHeight > requiredItemHeight) {
-                    requiredItemHeight = sizeHintHeight;
-                }
-
-                ItemInfo& itemInfo = m_itemInfos[index];
-                itemInfo.column = column;
-                itemInfo.row = row;
-
-                if (grouped && horizontalScrolling) {
-                    // When grouping is enabled in the horizontal mode, the header alignment
-                    // looks like this:
-                    //   Header-1 Header-2 Header-3
-                    //   Item 1   Item 4   Item 7
-                    //   Item 2   Item 5   Item 8
-                    //   Item 3   Item 6   Item 9
-                    // In this case 'requiredItemHeight' represents the column-width. We don't
-                    // check the content of the header in the layouter to determine the required
-                    // width, hence assure that at least a minimal width of 15 characters is given
-                    // (in average a character requires the halve width of the font height).
-                    //
-                    // TODO: Let the group headers provide a minimum width and respect this width here
-                    const qreal headerWidth = minimumGroupHeaderWidth();
-                    if (requiredItemHeight < headerWidth) {
-                        requiredItemHeight = headerWidth;
-                    }
-                }
-
-                maxItemHeight = qMax(maxItemHeight, requiredItemHeight);
-                ++index;
-                ++column;
+        const int groupCount = m_groupFirstIndexes.count();
+        m_groupFirstRows.resize(groupCount);
+        m_rowCount = 0;
+        for (int group = 0; group < groupCount; ++group) {
+            const int groupBegin = m_groupFirstIndexes.at(group);
+            const int groupEnd = (group + 1 < groupCount) ? m_groupFirstIndexes.at(group + 1) : itemCount;
+            m_groupFirstRows[group] = m_rowCount;
+            m_rowCount += (groupEnd - groupBegin + m_columnCount - 1) / m_columnCount;
+        }
 
-                if (grouped && m_groupItemIndexes.contains(index)) {
-                    // The item represents the first index of a group
-                    // and must aligned in the first column
-                    break;
-                }
-            }
+        m_firstRowOffset = m_headerHeight + itemMargin.height();
 
-            y += maxItemHeight + itemMargin.height();
-            ++row;
+        m_rowSpans.resize(m_rowCount);
+        for (int row = 0; row < m_rowCount; ++row) {
+            m_rowSpans[row] = calculateRowSpan(row);
         }
+        buildRowSpanTree();
+        m_dirtyRows.clear();
 
         if (itemCount > 0) {
-            m_maximumScrollOffset = y;
+            m_maximumScrollOffset = m_firstRowOffset + rowSpanSum(m_rowCount);
             m_maximumItemOffset = m_columnCount * m_columnWidth;
         } else {
             m_maximumScrollOffset = 0;
@@ -519,6 +553,8 @@ void KItemListViewLayouter::doLayout()
         qCDebug(DolphinDebug) << "[TIME] doLayout() for " << m_model->count() << "items:" << timer.elapsed();
 #endif
         m_dirty = false;
+    } else if (!m_dirtyRows.isEmpty()) {
+        updateDirtyRows();
     }
 
     updateVisibleIndexes();
@@ -532,42 +568,28 @@ void KItemListViewLayouter::updateVisibleIndexes()
 
     Q_ASSERT(!m_dirty);
 
-    if (m_model->count() <= 0) {
+    if (m_itemCount <= 0) {
         m_firstVisibleIndex = -1;
         m_lastVisibleIndex = -1;
         m_visibleIndexesDirty = false;
         return;
     }
 
-    const int maxIndex = m_model->count() - 1;
-
-    // Calculate the first visible index that is fully visible
+    // The first visible row is the last row that starts above the
+    // scroll offset, as it might be partly visible.
     int min = 0;
-    int max = maxIndex;
-    int mid = 0;
-    do {
-        mid = (min + max) / 2;
-        if (m_rowOffsets.at(m_itemInfos[mid].row) < m_scrollOffset) {
+    int max = m_rowCount - 1;
+    int firstVisibleRow = 0;
+    while (min <= max) {
+        const int mid = (min + max) / 2;
+        if (rowOffset(mid) < m_scrollOffset) {
+            firstVisibleRow = mid;
             min = mid + 1;
         } else {
             max = mid - 1;
         }
-    } while (min <= max);
-
-    if (mid > 0) {
-        // Include the row before the first fully visible index, as it might
-        // be partly visible
-        if (m_rowOffsets.at(m_itemInfos[mid].row) >= m_scrollOffset) {
-            --mid;
-            Q_ASSERT(m_rowOffsets.at(m_itemInfos[mid].row) < m_scrollOffset);
-        }
-
-        const int firstVisibleRow = m_itemInfos[mid].row;
-        while (mid > 0 && m_itemInfos[mid - 1].row == firstVisibleRow) {
-            --mid;
-        }
     }
-    m_firstVisibleIndex = mid;
+    m_firstVisibleIndex = firstIndexOfRow(firstVisibleRow);
 
     // Calculate the last visible index that is (at least partly) visible
     const int visibleHeight = (m_scrollOrientation == Qt::Horizontal) ? m_size.width() : m_size.height();
@@ -576,46 +598,266 @@ void KItemListViewLayouter::updateVisibleIndexes()
         bottom += m_groupHeaderHeight;
     }
 
-    min = m_firstVisibleIndex;
-    max = maxIndex;
-    do {
-        mid = (min + max) / 2;
-        if (m_rowOffsets.at(m_itemInfos[mid].row) <= bottom) {
+    min = firstVisibleRow;
+    max = m_rowCount - 1;
+    int lastVisibleRow = firstVisibleRow;
+    while (min <= max) {
+        const int mid = (min + max) / 2;
+        if (rowOffset(mid) <= bottom) {
+            lastVisibleRow = mid;
             min = mid + 1;
         } else {
             max = mid - 1;
         }
-    } while (min <= max);
-
-    while (mid > 0 && m_rowOffsets.at(m_itemInfos[mid].row) > bottom) {
-        --mid;
     }
-    m_lastVisibleIndex = mid;
+    m_lastVisibleIndex = lastIndexOfRow(lastVisibleRow);
 
     m_visibleIndexesDirty = false;
 }
 
 bool KItemListViewLayouter::createGroupHeaders()
 {
+    m_groupFirstIndexes.clear();
+
     if (!m_model->groupedSorting()) {
         return false;
     }
 
-    m_groupItemIndexes.clear();
-
     const QList<QPair<int, QVariant> > groups = m_model->groups();
     if (groups.isEmpty()) {
         return false;
     }
 
+    m_groupFirstIndexes.reserve(groups.count() + 1);
+    if (groups.first().first > 0) {
+        // Assure that each item belongs to a group.
+        m_groupFirstIndexes.append(0);
+    }
+
     for (int i = 0; i < groups.count(); ++i) {
         const int firstItemIndex = groups.at(i).first;
-        m_groupItemIndexes.insert(firstItemIndex);
+        m_groupFirstIndexes.append(firstItemIndex);
     }
 
     return true;
 }
 
+void KItemListViewLayouter::updateDirtyRows()
+{
+    foreach (int row, m_dirtyRows) {
+        setRowSpan(row, calculateRowSpan(row));
+    }
+    m_dirtyRows.clear();
+
+    if (m_itemCount > 0) {
+        m_maximumScrollOffset = m_firstRowOffset + rowSpanSum(m_rowCount);
+    }
+    m_visibleIndexesDirty = true;
+}
+
+void KItemListViewLayouter::updateRowsForChangedItems(const KItemRangeList& itemRanges, bool inserted)
+{
+    int changedCount = 0;
+    foreach (const KItemRange& range, itemRanges) {
+        changedCount += range.count;
+    }
+
+    const int previousItemCount = m_itemCount;
+    const int itemCount = inserted ? previousItemCount + changedCount : previousItemCount - changedCount;
+
+    // The groups must be determined again if grouping is enabled. The width of
+    // the columns depends on whether there are more items than columns, see doLayout().
+    if (m_dirty || !m_dirtyRows.isEmpty() || m_model->groupedSorting() ||
+        itemCount != m_model->count() || itemCount <= m_columnCount || previousItemCount <= m_columnCount) {
+        m_dirty = true;
+        return;
+    }
+
+    const QVector<qreal> previousRowSpans = m_rowSpans;
+
+    m_itemCount = itemCount;
+    m_rowCount = (itemCount + m_columnCount - 1) / m_columnCount;
+    m_rowSpans.resize(m_rowCount);
+
+    // A row keeps its span if it contains exactly the items
+    // of a previous row.
+    PreviousIndexMapper mapper(itemRanges, inserted);
+    for (int row = 0; row < m_rowCount; ++row) {
+        const int first = row * m_columnCount;
+        const int last = qMin(first + m_columnCount, itemCount) - 1;
+        const int previousFirst = mapper.previousIndex(first);
+        const int previousLast = mapper.previousIndex(last);
+
+        const bool movedRow = previousFirst >= 0 && previousLast >= 0 &&
+                              previousLast - previousFirst == last - first &&
+                              previousFirst % m_columnCount == 0 &&
+                              qMin(previousFirst + m_columnCount, previousItemCount) - 1 == previousLast;
+        m_rowSpans[row] = movedRow ? previousRowSpans.at(previousFirst / m_columnCount)
+                                   : calculateRowSpan(row);
+    }
+    buildRowSpanTree();
+
+    m_maximumScrollOffset = m_firstRowOffset + rowSpanSum(m_rowCount);
+    m_visibleIndexesDirty = true;
+}
+
+int KItemListViewLayouter::groupOfItem(int index) const
+{
+    // If several groups start with the same index, the last one is used,
+    // as the other groups are empty.
+    return std::upper_bound(m_groupFirstIndexes.constBegin(), m_groupFirstIndexes.constEnd(), index)
+           - m_groupFirstIndexes.constBegin() - 1;
+}
+
+int KItemListViewLayouter::groupOfRow(int row) const
+{
+    return std::upper_bound(m_groupFirstRows.constBegin(), m_groupFirstRows.constEnd(), row)
+           - m_groupFirstRows.constBegin() - 1;
+}
+
+int KItemListViewLayouter::rowOfItem(int index) const
+{
+    const int group = groupOfItem(index);
+    return m_groupFirstRows.at(group) + (index - m_groupFirstIndexes.at(group)) / m_columnCount;
+}
+
+int KItemListViewLayouter::columnOfItem(int index) const
+{
+    const int group = groupOfItem(index);
+    return (index - m_groupFirstIndexes.at(group)) % m_columnCount;
+}
+
+int KItemListViewLayouter::firstIndexOfRow(int row) const
+{
+    const int group = groupOfRow(row);
+    return m_groupFirstIndexes.at(group) + (row - m_groupFirstRows.at(group)) * m_columnCount;
+}
+
+int KItemListViewLayouter::lastIndexOfRow(int row) const
+{
+    const int group = groupOfRow(row);
+    const int groupEnd = (group + 1 < m_groupFirstIndexes.count())
+                         ? m_groupFirstIndexes.at(group + 1) : m_itemCount;
+    const int rowEnd = m_groupFirstIndexes.at(group) + (row - m_groupFirstRows.at(group) + 1) * m_columnCount;
+    return qMin(rowEnd, groupEnd) - 1;
+}
+
+qreal KItemListViewLayouter::rowOffset(int row) const
+{
+    return m_firstRowOffset + rowSpanSum(row) + groupHeaderSpace(row);
+}
+
+qreal KItemListViewLayouter::groupHeaderSpace(int row) const
+{
+    if (!m_grouped) {
+        return 0;
+    }
+
+    const int group = groupOfRow(row);
+    if (m_groupFirstRows.at(group) != row) {
+        return 0;
+    }
+
+    const bool horizontalScrolling = (m_scrollOrientation == Qt::Horizontal);
+
+    qreal space = 0;
+    if (m_groupFirstIndexes.at(group) > 0) {
+        // Only add a margin if there has been added another
+        // group already before
+        space += m_groupHeaderMargin;
+    } else if (!horizontalScrolling) {
+        // The first group header should be aligned on top
+        space -= m_logicalItemMargin.height();
+    }
+
+    if (!horizontalScrolling) {
+        space += m_groupHeaderHeight;
+    }
+
+    return space;
+}
+
+qreal KItemListViewLayouter::calculateRowSpan(int row) const
+{
+    const bool horizontalGroups = m_grouped && (m_scrollOrientation == Qt::Horizontal);
+
+    qreal maxItemHeight = m_logicalItemSize.height();
+
+    const int lastIndex = lastIndexOfRow(row);
+    for (int index = firstIndexOfRow(row); index <= lastIndex; ++index) {
+        qreal requiredItemHeight = m_logicalItemSize.height();
+        const qreal sizeHintHeight = m_sizeHintResolver->sizeHint(index).height();
+        if (sizeHintHeight > requiredItemHeight) {
+            requiredItemHeight = sizeHintHeight;
+        }
+
+        if (horizontalGroups) {
+            // When grouping is enabled in the horizontal mode, the header alignment
+            // looks like this:
+            //   Header-1 Header-2 Header-3
+            //   Item 1   Item 4   Item 7
+            //   Item 2   Item 5   Item 8
+            //   Item 3   Item 6   Item 9
+            // In this case 'requiredItemHeight' represents the column-width. We don't
+            // check the content of the header in the layouter to determine the required
+            // width, hence assure that at least a minimal width of 15 characters is given
+            // (in average a character requires the halve width of the font height).
+            //
+            // TODO: Let the group headers provide a minimum width and respect this width here
+            const qreal headerWidth = minimumGroupHeaderWidth();
+            if (requiredItemHeight < headerWidth) {
+                requiredItemHeight = headerWidth;
+            }
+        }
+
+        maxItemHeight = qMax(maxItemHeight, requiredItemHeight);
+    }
+
+    return groupHeaderSpace(row) + maxItemHeight + m_logicalItemMargin.height();
+}
+
+void KItemListViewLayouter::buildRowSpanTree()
+{
+    const int count = m_rowSpans.count();
+    m_rowSpanTree.resize(count + 1);
+    m_rowSpanTree[0] = 0;
+    for (int i = 1; i <= count; ++i) {
+        m_rowSpanTree[i] = m_rowSpans.at(i - 1);
+    }
+
+    // Add each node to its parent, which results in the
+    // same tree as count calls of setRowSpan().
+    for (int i = 1; i <= count; ++i) {
+        const int parent = i + (i & -i);
+        if (parent <= count) {
+            m_rowSpanTree[parent] += m_rowSpanTree.at(i);
+        }
+    }
+}
+
+void KItemListViewLayouter::setRowSpan(int row, qreal span)
+{
+    const qreal delta = span - m_rowSpans.at(row);
+    if (delta == 0) {
+        return;
+    }
+
+    m_rowSpans[row] = span;
+    const int count = m_rowSpans.count();
+    for (int i = row + 1; i <= count; i += i & -i) {
+        m_rowSpanTree[i] += delta;
+    }
+}
+
+qreal KItemListViewLayouter::rowSpanSum(int rowCount) const
+{
+    qreal sum = 0;
+    for (int i = rowCount; i > 0; i -= i & -i) {
+        sum += m_rowSpanTree.at(i);
+    }
+    return sum;
+}
+
 qreal KItemListViewLayouter::minimumGroupHeaderWidth() const
 {
     return 100;
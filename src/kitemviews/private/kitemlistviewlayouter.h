@@ -22,6 +22,8 @@
 
 #include "dolphin_export.h"
 
+#include <kitemviews/kitemrange.h>
+
 #include <QObject>
 #include <QRectF>
 #include <QSet>
@@ -44,6 +46,21 @@ class KItemListSizeHintResolver;
  * marking the layouter as dirty (see markAsDirty()). This means that
  * changing properties of the layouter is not expensive, only the
  * first read of a property can get expensive.
+ *
+ * The layouter does not store the position of each item. The row and column
+ * of an item are calculated from the index of the item and the first indexes
+ * of the groups. The space required by each row is stored in a Fenwick tree
+ * (binary indexed tree), which allows to determine the offset of a row and
+ * to update the height of a row in O(log n). Hence changing the size hints of
+ * some items (see markItemsAsDirty()) does not require a relayout of all items.
+ *
+ * Inserting or removing items (see itemsInserted() and itemsRemoved()) moves
+ * the following items to other rows, which cannot be expressed by updates of
+ * the Fenwick tree. In this case the spans of the rows which only contain
+ * moved items are taken from the previous layout, and only the rows that
+ * contain inserted items or items from several previous rows are calculated
+ * again. The Fenwick tree is rebuilt afterwards, which is O(n), but only
+ * requires additions and no size hints.
  */
 class DOLPHIN_EXPORT KItemListViewLayouter : public QObject
 {
@@ -162,6 +179,29 @@ public:
      */
     void markAsDirty();
 
+    /**
+     * Must be invoked if the size hints of the items in the range
+     * \a index to \a index + \a count - 1 have been changed. Only the
+     * rows of these items are updated, as long as the layouter has not
+     * been marked as dirty.
+     */
+    void markItemsAsDirty(int index, int count);
+
+    /**
+     * Must be invoked after the items \a itemRanges have been inserted into
+     * the model and into the size hint resolver. The indexes of the ranges
+     * are related to the model before the items have been inserted. If
+     * grouping is enabled, or if the number of columns might change, the
+     * layouter is marked as dirty instead.
+     */
+    void itemsInserted(const KItemRangeList& itemRanges);
+
+    /**
+     * Must be invoked after the items \a itemRanges have been removed from
+     * the model and from the size hint resolver. See itemsInserted().
+     */
+    void itemsRemoved(const KItemRangeList& itemRanges);
+
     inline int columnCount() const
     {
         return m_columnCount;
@@ -181,6 +221,69 @@ private:
     void updateVisibleIndexes();
     bool createGroupHeaders();
 
+    /**
+     * Updates the rows which have been marked by markItemsAsDirty().
+     */
+    void updateDirtyRows();
+
+    /**
+     * Helper method for itemsInserted() and itemsRemoved(): Updates the rows
+     * after \a itemRanges have been inserted or removed.
+     */
+    void updateRowsForChangedItems(const KItemRangeList& itemRanges, bool inserted);
+
+    /**
+     * @return Index of the group (in m_groupFirstIndexes) that contains the
+     *         item with the index \a index.
+     */
+    int groupOfItem(int index) const;
+
+    /**
+     * @return Index of the group (in m_groupFirstIndexes) that contains
+     *         the logical row \a row.
+     */
+    int groupOfRow(int row) const;
+
+    int rowOfItem(int index) const;
+    int columnOfItem(int index) const;
+    int firstIndexOfRow(int row) const;
+    int lastIndexOfRow(int row) const;
+
+    /**
+     * @return The logical y-coordinate of the row \a row.
+     */
+    qreal rowOffset(int row) const;
+
+    /**
+     * @return The space that is required for a group header above the
+     *         row \a row. 0 is returned if \a row is not the first row of
+     *         a group.
+     */
+    qreal groupHeaderSpace(int row) const;
+
+    /**
+     * @return The space that is required by the row \a row in the logical
+     *         vertical direction, including the margin below the row and
+     *         the group header above the row.
+     */
+    qreal calculateRowSpan(int row) const;
+
+    /**
+     * Builds the Fenwick tree m_rowSpanTree from m_rowSpans in O(n).
+     */
+    void buildRowSpanTree();
+
+    /**
+     * Sets the span of the row \a row to \a span and updates
+     * the Fenwick tree in O(log n).
+     */
+    void setRowSpan(int row, qreal span);
+
+    /**
+     * @return The sum of the spans of the first \a rowCount rows in O(log n).
+     */
+    qreal rowSpanSum(int rowCount) const;
+
     /**
      * @return Minimum width of group headers when grouping is enabled in the horizontal
      *         alignment mode. The header alignment is done like this:
@@ -217,22 +320,35 @@ private:
     qreal m_xPosInc;
     int m_columnCount;
 
-    QVector<qreal> m_rowOffsets;
     QVector<qreal> m_columnOffsets;
 
-    // Stores all item indexes that are the first item of a group.
-    // Assures fast access for KItemListViewLayouter::isFirstGroupItem().
-    QSet<int> m_groupItemIndexes;
+    // The number of items and the logical (flipped for horizontal scrolling)
+    // item size and margin of the last layout.
+    int m_itemCount;
+    QSizeF m_logicalItemSize;
+    QSizeF m_logicalItemMargin;
+
+    // Sorted indexes of the first items of the groups and the first rows of
+    // the groups. If grouping is disabled, all items belong to one group.
+    QVector<int> m_groupFirstIndexes;
+    QVector<int> m_groupFirstRows;
+    bool m_grouped;
     qreal m_groupHeaderHeight;
     qreal m_groupHeaderMargin;
 
-    struct ItemInfo {
-        int column;
-        int row;
-    };
-    QVector<ItemInfo> m_itemInfos;
+    // Space required by each row (see calculateRowSpan()). The offset of a row
+    // is the sum of the spans of all previous rows, which is determined by the
+    // Fenwick tree m_rowSpanTree. The tree uses 1-based indexes.
+    int m_rowCount;
+    qreal m_firstRowOffset;
+    QVector<qreal> m_rowSpans;
+    QVector<qreal> m_rowSpanTree;
+
+    // Rows that must be updated because of changed size hints.
+    QSet<int> m_dirtyRows;
 
     friend class KItemListControllerTest;
+    friend class KItemListViewLayouterTest;
 };
 
 #endif
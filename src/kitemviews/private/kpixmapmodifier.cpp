@@ -258,7 +258,10 @@ static void shadowBlur(QImage& image, float radius, const QColor& color)
 }
 
 namespace {
-    /** Helper class for drawing frames for KPixmapModifier::applyFrame(). */
+    /**
+     * Helper class for drawing frames for KPixmapModifier::applyFrame(). The
+     * tiles are pre-rendered images, so they may be painted in worker threads.
+     */
     class TileSet
     {
     public:
@@ -280,41 +283,104 @@ namespace {
 
             shadowBlur(image, 3, Qt::black);
 
-            QPixmap pixmap = QPixmap::fromImage(image);
-            m_tiles[TopLeftCorner]     = pixmap.copy(0, 0, 8, 8);
-            m_tiles[TopSide]           = pixmap.copy(8, 0, 8, 8);
-            m_tiles[TopRightCorner]    = pixmap.copy(16, 0, 8, 8);
-            m_tiles[LeftSide]          = pixmap.copy(0, 8, 8, 8);
-            m_tiles[RightSide]         = pixmap.copy(16, 8, 8, 8);
-            m_tiles[BottomLeftCorner]  = pixmap.copy(0, 16, 8, 8);
-            m_tiles[BottomSide]        = pixmap.copy(8, 16, 8, 8);
-            m_tiles[BottomRightCorner] = pixmap.copy(16, 16, 8, 8);
+            m_tiles[TopLeftCorner]     = image.copy(0, 0, 8, 8);
+            m_tiles[TopSide]           = image.copy(8, 0, 8, 8);
+            m_tiles[TopRightCorner]    = image.copy(16, 0, 8, 8);
+            m_tiles[LeftSide]          = image.copy(0, 8, 8, 8);
+            m_tiles[RightSide]         = image.copy(16, 8, 8, 8);
+            m_tiles[BottomLeftCorner]  = image.copy(0, 16, 8, 8);
+            m_tiles[BottomSide]        = image.copy(8, 16, 8, 8);
+            m_tiles[BottomRightCorner] = image.copy(16, 16, 8, 8);
         }
 
-        void paint(QPainter* p, const QRect& r)
+        /**
+         * @return The tile set. It is created on first use, which is
+         *         thread-safe.
+         */
+        static const TileSet& instance()
         {
-            p->drawPixmap(r.topLeft(), m_tiles[TopLeftCorner]);
+            static const TileSet tileSet;
+            return tileSet;
+        }
+
+        void paint(QPainter* p, const QRect& r) const
+        {
+            p->drawImage(r.topLeft(), m_tiles[TopLeftCorner]);
             if (r.width() - 16 > 0) {
-                p->drawTiledPixmap(r.x() + 8, r.y(), r.width() - 16, 8, m_tiles[TopSide]);
+                drawTiledImage(p, QRect(r.x() + 8, r.y(), r.width() - 16, 8), m_tiles[TopSide]);
             }
-            p->drawPixmap(r.right() - 8 + 1, r.y(), m_tiles[TopRightCorner]);
+            p->drawImage(r.right() - 8 + 1, r.y(), m_tiles[TopRightCorner]);
             if (r.height() - 16 > 0) {
-                p->drawTiledPixmap(r.x(), r.y() + 8, 8, r.height() - 16,  m_tiles[LeftSide]);
-                p->drawTiledPixmap(r.right() - 8 + 1, r.y() + 8, 8, r.height() - 16, m_tiles[RightSide]);
+                drawTiledImage(p, QRect(r.x(), r.y() + 8, 8, r.height() - 16),  m_tiles[LeftSide]);
+                drawTiledImage(p, QRect(r.right() - 8 + 1, r.y() + 8, 8, r.height() - 16), m_tiles[RightSide]);
             }
-            p->drawPixmap(r.x(), r.bottom() - 8 + 1, m_tiles[BottomLeftCorner]);
+            p->drawImage(r.x(), r.bottom() - 8 + 1, m_tiles[BottomLeftCorner]);
             if (r.width() - 16 > 0) {
-                p->drawTiledPixmap(r.x() + 8, r.bottom() - 8 + 1, r.width() - 16, 8, m_tiles[BottomSide]);
+                drawTiledImage(p, QRect(r.x() + 8, r.bottom() - 8 + 1, r.width() - 16, 8), m_tiles[BottomSide]);
             }
-            p->drawPixmap(r.right() - 8 + 1, r.bottom() - 8 + 1, m_tiles[BottomRightCorner]);
+            p->drawImage(r.right() - 8 + 1, r.bottom() - 8 + 1, m_tiles[BottomRightCorner]);
 
             const QRect contentRect = r.adjusted(LeftMargin + 1, TopMargin + 1,
                                                  -(RightMargin + 1), -(BottomMargin + 1));
             p->fillRect(contentRect, Qt::transparent);
         }
 
-        QPixmap m_tiles[NumTiles];
+    private:
+        /**
+         * Counterpart of QPainter::drawTiledPixmap() for images.
+         */
+        static void drawTiledImage(QPainter* p, const QRect& r, const QImage& tile)
+        {
+            for (int y = r.y(); y <= r.bottom(); y += tile.height()) {
+                const int height = qMin(tile.height(), r.bottom() + 1 - y);
+                for (int x = r.x(); x <= r.right(); x += tile.width()) {
+                    const int width = qMin(tile.width(), r.right() + 1 - x);
+                    p->drawImage(QRect(x, y, width, height), tile, QRect(0, 0, width, height));
+                }
+            }
+        }
+
+        QImage m_tiles[NumTiles];
     };
+
+    /**
+     * @return The average of the ARGB32 pixels \a a, \a b, \a c and \a d.
+     * Two channels are handled at once by splitting the pixels into the
+     * red/blue and the alpha/green channels. Rounding is done like in
+     * (a + b + c + d + 2) / 4 for each channel.
+     */
+    inline quint32 averageOfFour(quint32 a, quint32 b, quint32 c, quint32 d)
+    {
+        const quint32 redBlue = ((a & 0x00ff00ff) + (b & 0x00ff00ff) +
+                                 (c & 0x00ff00ff) + (d & 0x00ff00ff) + 0x00020002) >> 2;
+        const quint32 alphaGreen = (((a >> 8) & 0x00ff00ff) + ((b >> 8) & 0x00ff00ff) +
+                                    ((c >> 8) & 0x00ff00ff) + ((d >> 8) & 0x00ff00ff) + 0x00020002) >> 2;
+        return (redBlue & 0x00ff00ff) | ((alphaGreen & 0x00ff00ff) << 8);
+    }
+
+    /**
+     * @return An image with half the width and height of \a image. Each pixel
+     * is the average of 2 x 2 pixels (box filter). The inner loop has no
+     * branches and can be vectorized by the compiler. \a image must use a
+     * format with 32 bits per pixel and premultiplied alpha.
+     */
+    QImage halved(const QImage& image)
+    {
+        const int width = image.width() / 2;
+        const int height = image.height() / 2;
+
+        QImage result(width, height, image.format());
+        for (int y = 0; y < height; ++y) {
+            const quint32* upperLine = reinterpret_cast<const quint32*>(image.constScanLine(2 * y));
+            const quint32* lowerLine = reinterpret_cast<const quint32*>(image.constScanLine(2 * y + 1));
+            quint32* resultLine = reinterpret_cast<quint32*>(result.scanLine(y));
+            for (int x = 0; x < width; ++x) {
+                resultLine[x] = averageOfFour(upperLine[2 * x], upperLine[2 * x + 1],
+                                              lowerLine[2 * x], lowerLine[2 * x + 1]);
+            }
+        }
+        return result;
+    }
 }
 
 void KPixmapModifier::scale(QPixmap& pixmap, const QSize& scaledSize)
@@ -328,9 +394,33 @@ void KPixmapModifier::scale(QPixmap& pixmap, const QSize& scaledSize)
     pixmap.setDevicePixelRatio(dpr);
 }
 
+void KPixmapModifier::scale(QImage& image, const QSize& scaledSize)
+{
+    if (scaledSize.isEmpty() || image.isNull()) {
+        image = QImage();
+        return;
+    }
+
+    const qreal dpr = image.devicePixelRatio();
+    const QSize targetSize = image.size().scaled(scaledSize, Qt::KeepAspectRatio);
+
+    if (image.format() != QImage::Format_RGB32 && image.format() != QImage::Format_ARGB32_Premultiplied) {
+        image = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    }
+
+    while (image.width() >= 2 * targetSize.width() && image.height() >= 2 * targetSize.height()) {
+        image = halved(image);
+    }
+
+    if (image.size() != targetSize) {
+        image = image.scaled(targetSize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    }
+    image.setDevicePixelRatio(dpr);
+}
+
 void KPixmapModifier::applyFrame(QPixmap& icon, const QSize& scaledSize)
 {
-    static TileSet tileSet;
+    const TileSet& tileSet = TileSet::instance();
     qreal dpr = qApp->devicePixelRatio();
 
     // Resize the icon to the maximum size minus the space required for the frame
@@ -354,6 +444,34 @@ void KPixmapModifier::applyFrame(QPixmap& icon, const QSize& scaledSize)
     icon = framedIcon;
 }
 
+void KPixmapModifier::applyFrame(QImage& icon, const QSize& scaledSize, qreal devicePixelRatio)
+{
+    const TileSet& tileSet = TileSet::instance();
+    const qreal dpr = devicePixelRatio;
+
+    // Resize the icon to the maximum size minus the space required for the frame
+    const QSize size(scaledSize.width() - TileSet::LeftMargin - TileSet::RightMargin,
+                     scaledSize.height() - TileSet::TopMargin - TileSet::BottomMargin);
+    scale(icon, size * dpr);
+    icon.setDevicePixelRatio(dpr);
+
+    QImage framedIcon(icon.size().width() + (TileSet::LeftMargin + TileSet::RightMargin) * dpr,
+                      icon.size().height() + (TileSet::TopMargin + TileSet::BottomMargin) * dpr,
+                      QImage::Format_ARGB32_Premultiplied);
+    framedIcon.setDevicePixelRatio(dpr);
+    framedIcon.fill(Qt::transparent);
+
+    QPainter painter;
+    painter.begin(&framedIcon);
+    painter.setCompositionMode(QPainter::CompositionMode_Source);
+    tileSet.paint(&painter, QRect(QPoint(0,0), framedIcon.size() / dpr));
+    painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
+    painter.drawImage(TileSet::LeftMargin, TileSet::TopMargin, icon);
+    painter.end();
+
+    icon = framedIcon;
+}
+
 QSize KPixmapModifier::sizeInsideFrame(const QSize& frameSize)
 {
     return QSize(frameSize.width() - TileSet::LeftMargin - TileSet::RightMargin,
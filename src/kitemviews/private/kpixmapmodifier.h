@@ -22,6 +22,9 @@
 
 #include "dolphin_export.h"
 
+#include <QtGlobal>
+
+class QImage;
 class QPixmap;
 class QSize;
 
@@ -35,6 +38,14 @@ public:
      */
     static void scale(QPixmap& pixmap, const QSize& scaledSize);
 
+    /**
+     * Scale an image to a given size. Large images are halved by a box filter
+     * until the remaining factor is smaller than 2, which is handled by a
+     * bilinear filter. Can be used in worker threads.
+     * @arg scaledSize is in device pixels
+     */
+    static void scale(QImage& image, const QSize& scaledSize);
+
     /**
      * Resize and paint a frame round an icon
      * @arg scaledSize is in device-independent pixels
@@ -42,6 +53,14 @@ public:
      */
     static void applyFrame(QPixmap& icon, const QSize& scaledSize);
 
+    /**
+     * Resize and paint a frame round an image. In contrast to the QPixmap
+     * variant, this can be used in worker threads.
+     * @arg scaledSize is in device-independent pixels
+     * The returned image will be scaled by \a devicePixelRatio
+     */
+    static void applyFrame(QImage& icon, const QSize& scaledSize, qreal devicePixelRatio);
+
     /**
      * return and paint a frame round an icon
      * @arg framesize is in device-independent pixels
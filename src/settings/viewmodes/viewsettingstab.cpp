@@ -45,7 +45,8 @@ ViewSettingsTab::ViewSettingsTab(Mode mode, QWidget* parent) :
     m_fontRequester(0),
     m_widthBox(0),
     m_maxLinesBox(0),
-    m_expandableFolders(0)
+    m_expandableFolders(0),
+    m_recursiveFolderSizes(0)
 {
     QVBoxLayout* topLayout = new QVBoxLayout(this);
 
@@ -126,6 +127,9 @@ ViewSettingsTab::ViewSettingsTab(Mode mode, QWidget* parent) :
     }
     case DetailsMode:
         m_expandableFolders = new QCheckBox(i18nc("@option:check", "Expandable folders"), this);
+        m_recursiveFolderSizes = new QCheckBox(i18nc("@option:check", "Show size of folder contents"), this);
+        m_recursiveFolderSizes->setToolTip(i18nc("@info:tooltip", "Determines the disk usage of all files "
+                                                 "inside a folder, which might take a long time"));
         break;
     default:
         break;
@@ -136,6 +140,9 @@ ViewSettingsTab::ViewSettingsTab(Mode mode, QWidget* parent) :
     if (m_expandableFolders) {
         topLayout->addWidget(m_expandableFolders);
     }
+    if (m_recursiveFolderSizes) {
+        topLayout->addWidget(m_recursiveFolderSizes);
+    }
     topLayout->addStretch(1);
 
     loadSettings();
@@ -154,6 +161,7 @@ ViewSettingsTab::ViewSettingsTab(Mode mode, QWidget* parent) :
         break;
     case DetailsMode:
         connect(m_expandableFolders, &QCheckBox::toggled, this, &ViewSettingsTab::changed);
+        connect(m_recursiveFolderSizes, &QCheckBox::toggled, this, &ViewSettingsTab::changed);
         break;
     default:
         break;
@@ -179,6 +187,7 @@ void ViewSettingsTab::applySettings()
         break;
     case DetailsMode:
         DetailsModeSettings::setExpandableFolders(m_expandableFolders->isChecked());
+        DetailsModeSettings::setRecursiveFolderSizes(m_recursiveFolderSizes->isChecked());
         break;
     default:
         break;
@@ -227,6 +236,7 @@ void ViewSettingsTab::loadSettings()
         break;
     case DetailsMode:
         m_expandableFolders->setChecked(DetailsModeSettings::expandableFolders());
+        m_recursiveFolderSizes->setChecked(DetailsModeSettings::recursiveFolderSizes());
         break;
     default:
         break;
@@ -71,6 +71,7 @@ private:
     KComboBox* m_widthBox;
     KComboBox* m_maxLinesBox;
     QCheckBox* m_expandableFolders;
+    QCheckBox* m_recursiveFolderSizes;
 };
 
 #endif
@@ -0,0 +1,154 @@
+/***************************************************************************
+ *   Copyright (C) 2017 by agent <agent@local>                             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA            *
+ ***************************************************************************/
+
+#include <QFile>
+#include <QTest>
+
+#include "kitemviews/private/kdirectorycontentscounterworker.h"
+#include "testdir.h"
+
+#include <unistd.h>
+
+class KDirectoryContentsCounterWorkerTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    void testCachedCount();
+    void testChangedModificationTime();
+    void testInvalidateCount();
+    void testDirectorySizeWithHardLinks();
+
+private:
+    QString dirPath() const;
+
+private:
+    TestDir* m_testDir;
+    QDateTime m_time;
+};
+
+void KDirectoryContentsCounterWorkerTest::init()
+{
+    m_testDir = new TestDir();
+    m_time = QDateTime::currentDateTime().addDays(-1);
+    m_testDir->createFiles(QStringList() << "dir/a" << "dir/b" << "dir/.hidden");
+    m_testDir->createDir("dir", m_time);
+}
+
+void KDirectoryContentsCounterWorkerTest::cleanup()
+{
+    delete m_testDir;
+    m_testDir = 0;
+}
+
+/**
+ * Verifies that the items are counted for each combination of options,
+ * and that the cached counts are used as long as the modification time
+ * of the directory is unchanged.
+ */
+void KDirectoryContentsCounterWorkerTest::testCachedCount()
+{
+    typedef KDirectoryContentsCounterWorker Worker;
+
+    QCOMPARE(Worker::cachedSubItemsCount(dirPath(), Worker::NoOptions), 2);
+    QCOMPARE(Worker::cachedSubItemsCount(dirPath(), Worker::CountHiddenFiles), 3);
+
+    // Add a file, but keep the modification time like file systems which
+    // store it in seconds do for changes within the same second.
+    m_testDir->createFile("dir/c");
+    m_testDir->createDir("dir", m_time);
+
+    QCOMPARE(Worker::cachedSubItemsCount(dirPath(), Worker::NoOptions), 2);
+    QCOMPARE(Worker::cachedSubItemsCount(dirPath(), Worker::CountHiddenFiles), 3);
+    QCOMPARE(Worker::subItemsCount(dirPath(), Worker::NoOptions), 3);
+}
+
+/**
+ * Verifies that a cached count is not used anymore if the modification
+ * time of the directory has been changed.
+ */
+void KDirectoryContentsCounterWorkerTest::testChangedModificationTime()
+{
+    typedef KDirectoryContentsCounterWorker Worker;
+
+    QCOMPARE(Worker::cachedSubItemsCount(dirPath(), Worker::NoOptions), 2);
+
+    m_testDir->createFile("dir/c");
+    m_testDir->createDir("dir", m_time.addSecs(1));
+
+    QCOMPARE(Worker::cachedSubItemsCount(dirPath(), Worker::NoOptions), 3);
+}
+
+/**
+ * Verifies that invalidateCount() removes the cached counts of
+ * a directory for all options.
+ */
+void KDirectoryContentsCounterWorkerTest::testInvalidateCount()
+{
+    typedef KDirectoryContentsCounterWorker Worker;
+
+    QCOMPARE(Worker::cachedSubItemsCount(dirPath(), Worker::NoOptions), 2);
+    QCOMPARE(Worker::cachedSubItemsCount(dirPath(), Worker::CountHiddenFiles), 3);
+
+    m_testDir->createFile("dir/c");
+    m_testDir->createDir("dir", m_time);
+    Worker::invalidateCount(dirPath());
+
+    QCOMPARE(Worker::cachedSubItemsCount(dirPath(), Worker::NoOptions), 3);
+    QCOMPARE(Worker::cachedSubItemsCount(dirPath(), Worker::CountHiddenFiles), 4);
+}
+
+/**
+ * Verifies that the size of a file with several hard links inside
+ * the scanned directory is only counted once, like "du" does.
+ */
+void KDirectoryContentsCounterWorkerTest::testDirectorySizeWithHardLinks()
+{
+    typedef KDirectoryContentsCounterWorker Worker;
+
+    m_testDir->createFile("size/a/file", QByteArray(16384, 'x'));
+    m_testDir->createDir("size/b");
+    const QString sizePath = m_testDir->path() + QLatin1String("/size");
+
+    QSharedPointer<Worker::SizeScan> scan(new Worker::SizeScan());
+    Worker::directorySize(sizePath, Worker::NoOptions, scan);
+    const KIO::filesize_t size = scan->size();
+    QVERIFY(size > 0);
+
+    QCOMPARE(::link(QFile::encodeName(sizePath + QLatin1String("/a/file")).constData(),
+                    QFile::encodeName(sizePath + QLatin1String("/b/file")).constData()), 0);
+    Worker::invalidateDirectorySize(sizePath + QLatin1String("/a"));
+    Worker::invalidateDirectorySize(sizePath + QLatin1String("/b"));
+
+    QSharedPointer<Worker::SizeScan> linkScan(new Worker::SizeScan());
+    Worker::directorySize(sizePath, Worker::NoOptions, linkScan);
+    QCOMPARE(linkScan->size(), size);
+}
+
+QString KDirectoryContentsCounterWorkerTest::dirPath() const
+{
+    return m_testDir->path() + QLatin1String("/dir");
+}
+
+QTEST_GUILESS_MAIN(KDirectoryContentsCounterWorkerTest)
+
+#include "kdirectorycontentscounterworkertest.moc"
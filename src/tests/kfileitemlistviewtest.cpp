@@ -34,6 +34,7 @@ private slots:
     void init();
     void cleanup();
     void testGroupedItemChanges();
+    void testCoalescedModelChanges();
 
 private:
     KFileItemListView* m_listView;
@@ -110,6 +111,42 @@ void KFileItemListViewTest::testGroupedItemChanges()
     QCOMPARE(m_model->count(), 2);
 }
 
+/**
+ * Inserting items several times within one frame must result in only
+ * one postponed layout after the first change. After the layout, the
+ * visible widgets must show the items of the model.
+ */
+void KFileItemListViewTest::testCoalescedModelChanges()
+{
+    m_listView->setGeometry(QRectF(0, 0, 500, 500));
+
+    const QUrl dirUrl = m_testDir->url();
+    for (int i = 0; i < 5; ++i) {
+        const QUrl url = QUrl::fromLocalFile(m_testDir->path() + "/" + QString::number(i));
+        m_model->slotItemsAdded(dirUrl, KFileItemList() << KFileItem(url, QString(), KFileItem::Unknown));
+        m_model->dispatchPendingItemsToInsert();
+
+        if (i == 0) {
+            // The first change of a frame is laid out immediately.
+            QVERIFY(!m_listView->m_modelChangeTimer->isActive());
+            QCOMPARE(m_listView->m_visibleItems.count(), 1);
+        }
+    }
+
+    QCOMPARE(m_model->count(), 5);
+    QVERIFY(m_listView->m_modelChangeTimer->isActive());
+
+    QTRY_VERIFY(!m_listView->m_modelChangeTimer->isActive());
+    QCOMPARE(m_listView->m_visibleItems.count(), 5);
+
+    QHashIterator<int, KItemListWidget*> it(m_listView->m_visibleItems);
+    while (it.hasNext()) {
+        it.next();
+        QCOMPARE(it.value()->index(), it.key());
+        QCOMPARE(it.value()->data().value("text").toString(), m_model->data(it.key()).value("text").toString());
+    }
+}
+
 QTEST_MAIN(KFileItemListViewTest)
 
 #include "kfileitemlistviewtest.moc"
@@ -0,0 +1,133 @@
+/***************************************************************************
+ *   Copyright (C) 2017 by agent <agent@local>                             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA            *
+ ***************************************************************************/
+
+#include <QTest>
+#include <QSignalSpy>
+#include <QFile>
+
+#include <KIO/UDSEntry>
+
+#include "kitemviews/private/kfileitemmimetyperesolver.h"
+#include "testdir.h"
+
+#include <sys/stat.h>
+
+class KFileItemMimeTypeResolverTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void init();
+    void cleanup();
+
+    void testResolveByContents();
+    void testMissingFile();
+    void testBrokenSymLink();
+
+private:
+    KFileItem createItem(const QString& fileName) const;
+    QString resolveMimeType(const KFileItem& item);
+
+private:
+    KFileItemMimeTypeResolver* m_resolver;
+    TestDir* m_testDir;
+};
+
+void KFileItemMimeTypeResolverTest::initTestCase()
+{
+    qRegisterMetaType<KFileItem>("KFileItem");
+}
+
+void KFileItemMimeTypeResolverTest::init()
+{
+    m_testDir = new TestDir();
+    m_resolver = new KFileItemMimeTypeResolver();
+}
+
+void KFileItemMimeTypeResolverTest::cleanup()
+{
+    delete m_resolver;
+    m_resolver = 0;
+
+    delete m_testDir;
+    m_testDir = 0;
+}
+
+/**
+ * Verifies that the MIME type of a file without a known extension
+ * is determined by reading its contents.
+ */
+void KFileItemMimeTypeResolverTest::testResolveByContents()
+{
+    m_testDir->createFile("README", "Some text");
+
+    const KFileItem item = createItem("README");
+    QVERIFY(KFileItemMimeTypeResolver::canResolve(item));
+    QCOMPARE(resolveMimeType(item), QString("text/plain"));
+}
+
+/**
+ * Verifies that the MIME type of a file that has been deleted
+ * before the worker has checked it is announced nevertheless.
+ */
+void KFileItemMimeTypeResolverTest::testMissingFile()
+{
+    const KFileItem item = createItem("missing");
+    QVERIFY(KFileItemMimeTypeResolver::canResolve(item));
+    QCOMPARE(resolveMimeType(item), QString("application/octet-stream"));
+}
+
+/**
+ * Verifies that a MIME type is announced for a symbolic link
+ * whose target does not exist.
+ */
+void KFileItemMimeTypeResolverTest::testBrokenSymLink()
+{
+    const QString linkPath = m_testDir->path() + QLatin1String("/link.txt");
+    QVERIFY(QFile::link(m_testDir->path() + QLatin1String("/nonexistent"), linkPath));
+
+    const KFileItem item = createItem("link.txt");
+    QVERIFY(KFileItemMimeTypeResolver::canResolve(item));
+    QCOMPARE(resolveMimeType(item), QString("text/plain"));
+}
+
+KFileItem KFileItemMimeTypeResolverTest::createItem(const QString& fileName) const
+{
+    KIO::UDSEntry entry;
+    entry.insert(KIO::UDSEntry::UDS_NAME, fileName);
+    entry.insert(KIO::UDSEntry::UDS_FILE_TYPE, S_IFREG);
+
+    const QUrl url = QUrl::fromLocalFile(m_testDir->path() + QLatin1Char('/') + fileName);
+    return KFileItem(entry, url, true);
+}
+
+QString KFileItemMimeTypeResolverTest::resolveMimeType(const KFileItem& item)
+{
+    QSignalSpy spy(m_resolver, SIGNAL(mimeTypeResolved(KFileItem,QString)));
+    m_resolver->addItem(item);
+    if (!spy.wait() || spy.count() != 1 || m_resolver->isPending(item)) {
+        return QString();
+    }
+    return spy.first().at(1).toString();
+}
+
+QTEST_GUILESS_MAIN(KFileItemMimeTypeResolverTest)
+
+#include "kfileitemmimetyperesolvertest.moc"
@@ -62,6 +62,10 @@ public:
 private slots:
     void insertAndRemoveManyItems_data();
     void insertAndRemoveManyItems();
+    void insertItemsAndLookUpIndexes_data();
+    void insertItemsAndLookUpIndexes();
+    void sortBySortRole_data();
+    void sortBySortRole();
 
 private:
     static KFileItemList createFileItemList(const QStringList& fileNames, const QString& urlPrefix = QLatin1String("file:///"));
@@ -79,6 +83,7 @@ void KFileItemModelBenchmark::insertAndRemoveManyItems_data()
     QTest::addColumn<KFileItemList>("expectedFinalItems");
     QTest::addColumn<KItemRangeList>("expectedItemsInserted");
     QTest::addColumn<KItemRangeList>("expectedItemsRemoved");
+    QTest::addColumn<bool>("naturalSorting");
 
     QList<int> sizes;
     sizes << 100000;
@@ -89,6 +94,9 @@ void KFileItemModelBenchmark::insertAndRemoveManyItems_data()
             allStrings << QString::number(i);
         }
 
+        // The numbers are in the order that is expected with natural sorting.
+        const KFileItemList allNatural = createFileItemList(allStrings);
+
         // We want to keep the sorting overhead in the benchmark low.
         // Therefore, we do not use natural sorting. However, this
         // means that our list is currently not sorted.
@@ -129,25 +137,28 @@ void KFileItemModelBenchmark::insertAndRemoveManyItems_data()
         char buffer[bufferSize];
 
         snprintf(buffer, bufferSize, "all--n=%i", n);
-        QTest::newRow(buffer) << all << KFileItemList() << KFileItemList() << all << KItemRangeList() << KItemRangeList();
+        QTest::newRow(buffer) << all << KFileItemList() << KFileItemList() << all << KItemRangeList() << KItemRangeList() << false;
 
         snprintf(buffer, bufferSize, "1st half + 2nd half--n=%i", n);
-        QTest::newRow(buffer) << firstHalf << secondHalf << KFileItemList() << all << itemRangeListSecondHalf << KItemRangeList();
+        QTest::newRow(buffer) << firstHalf << secondHalf << KFileItemList() << all << itemRangeListSecondHalf << KItemRangeList() << false;
 
         snprintf(buffer, bufferSize, "2nd half + 1st half--n=%i", n);
-        QTest::newRow(buffer) << secondHalf << firstHalf << KFileItemList() << all << itemRangeListFirstHalf << KItemRangeList();
+        QTest::newRow(buffer) << secondHalf << firstHalf << KFileItemList() << all << itemRangeListFirstHalf << KItemRangeList() << false;
 
         snprintf(buffer, bufferSize, "even + odd--n=%i", n);
-        QTest::newRow(buffer) << even << odd << KFileItemList() << all << itemRangeListOddInserted << KItemRangeList();
+        QTest::newRow(buffer) << even << odd << KFileItemList() << all << itemRangeListOddInserted << KItemRangeList() << false;
 
         snprintf(buffer, bufferSize, "all - 2nd half--n=%i", n);
-        QTest::newRow(buffer) << all << KFileItemList() << secondHalf << firstHalf << KItemRangeList() << itemRangeListSecondHalf;
+        QTest::newRow(buffer) << all << KFileItemList() << secondHalf << firstHalf << KItemRangeList() << itemRangeListSecondHalf << false;
 
         snprintf(buffer, bufferSize, "all - 1st half--n=%i", n);
-        QTest::newRow(buffer) << all << KFileItemList() << firstHalf << secondHalf << KItemRangeList() << itemRangeListFirstHalf;
+        QTest::newRow(buffer) << all << KFileItemList() << firstHalf << secondHalf << KItemRangeList() << itemRangeListFirstHalf << false;
 
         snprintf(buffer, bufferSize, "all - odd--n=%i", n);
-        QTest::newRow(buffer) << all << KFileItemList() << odd << even << KItemRangeList() << itemRangeListOddRemoved;
+        QTest::newRow(buffer) << all << KFileItemList() << odd << even << KItemRangeList() << itemRangeListOddRemoved << false;
+
+        snprintf(buffer, bufferSize, "all, natural sorting--n=%i", n);
+        QTest::newRow(buffer) << allNatural << KFileItemList() << KFileItemList() << allNatural << KItemRangeList() << KItemRangeList() << true;
     }
 }
 
@@ -159,12 +170,13 @@ void KFileItemModelBenchmark::insertAndRemoveManyItems()
     QFETCH(KFileItemList, expectedFinalItems);
     QFETCH(KItemRangeList, expectedItemsInserted);
     QFETCH(KItemRangeList, expectedItemsRemoved);
+    QFETCH(bool, naturalSorting);
 
     KFileItemModel model;
 
-    // Avoid overhead caused by natural sorting
-    // and determining the isDir/isLink roles.
-    model.m_naturalSorting = false;
+    // Avoid overhead caused by natural sorting (unless the natural
+    // sorting itself should be measured) and determining the isDir/isLink roles.
+    model.m_naturalSorting = naturalSorting;
     model.setRoles({"text"});
 
     QSignalSpy spyItemsInserted(&model, SIGNAL(itemsInserted(KItemRangeList)));
@@ -207,6 +219,126 @@ void KFileItemModelBenchmark::insertAndRemoveManyItems()
     }
 }
 
+void KFileItemModelBenchmark::insertItemsAndLookUpIndexes_data()
+{
+    QTest::addColumn<KFileItemList>("initialItems");
+    QTest::addColumn<KFileItemList>("newItems");
+    QTest::addColumn<int>("batchSize");
+
+    QList<int> sizes;
+    sizes << 100000;
+
+    foreach (int n, sizes) {
+        QStringList allStrings;
+        for (int i = 0; i < n; ++i) {
+            allStrings << QString::number(i);
+        }
+        allStrings.sort();
+
+        const KFileItemList all = createFileItemList(allStrings);
+
+        // Every 100th item is added in small batches after the initial items
+        // have been loaded, like files that are created in a watched directory.
+        KFileItemList initialItems, newItems;
+        for (int i = 0; i < n; ++i) {
+            if (i % 100 == 50) {
+                newItems << all.at(i);
+            } else {
+                initialItems << all.at(i);
+            }
+        }
+
+        const int bufferSize = 128;
+        char buffer[bufferSize];
+
+        snprintf(buffer, bufferSize, "batches of 1--n=%i", n);
+        QTest::newRow(buffer) << initialItems << newItems << 1;
+
+        snprintf(buffer, bufferSize, "batches of 10--n=%i", n);
+        QTest::newRow(buffer) << initialItems << newItems << 10;
+    }
+}
+
+void KFileItemModelBenchmark::insertItemsAndLookUpIndexes()
+{
+    QFETCH(KFileItemList, initialItems);
+    QFETCH(KFileItemList, newItems);
+    QFETCH(int, batchSize);
+
+    KFileItemModel model;
+    model.m_naturalSorting = false;
+    model.setRoles({"text"});
+
+    QBENCHMARK {
+        model.slotClear();
+        model.slotItemsAdded(model.directory(), initialItems);
+        model.slotCompleted();
+        QCOMPARE(model.count(), initialItems.count());
+
+        // After each batch, the indexes of the new items and of the last
+        // item are requested, like the roles updater and the version control
+        // observer do it after the model has been changed.
+        const KFileItem lastItem = initialItems.last();
+        for (int i = 0; i < newItems.count(); i += batchSize) {
+            const KFileItemList batch = newItems.mid(i, batchSize);
+            model.slotItemsAdded(model.directory(), batch);
+            model.slotCompleted();
+
+            foreach (const KFileItem& item, batch) {
+                QVERIFY(model.index(item) >= 0);
+            }
+            QCOMPARE(model.index(lastItem), model.count() - 1);
+        }
+        QCOMPARE(model.count(), initialItems.count() + newItems.count());
+    }
+
+    QVERIFY(model.isConsistent());
+}
+
+void KFileItemModelBenchmark::sortBySortRole_data()
+{
+    QTest::addColumn<QByteArray>("sortRole");
+    QTest::addColumn<int>("itemCount");
+
+    QTest::newRow("size--n=100000") << QByteArray("size") << 100000;
+    QTest::newRow("rating--n=100000") << QByteArray("rating") << 100000;
+}
+
+void KFileItemModelBenchmark::sortBySortRole()
+{
+    QFETCH(QByteArray, sortRole);
+    QFETCH(int, itemCount);
+
+    QStringList fileNames;
+    for (int i = 0; i < itemCount; ++i) {
+        fileNames << QString::number(i);
+    }
+
+    KFileItemModel model;
+    model.m_naturalSorting = false;
+    model.setRoles({"text", sortRole});
+    model.slotItemsAdded(model.directory(), createFileItemList(fileNames));
+    model.slotCompleted();
+    QCOMPARE(model.count(), itemCount);
+
+    // Assign values in an order that differs from the order of the names.
+    for (int i = 0; i < itemCount; ++i) {
+        QHash<QByteArray, QVariant> values;
+        values.insert(sortRole, (i * 7919) % 1000);
+        model.setData(i, values);
+    }
+    model.m_resortAllItemsTimer->stop();
+
+    model.setSortRole(sortRole);
+
+    QBENCHMARK {
+        model.setSortOrder(Qt::DescendingOrder);
+        model.setSortOrder(Qt::AscendingOrder);
+    }
+
+    QVERIFY(model.isConsistent());
+}
+
 KFileItemList KFileItemModelBenchmark::createFileItemList(const QStringList& fileNames, const QString& prefix)
 {
     // Suppress 'file does not exist anymore' messages from KFileItemPrivate::init().
@@ -68,8 +68,13 @@ private slots:
     void testRemoveItems();
     void testDirLoadingCompleted();
     void testSetData();
+    void testSetRoleValues();
+    void testSetValuesOfSeveralRoles();
+    void testRoleValue();
+    void testRecursiveDirectorySize();
     void testSetDataWithModifiedSortRole_data();
     void testSetDataWithModifiedSortRole();
+    void testResortChangedItems();
     void testChangeSortRole();
     void testResortAfterChangingName();
     void testModelConsistencyWhenInsertingItems();
@@ -89,6 +94,7 @@ private slots:
     void testGeneralParentChildRelationships();
     void testNameRoleGroups();
     void testNameRoleGroupsWithExpandedItems();
+    void testGroupsAfterInsertingAndRemovingItems();
     void testInconsistentModel();
     void testChangeRolesForFilteredItems();
     void testChangeSortRoleWhileFiltering();
@@ -96,6 +102,8 @@ private slots:
     void testCollapseFolderWhileLoading();
     void testCreateMimeData();
     void testDeleteFileMoreThanOnce();
+    void testPrepareItemsInWorkerThread();
+    void testCollapseFolderWhilePreparingItems();
 
 private:
     QStringList itemsInModel() const;
@@ -265,6 +273,184 @@ void KFileItemModelTest::testSetData()
     QVERIFY(m_model->isConsistent());
 }
 
+/**
+ * Verifies that setRoleValues() changes the values of several items,
+ * e.g. the version states of a repository, with only one itemsChanged()
+ * signal, and that unchanged values do not result in any signal.
+ */
+void KFileItemModelTest::testSetRoleValues()
+{
+    QSignalSpy itemsInsertedSpy(m_model, SIGNAL(itemsInserted(KItemRangeList)));
+    QVERIFY(itemsInsertedSpy.isValid());
+    QSignalSpy itemsChangedSpy(m_model, SIGNAL(itemsChanged(KItemRangeList, QSet<QByteArray>)));
+    QVERIFY(itemsChangedSpy.isValid());
+
+    m_testDir->createFiles({"a.txt", "b.txt", "c.txt", "d.txt"});
+
+    m_model->loadDirectory(m_testDir->url());
+    QVERIFY(itemsInsertedSpy.wait());
+    QCOMPARE(m_model->count(), 4);
+
+    QHash<int, QVariant> values;
+    values.insert(0, 1);
+    values.insert(2, 2);
+    values.insert(3, 2);
+    values.insert(4, 3); // Invalid index, which must be ignored
+    m_model->setRoleValues("version", values);
+
+    QCOMPARE(itemsChangedSpy.count(), 1);
+    QList<QVariant> arguments = itemsChangedSpy.takeFirst();
+    QCOMPARE(arguments.at(0).value<KItemRangeList>(), KItemRangeList() << KItemRange(0, 1) << KItemRange(2, 2));
+    QCOMPARE(arguments.at(1).value<QSet<QByteArray> >(), QSet<QByteArray>() << "version");
+
+    QCOMPARE(m_model->data(0).value("version").toInt(), 1);
+    QVERIFY(!m_model->data(1).contains("version"));
+    QCOMPARE(m_model->data(2).value("version").toInt(), 2);
+    QCOMPARE(m_model->data(3).value("version").toInt(), 2);
+
+    // Setting the same values again does not change anything.
+    m_model->setRoleValues("version", values);
+    QCOMPARE(itemsChangedSpy.count(), 0);
+
+    values.clear();
+    values.insert(1, 1);
+    values.insert(2, 2);
+    m_model->setRoleValues("version", values);
+    QCOMPARE(itemsChangedSpy.count(), 1);
+    arguments = itemsChangedSpy.takeFirst();
+    QCOMPARE(arguments.at(0).value<KItemRangeList>(), KItemRangeList() << KItemRange(1, 1));
+    QCOMPARE(m_model->data(1).value("version").toInt(), 1);
+    QVERIFY(m_model->isConsistent());
+}
+
+/**
+ * Verifies that setting the values of several roles for several items,
+ * like KFileItemModelRolesUpdater does once per frame, results in only
+ * one itemsChanged() signal.
+ */
+void KFileItemModelTest::testSetValuesOfSeveralRoles()
+{
+    QSignalSpy itemsInsertedSpy(m_model, SIGNAL(itemsInserted(KItemRangeList)));
+    QVERIFY(itemsInsertedSpy.isValid());
+    QSignalSpy itemsChangedSpy(m_model, SIGNAL(itemsChanged(KItemRangeList, QSet<QByteArray>)));
+    QVERIFY(itemsChangedSpy.isValid());
+
+    m_testDir->createFiles({"a.txt", "b.txt", "c.txt", "d.txt"});
+
+    m_model->loadDirectory(m_testDir->url());
+    QVERIFY(itemsInsertedSpy.wait());
+    QCOMPARE(m_model->count(), 4);
+
+    QHash<QByteArray, QVariant> valuesA;
+    valuesA.insert("iconName", "text-x-generic");
+    valuesA.insert("version", 1);
+    QHash<QByteArray, QVariant> valuesB;
+    valuesB.insert("iconOverlays", QStringList() << "emblem-symbolic-link");
+    QHash<QByteArray, QVariant> valuesD;
+    valuesD.insert("version", 2);
+
+    QHash<int, QHash<QByteArray, QVariant> > values;
+    values.insert(0, valuesA);
+    values.insert(1, valuesB);
+    values.insert(3, valuesD);
+    values.insert(4, valuesD); // Invalid index, which must be ignored
+    m_model->setRoleValues(values);
+
+    QCOMPARE(itemsChangedSpy.count(), 1);
+    const QList<QVariant> arguments = itemsChangedSpy.takeFirst();
+    QCOMPARE(arguments.at(0).value<KItemRangeList>(), KItemRangeList() << KItemRange(0, 2) << KItemRange(3, 1));
+    QCOMPARE(arguments.at(1).value<QSet<QByteArray> >(),
+             QSet<QByteArray>() << "iconName" << "version" << "iconOverlays");
+
+    QCOMPARE(m_model->data(0).value("iconName").toString(), QString("text-x-generic"));
+    QCOMPARE(m_model->data(0).value("version").toInt(), 1);
+    QCOMPARE(m_model->data(1).value("iconOverlays").toStringList(), QStringList() << "emblem-symbolic-link");
+    QCOMPARE(m_model->data(3).value("version").toInt(), 2);
+
+    // Setting the same values again does not change anything.
+    m_model->setRoleValues(values);
+    QCOMPARE(itemsChangedSpy.count(), 0);
+    QVERIFY(m_model->isConsistent());
+}
+
+void KFileItemModelTest::testRoleValue()
+{
+    QSignalSpy itemsInsertedSpy(m_model, SIGNAL(itemsInserted(KItemRangeList)));
+
+    QSet<QByteArray> modelRoles = m_model->roles();
+    modelRoles << "size" << "owner";
+    m_model->setRoles(modelRoles);
+
+    m_testDir->createDir("a");
+    m_testDir->createFile("b.txt");
+
+    m_model->loadDirectory(m_testDir->url());
+    QVERIFY(itemsInsertedSpy.wait());
+    QCOMPARE(m_model->count(), 2);
+
+    QHash<QByteArray, QVariant> values;
+    values.insert("customRole", "Test");
+    m_model->setData(1, values);
+
+    // roleValue() must return the same values as data() for all roles
+    for (int index = 0; index < m_model->count(); ++index) {
+        const QHash<QByteArray, QVariant> data = m_model->data(index);
+        QHashIterator<QByteArray, QVariant> it(data);
+        while (it.hasNext()) {
+            it.next();
+            QCOMPARE(m_model->roleValue(index, KItemModelBase::roleId(it.key())), it.value());
+        }
+    }
+
+    QCOMPARE(m_model->roleValue(1, KItemModelBase::roleId("customRole")).toString(), QString("Test"));
+    QVERIFY(!m_model->roleValue(0, KItemModelBase::roleId("customRole")).isValid());
+    QVERIFY(!m_model->roleValue(2, KItemModelBase::roleId("text")).isValid());
+
+    QCOMPARE(KItemModelBase::roleId("text"), KItemModelBase::roleId("text"));
+    QCOMPARE(KItemModelBase::roleForId(KItemModelBase::roleId("text")), QByteArray("text"));
+}
+
+void KFileItemModelTest::testRecursiveDirectorySize()
+{
+    QSignalSpy itemsInsertedSpy(m_model, SIGNAL(itemsInserted(KItemRangeList)));
+    QSignalSpy itemsMovedSpy(m_model, SIGNAL(itemsMoved(KItemRange,QList<int>)));
+    QVERIFY(itemsMovedSpy.isValid());
+
+    QSet<QByteArray> modelRoles = m_model->roles();
+    modelRoles << "size";
+    m_model->setRoles(modelRoles);
+    m_model->setSortRole("size");
+
+    m_testDir->createDir("a");
+    m_testDir->createDir("b");
+
+    m_model->loadDirectory(m_testDir->url());
+    QVERIFY(itemsInsertedSpy.wait());
+    QCOMPARE(itemsInModel(), QStringList() << "a" << "b");
+
+    // The size of a directory is the number of items per default
+    QHash<QByteArray, QVariant> values;
+    values.insert("size", 2);
+    m_model->setData(1, values);
+    QCOMPARE(m_model->data(1).value("size").userType(), int(QVariant::Int));
+    QCOMPARE(m_model->data(1).value("size").toInt(), 2);
+
+    // The size of the contents of a directory might exceed the range of int
+    const KIO::filesize_t contentsSize = Q_UINT64_C(4294967297);
+    values.insert("size", QVariant::fromValue(contentsSize));
+    m_model->setData(0, values);
+    QVERIFY(itemsMovedSpy.wait());
+    QCOMPARE(itemsInModel(), QStringList() << "b" << "a");
+    QCOMPARE(m_model->data(1).value("size").userType(), qMetaTypeId<KIO::filesize_t>());
+    QCOMPARE(m_model->data(1).value("size").value<KIO::filesize_t>(), contentsSize);
+
+    // Setting the number of items again replaces the size of the contents
+    values.insert("size", 3);
+    m_model->setData(1, values);
+    QCOMPARE(m_model->data(1).value("size").userType(), int(QVariant::Int));
+    QVERIFY(m_model->isConsistent());
+}
+
 void KFileItemModelTest::testSetDataWithModifiedSortRole_data()
 {
     QTest::addColumn<int>("changedIndex");
@@ -350,6 +536,49 @@ void KFileItemModelTest::testSetDataWithModifiedSortRole()
     QVERIFY(m_model->isConsistent());
 }
 
+void KFileItemModelTest::testResortChangedItems()
+{
+    QSignalSpy itemsInsertedSpy(m_model, SIGNAL(itemsInserted(KItemRangeList)));
+    QVERIFY(itemsInsertedSpy.isValid());
+    QSignalSpy itemsMovedSpy(m_model, SIGNAL(itemsMoved(KItemRange,QList<int>)));
+    QVERIFY(itemsMovedSpy.isValid());
+
+    m_model->setSortRole("rating");
+
+    m_testDir->createFiles({"a", "b", "c", "d", "e", "f", "g", "h", "i", "j"});
+
+    m_model->loadDirectory(m_testDir->url());
+    QVERIFY(itemsInsertedSpy.wait());
+
+    // Assign increasing ratings, which does not change the order of the items.
+    for (int index = 0; index < m_model->count(); ++index) {
+        QHash<QByteArray, QVariant> rating;
+        rating.insert("rating", (index + 1) * 10);
+        m_model->setData(index, rating);
+    }
+    QVERIFY(!itemsMovedSpy.wait(100));
+    QCOMPARE(itemsInModel(), QStringList() << "a" << "b" << "c" << "d" << "e" << "f" << "g" << "h" << "i" << "j");
+
+    // Change the ratings of "b" and "i". Only these two items are moved,
+    // and a single itemsMoved() signal covers both changes.
+    QHash<QByteArray, QVariant> ratingB;
+    ratingB.insert("rating", 75);
+    m_model->setData(1, ratingB);
+
+    QHash<QByteArray, QVariant> ratingI;
+    ratingI.insert("rating", 5);
+    m_model->setData(8, ratingI);
+
+    QVERIFY(itemsMovedSpy.wait());
+    QCOMPARE(itemsMovedSpy.count(), 1);
+    QList<QVariant> arguments = itemsMovedSpy.takeFirst();
+    QCOMPARE(arguments.at(0).value<KItemRange>(), KItemRange(0, 9));
+    QCOMPARE(arguments.at(1).value<QList<int> >(), QList<int>() << 1 << 7 << 2 << 3 << 4 << 5 << 6 << 8 << 0);
+
+    QCOMPARE(itemsInModel(), QStringList() << "i" << "a" << "c" << "d" << "e" << "f" << "g" << "b" << "h" << "j");
+    QVERIFY(m_model->isConsistent());
+}
+
 void KFileItemModelTest::testChangeSortRole()
 {
     QSignalSpy itemsInsertedSpy(m_model, SIGNAL(itemsInserted(KItemRangeList)));
@@ -1435,6 +1664,60 @@ void KFileItemModelTest::testNameRoleGroupsWithExpandedItems()
     QCOMPARE(m_model->groups(), expectedGroups);
 }
 
+void KFileItemModelTest::testGroupsAfterInsertingAndRemovingItems()
+{
+    QSignalSpy itemsInsertedSpy(m_model, SIGNAL(itemsInserted(KItemRangeList)));
+
+    m_testDir->createFiles({"b1", "b2", "d1", "f1"});
+
+    m_model->setGroupedSorting(true);
+    m_model->loadDirectory(m_testDir->url());
+    QVERIFY(itemsInsertedSpy.wait());
+    QCOMPARE(itemsInModel(), QStringList() << "b1" << "b2" << "d1" << "f1");
+
+    QList<QPair<int, QVariant> > expectedGroups;
+    expectedGroups << QPair<int, QVariant>(0, QLatin1String("B"));
+    expectedGroups << QPair<int, QVariant>(2, QLatin1String("D"));
+    expectedGroups << QPair<int, QVariant>(3, QLatin1String("F"));
+    QCOMPARE(m_model->groups(), expectedGroups);
+
+    // Insert items in front of, inside, and behind the existing groups.
+    // The groups are updated without determining them again.
+    KFileItemList items;
+    foreach (const QString& name, QStringList() << "a1" << "c1" << "d2" << "g1") {
+        items << KFileItem(QUrl::fromLocalFile(m_testDir->path() + '/' + name), QString(), KFileItem::Unknown);
+    }
+    m_model->slotItemsAdded(m_model->directory(), items);
+    m_model->slotCompleted();
+    QCOMPARE(itemsInModel(), QStringList() << "a1" << "b1" << "b2" << "c1" << "d1" << "d2" << "f1" << "g1");
+
+    expectedGroups.clear();
+    expectedGroups << QPair<int, QVariant>(0, QLatin1String("A"));
+    expectedGroups << QPair<int, QVariant>(1, QLatin1String("B"));
+    expectedGroups << QPair<int, QVariant>(3, QLatin1String("C"));
+    expectedGroups << QPair<int, QVariant>(4, QLatin1String("D"));
+    expectedGroups << QPair<int, QVariant>(6, QLatin1String("F"));
+    expectedGroups << QPair<int, QVariant>(7, QLatin1String("G"));
+    QCOMPARE(m_model->groups(), expectedGroups);
+
+    // Remove a whole group, a group that follows directly, and the first item of a group.
+    m_model->slotItemsDeleted(KFileItemList() << m_model->fileItem(1) << m_model->fileItem(2)
+                                              << m_model->fileItem(3) << m_model->fileItem(4));
+    QCOMPARE(itemsInModel(), QStringList() << "a1" << "d2" << "f1" << "g1");
+
+    expectedGroups.clear();
+    expectedGroups << QPair<int, QVariant>(0, QLatin1String("A"));
+    expectedGroups << QPair<int, QVariant>(1, QLatin1String("D"));
+    expectedGroups << QPair<int, QVariant>(2, QLatin1String("F"));
+    expectedGroups << QPair<int, QVariant>(3, QLatin1String("G"));
+    QCOMPARE(m_model->groups(), expectedGroups);
+
+    // The result must not differ from determining all groups again.
+    m_model->m_groups.clear();
+    QCOMPARE(m_model->groups(), expectedGroups);
+    QVERIFY(m_model->isConsistent());
+}
+
 void KFileItemModelTest::testInconsistentModel()
 {
     QSignalSpy itemsInsertedSpy(m_model, SIGNAL(itemsInserted(KItemRangeList)));
@@ -1743,6 +2026,76 @@ void KFileItemModelTest::testDeleteFileMoreThanOnce()
     QCOMPARE(itemsInModel(), QStringList() << "a.txt" << "c.txt" << "d.txt");
 }
 
+/**
+ * Verifies that large batches of items, which are prepared in a worker thread,
+ * are filtered and sorted like items that are prepared in the main thread.
+ */
+void KFileItemModelTest::testPrepareItemsInWorkerThread()
+{
+    QSignalSpy itemsInsertedSpy(m_model, SIGNAL(itemsInserted(KItemRangeList)));
+
+    m_model->setNameFilter("a");
+
+    KFileItemList items;
+    for (int i = 0; i < 500; ++i) {
+        const QString name = QLatin1String(i % 2 == 0 ? "a" : "b") + QString::number(i);
+        items << KFileItem(QUrl::fromLocalFile(m_testDir->path() + '/' + name), QString(), KFileItem::Unknown);
+    }
+
+    m_model->slotItemsAdded(m_testDir->url(), items);
+    m_model->slotCompleted();
+
+    QCOMPARE(itemsInsertedSpy.count(), 1);
+    QCOMPARE(m_model->count(), 250);
+    QCOMPARE(m_model->m_filteredItems.count(), 250);
+    QVERIFY(m_model->isConsistent());
+    QCOMPARE(m_model->data(0).value("text").toString(), QString("a0"));
+
+    m_model->setNameFilter(QString());
+    QCOMPARE(m_model->count(), 500);
+    QVERIFY(m_model->isConsistent());
+}
+
+/**
+ * Verifies that the children of a folder, which are prepared in a worker
+ * thread, are not added to the model if the folder gets collapsed while
+ * the children are prepared.
+ */
+void KFileItemModelTest::testCollapseFolderWhilePreparingItems()
+{
+    QSignalSpy itemsInsertedSpy(m_model, SIGNAL(itemsInserted(KItemRangeList)));
+
+    QSet<QByteArray> modelRoles = m_model->roles();
+    modelRoles << "isExpanded" << "isExpandable" << "expandedParentsCount";
+    m_model->setRoles(modelRoles);
+
+    m_testDir->createFile("a/b.txt");
+
+    m_model->loadDirectory(m_testDir->url());
+    QVERIFY(itemsInsertedSpy.wait());
+    QCOMPARE(itemsInModel(), QStringList() << "a");
+
+    m_model->setExpanded(0, true);
+    QVERIFY(m_model->isExpanded(0));
+    QVERIFY(itemsInsertedSpy.wait());
+    QCOMPARE(itemsInModel(), QStringList() << "a" << "b.txt");
+
+    // Simulate that many new items appear in "a/", which are prepared
+    // in a worker thread.
+    const QUrl urlA = m_model->fileItem(0).url();
+    KFileItemList items;
+    for (int i = 0; i < 200; ++i) {
+        const QUrl url = QUrl::fromLocalFile(m_testDir->path() + "/a/c" + QString::number(i));
+        items << KFileItem(url, QString(), KFileItem::Unknown);
+    }
+    m_model->slotItemsAdded(urlA, items);
+
+    m_model->setExpanded(0, false);
+    m_model->slotCompleted();
+    QCOMPARE(itemsInModel(), QStringList() << "a");
+    QVERIFY(m_model->isConsistent());
+}
+
 QStringList KFileItemModelTest::itemsInModel() const
 {
     QStringList items;
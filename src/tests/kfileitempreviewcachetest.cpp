@@ -0,0 +1,261 @@
+/***************************************************************************
+ *   Copyright (C) 2017 by agent <agent@local>                             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA            *
+ ***************************************************************************/
+
+#include <QTest>
+#include <QDir>
+#include <QFile>
+#include <QImage>
+#include <QPixmap>
+#include <QStandardPaths>
+
+#include <KFileItem>
+#include <KIO/UDSEntry>
+
+#include "kitemviews/private/kfileitempreviewcache.h"
+#include "testdir.h"
+
+#ifdef Q_OS_UNIX
+#include <utime.h>
+#else
+#include <sys/utime.h>
+#endif
+
+class KFileItemPreviewCacheTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void init();
+    void cleanup();
+
+    void testPixmap();
+    void testChangedModificationTime();
+    void testChangedIconSize();
+    void testChangedPlugins();
+    void testRemoteFile();
+    void testCorruptHeader();
+    void testRemoveOldestFiles();
+
+private:
+    KFileItem createItem(const QString& fileName, const QDateTime& time);
+    static QImage createImage();
+    static void setTimeStamp(const QString& path, const QDateTime& time);
+
+private:
+    KFileItemPreviewCache* m_cache;
+    TestDir* m_testDir;
+    QDateTime m_time;
+};
+
+void KFileItemPreviewCacheTest::initTestCase()
+{
+    QStandardPaths::setTestModeEnabled(true);
+}
+
+void KFileItemPreviewCacheTest::init()
+{
+    m_testDir = new TestDir();
+    m_time = QDateTime::currentDateTime().addDays(-1);
+
+    m_cache = new KFileItemPreviewCache();
+    m_cache->setIconSize(QSize(64, 64));
+    m_cache->setEnabledPlugins(QStringList() << "imagethumbnail");
+}
+
+void KFileItemPreviewCacheTest::cleanup()
+{
+    QDir(m_cache->m_path).removeRecursively();
+
+    delete m_cache;
+    m_cache = 0;
+
+    delete m_testDir;
+    m_testDir = 0;
+}
+
+/**
+ * Verifies that an inserted preview is returned by pixmap().
+ */
+void KFileItemPreviewCacheTest::testPixmap()
+{
+    const KFileItem item = createItem("a.png", m_time);
+    QVERIFY(m_cache->pixmap(item).isNull());
+
+    const QImage image = createImage();
+    m_cache->insert(item, image);
+
+    // The file is written in a worker thread.
+    QTRY_VERIFY(!m_cache->pixmap(item).isNull());
+    const QPixmap pixmap = m_cache->pixmap(item);
+    QCOMPARE(pixmap.size(), image.size());
+    QCOMPARE(pixmap.toImage().pixel(0, 0), image.pixel(0, 0));
+}
+
+/**
+ * Verifies that a cached preview is not used anymore if the
+ * file has been modified.
+ */
+void KFileItemPreviewCacheTest::testChangedModificationTime()
+{
+    const KFileItem item = createItem("a.png", m_time);
+    m_cache->insert(item, createImage());
+    QTRY_VERIFY(!m_cache->pixmap(item).isNull());
+
+    const KFileItem modifiedItem = createItem("a.png", m_time.addSecs(10));
+    QVERIFY(m_cache->fileName(modifiedItem) != m_cache->fileName(item));
+    QVERIFY(m_cache->pixmap(modifiedItem).isNull());
+}
+
+/**
+ * Verifies that a cached preview is not used for another icon size.
+ */
+void KFileItemPreviewCacheTest::testChangedIconSize()
+{
+    const KFileItem item = createItem("a.png", m_time);
+    m_cache->insert(item, createImage());
+    QTRY_VERIFY(!m_cache->pixmap(item).isNull());
+
+    m_cache->setIconSize(QSize(128, 128));
+    QVERIFY(m_cache->pixmap(item).isNull());
+
+    m_cache->setIconSize(QSize(64, 64));
+    QVERIFY(!m_cache->pixmap(item).isNull());
+}
+
+/**
+ * Verifies that a cached preview is not used if other
+ * preview plugins are enabled.
+ */
+void KFileItemPreviewCacheTest::testChangedPlugins()
+{
+    const KFileItem item = createItem("a.png", m_time);
+    m_cache->insert(item, createImage());
+    QTRY_VERIFY(!m_cache->pixmap(item).isNull());
+
+    m_cache->setEnabledPlugins(QStringList() << "imagethumbnail" << "jpegthumbnail");
+    QVERIFY(m_cache->pixmap(item).isNull());
+}
+
+/**
+ * Verifies that no previews of remote files and of files inside
+ * a cache directory are stored.
+ */
+void KFileItemPreviewCacheTest::testRemoteFile()
+{
+    KIO::UDSEntry entry;
+    entry.insert(KIO::UDSEntry::UDS_NAME, QStringLiteral("a.png"));
+    entry.insert(KIO::UDSEntry::UDS_MODIFICATION_TIME, m_time.toTime_t());
+    const KFileItem remoteItem(entry, QUrl("sftp://example.com/a.png"), true);
+    QVERIFY(m_cache->fileName(remoteItem).isEmpty());
+
+    const QString cachePath = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation);
+    QDir().mkpath(cachePath);
+    const QString cachedFile = cachePath + QLatin1String("/a.png");
+    QFile file(cachedFile);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.close();
+    QVERIFY(m_cache->fileName(KFileItem(QUrl::fromLocalFile(cachedFile))).isEmpty());
+    QFile::remove(cachedFile);
+
+    QVERIFY(!m_cache->fileName(createItem("a.png", m_time)).isEmpty());
+}
+
+/**
+ * Verifies that cache files with a corrupt header are ignored and removed.
+ */
+void KFileItemPreviewCacheTest::testCorruptHeader()
+{
+    const KFileItem item = createItem("a.png", m_time);
+    m_cache->insert(item, createImage());
+    QTRY_VERIFY(!m_cache->pixmap(item).isNull());
+
+    // Pretend that the image is much wider than the data in the file
+    const QString fileName = m_cache->fileName(item);
+    QFile file(fileName);
+    QVERIFY(file.open(QIODevice::ReadWrite));
+    QVERIFY(file.seek(2 * sizeof(quint32)));
+    const qint32 width = 100000;
+    file.write(reinterpret_cast<const char*>(&width), sizeof(width));
+    file.close();
+
+    QVERIFY(m_cache->pixmap(item).isNull());
+    QVERIFY(!QFile::exists(fileName));
+}
+
+/**
+ * Verifies that the least recently used files are removed
+ * if the cache exceeds its maximum size.
+ */
+void KFileItemPreviewCacheTest::testRemoveOldestFiles()
+{
+    const KFileItem itemA = createItem("a.png", m_time);
+    const KFileItem itemB = createItem("b.png", m_time);
+    const KFileItem itemC = createItem("c.png", m_time);
+    m_cache->insert(itemA, createImage());
+    m_cache->insert(itemB, createImage());
+    m_cache->insert(itemC, createImage());
+    QTRY_VERIFY(QFile::exists(m_cache->fileName(itemA)));
+    QTRY_VERIFY(QFile::exists(m_cache->fileName(itemB)));
+    QTRY_VERIFY(QFile::exists(m_cache->fileName(itemC)));
+
+    // "b" has been used least recently, and "a" most recently.
+    setTimeStamp(m_cache->fileName(itemA), m_time.addSecs(30));
+    setTimeStamp(m_cache->fileName(itemB), m_time.addSecs(10));
+    setTimeStamp(m_cache->fileName(itemC), m_time.addSecs(20));
+
+    const qint64 fileSize = QFileInfo(m_cache->fileName(itemA)).size();
+    KFileItemPreviewCache::removeOldestFiles(m_cache->m_path, 2 * fileSize);
+
+    QVERIFY(QFile::exists(m_cache->fileName(itemA)));
+    QVERIFY(!QFile::exists(m_cache->fileName(itemB)));
+    QVERIFY(QFile::exists(m_cache->fileName(itemC)));
+}
+
+KFileItem KFileItemPreviewCacheTest::createItem(const QString& fileName, const QDateTime& time)
+{
+    m_testDir->createFile(fileName, "test", time);
+    return KFileItem(QUrl::fromLocalFile(m_testDir->path() + QLatin1Char('/') + fileName));
+}
+
+QImage KFileItemPreviewCacheTest::createImage()
+{
+    QImage image(48, 32, QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::red);
+    return image;
+}
+
+void KFileItemPreviewCacheTest::setTimeStamp(const QString& path, const QDateTime& time)
+{
+#ifdef Q_OS_UNIX
+    struct utimbuf utbuf;
+    utbuf.actime = time.toTime_t();
+    utbuf.modtime = utbuf.actime;
+    utime(QFile::encodeName(path), &utbuf);
+#elif defined(Q_OS_WIN)
+    struct _utimbuf utbuf;
+    utbuf.actime = time.toTime_t();
+    utbuf.modtime = utbuf.actime;
+    _wutime(reinterpret_cast<const wchar_t *>(path.utf16()), &utbuf);
+#endif
+}
+
+QTEST_MAIN(KFileItemPreviewCacheTest)
+
+#include "kfileitempreviewcachetest.moc"
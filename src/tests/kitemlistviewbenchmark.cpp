@@ -0,0 +1,135 @@
+/***************************************************************************
+ *   Copyright (C) 2017 by agent <agent@local>                             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA            *
+ ***************************************************************************/
+
+#include <QTest>
+#include <QSignalSpy>
+#include <QGraphicsScene>
+#include <QGraphicsView>
+
+#include "kitemviews/kitemlistcontainer.h"
+#include "kitemviews/kitemlistcontroller.h"
+#include "kitemviews/kfileitemlistview.h"
+#include "kitemviews/kfileitemmodel.h"
+
+#include "testdir.h"
+
+Q_DECLARE_METATYPE(QGraphicsScene::ItemIndexMethod)
+Q_DECLARE_METATYPE(QGraphicsView::ViewportUpdateMode)
+
+/**
+ * Measures how long scrolling takes if many item-widgets are visible. The
+ * rows with the BSP tree index and the minimal viewport updates correspond
+ * to the settings of the scene before they were changed in KItemListContainer,
+ * so the results of the rows can be compared directly.
+ */
+class KItemListViewBenchmark : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void scrollManyVisibleItems_data();
+    void scrollManyVisibleItems();
+
+private:
+    TestDir* m_testDir;
+    KFileItemModel* m_model;
+    KFileItemListView* m_view;
+    KItemListContainer* m_container;
+};
+
+void KItemListViewBenchmark::initTestCase()
+{
+    m_testDir = new TestDir();
+
+    QStringList files;
+    for (int i = 0; i < 5000; ++i) {
+        files << QString::number(i);
+    }
+    m_testDir->createFiles(files);
+
+    m_model = new KFileItemModel();
+    m_view = new KFileItemListView();
+    m_view->setItemLayout(KFileItemListView::CompactLayout);
+
+    KItemListController* controller = new KItemListController(m_model, m_view, this);
+    m_container = new KItemListContainer(controller);
+
+    QSignalSpy spyDirectoryLoadingCompleted(m_model, SIGNAL(directoryLoadingCompleted()));
+    m_model->loadDirectory(m_testDir->url());
+    QVERIFY(spyDirectoryLoadingCompleted.wait());
+
+    m_container->resize(1920, 1080);
+    m_container->show();
+    QVERIFY(QTest::qWaitForWindowExposed(m_container));
+}
+
+void KItemListViewBenchmark::cleanupTestCase()
+{
+    delete m_container;
+    m_container = 0;
+
+    delete m_testDir;
+    m_testDir = 0;
+}
+
+void KItemListViewBenchmark::scrollManyVisibleItems_data()
+{
+    QTest::addColumn<QGraphicsScene::ItemIndexMethod>("itemIndexMethod");
+    QTest::addColumn<QGraphicsView::ViewportUpdateMode>("viewportUpdateMode");
+
+    QTest::newRow("BSP tree index, minimal viewport updates")
+        << QGraphicsScene::BspTreeIndex << QGraphicsView::MinimalViewportUpdate;
+    QTest::newRow("No index, minimal viewport updates")
+        << QGraphicsScene::NoIndex << QGraphicsView::MinimalViewportUpdate;
+    QTest::newRow("No index, smart viewport updates")
+        << QGraphicsScene::NoIndex << QGraphicsView::SmartViewportUpdate;
+}
+
+void KItemListViewBenchmark::scrollManyVisibleItems()
+{
+    QFETCH(QGraphicsScene::ItemIndexMethod, itemIndexMethod);
+    QFETCH(QGraphicsView::ViewportUpdateMode, viewportUpdateMode);
+
+    QGraphicsView* graphicsView = qobject_cast<QGraphicsView*>(m_container->viewport());
+    QVERIFY(graphicsView);
+    graphicsView->scene()->setItemIndexMethod(itemIndexMethod);
+    graphicsView->setViewportUpdateMode(viewportUpdateMode);
+
+    const qreal maximumScrollOffset = m_view->maximumScrollOffset();
+    QVERIFY(maximumScrollOffset > 0);
+    const int scrollSteps = 100;
+    const qreal scrollStep = maximumScrollOffset / scrollSteps;
+
+    QBENCHMARK {
+        for (int step = 0; step <= scrollSteps; ++step) {
+            m_view->setScrollOffset(step * scrollStep);
+            QCoreApplication::processEvents();
+            graphicsView->viewport()->repaint();
+        }
+    }
+
+    m_view->setScrollOffset(0);
+}
+
+QTEST_MAIN(KItemListViewBenchmark)
+
+#include "kitemlistviewbenchmark.moc"
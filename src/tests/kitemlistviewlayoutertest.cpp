@@ -0,0 +1,382 @@
+/***************************************************************************
+ *   Copyright (C) 2017 by agent <agent@local>                             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA            *
+ ***************************************************************************/
+
+#include <QTest>
+
+#include "kitemviews/kitemlistcontroller.h"
+#include "kitemviews/kstandarditem.h"
+#include "kitemviews/kstandarditemlistview.h"
+#include "kitemviews/kstandarditemlistwidget.h"
+#include "kitemviews/kstandarditemmodel.h"
+#include "kitemviews/private/kitemlistsizehintresolver.h"
+#include "kitemviews/private/kitemlistviewlayouter.h"
+
+namespace {
+    const qreal ItemWidth = 100;
+    const qreal ItemHeight = 20;
+    const qreal ItemMargin = 5;
+}
+
+/**
+ * Model whose groups can be set by the test. In contrast to
+ * KStandardItemModel, the first group might start after the first item.
+ */
+class LayouterTestModel : public KStandardItemModel
+{
+public:
+    LayouterTestModel() : KStandardItemModel(), m_groups() {}
+
+    virtual QList<QPair<int, QVariant> > groups() const Q_DECL_OVERRIDE
+    {
+        return m_groups;
+    }
+
+    QList<QPair<int, QVariant> > m_groups;
+};
+
+/**
+ * Uses the value of the role "height" of the items as
+ * their size hints, or ItemHeight if it is not set.
+ */
+class LayouterTestWidgetCreator : public KItemListWidgetCreator<KStandardItemListWidget>
+{
+public:
+    virtual void calculateItemSizeHints(QVector<qreal>& logicalHeightHints, qreal& logicalWidthHint,
+                                        const KItemListView* view) const Q_DECL_OVERRIDE
+    {
+        for (int i = 0; i < logicalHeightHints.count(); ++i) {
+            logicalHeightHints[i] = view->model()->data(i).value("height", ItemHeight).toReal();
+        }
+        logicalWidthHint = ItemWidth;
+    }
+};
+
+class KItemListViewLayouterTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    void testMixedRowHeights();
+    void testMarkItemsAsDirty();
+    void testGroupHeaderOffsets();
+    void testItemsInserted_data();
+    void testItemsInserted();
+    void testItemsRemoved_data();
+    void testItemsRemoved();
+    void testSeveralRanges();
+
+private:
+    void appendItems(const QList<qreal>& heights);
+
+    /**
+     * Verifies that the layout of the items is the same as
+     * after a complete relayout.
+     */
+    void verifyLayout();
+
+private:
+    LayouterTestModel* m_model;
+    KStandardItemListView* m_view;
+    KItemListController* m_controller;
+    KItemListSizeHintResolver* m_sizeHintResolver;
+    KItemListViewLayouter* m_layouter;
+    bool m_forwardModelChanges;
+};
+
+void KItemListViewLayouterTest::init()
+{
+    m_model = new LayouterTestModel();
+    m_view = new KStandardItemListView();
+    m_view->setWidgetCreator(new LayouterTestWidgetCreator());
+    m_controller = new KItemListController(m_model, m_view, this);
+
+    // The layouter is tested separately from the layouter of the view,
+    // so that the changes of the model can be forwarded explicitly.
+    m_sizeHintResolver = new KItemListSizeHintResolver(m_view);
+    m_layouter = new KItemListViewLayouter(m_sizeHintResolver, this);
+    m_layouter->setModel(m_model);
+    m_layouter->setSize(QSizeF(3 * ItemWidth, 500));
+    m_layouter->setItemSize(QSizeF(ItemWidth, ItemHeight));
+    m_layouter->setItemMargin(QSizeF(0, ItemMargin));
+
+    m_forwardModelChanges = true;
+    connect(m_model, &KItemModelBase::itemsInserted, this, [this](const KItemRangeList& itemRanges) {
+        if (m_forwardModelChanges) {
+            m_sizeHintResolver->itemsInserted(itemRanges);
+            m_layouter->itemsInserted(itemRanges);
+        }
+    });
+    connect(m_model, &KItemModelBase::itemsRemoved, this, [this](const KItemRangeList& itemRanges) {
+        if (m_forwardModelChanges) {
+            m_sizeHintResolver->itemsRemoved(itemRanges);
+            m_layouter->itemsRemoved(itemRanges);
+        }
+    });
+    connect(m_model, &KItemModelBase::itemsChanged, this, [this](const KItemRangeList& itemRanges, const QSet<QByteArray>& roles) {
+        foreach (const KItemRange& range, itemRanges) {
+            m_sizeHintResolver->itemsChanged(range.index, range.count, roles);
+            m_layouter->markItemsAsDirty(range.index, range.count);
+        }
+    });
+}
+
+void KItemListViewLayouterTest::cleanup()
+{
+    delete m_layouter;
+    m_layouter = 0;
+
+    delete m_sizeHintResolver;
+    m_sizeHintResolver = 0;
+
+    delete m_controller;
+    m_controller = 0;
+
+    delete m_view;
+    m_view = 0;
+
+    delete m_model;
+    m_model = 0;
+}
+
+/**
+ * Verifies the positions of the items if the rows have different heights.
+ */
+void KItemListViewLayouterTest::testMixedRowHeights()
+{
+    appendItems({20, 40, 20,
+                 20, 20, 20,
+                 30});
+
+    QCOMPARE(m_layouter->columnCount(), 3);
+
+    // The spans of the rows are 45, 25 and 35, and the first row
+    // starts after the margin.
+    QCOMPARE(m_layouter->itemRect(0), QRectF(0, 5, ItemWidth, 20));
+    QCOMPARE(m_layouter->itemRect(1), QRectF(100, 5, ItemWidth, 40));
+    QCOMPARE(m_layouter->itemRect(4), QRectF(100, 50, ItemWidth, 20));
+    QCOMPARE(m_layouter->itemRect(6), QRectF(0, 75, ItemWidth, 30));
+    QCOMPARE(m_layouter->maximumScrollOffset(), qreal(110));
+
+    QCOMPARE(m_layouter->itemColumn(4), 1);
+    QCOMPARE(m_layouter->itemRow(4), 1);
+    QCOMPARE(m_layouter->itemColumn(6), 0);
+    QCOMPARE(m_layouter->itemRow(6), 2);
+    QCOMPARE(m_layouter->itemRow(7), -1);
+
+    m_layouter->setScrollOffset(60);
+    QCOMPARE(m_layouter->firstVisibleIndex(), 3);
+    QCOMPARE(m_layouter->lastVisibleIndex(), 6);
+}
+
+/**
+ * Verifies that changing the size hint of an item only updates its row.
+ */
+void KItemListViewLayouterTest::testMarkItemsAsDirty()
+{
+    appendItems({20, 40, 20,
+                 20, 20, 20,
+                 30});
+    QCOMPARE(m_layouter->maximumScrollOffset(), qreal(110));
+
+    m_model->item(4)->setDataValue("height", 50);
+    QVERIFY(!m_layouter->m_dirty);
+
+    QCOMPARE(m_layouter->itemRect(4), QRectF(100, 50, ItemWidth, 50));
+    QCOMPARE(m_layouter->itemRect(6), QRectF(0, 105, ItemWidth, 30));
+    QCOMPARE(m_layouter->maximumScrollOffset(), qreal(140));
+    verifyLayout();
+}
+
+/**
+ * Verifies the positions of the group headers and of the items if
+ * the first group does not start with the first item.
+ */
+void KItemListViewLayouterTest::testGroupHeaderOffsets()
+{
+    m_layouter->setGroupHeaderHeight(10);
+    m_layouter->setGroupHeaderMargin(8);
+
+    appendItems({20, 20, 20, 20, 20, 20, 20});
+    m_model->m_groups << qMakePair(3, QVariant("B")) << qMakePair(5, QVariant("C"));
+    m_model->setGroupedSorting(true);
+    m_layouter->markAsDirty();
+
+    // The items 0 to 2 belong to an implicit group. The header of the
+    // first group replaces the margin above the first row.
+    QVERIFY(m_layouter->isFirstGroupItem(0));
+    QVERIFY(m_layouter->isFirstGroupItem(3));
+    QVERIFY(!m_layouter->isFirstGroupItem(4));
+    QVERIFY(m_layouter->isFirstGroupItem(5));
+
+    QCOMPARE(m_layouter->itemRect(0), QRectF(0, 10, ItemWidth, 20));
+    QCOMPARE(m_layouter->itemRect(3), QRectF(0, 53, ItemWidth, 20));
+    QCOMPARE(m_layouter->itemRect(4), QRectF(100, 53, ItemWidth, 20));
+    QCOMPARE(m_layouter->itemRect(5), QRectF(0, 96, ItemWidth, 20));
+    QCOMPARE(m_layouter->groupHeaderRect(3), QRectF(0, 43, 3 * ItemWidth, 10));
+    QCOMPARE(m_layouter->maximumScrollOffset(), qreal(121));
+
+    QCOMPARE(m_layouter->itemRow(4), 1);
+    QCOMPARE(m_layouter->itemColumn(4), 1);
+    QCOMPARE(m_layouter->itemRow(5), 2);
+    QCOMPARE(m_layouter->itemColumn(5), 0);
+}
+
+void KItemListViewLayouterTest::testItemsInserted_data()
+{
+    QTest::addColumn<int>("index");
+    QTest::addColumn<int>("count");
+
+    QTest::newRow("Start of the first row") << 0 << 1;
+    QTest::newRow("Start of a row, whole rows") << 3 << 3;
+    QTest::newRow("Middle of a row, whole rows") << 4 << 6;
+    QTest::newRow("Middle of a row") << 4 << 2;
+    QTest::newRow("End") << 10 << 4;
+}
+
+/**
+ * Verifies that inserting items does not require a relayout,
+ * and results in the same layout as a relayout.
+ */
+void KItemListViewLayouterTest::testItemsInserted()
+{
+    QFETCH(int, index);
+    QFETCH(int, count);
+
+    appendItems({20, 40, 20, 20, 30, 20, 20, 20, 50, 20});
+    QCOMPARE(m_layouter->columnCount(), 3);
+    m_layouter->maximumScrollOffset();
+
+    for (int i = 0; i < count; ++i) {
+        KStandardItem* item = new KStandardItem(QString::number(i));
+        item->setDataValue("height", 25 + i);
+        m_model->insertItem(index + i, item);
+        QVERIFY(!m_layouter->m_dirty);
+    }
+
+    QCOMPARE(m_layouter->m_itemCount, 10 + count);
+    verifyLayout();
+}
+
+void KItemListViewLayouterTest::testItemsRemoved_data()
+{
+    QTest::addColumn<int>("index");
+    QTest::addColumn<int>("count");
+
+    QTest::newRow("Start of the first row") << 0 << 1;
+    QTest::newRow("Start of a row, whole rows") << 3 << 3;
+    QTest::newRow("Middle of a row, whole rows") << 1 << 6;
+    QTest::newRow("Middle of a row") << 4 << 2;
+    QTest::newRow("End") << 10 << 3;
+}
+
+/**
+ * Verifies that removing items does not require a relayout,
+ * and results in the same layout as a relayout.
+ */
+void KItemListViewLayouterTest::testItemsRemoved()
+{
+    QFETCH(int, index);
+    QFETCH(int, count);
+
+    appendItems({20, 40, 20, 20, 30, 20, 20, 20, 50, 20, 35, 20, 20});
+    QCOMPARE(m_layouter->columnCount(), 3);
+    m_layouter->maximumScrollOffset();
+
+    for (int i = 0; i < count; ++i) {
+        m_model->removeItem(index);
+        QVERIFY(!m_layouter->m_dirty);
+    }
+
+    QCOMPARE(m_layouter->m_itemCount, 13 - count);
+    verifyLayout();
+}
+
+/**
+ * Verifies that inserting and removing several ranges at once
+ * results in the same layout as a relayout.
+ */
+void KItemListViewLayouterTest::testSeveralRanges()
+{
+    appendItems({20, 40, 20, 20, 30, 20, 20, 20, 50, 20});
+    m_layouter->maximumScrollOffset();
+
+    // Insert one item before the item 2 and three items before the item 5.
+    m_forwardModelChanges = false;
+    m_model->insertItem(2, new KStandardItem("a"));
+    for (int i = 0; i < 3; ++i) {
+        KStandardItem* item = new KStandardItem("b");
+        item->setDataValue("height", 45);
+        m_model->insertItem(6, item);
+    }
+    m_forwardModelChanges = true;
+
+    const KItemRangeList insertedRanges = KItemRangeList() << KItemRange(2, 1) << KItemRange(5, 3);
+    m_sizeHintResolver->itemsInserted(insertedRanges);
+    m_layouter->itemsInserted(insertedRanges);
+    QVERIFY(!m_layouter->m_dirty);
+    verifyLayout();
+
+    // Remove the items 1 and 6 to 8.
+    m_forwardModelChanges = false;
+    for (int i = 0; i < 3; ++i) {
+        m_model->removeItem(6);
+    }
+    m_model->removeItem(1);
+    m_forwardModelChanges = true;
+
+    const KItemRangeList removedRanges = KItemRangeList() << KItemRange(1, 1) << KItemRange(6, 3);
+    m_sizeHintResolver->itemsRemoved(removedRanges);
+    m_layouter->itemsRemoved(removedRanges);
+    QVERIFY(!m_layouter->m_dirty);
+    verifyLayout();
+}
+
+void KItemListViewLayouterTest::appendItems(const QList<qreal>& heights)
+{
+    foreach (qreal height, heights) {
+        KStandardItem* item = new KStandardItem(QString::number(m_model->count()));
+        item->setDataValue("height", height);
+        m_model->appendItem(item);
+    }
+    m_layouter->markAsDirty();
+}
+
+void KItemListViewLayouterTest::verifyLayout()
+{
+    const int itemCount = m_model->count();
+
+    QVector<QRectF> itemRects;
+    for (int i = 0; i < itemCount; ++i) {
+        itemRects.append(m_layouter->itemRect(i));
+    }
+    const qreal maximumScrollOffset = m_layouter->maximumScrollOffset();
+
+    m_layouter->markAsDirty();
+    for (int i = 0; i < itemCount; ++i) {
+        QCOMPARE(m_layouter->itemRect(i), itemRects.at(i));
+    }
+    QCOMPARE(m_layouter->maximumScrollOffset(), maximumScrollOffset);
+}
+
+QTEST_MAIN(KItemListViewLayouterTest)
+
+#include "kitemlistviewlayoutertest.moc"
@@ -0,0 +1,241 @@
+/***************************************************************************
+ *   Copyright (C) 2017 by agent <agent@local>                             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA            *
+ ***************************************************************************/
+
+#include <QSignalSpy>
+#include <QTest>
+
+#include <KFileItem>
+#include <KFileItemList>
+#include <KIO/UDSEntry>
+
+#include "views/versioncontrol/kversioncontrolplugin.h"
+#include "views/versioncontrol/updateitemstatesthread.h"
+
+typedef QPair<KFileItem, KVersionControlPlugin::ItemVersion> ItemState;
+typedef QMap<QString, QVector<ItemState> > ItemStates;
+
+/**
+ * Plugin that returns the versions set by the test
+ * and counts the retrievals.
+ */
+class TestVersionControlPlugin : public KVersionControlPlugin
+{
+public:
+    TestVersionControlPlugin() : KVersionControlPlugin(), m_retrievalCount(0), m_version(NormalVersion) {}
+
+    virtual QString fileName() const Q_DECL_OVERRIDE
+    {
+        return QStringLiteral(".test");
+    }
+
+    virtual bool beginRetrieval(const QString& directory) Q_DECL_OVERRIDE
+    {
+        Q_UNUSED(directory);
+        ++m_retrievalCount;
+        return true;
+    }
+
+    virtual void endRetrieval() Q_DECL_OVERRIDE
+    {
+    }
+
+    virtual ItemVersion itemVersion(const KFileItem& item) const Q_DECL_OVERRIDE
+    {
+        Q_UNUSED(item);
+        return m_version;
+    }
+
+    virtual QList<QAction*> actions(const KFileItemList& items) const Q_DECL_OVERRIDE
+    {
+        Q_UNUSED(items);
+        return QList<QAction*>();
+    }
+
+    int m_retrievalCount;
+    ItemVersion m_version;
+};
+
+class UpdateItemStatesThreadTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    void testReuseVersions();
+    void testOtherDirectory();
+    void testChangedModificationTime();
+    void testInvalidateVersions();
+
+private:
+    /**
+     * Updates the versions of the items \a names in \a directory of the repository
+     * \a repositoryRoot. The result is stored in m_itemStates.
+     */
+    void updateItemStates(const QString& repositoryRoot, const QString& directory,
+                          const QStringList& names, qint64 modificationTime = 1000);
+
+    /**
+     * @return The versions of all items of m_itemStates.
+     */
+    QList<KVersionControlPlugin::ItemVersion> versions() const;
+
+private:
+    TestVersionControlPlugin* m_plugin;
+    ItemStates m_itemStates;
+};
+
+void UpdateItemStatesThreadTest::init()
+{
+    m_plugin = new TestVersionControlPlugin();
+    m_itemStates.clear();
+}
+
+void UpdateItemStatesThreadTest::cleanup()
+{
+    delete m_plugin;
+    m_plugin = 0;
+}
+
+/**
+ * Verifies that the versions of a directory that have been retrieved
+ * recently are used without another retrieval.
+ */
+void UpdateItemStatesThreadTest::testReuseVersions()
+{
+    const QString repositoryRoot = QStringLiteral("/testReuseVersions");
+    const QString directory = repositoryRoot + QStringLiteral("/dir/");
+
+    updateItemStates(repositoryRoot, directory, {"a", "b"});
+    QCOMPARE(m_plugin->m_retrievalCount, 1);
+    QCOMPARE(versions(), QList<KVersionControlPlugin::ItemVersion>()
+                         << KVersionControlPlugin::NormalVersion << KVersionControlPlugin::NormalVersion);
+
+    // The plugin would return another version, but the recently
+    // retrieved versions must be used.
+    m_plugin->m_version = KVersionControlPlugin::LocallyModifiedVersion;
+    updateItemStates(repositoryRoot, directory, {"b"});
+    QCOMPARE(m_plugin->m_retrievalCount, 1);
+    QCOMPARE(versions(), QList<KVersionControlPlugin::ItemVersion>() << KVersionControlPlugin::NormalVersion);
+
+    // An item that has not been retrieved before requires a retrieval.
+    updateItemStates(repositoryRoot, directory, {"a", "c"});
+    QCOMPARE(m_plugin->m_retrievalCount, 2);
+    QCOMPARE(versions(), QList<KVersionControlPlugin::ItemVersion>()
+                         << KVersionControlPlugin::LocallyModifiedVersion << KVersionControlPlugin::LocallyModifiedVersion);
+}
+
+/**
+ * Verifies that the versions of one directory are not used for another one.
+ */
+void UpdateItemStatesThreadTest::testOtherDirectory()
+{
+    const QString repositoryRoot = QStringLiteral("/testOtherDirectory");
+
+    updateItemStates(repositoryRoot, repositoryRoot + QStringLiteral("/dir1/"), {"a"});
+    QCOMPARE(m_plugin->m_retrievalCount, 1);
+
+    updateItemStates(repositoryRoot, repositoryRoot + QStringLiteral("/dir2/"), {"a"});
+    QCOMPARE(m_plugin->m_retrievalCount, 2);
+}
+
+/**
+ * Verifies that the version of an item is retrieved again
+ * if its modification time has been changed.
+ */
+void UpdateItemStatesThreadTest::testChangedModificationTime()
+{
+    const QString repositoryRoot = QStringLiteral("/testChangedModificationTime");
+    const QString directory = repositoryRoot + QStringLiteral("/dir/");
+
+    updateItemStates(repositoryRoot, directory, {"a"}, 1000);
+    QCOMPARE(m_plugin->m_retrievalCount, 1);
+
+    m_plugin->m_version = KVersionControlPlugin::LocallyModifiedVersion;
+    updateItemStates(repositoryRoot, directory, {"a"}, 2000);
+    QCOMPARE(m_plugin->m_retrievalCount, 2);
+    QCOMPARE(versions(), QList<KVersionControlPlugin::ItemVersion>() << KVersionControlPlugin::LocallyModifiedVersion);
+}
+
+/**
+ * Verifies that invalidating the versions of a repository
+ * requires a new retrieval only for this repository.
+ */
+void UpdateItemStatesThreadTest::testInvalidateVersions()
+{
+    const QString repositoryRoot = QStringLiteral("/testInvalidateVersions");
+    const QString otherRepositoryRoot = QStringLiteral("/testInvalidateVersionsOther");
+
+    updateItemStates(repositoryRoot, repositoryRoot + QStringLiteral("/dir/"), {"a"});
+    updateItemStates(otherRepositoryRoot, otherRepositoryRoot + QStringLiteral("/dir/"), {"a"});
+    QCOMPARE(m_plugin->m_retrievalCount, 2);
+
+    UpdateItemStatesThread::invalidateVersions(repositoryRoot);
+    m_plugin->m_version = KVersionControlPlugin::AddedVersion;
+
+    updateItemStates(repositoryRoot, repositoryRoot + QStringLiteral("/dir/"), {"a"});
+    QCOMPARE(m_plugin->m_retrievalCount, 3);
+    QCOMPARE(versions(), QList<KVersionControlPlugin::ItemVersion>() << KVersionControlPlugin::AddedVersion);
+
+    updateItemStates(otherRepositoryRoot, otherRepositoryRoot + QStringLiteral("/dir/"), {"a"});
+    QCOMPARE(m_plugin->m_retrievalCount, 3);
+    QCOMPARE(versions(), QList<KVersionControlPlugin::ItemVersion>() << KVersionControlPlugin::NormalVersion);
+}
+
+void UpdateItemStatesThreadTest::updateItemStates(const QString& repositoryRoot, const QString& directory,
+                                                  const QStringList& names, qint64 modificationTime)
+{
+    QVector<ItemState> items;
+    foreach (const QString& name, names) {
+        KIO::UDSEntry entry;
+        entry.insert(KIO::UDSEntry::UDS_NAME, name);
+        entry.insert(KIO::UDSEntry::UDS_MODIFICATION_TIME, modificationTime);
+
+        ItemState itemState;
+        itemState.first = KFileItem(entry, QUrl::fromLocalFile(directory), false, true);
+        itemState.second = KVersionControlPlugin::UnversionedVersion;
+        items.append(itemState);
+    }
+
+    ItemStates itemStates;
+    itemStates.insert(directory, items);
+
+    UpdateItemStatesThread thread(m_plugin, repositoryRoot, itemStates);
+    QSignalSpy spy(&thread, &UpdateItemStatesThread::finished);
+    thread.start();
+    QVERIFY(spy.wait());
+
+    m_itemStates = thread.itemStates();
+}
+
+QList<KVersionControlPlugin::ItemVersion> UpdateItemStatesThreadTest::versions() const
+{
+    QList<KVersionControlPlugin::ItemVersion> result;
+    foreach (const QVector<ItemState>& items, m_itemStates) {
+        foreach (const ItemState& itemState, items) {
+            result.append(itemState.second);
+        }
+    }
+    return result;
+}
+
+QTEST_GUILESS_MAIN(UpdateItemStatesThreadTest)
+
+#include "updateitemstatesthreadtest.moc"
@@ -92,6 +92,7 @@ void DolphinItemListView::readSettings()
 
     updateFont();
     updateGridSize();
+    updateRecursiveFolderSizes();
 
     const KConfigGroup globalConfig(KSharedConfig::openConfig(), "PreviewSettings");
     const QStringList plugins = globalConfig.readEntry("Plugins", QStringList()
@@ -128,6 +129,17 @@ void DolphinItemListView::onItemLayoutChanged(ItemLayout current, ItemLayout pre
     updateGridSize();
 
     KFileItemListView::onItemLayoutChanged(current, previous);
+
+    updateRecursiveFolderSizes();
+}
+
+void DolphinItemListView::onModelChanged(KItemModelBase* current, KItemModelBase* previous)
+{
+    KFileItemListView::onModelChanged(current, previous);
+
+    // The roles updater is created for the new model, so
+    // the recursive sizes must be applied again.
+    updateRecursiveFolderSizes();
 }
 
 void DolphinItemListView::onPreviewsShownChanged(bool shown)
@@ -245,6 +257,11 @@ void DolphinItemListView::updateGridSize()
     endTransaction();
 }
 
+void DolphinItemListView::updateRecursiveFolderSizes()
+{
+    setRecursiveFolderSizes(itemLayout() == DetailsLayout && DetailsModeSettings::recursiveFolderSizes());
+}
+
 ViewModeSettings::ViewMode DolphinItemListView::viewMode() const
 {
     ViewModeSettings::ViewMode mode;
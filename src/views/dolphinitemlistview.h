@@ -52,6 +52,7 @@ protected:
     virtual KItemListWidgetCreatorBase* defaultWidgetCreator() const Q_DECL_OVERRIDE;
     virtual bool itemLayoutSupportsItemExpanding(ItemLayout layout) const Q_DECL_OVERRIDE;
     virtual void onItemLayoutChanged(ItemLayout current, ItemLayout previous) Q_DECL_OVERRIDE;
+    virtual void onModelChanged(KItemModelBase* current, KItemModelBase* previous) Q_DECL_OVERRIDE;
     virtual void onPreviewsShownChanged(bool shown) Q_DECL_OVERRIDE;
     virtual void onVisibleRolesChanged(const QList<QByteArray>& current,
                                        const QList<QByteArray>& previous) Q_DECL_OVERRIDE;
@@ -61,6 +62,12 @@ protected:
 private:
     void updateGridSize();
 
+    /**
+     * Shows the size of the contents of folders if this is
+     * enabled for the details mode.
+     */
+    void updateRecursiveFolderSizes();
+
     ViewModeSettings::ViewMode viewMode() const;
 
 private:
@@ -39,6 +39,7 @@
 #include <KDirModel>
 #include <KFileItem>
 #include <KFileItemListProperties>
+#include <KIconLoader>
 #include <KLocalizedString>
 #include <kitemviews/kfileitemmodel.h>
 #include <kitemviews/kfileitemlistview.h>
@@ -47,6 +48,7 @@
 #include <kitemviews/kitemlistselectionmanager.h>
 #include <kitemviews/kitemlistview.h>
 #include <kitemviews/kitemlistcontroller.h>
+#include <kitemviews/private/kitemlisticoncache.h>
 #include <KIO/CopyJob>
 #include <KIO/DeleteJob>
 #include <KIO/JobUiDelegate>
@@ -111,6 +113,9 @@ DolphinView::DolphinView(const QUrl& url, QWidget* parent) :
     connect(&DolphinNewFileMenuObserver::instance(), &DolphinNewFileMenuObserver::itemCreated,
             this, &DolphinView::observeCreatedItem);
 
+    connect(KIconLoader::global(), &KIconLoader::iconLoaderSettingsChanged,
+            this, &DolphinView::slotIconLoaderSettingsChanged);
+
     m_selectionChangedTimer = new QTimer(this);
     m_selectionChangedTimer->setSingleShot(true);
     m_selectionChangedTimer->setInterval(300);
@@ -729,6 +734,7 @@ bool DolphinView::eventFilter(QObject* watched, QEvent* event)
     case QEvent::PaletteChange:
         updatePalette();
         QPixmapCache::clear();
+        KItemListIconCache::instance()->clear();
         break;
 
     case QEvent::KeyPress:
@@ -1322,6 +1328,12 @@ void DolphinView::slotDirectoryRedirection(const QUrl& oldUrl, const QUrl& newUr
     }
 }
 
+void DolphinView::slotIconLoaderSettingsChanged()
+{
+    QPixmapCache::clear();
+    KItemListIconCache::instance()->clear();
+}
+
 void DolphinView::updateViewState()
 {
     if (m_currentItemUrl != QUrl()) {
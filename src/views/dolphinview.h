@@ -688,6 +688,12 @@ private slots:
      */
     void slotDirectoryRedirection(const QUrl& oldUrl, const QUrl& newUrl);
 
+    /**
+     * Is invoked if the icon theme has been changed. Clears the caches
+     * that contain rendered theme icons.
+     */
+    void slotIconLoaderSettingsChanged();
+
     /**
      * Applies the state that has been restored by restoreViewState()
      * to the view.
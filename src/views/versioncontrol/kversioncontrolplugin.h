@@ -24,6 +24,7 @@
 
 #include <QObject>
 #include <QAction>
+#include <QStringList>
 class KFileItemList;
 class KFileItem;
 /**
@@ -200,6 +201,16 @@ Q_SIGNALS:
      */
     void itemVersionsChanged();
 
+    /**
+     * Can be emitted instead of itemVersionsChanged() if the plugin knows
+     * which files might have a changed version state, e. g. by comparing
+     * the state of the repository with the state of the last retrieval.
+     * Only the versions of the files \p filePaths will be updated, which
+     * is much faster for large directories.
+     * @since 17.12
+     */
+    void itemVersionsOfFilesChanged(const QStringList& filePaths);
+
     /**
      * Is emitted if an information message with the content \a msg
      * should be shown.
@@ -19,43 +19,304 @@
 
 #include "updateitemstatesthread.h"
 
-#include <QVector>
+#include <KIO/UDSEntry>
+
+#include <QElapsedTimer>
+#include <QFutureWatcher>
+#include <QHash>
+#include <QMutex>
 #include <QMutexLocker>
+#include <QPair>
+#include <QThreadPool>
+#include <QVector>
+#include <QtConcurrent/QtConcurrentRun>
+
+namespace {
+    // Maximum number of threads that update the versions of items. Most
+    // updates are serialized by the plugin mutexes anyway.
+    const int MaxThreadCount = 2;
+
+    // Time in milliseconds during which the retrieved versions of a directory
+    // are reused, e. g. by a split view that shows the same directory.
+    const int SnapshotLifetime = 2000;
+
+    /**
+     * Stores the thread pool, the mutexes of the plugins and repositories
+     * and the recently retrieved versions of each directory. It is shared
+     * by all instances of UpdateItemStatesThread.
+     */
+    class VersionCache
+    {
+    public:
+        VersionCache() :
+            m_threadPool(),
+            m_mutex(),
+            m_pluginMutexes(),
+            m_retrievalMutexes(),
+            m_generations(),
+            m_snapshots()
+        {
+            m_threadPool.setMaxThreadCount(MaxThreadCount);
+        }
+
+        ~VersionCache()
+        {
+            m_threadPool.waitForDone();
+            qDeleteAll(m_pluginMutexes);
+            qDeleteAll(m_retrievalMutexes);
+        }
+
+        QThreadPool* threadPool()
+        {
+            return &m_threadPool;
+        }
+
+        /**
+         * @return Mutex that serializes the accesses to \a plugin. The
+         *         plugins keep the state of the current retrieval, so
+         *         a plugin may only be used by one thread at the same time.
+         */
+        QMutex* pluginMutex(KVersionControlPlugin* plugin)
+        {
+            QMutexLocker locker(&m_mutex);
+            QMutex* mutex = m_pluginMutexes.value(plugin);
+            if (!mutex) {
+                mutex = new QMutex();
+                m_pluginMutexes.insert(plugin, mutex);
+            }
+            return mutex;
+        }
+
+        /**
+         * @return Mutex that serializes the retrievals of \a plugin for the
+         *         repository \a repositoryRoot. A thread that waits for it can
+         *         use the versions retrieved by the thread that holds it.
+         */
+        QMutex* retrievalMutex(KVersionControlPlugin* plugin, const QString& repositoryRoot)
+        {
+            QMutexLocker locker(&m_mutex);
+            const RetrievalKey key(plugin, repositoryRoot);
+            QMutex* mutex = m_retrievalMutexes.value(key);
+            if (!mutex) {
+                mutex = new QMutex();
+                m_retrievalMutexes.insert(key, mutex);
+            }
+            return mutex;
+        }
+
+        /**
+         * Fills the versions of \a items from the snapshot of \a directory.
+         * @return True if the versions of all items are part of a valid
+         *         snapshot. Otherwise \a items stays unchanged.
+         */
+        bool versions(const QString& repositoryRoot, const QString& directory,
+                      QVector<VersionControlObserver::ItemState>& items)
+        {
+            QMutexLocker locker(&m_mutex);
+            const Snapshot* snapshot = validSnapshot(repositoryRoot, directory);
+            if (!snapshot) {
+                return false;
+            }
+
+            QVector<KVersionControlPlugin::ItemVersion> versions;
+            versions.reserve(items.count());
+            foreach (const VersionControlObserver::ItemState& item, items) {
+                const QHash<QUrl, Entry>::const_iterator it = snapshot->entries.constFind(item.first.url());
+                if (it == snapshot->entries.constEnd() || it->modificationTime != modificationTime(item.first)) {
+                    return false;
+                }
+                versions.append(it->version);
+            }
+
+            for (int i = 0; i < items.count(); ++i) {
+                items[i].second = versions.at(i);
+            }
+            return true;
+        }
+
+        /**
+         * Adds the retrieved versions of \a items to the snapshot of \a directory.
+         * \a generation must be the result of generation() before the retrieval
+         * has been started.
+         */
+        void insert(const QString& repositoryRoot, const QString& directory, int generation,
+                    const QVector<VersionControlObserver::ItemState>& items)
+        {
+            QMutexLocker locker(&m_mutex);
+            if (generation != m_generations.value(repositoryRoot)) {
+                // The versions have been invalidated during the retrieval
+                return;
+            }
+
+            removeExpiredSnapshots();
+
+            const SnapshotKey key(repositoryRoot, directory);
+            if (!validSnapshot(repositoryRoot, directory)) {
+                Snapshot& snapshot = m_snapshots[key];
+                snapshot.generation = generation;
+                snapshot.entries.clear();
+                snapshot.age.start();
+            }
+
+            Snapshot& snapshot = m_snapshots[key];
+            foreach (const VersionControlObserver::ItemState& item, items) {
+                Entry entry;
+                entry.modificationTime = modificationTime(item.first);
+                entry.version = item.second;
+                snapshot.entries.insert(item.first.url(), entry);
+            }
+        }
+
+        int generation(const QString& repositoryRoot)
+        {
+            QMutexLocker locker(&m_mutex);
+            return m_generations.value(repositoryRoot);
+        }
+
+        /**
+         * Invalidates all snapshots of the repository \a repositoryRoot.
+         */
+        void invalidate(const QString& repositoryRoot)
+        {
+            QMutexLocker locker(&m_mutex);
+            ++m_generations[repositoryRoot];
+        }
+
+    private:
+        struct Entry
+        {
+            qint64 modificationTime;
+            KVersionControlPlugin::ItemVersion version;
+        };
+
+        struct Snapshot
+        {
+            int generation;
+            QElapsedTimer age;
+            QHash<QUrl, Entry> entries;
+        };
+
+        typedef QPair<KVersionControlPlugin*, QString> RetrievalKey; // Plugin and repository root
+        typedef QPair<QString, QString> SnapshotKey; // Repository root and directory
+
+        static qint64 modificationTime(const KFileItem& item)
+        {
+            // KFileItem::time() caches its result in the data that is shared
+            // with the items of the model, so it may not be used by a worker
+            // thread. The UDS entry is only read.
+            return item.entry().numberValue(KIO::UDSEntry::UDS_MODIFICATION_TIME, -1);
+        }
+
+        const Snapshot* validSnapshot(const QString& repositoryRoot, const QString& directory) const
+        {
+            const QHash<SnapshotKey, Snapshot>::const_iterator it = m_snapshots.constFind(SnapshotKey(repositoryRoot, directory));
+            if (it == m_snapshots.constEnd() || !isValid(repositoryRoot, *it)) {
+                return 0;
+            }
+            return &(*it);
+        }
+
+        bool isValid(const QString& repositoryRoot, const Snapshot& snapshot) const
+        {
+            return snapshot.generation == m_generations.value(repositoryRoot) &&
+                   !snapshot.age.hasExpired(SnapshotLifetime);
+        }
+
+        void removeExpiredSnapshots()
+        {
+            QHash<SnapshotKey, Snapshot>::iterator it = m_snapshots.begin();
+            while (it != m_snapshots.end()) {
+                if (isValid(it.key().first, it.value())) {
+                    ++it;
+                } else {
+                    it = m_snapshots.erase(it);
+                }
+            }
+        }
+
+        QThreadPool m_threadPool;
+        QMutex m_mutex;
+        QHash<KVersionControlPlugin*, QMutex*> m_pluginMutexes;
+        QHash<RetrievalKey, QMutex*> m_retrievalMutexes;
+        QHash<QString, int> m_generations;
+        QHash<SnapshotKey, Snapshot> m_snapshots;
+    };
+
+    Q_GLOBAL_STATIC(VersionCache, s_versionCache)
+}
 
 UpdateItemStatesThread::UpdateItemStatesThread(KVersionControlPlugin* plugin,
+                                               const QString& repositoryRoot,
                                                const QMap<QString, QVector<VersionControlObserver::ItemState> >& itemStates) :
-    QThread(),
-    m_globalPluginMutex(0),
+    QObject(),
+    m_pluginMutex(0),
+    m_retrievalMutex(0),
+    m_futureWatcher(0),
     m_plugin(plugin),
+    m_repositoryRoot(repositoryRoot),
     m_itemStates(itemStates)
 {
-    // Several threads may share one instance of a plugin. A global
-    // mutex is required to serialize the retrieval of version control
-    // states inside run().
-    static QMutex globalMutex;
-    m_globalPluginMutex = &globalMutex;
+    // Updates for the same plugin and repository are serialized, so that an
+    // update reuses the versions that another one has just retrieved instead
+    // of querying the plugin again. Additionally all views share one instance
+    // of a plugin, which keeps the state between beginRetrieval() and
+    // endRetrieval(). So only this part is serialized for all repositories.
+    m_retrievalMutex = s_versionCache->retrievalMutex(plugin, repositoryRoot);
+    m_pluginMutex = s_versionCache->pluginMutex(plugin);
+
+    m_futureWatcher = new QFutureWatcher<void>(this);
+    connect(m_futureWatcher, &QFutureWatcher<void>::finished,
+            this, &UpdateItemStatesThread::finished);
 }
 
 UpdateItemStatesThread::~UpdateItemStatesThread()
 {
 }
 
+void UpdateItemStatesThread::start()
+{
+    m_futureWatcher->setFuture(QtConcurrent::run(s_versionCache->threadPool(),
+                                                 this, &UpdateItemStatesThread::run));
+}
+
+void UpdateItemStatesThread::invalidateVersions(const QString& repositoryRoot)
+{
+    s_versionCache->invalidate(repositoryRoot);
+}
+
 void UpdateItemStatesThread::run()
 {
     Q_ASSERT(!m_itemStates.isEmpty());
     Q_ASSERT(m_plugin);
 
-    QMutexLocker pluginLocker(m_globalPluginMutex);
     QMap<QString, QVector<VersionControlObserver::ItemState> >::iterator it = m_itemStates.begin();
     for (; it != m_itemStates.end(); ++it) {
-        if (m_plugin->beginRetrieval(it.key())) {
-            QVector<VersionControlObserver::ItemState>& items = it.value();
+        const QString& directory = it.key();
+        QVector<VersionControlObserver::ItemState>& items = it.value();
+        if (s_versionCache->versions(m_repositoryRoot, directory, items)) {
+            // The versions have been retrieved recently by another thread
+            continue;
+        }
+
+        QMutexLocker retrievalLocker(m_retrievalMutex);
+
+        // Another thread might have retrieved the versions while
+        // waiting for the mutex.
+        if (s_versionCache->versions(m_repositoryRoot, directory, items)) {
+            continue;
+        }
+
+        QMutexLocker pluginLocker(m_pluginMutex);
+
+        const int generation = s_versionCache->generation(m_repositoryRoot);
+        if (m_plugin->beginRetrieval(directory)) {
             const int count = items.count();
             for (int i = 0; i < count; ++i) {
                 const KFileItem& item = items.at(i).first;
                 const KVersionControlPlugin::ItemVersion version = m_plugin->itemVersion(item);
                 items[i].second = version;
             }
+            s_versionCache->insert(m_repositoryRoot, directory, generation, items);
         }
 
         m_plugin->endRetrieval();
@@ -66,4 +327,3 @@ QMap<QString, QVector<VersionControlObserver::ItemState> > UpdateItemStatesThrea
 {
     return m_itemStates;
 }
-
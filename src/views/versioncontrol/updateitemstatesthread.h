@@ -24,14 +24,23 @@
 #include <views/versioncontrol/versioncontrolobserver.h>
 
 #include <QMutex>
-#include <QThread>
+#include <QObject>
+
+template<typename T> class QFutureWatcher;
 
 /**
  * The performance of updating the version state of items depends
  * on the used plugin. To prevent that Dolphin gets blocked by a
  * slow plugin, the updating is delegated to a thread.
+ *
+ * The updates of all views share a thread pool with a small number of
+ * threads, so that many views don't start one thread each. The updates
+ * for the same plugin and repository are serialized. The retrieved
+ * versions of a directory are kept per repository for a short time, so
+ * that e. g. split views showing the same directory don't need to query
+ * the plugin twice.
  */
-class DOLPHIN_EXPORT UpdateItemStatesThread : public QThread
+class DOLPHIN_EXPORT UpdateItemStatesThread : public QObject
 {
     Q_OBJECT
 
@@ -42,20 +51,42 @@ public:
      *                   from the thread creator after starting the thread,
      *                   UpdateItemStatesThread::lockPlugin() and
      *                   UpdateItemStatesThread::unlockPlugin() must be used.
+     * @param repositoryRoot Directory that contains the version information
+     *                   file of the plugin, see VersionControlObserver::searchPlugin().
      * @param itemStates List of items, where the states get updated.
      */
     UpdateItemStatesThread(KVersionControlPlugin* plugin,
+                           const QString& repositoryRoot,
                            const QMap<QString, QVector<VersionControlObserver::ItemState> >& itemStates);
     virtual ~UpdateItemStatesThread();
 
+    /**
+     * Starts the update in the thread pool. The signal finished()
+     * is emitted when the update has been finished.
+     */
+    void start();
+
     QMap<QString, QVector<VersionControlObserver::ItemState> > itemStates() const;
 
-protected:
-    virtual void run() Q_DECL_OVERRIDE;
+    /**
+     * Discards the recently retrieved versions of the repository
+     * \a repositoryRoot. Must be invoked if the plugin reports that
+     * the versions have been changed.
+     */
+    static void invalidateVersions(const QString& repositoryRoot);
+
+signals:
+    void finished();
+
+private:
+    void run();
 
 private:
-    QMutex* m_globalPluginMutex; // Protects the m_plugin globally
+    QMutex* m_pluginMutex; // Protects the m_plugin across all threads
+    QMutex* m_retrievalMutex; // Serializes the retrievals for m_plugin and m_repositoryRoot
+    QFutureWatcher<void>* m_futureWatcher;
     KVersionControlPlugin* m_plugin;
+    QString m_repositoryRoot;
 
     QMap<QString, QVector<VersionControlObserver::ItemState> > m_itemStates;
 };
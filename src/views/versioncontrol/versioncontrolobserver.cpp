@@ -21,6 +21,7 @@
 
 #include "dolphin_versioncontrolsettings.h"
 
+#include <KDirWatch>
 #include <KLocalizedString>
 #include <KService>
 #include "dolphindebug.h"
@@ -29,17 +30,167 @@
 
 #include "updateitemstatesthread.h"
 
-#include <QFile>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QHash>
+#include <QPointer>
 #include <QTimer>
 
+namespace {
+    // Maximum number of marker files in the cache. The cache is
+    // cleared if this limit is exceeded.
+    const int MaxCachedMarkers = 1000;
+
+    // Time in milliseconds during which a missing marker file is
+    // assumed to be still missing. Missing files are not watched.
+    const int MissingMarkerLifetime = 10000;
+
+    /**
+     * Remembers whether the version information files of the plugins
+     * (e. g. ".git" or ".svn") exist. Existing files are watched by
+     * KDirWatch, so that the result can be kept until the file is deleted.
+     * Missing files are not watched, as most checked files are missing
+     * and watching them would use up the watches of the system. Instead
+     * the result is only kept for a short time. This prevents checking the
+     * same files again each time a directory of a repository is entered,
+     * which is expensive on network file systems.
+     *
+     * The cache is a child of the application, so that the KDirWatch
+     * instance is destroyed before the application.
+     */
+    class MarkerCache : public QObject
+    {
+    public:
+        /**
+         * @return The cache of the application. 0 is returned if no
+         *         application exists (anymore).
+         */
+        static MarkerCache* instance()
+        {
+            static QPointer<MarkerCache> cache;
+            QCoreApplication* application = QCoreApplication::instance();
+            if (!cache && application) {
+                cache = new MarkerCache(application);
+            }
+            return cache;
+        }
+
+        bool exists(const QString& fileName)
+        {
+            const QHash<QString, Marker>::const_iterator it = m_markers.constFind(fileName);
+            if (it != m_markers.constEnd()) {
+                if (it->exists || !it->age.hasExpired(MissingMarkerLifetime)) {
+                    return it->exists;
+                }
+                m_markers.remove(fileName);
+            }
+
+            if (m_markers.count() >= MaxCachedMarkers) {
+                clear();
+            }
+
+            Marker marker;
+            const QFileInfo info(fileName);
+            marker.exists = info.exists();
+            if (marker.exists) {
+                if (info.isDir()) {
+                    m_dirWatch->addDir(fileName);
+                    m_watchedDirs.insert(fileName);
+                } else {
+                    m_dirWatch->addFile(fileName);
+                }
+            } else {
+                marker.age.start();
+            }
+            m_markers.insert(fileName, marker);
+            return marker.exists;
+        }
+
+    private:
+        explicit MarkerCache(QObject* parent) :
+            QObject(parent),
+            m_dirWatch(0),
+            m_markers(),
+            m_watchedDirs()
+        {
+            m_dirWatch = new KDirWatch(this);
+            connect(m_dirWatch, &KDirWatch::deleted,
+                    this, [this](const QString& path) { remove(path); });
+        }
+
+        void remove(const QString& fileName)
+        {
+            const QHash<QString, Marker>::iterator it = m_markers.find(fileName);
+            if (it == m_markers.end()) {
+                return;
+            }
+
+            if (it->exists) {
+                if (m_watchedDirs.remove(fileName)) {
+                    m_dirWatch->removeDir(fileName);
+                } else {
+                    m_dirWatch->removeFile(fileName);
+                }
+            }
+            m_markers.erase(it);
+        }
+
+        void clear()
+        {
+            foreach (const QString& fileName, m_markers.keys()) {
+                remove(fileName);
+            }
+        }
+
+        struct Marker
+        {
+            bool exists;
+            QElapsedTimer age; // Only valid for missing files
+        };
+
+        KDirWatch* m_dirWatch;
+        QHash<QString, Marker> m_markers;
+        QSet<QString> m_watchedDirs; // Required as KDirWatch does not offer a getter method
+    };
+
+    bool markerExists(const QString& fileName)
+    {
+        MarkerCache* cache = MarkerCache::instance();
+        return cache ? cache->exists(fileName) : QFileInfo::exists(fileName);
+    }
+
+    /**
+     * @return True if changing the given roles of an item might change its
+     *         version. An empty set means that any role might have changed.
+     */
+    bool changesVersion(const QSet<QByteArray>& roles)
+    {
+        if (roles.isEmpty()) {
+            return true;
+        }
+
+        static const char* const versionRelatedRoles[] = { "text", "size", "modificationtime", "permissions" };
+        for (const char* role : versionRelatedRoles) {
+            if (roles.contains(role)) {
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
 VersionControlObserver::VersionControlObserver(QObject* parent) :
     QObject(parent),
     m_pendingItemStatesUpdate(false),
     m_versionedDirectory(false),
     m_silentUpdate(false),
+    m_updateAllItems(true),
+    m_changedItems(),
     m_model(0),
     m_dirVerificationTimer(0),
     m_plugin(0),
+    m_repositoryRoot(),
     m_updateItemStatesThread(0)
 {
     // The verification timer specifies the timeout until the shown directory
@@ -66,18 +217,20 @@ void VersionControlObserver::setModel(KFileItemModel* model)
 {
     if (m_model) {
         disconnect(m_model, &KFileItemModel::itemsInserted,
-                   this, &VersionControlObserver::delayedDirectoryVerification);
+                   this, &VersionControlObserver::slotItemsInserted);
         disconnect(m_model, &KFileItemModel::itemsChanged,
-                   this, &VersionControlObserver::delayedDirectoryVerification);
+                   this, &VersionControlObserver::slotItemsChanged);
     }
 
     m_model = model;
+    m_updateAllItems = true;
+    m_changedItems.clear();
 
     if (model) {
         connect(m_model, &KFileItemModel::itemsInserted,
-                this, &VersionControlObserver::delayedDirectoryVerification);
+                this, &VersionControlObserver::slotItemsInserted);
         connect(m_model, &KFileItemModel::itemsChanged,
-                this, &VersionControlObserver::delayedDirectoryVerification);
+                this, &VersionControlObserver::slotItemsChanged);
     }
 }
 
@@ -116,6 +269,48 @@ void VersionControlObserver::silentDirectoryVerification()
     m_dirVerificationTimer->start();
 }
 
+void VersionControlObserver::slotItemsInserted(const KItemRangeList& itemRanges)
+{
+    addChangedItems(itemRanges, true);
+    delayedDirectoryVerification();
+}
+
+void VersionControlObserver::slotItemsChanged(const KItemRangeList& itemRanges, const QSet<QByteArray>& roles)
+{
+    if (!changesVersion(roles)) {
+        // The change has been triggered by slotThreadFinished() or by
+        // resolving roles like previews, which does not change the versions.
+        return;
+    }
+
+    addChangedItems(itemRanges, false);
+    delayedDirectoryVerification();
+}
+
+void VersionControlObserver::slotItemVersionsChanged()
+{
+    UpdateItemStatesThread::invalidateVersions(m_repositoryRoot);
+    m_updateAllItems = true;
+    silentDirectoryVerification();
+}
+
+void VersionControlObserver::slotItemVersionsOfFilesChanged(const QStringList& filePaths)
+{
+    UpdateItemStatesThread::invalidateVersions(m_repositoryRoot);
+
+    if (!m_model) {
+        return;
+    }
+
+    foreach (const QString& filePath, filePaths) {
+        const KFileItem item = m_model->fileItem(QUrl::fromLocalFile(filePath));
+        if (!item.isNull()) {
+            m_changedItems.insert(item);
+        }
+    }
+    silentDirectoryVerification();
+}
+
 void VersionControlObserver::verifyDirectory()
 {
     if (!m_model) {
@@ -131,10 +326,21 @@ void VersionControlObserver::verifyDirectory()
         m_plugin->disconnect(this);
     }
 
-    m_plugin = searchPlugin(rootItem.url());
+    QString repositoryRoot;
+    KVersionControlPlugin* plugin = searchPlugin(rootItem.url(), &repositoryRoot);
+    if (plugin != m_plugin || repositoryRoot != m_repositoryRoot) {
+        // The versions that have been retrieved by another
+        // plugin cannot be used anymore.
+        m_updateAllItems = true;
+    }
+    m_plugin = plugin;
+    m_repositoryRoot = repositoryRoot;
+
     if (m_plugin) {
         connect(m_plugin, &KVersionControlPlugin::itemVersionsChanged,
-                this, &VersionControlObserver::silentDirectoryVerification);
+                this, &VersionControlObserver::slotItemVersionsChanged);
+        connect(m_plugin, &KVersionControlPlugin::itemVersionsOfFilesChanged,
+                this, &VersionControlObserver::slotItemVersionsOfFilesChanged);
         connect(m_plugin, &KVersionControlPlugin::infoMessage,
                 this, &VersionControlObserver::infoMessage);
         connect(m_plugin, &KVersionControlPlugin::errorMessage,
@@ -150,7 +356,11 @@ void VersionControlObserver::verifyDirectory()
             m_dirVerificationTimer->setInterval(100);
         }
         updateItemStates();
-    } else if (m_versionedDirectory) {
+    } else {
+        m_changedItems.clear();
+    }
+
+    if (!m_plugin && m_versionedDirectory) {
         m_versionedDirectory = false;
 
         // The directory is not versioned. Reset the verification timer to a higher
@@ -169,19 +379,22 @@ void VersionControlObserver::slotThreadFinished()
         return;
     }
 
+    // Apply all versions at once, so that the model emits only one
+    // itemsChanged() signal instead of one signal per item.
+    QHash<int, QVariant> versions;
     const QMap<QString, QVector<ItemState> >& itemStates = thread->itemStates();
     QMap<QString, QVector<ItemState> >::const_iterator it = itemStates.constBegin();
     for (; it != itemStates.constEnd(); ++it) {
         const QVector<ItemState>& items = it.value();
 
         foreach (const ItemState& item, items) {
-            const KFileItem& fileItem = item.first;
-            const KVersionControlPlugin::ItemVersion version = item.second;
-            QHash<QByteArray, QVariant> values;
-            values.insert("version", QVariant(version));
-            m_model->setData(m_model->index(fileItem), values);
+            const int index = m_model->index(item.first);
+            if (index >= 0) {
+                versions.insert(index, QVariant(item.second));
+            }
         }
     }
+    m_model->setRoleValues("version", versions);
 
     if (!m_silentUpdate) {
         // Using an empty message results in clearing the previously shown information message and showing
@@ -207,13 +420,19 @@ void VersionControlObserver::updateItemStates()
     }
 
     QMap<QString, QVector<ItemState> > itemStates;
-    createItemStatesList(itemStates);
+    if (m_updateAllItems) {
+        createItemStatesList(itemStates);
+    } else {
+        createChangedItemStatesList(itemStates);
+    }
+    m_updateAllItems = false;
+    m_changedItems.clear();
 
     if (!itemStates.isEmpty()) {
         if (!m_silentUpdate) {
             emit infoMessage(i18nc("@info:status", "Updating version information..."));
         }
-        m_updateItemStatesThread = new UpdateItemStatesThread(m_plugin, itemStates);
+        m_updateItemStatesThread = new UpdateItemStatesThread(m_plugin, m_repositoryRoot, itemStates);
         connect(m_updateItemStatesThread, &UpdateItemStatesThread::finished,
                 this, &VersionControlObserver::slotThreadFinished);
         connect(m_updateItemStatesThread, &UpdateItemStatesThread::finished,
@@ -258,7 +477,55 @@ int VersionControlObserver::createItemStatesList(QMap<QString, QVector<ItemState
     return index - firstIndex; // number of processed items
 }
 
-KVersionControlPlugin* VersionControlObserver::searchPlugin(const QUrl& directory) const
+void VersionControlObserver::createChangedItemStatesList(QMap<QString, QVector<ItemState> >& itemStates) const
+{
+    QSet<QUrl> addedUrls;
+    foreach (const KFileItem& item, m_changedItems) {
+        if (m_model->index(item) < 0) {
+            // The item has been removed in the meantime
+            continue;
+        }
+
+        // The version of a directory depends on the versions of its contents,
+        // so the expanded parent directories of the item are updated too.
+        KFileItem currentItem = item;
+        while (!currentItem.isNull() && !addedUrls.contains(currentItem.url())) {
+            const QUrl parentUrl = currentItem.url().adjusted(QUrl::RemoveFilename);
+            addedUrls.insert(currentItem.url());
+
+            ItemState itemState;
+            itemState.first = currentItem;
+            itemState.second = KVersionControlPlugin::UnversionedVersion;
+            itemStates[parentUrl.path()].append(itemState);
+
+            const int parentIndex = m_model->index(parentUrl);
+            currentItem = (parentIndex >= 0) ? m_model->fileItem(parentIndex) : KFileItem();
+        }
+    }
+}
+
+void VersionControlObserver::addChangedItems(const KItemRangeList& itemRanges, bool inserted)
+{
+    if (m_updateAllItems) {
+        // All items will be updated anyway
+        return;
+    }
+
+    // The indexes of inserted ranges refer to the model before the
+    // insertion, so the items of the previous ranges must be skipped.
+    int offset = 0;
+    foreach (const KItemRange& range, itemRanges) {
+        const int firstIndex = range.index + offset;
+        for (int index = firstIndex; index < firstIndex + range.count; ++index) {
+            m_changedItems.insert(m_model->fileItem(index));
+        }
+        if (inserted) {
+            offset += range.count;
+        }
+    }
+}
+
+KVersionControlPlugin* VersionControlObserver::searchPlugin(const QUrl& directory, QString* repositoryRoot) const
 {
     static bool pluginsAvailable = true;
     static QList<KVersionControlPlugin*> plugins;
@@ -292,15 +559,19 @@ KVersionControlPlugin* VersionControlObserver::searchPlugin(const QUrl& director
     // We use the number of upUrl() calls to find the best matching plugin
     // for the given directory. The smaller value, the better it is (0 is best).
     KVersionControlPlugin* bestPlugin = 0;
+    QString bestRepositoryRoot;
     int bestScore = INT_MAX;
 
     // Verify whether the current directory contains revision information
     // like .svn, .git, ...
     foreach (KVersionControlPlugin* plugin, plugins) {
         const QString fileName = directory.path() + '/' + plugin->fileName();
-        if (QFile::exists(fileName)) {
+        if (markerExists(fileName)) {
             // The score of this plugin is 0 (best), so we can just return this plugin,
             // instead of going through the plugin scoring procedure, we can't find a better one ;)
+            if (repositoryRoot) {
+                *repositoryRoot = directory.path();
+            }
             return plugin;
         }
 
@@ -316,9 +587,10 @@ KVersionControlPlugin* VersionControlObserver::searchPlugin(const QUrl& director
             int upUrlCounter = 1;
             while ((upUrlCounter < bestScore) && (upUrl != dirUrl)) {
                 const QString fileName = dirUrl.path() + '/' + plugin->fileName();
-                if (QFile::exists(fileName)) {
+                if (markerExists(fileName)) {
                     if (upUrlCounter < bestScore) {
                         bestPlugin = plugin;
+                        bestRepositoryRoot = dirUrl.path();
                         bestScore = upUrlCounter;
                     }
                     break;
@@ -330,6 +602,9 @@ KVersionControlPlugin* VersionControlObserver::searchPlugin(const QUrl& director
         }
     }
 
+    if (repositoryRoot) {
+        *repositoryRoot = bestRepositoryRoot;
+    }
     return bestPlugin;
 }
 
@@ -26,9 +26,12 @@
 
 #include <KFileItem>
 
+#include <kitemviews/kitemmodelbase.h>
+
 #include <QUrl>
 #include <QList>
 #include <QObject>
+#include <QSet>
 #include <QString>
 
 class KFileItemList;
@@ -93,6 +96,25 @@ private slots:
      */
     void silentDirectoryVerification();
 
+    /**
+     * Remembers the inserted or changed items, so that only their
+     * versions are updated by the next verifyDirectory().
+     */
+    void slotItemsInserted(const KItemRangeList& itemRanges);
+    void slotItemsChanged(const KItemRangeList& itemRanges, const QSet<QByteArray>& roles);
+
+    /**
+     * Is invoked if the plugin reports that the versions of
+     * all items might have been changed.
+     */
+    void slotItemVersionsChanged();
+
+    /**
+     * Is invoked if the plugin reports that the versions of
+     * the files \a filePaths might have been changed.
+     */
+    void slotItemVersionsOfFilesChanged(const QStringList& filePaths);
+
     void verifyDirectory();
 
     /**
@@ -122,11 +144,25 @@ private:
     int createItemStatesList(QMap<QString, QVector<ItemState> >& itemStates,
                              const int firstIndex = 0);
 
+    /**
+     * Like createItemStatesList(), but only adds the items of m_changedItems
+     * which are still part of the model, and their expanded parent directories.
+     */
+    void createChangedItemStatesList(QMap<QString, QVector<ItemState> >& itemStates) const;
+
+    /**
+     * Adds the items of \a itemRanges to m_changedItems. If \a inserted is
+     * true, the ranges have been announced by KFileItemModel::itemsInserted().
+     */
+    void addChangedItems(const KItemRangeList& itemRanges, bool inserted);
+
     /**
      * Returns a matching plugin for the given directory.
      * 0 is returned, if no matching plugin has been found.
+     * If \a repositoryRoot is not null, it is set to the directory
+     * that contains the version information file of the plugin.
      */
-    KVersionControlPlugin* searchPlugin(const QUrl& directory) const;
+    KVersionControlPlugin* searchPlugin(const QUrl& directory, QString* repositoryRoot = 0) const;
 
     /**
      * Returns true, if the directory contains a version control information.
@@ -139,11 +175,17 @@ private:
     bool m_silentUpdate; // if true, no messages will be send during the update
                          // of version states
 
+    // If m_updateAllItems is false, only the versions of the
+    // items in m_changedItems are updated.
+    bool m_updateAllItems;
+    QSet<KFileItem> m_changedItems;
+
     KFileItemModel* m_model;
 
     QTimer* m_dirVerificationTimer;
 
     KVersionControlPlugin* m_plugin;
+    QString m_repositoryRoot; // Directory with the version information file of m_plugin
     UpdateItemStatesThread* m_updateItemStatesThread;
 
     friend class UpdateItemStatesThread;